@@ -0,0 +1,675 @@
+//******************************************************************************
+//
+//  LinkMap.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module keeps a map of SBD session outcomes and signal quality by
+//  position and heading, saved on the PCMCIA card so it builds up over
+//  many flights.
+//
+//  The world is cut into LINK_MAP_CELL_DEG degree cells, each split in
+//  four heading quadrants (the antenna is shadowed differently flying
+//  north or south). Only the cells flown through are kept, in a table of
+//  LINK_MAP_SIZE entries; when it is full the cell that saw a session
+//  longest ago makes room. Counts are halved when they saturate, so recent
+//  flights weigh more than old ones.
+//
+//  The map file holds a LINK_MAP_FILE_HDR followed by the cells.
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+    #include "artl.h"
+    #include "artlx.h"
+    #ifdef __BORLANDC__
+        #include "Stubfunctions.h"
+        #include "DebugOut.h"
+        #include "pcmciaAPIStub.h"
+    #endif
+#else
+    #include "FileUtils.h"
+    #include "LinkMap.h"
+    #include "MtcePort.h"
+    #include "pcmciaAPI.h"
+    #include "utils.h"
+#endif
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define LINK_MAP_SIZE           128     // Cells kept
+#define LINK_MAP_CELL_DEG       5       // Cell size in degrees
+#define LINK_MAP_LAT_CELLS      ( 180 / LINK_MAP_CELL_DEG )
+#define LINK_MAP_LON_CELLS      ( 360 / LINK_MAP_CELL_DEG )
+#define LINK_MAP_HEADINGS       4
+#define LINK_MAP_NO_CELL        0xFFFF
+
+#define LINK_MAP_MIN_SESSIONS   4       // Before a cell is judged
+#define LINK_MAP_POOR_PERCENT   35      // Success rate below: poor
+#define LINK_MAP_GOOD_PERCENT   80      // Success rate at or above: good
+#define LINK_MAP_CSQ_SCALE      16      // Fixed point of the average CSQ
+#define LINK_MAP_CSQ_UNKNOWN    0xFF    // No signal strength seen in the cell yet
+#define LINK_MAP_SAVE_SESSIONS  8       // New sessions between saves
+
+#define LINK_MAP_MAGIC          0x4C4D  // "LM"
+#define LINK_MAP_VERSION        2
+#define LINK_MAP_FILENAME       "LINKMAP.DAT"
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+#pragma pack(1)
+typedef struct
+#else
+typedef struct __attribute__ ((__packed__))
+#endif
+{
+    WORD  wCell;                    // Cell and heading quadrant
+    BYTE  bySessions;
+    BYTE  byLinkUps;
+    BYTE  byCSQ;                    // Average, LINK_MAP_CSQ_SCALE per bar
+    DWORD dwLastUsed;               // dwSessionClock at the last session
+
+} LINK_CELL;
+
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+typedef struct
+#else
+typedef struct __attribute__ ((__packed__))
+#endif
+{
+    WORD  wMagic;
+    WORD  wVersion;
+    WORD  wNbrCells;
+    WORD  wCRC;                     // Of the cells
+
+} LINK_MAP_FILE_HDR;
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+#pragma pack()
+#endif
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static LINK_CELL        linkCells[LINK_MAP_SIZE];
+static WORD             wNbrCells;
+
+static WORD             wCurrentCell;
+static DWORD            dwSessionClock;         // Sessions mapped, over all flights
+static BOOL             bLoaded;
+static BYTE             byUnsaved;              // Sessions since the last save
+
+static LINK_MAP_STATS   linkMapStats;
+
+static char             szLinkMapPath[EMAXPATH];
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static void       LoadLinkMap( void );
+static LINK_CELL* FindLinkCell( WORD wCell );
+static LINK_CELL* AddLinkCell( WORD wCell );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables. The saved map is
+//               only read the first time it is needed, from the main loop.
+//
+//******************************************************************************
+void InitLinkMap( void )
+{
+    MemSet( linkCells, 0, sizeof( linkCells ) );
+    MemSet( &linkMapStats, 0, sizeof( LINK_MAP_STATS ) );
+
+    wNbrCells      = 0;
+    wCurrentCell   = LINK_MAP_NO_CELL;
+    dwSessionClock = 0;
+    bLoaded        = FALSE;
+    byUnsaved      = 0;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetLinkMapPosition
+//
+//  Arguments:
+//    IN  iLatitude  - Latitude in degrees (-90 to 90, north positive).
+//    IN  iLongitude - Longitude in degrees (-180 to 180, east positive).
+//    IN  wHeading   - True heading in degrees (0 to 359).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to give the driver the aircraft
+//               position. Sessions are only mapped while it is known.
+//
+//******************************************************************************
+void SetLinkMapPosition( const short iLatitude, const short iLongitude, const WORD wHeading )
+{
+    WORD wLat;
+    WORD wLon;
+    WORD wQuadrant;
+
+    if( ( iLatitude < -90 ) || ( iLatitude > 90 ) || ( iLongitude < -180 ) || ( iLongitude > 180 ) )
+    {
+        wCurrentCell = LINK_MAP_NO_CELL;
+        return;
+    }
+
+    wLat = (WORD)( iLatitude + 90 ) / LINK_MAP_CELL_DEG;
+    wLon = (WORD)( iLongitude + 180 ) / LINK_MAP_CELL_DEG;
+
+    // The poles and the date line belong to the last cell.
+    if( wLat >= LINK_MAP_LAT_CELLS )
+    {
+        wLat = LINK_MAP_LAT_CELLS - 1;
+    }
+
+    if( wLon >= LINK_MAP_LON_CELLS )
+    {
+        wLon = LINK_MAP_LON_CELLS - 1;
+    }
+
+    // North, east, south and west quadrants centred on the cardinal points.
+    wQuadrant = ( ( wHeading % 360 ) + 45 ) / 90 % LINK_MAP_HEADINGS;
+
+    wCurrentCell = ( ( wLat * LINK_MAP_LON_CELLS ) + wLon ) * LINK_MAP_HEADINGS + wQuadrant;
+}
+
+
+//******************************************************************************
+//
+//  Function: ClearLinkMapPosition
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: The position is no longer known (e.g. GPS lost).
+//
+//******************************************************************************
+void ClearLinkMapPosition( void )
+{
+    wCurrentCell = LINK_MAP_NO_CELL;
+}
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapSession
+//
+//  Arguments:
+//    IN  bLinkUp - TRUE if the session reached the network.
+//    IN  iSignal - Last signal strength (0-5, -1 if unknown).
+//
+//  Returns: void.
+//
+//  Description: Adds an SBD session outcome to the cell the aircraft is in.
+//               An unknown signal strength leaves the cell average alone.
+//               The map is saved every few sessions.
+//
+//******************************************************************************
+void RecordLinkMapSession( const BOOL bLinkUp, const short iSignal )
+{
+    LINK_CELL* pCell;
+    BYTE       byCSQ = ( iSignal < 0 ) ? LINK_MAP_CSQ_UNKNOWN : (BYTE)( iSignal * LINK_MAP_CSQ_SCALE );
+
+    linkMapStats.dwSessions++;
+
+    if( bLinkUp )
+    {
+        linkMapStats.dwLinkUps++;
+    }
+
+    if( wCurrentCell == LINK_MAP_NO_CELL )
+    {
+        return;
+    }
+
+    LoadLinkMap();
+
+    pCell = FindLinkCell( wCurrentCell );
+
+    if( pCell == NULL )
+    {
+        pCell = AddLinkCell( wCurrentCell );
+        pCell->byCSQ = byCSQ;
+    }
+    else if( pCell->byCSQ == LINK_MAP_CSQ_UNKNOWN )
+    {
+        pCell->byCSQ = byCSQ;
+    }
+    else if( byCSQ != LINK_MAP_CSQ_UNKNOWN )
+    {
+        // Moving average over about four sessions.
+        pCell->byCSQ = pCell->byCSQ - ( pCell->byCSQ / 4 ) + ( byCSQ / 4 );
+    }
+
+    // Age the cell rather than let the counts saturate.
+    if( pCell->bySessions == 0xFF )
+    {
+        pCell->bySessions /= 2;
+        pCell->byLinkUps  /= 2;
+    }
+
+    pCell->bySessions++;
+    pCell->dwLastUsed = ++dwSessionClock;
+
+    if( bLinkUp )
+    {
+        pCell->byLinkUps++;
+    }
+
+    if( ++byUnsaved >= LINK_MAP_SAVE_SESSIONS )
+    {
+        SaveLinkMap();
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapDelivery
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Counts a delivered message, for the delivered messages per
+//               session attempt.
+//
+//******************************************************************************
+void RecordLinkMapDelivery( void )
+{
+    linkMapStats.dwDelivered++;
+}
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapDeferral
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Counts a report held back because of the cell quality.
+//
+//******************************************************************************
+void RecordLinkMapDeferral( void )
+{
+    linkMapStats.dwDeferrals++;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetLinkMapQuality
+//
+//  Arguments: void.
+//
+//  Returns: LINK_CELL_QUALITY of the cell the aircraft is in.
+//
+//  Description: Cells are judged on their session success rate once they
+//               have seen a few sessions; older sessions count for less. A
+//               cell with no signal strength on record is judged on its
+//               success rate alone.
+//
+//******************************************************************************
+LINK_CELL_QUALITY GetLinkMapQuality( void )
+{
+    LINK_CELL* pCell;
+    WORD       wPercent;
+
+    if( wCurrentCell == LINK_MAP_NO_CELL )
+    {
+        return LINK_CELL_UNKNOWN;
+    }
+
+    LoadLinkMap();
+
+    pCell = FindLinkCell( wCurrentCell );
+
+    if( ( pCell == NULL ) || ( pCell->bySessions < LINK_MAP_MIN_SESSIONS ) )
+    {
+        return LINK_CELL_UNKNOWN;
+    }
+
+    wPercent = ( (WORD)pCell->byLinkUps * 100 ) / pCell->bySessions;
+
+    if( ( wPercent < LINK_MAP_POOR_PERCENT ) || ( pCell->byCSQ < LINK_MAP_CSQ_SCALE ) )
+    {
+        return LINK_CELL_POOR;
+    }
+
+    if( wPercent >= LINK_MAP_GOOD_PERCENT )
+    {
+        return LINK_CELL_GOOD;
+    }
+
+    return LINK_CELL_FAIR;
+}
+
+
+//******************************************************************************
+//
+//  Function: SaveLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the map was saved (or had not changed).
+//           FALSE if the file could not be written.
+//
+//  Description: Writes the map to the PCMCIA card. Rules should call it
+//               when the flight ends, as the last few sessions may not
+//               have been saved yet.
+//
+//******************************************************************************
+BOOL SaveLinkMap( void )
+{
+    LINK_MAP_FILE_HDR hdr;
+    PCFD              fd;
+    WORD              wSize = wNbrCells * sizeof( LINK_CELL );
+    BOOL              bWritten;
+
+    if( !bLoaded || ( byUnsaved == 0 ) )
+    {
+        return TRUE;
+    }
+
+    hdr.wMagic    = LINK_MAP_MAGIC;
+    hdr.wVersion  = LINK_MAP_VERSION;
+    hdr.wNbrCells = wNbrCells;
+    hdr.wCRC      = CalcCRC( (BYTE*)linkCells, wSize );
+
+    fd = fileOpen( szLinkMapPath, PO_CREAT|PO_TRUNC|PO_WRONLY|PO_BINARY, PS_IREAD|PS_IWRITE );
+
+    if( fd == -1 )
+    {
+        return FALSE;
+    }
+
+    bWritten = ( fileWrite( fd, (BYTE*)&hdr, sizeof( hdr ) ) == sizeof( hdr ) )
+               &&
+               ( fileWrite( fd, (BYTE*)linkCells, wSize ) == wSize );
+
+    fileClose( fd );
+
+    if( !bWritten )
+    {
+        return FALSE;
+    }
+
+    byUnsaved = 0;
+    linkMapStats.wSaves++;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ClearLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Forgets all cells, including the saved map, and clears the
+//               statistics.
+//
+//******************************************************************************
+void ClearLinkMap( void )
+{
+    WORD wCell = wCurrentCell;
+
+    LoadLinkMap();
+    deleteFile( szLinkMapPath );
+
+    InitLinkMap();
+
+    // Still the same map file, just empty; keep the position too.
+    bLoaded      = TRUE;
+    wCurrentCell = wCell;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetLinkMapStats
+//
+//  Arguments:
+//    OUT pStats - LINK_MAP_STATS since power up (or ClearLinkMap()).
+//
+//  Returns: void.
+//
+//  Description: Link map statistics.
+//
+//******************************************************************************
+void GetLinkMapStats( LINK_MAP_STATS* pStats )
+{
+    linkMapStats.wCellsKnown = wNbrCells;
+
+    MemCpy( pStats, &linkMapStats, sizeof( LINK_MAP_STATS ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: DisplayLinkMapStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Prints the sessions, deliveries and delivered messages per
+//               hundred session attempts to the mtce port (used to compare
+//               scheduling settings in simulation).
+//
+//******************************************************************************
+void DisplayLinkMapStats( void )
+{
+    static char szValue[12];
+
+    SendStringToMtcePort( "\r\n[LINK MAP] sessions " );
+    IntToString( szValue, linkMapStats.dwSessions, 1 );
+    SendStringToMtcePort( szValue );
+
+    SendStringToMtcePort( " delivered " );
+    IntToString( szValue, linkMapStats.dwDelivered, 1 );
+    SendStringToMtcePort( szValue );
+
+    SendStringToMtcePort( " per 100 attempts " );
+    IntToString( szValue, ( linkMapStats.dwSessions == 0 ) ? 0 :
+                          ( linkMapStats.dwDelivered * 100 ) / linkMapStats.dwSessions, 1 );
+    SendStringToMtcePort( szValue );
+
+    SendStringToMtcePort( " deferred " );
+    IntToString( szValue, linkMapStats.dwDeferrals, 1 );
+    SendStringToMtcePort( szValue );
+
+    SendStringToMtcePort( " cells " );
+    IntToString( szValue, wNbrCells, 1 );
+    SendStringToMtcePort( szValue );
+    SendStringToMtcePort( "\r\n" );
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: LoadLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Reads the saved map the first time it is needed. A missing
+//               or corrupt file, or one of an older version, starts an
+//               empty map.
+//
+//******************************************************************************
+void LoadLinkMap( void )
+{
+    LINK_MAP_FILE_HDR hdr;
+    PCFD              fd;
+    WORD              wSize;
+    WORD              wIndex;
+
+    if( bLoaded )
+    {
+        return;
+    }
+
+    bLoaded = TRUE;
+
+    BuildPath( szLinkMapPath, GetPCMCIAPath( MODEM_DIR, NO_SUBDIR ), LINK_MAP_FILENAME );
+
+    fd = fileOpen( szLinkMapPath, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
+
+    if( fd == -1 )
+    {
+        return;
+    }
+
+    if( ( fileRead( fd, (BYTE*)&hdr, sizeof( hdr ) ) == sizeof( hdr ) )
+        &&
+        ( hdr.wMagic == LINK_MAP_MAGIC )
+        &&
+        ( hdr.wVersion == LINK_MAP_VERSION )
+        &&
+        ( hdr.wNbrCells <= LINK_MAP_SIZE ) )
+    {
+        wSize = hdr.wNbrCells * sizeof( LINK_CELL );
+
+        if( ( fileRead( fd, (BYTE*)linkCells, wSize ) == wSize )
+            &&
+            ( CalcCRC( (BYTE*)linkCells, wSize ) == hdr.wCRC ) )
+        {
+            wNbrCells = hdr.wNbrCells;
+
+            // Carry on from the most recent session of the saved map.
+            for( wIndex = 0; wIndex < wNbrCells; wIndex++ )
+            {
+                if( linkCells[wIndex].dwLastUsed > dwSessionClock )
+                {
+                    dwSessionClock = linkCells[wIndex].dwLastUsed;
+                }
+            }
+        }
+        else
+        {
+            MemSet( linkCells, 0, sizeof( linkCells ) );
+        }
+    }
+
+    fileClose( fd );
+}
+
+
+//******************************************************************************
+//
+//  Function: FindLinkCell
+//
+//  Arguments:
+//    IN  wCell - Cell and heading quadrant.
+//
+//  Returns: Pointer to the cell, or NULL if it is not in the map.
+//
+//  Description: Looks up a cell.
+//
+//******************************************************************************
+LINK_CELL* FindLinkCell( WORD wCell )
+{
+    WORD wIndex;
+
+    for( wIndex = 0; wIndex < wNbrCells; wIndex++ )
+    {
+        if( linkCells[wIndex].wCell == wCell )
+        {
+            return &linkCells[wIndex];
+        }
+    }
+
+    return NULL;
+}
+
+
+//******************************************************************************
+//
+//  Function: AddLinkCell
+//
+//  Arguments:
+//    IN  wCell - Cell and heading quadrant.
+//
+//  Returns: Pointer to the new (empty) cell.
+//
+//  Description: Adds a cell to the map. Once the map is full, the cell that
+//               saw a session longest ago is given up for it, so the cells
+//               of the current route are kept.
+//
+//******************************************************************************
+LINK_CELL* AddLinkCell( WORD wCell )
+{
+    LINK_CELL* pCell;
+    WORD       wIndex;
+
+    if( wNbrCells < LINK_MAP_SIZE )
+    {
+        pCell = &linkCells[wNbrCells++];
+    }
+    else
+    {
+        pCell = &linkCells[0];
+
+        for( wIndex = 1; wIndex < LINK_MAP_SIZE; wIndex++ )
+        {
+            if( linkCells[wIndex].dwLastUsed < pCell->dwLastUsed )
+            {
+                pCell = &linkCells[wIndex];
+            }
+        }
+    }
+
+    MemSet( pCell, 0, sizeof( LINK_CELL ) );
+    pCell->wCell = wCell;
+
+    return pCell;
+}
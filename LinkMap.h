@@ -0,0 +1,244 @@
+//******************************************************************************
+//
+//  LinkMap.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module keeps a map of SBD session outcomes and signal quality by
+//  position and heading, saved on the PCMCIA card so it builds up over
+//  many flights. The scheduler uses it to hold back non-urgent reports
+//  where sessions usually fail.
+//
+//  The aircraft position is not known to the driver; rules must keep it
+//  up to date with SetLinkMapPosition().
+//
+//******************************************************************************
+
+#ifndef _LINKMAP_H
+
+    #define _LINKMAP_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+/*artltyp+*/
+typedef BYTE    LINK_CELL_QUALITY;
+enum link_cell_quality
+{
+    LINK_CELL_UNKNOWN,      // No position, or too few sessions in the cell.
+    LINK_CELL_POOR,
+    LINK_CELL_FAIR,
+    LINK_CELL_GOOD,
+    NBR_LINK_CELL_QUALITIES
+} ;
+
+
+typedef struct
+{
+    DWORD dwSessions;               // SBD sessions attempted
+    DWORD dwLinkUps;                // Sessions that reached the network
+    DWORD dwDelivered;              // Messages delivered
+    DWORD dwDeferrals;              // Reports held back in poor cells
+    WORD  wCellsKnown;              // Cells in the map
+    WORD  wSaves;                   // Times the map was saved
+
+} LINK_MAP_STATS;
+/*artltyp-*/
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+/*artlx+*/
+//******************************************************************************
+//
+//  Function: InitLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables. The saved map is
+//               only read the first time it is needed, from the main loop.
+//
+//******************************************************************************
+void InitLinkMap( void );
+
+
+//******************************************************************************
+//
+//  Function: SetLinkMapPosition
+//
+//  Arguments:
+//    IN  iLatitude  - Latitude in degrees (-90 to 90, north positive).
+//    IN  iLongitude - Longitude in degrees (-180 to 180, east positive).
+//    IN  wHeading   - True heading in degrees (0 to 359).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to give the driver the aircraft
+//               position. Sessions are only mapped while it is known.
+//
+//******************************************************************************
+void SetLinkMapPosition( const short iLatitude, const short iLongitude, const WORD wHeading );
+
+
+//******************************************************************************
+//
+//  Function: ClearLinkMapPosition
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: The position is no longer known (e.g. GPS lost).
+//
+//******************************************************************************
+void ClearLinkMapPosition( void );
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapSession
+//
+//  Arguments:
+//    IN  bLinkUp - TRUE if the session reached the network.
+//    IN  iSignal - Last signal strength (0-5, -1 if unknown).
+//
+//  Returns: void.
+//
+//  Description: Adds an SBD session outcome to the cell the aircraft is in.
+//               The map is saved every few sessions.
+//
+//******************************************************************************
+void RecordLinkMapSession( const BOOL bLinkUp, const short iSignal );
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapDelivery
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Counts a delivered message, for the delivered messages per
+//               session attempt.
+//
+//******************************************************************************
+void RecordLinkMapDelivery( void );
+
+
+//******************************************************************************
+//
+//  Function: RecordLinkMapDeferral
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Counts a report held back because of the cell quality.
+//
+//******************************************************************************
+void RecordLinkMapDeferral( void );
+
+
+//******************************************************************************
+//
+//  Function: GetLinkMapQuality
+//
+//  Arguments: void.
+//
+//  Returns: LINK_CELL_QUALITY of the cell the aircraft is in.
+//
+//  Description: Cells are judged on their session success rate once they
+//               have seen a few sessions; older sessions count for less.
+//
+//******************************************************************************
+LINK_CELL_QUALITY GetLinkMapQuality( void );
+
+
+//******************************************************************************
+//
+//  Function: SaveLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the map was saved (or had not changed).
+//           FALSE if the file could not be written.
+//
+//  Description: Writes the map to the PCMCIA card. Rules should call it
+//               when the flight ends, as the last few sessions may not
+//               have been saved yet.
+//
+//******************************************************************************
+BOOL SaveLinkMap( void );
+
+
+//******************************************************************************
+//
+//  Function: ClearLinkMap
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Forgets all cells, including the saved map, and clears the
+//               statistics.
+//
+//******************************************************************************
+void ClearLinkMap( void );
+
+
+//******************************************************************************
+//
+//  Function: GetLinkMapStats
+//
+//  Arguments:
+//    OUT pStats - LINK_MAP_STATS since power up (or ClearLinkMap()).
+//
+//  Returns: void.
+//
+//  Description: Link map statistics.
+//
+//******************************************************************************
+void GetLinkMapStats( LINK_MAP_STATS* pStats );
+
+
+//******************************************************************************
+//
+//  Function: DisplayLinkMapStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Prints the sessions, deliveries and delivered messages per
+//               hundred session attempts to the mtce port (used to compare
+//               scheduling settings in simulation).
+//
+//******************************************************************************
+void DisplayLinkMapStats( void );
+/*artlx-*/
+
+
+#endif // _LINKMAP_H
@@ -52,10 +52,12 @@
     #include "Modem.h"
     #include "ModemSerial.h"
     #include "ModemAPI.h"
+    #include "ModemIpc.h"
     #include "ModemLog.h"
     #include "MsgHandler.h"
     #include "pcmciaAPI.h"
     #include "PowerManager.h"
+    #include "ReportHdrCodec.h"
     #include "rs422TxtMsg.h"
     #include "rulesbin.h"
     #include "SystemCfg.h"
@@ -69,13 +71,14 @@
 //------------------------------------------------------------------------------
 
 
-#define     STANDARD_RSP_TIMEOUT        5000
+#define     STANDARD_RSP_TIMEOUT        MODEM_STD_RSP_TIMEOUT
 
 #define     CARRIAGE_RETURN             '\r'
 #define     LINE_FEED                   '\n'
                                
 #define     STR_SIZE                    10      // " 65535\0" = max size of rspnse field
-#define     SATELLITE_RSP_TIMEOUT       65000   // in ms
+#define     SATELLITE_RSP_TIMEOUT       MODEM_SBD_SESSION_TIMEOUT
+#define     DEFAULT_MT_READ_RETRIES     3       // +SBDRB re-reads of a corrupt MT message
 #define     MAX_RX_SIZE                 sizeof( MODEM_RX_STRUCT )
 
 
@@ -233,6 +236,7 @@ enum cis_cmd_list
 };
 
 
+#if MODEM_HAS_CIS
 // String commands as enumerated in AT_CMD_LIST
 static BYTE CIS_CMDS[CIS_CMD_NBR_CODE][MAX_CMD_LINE_LEN] = 
 {
@@ -257,6 +261,7 @@ static BYTE CIS_CMDS[CIS_CMD_NBR_CODE][MAX_CMD_LINE_LEN] =
 
 // Length of each of the above commands, calc'd at init time.
 static BYTE CIS_CMDLEN[CIS_CMD_NBR_CODE];
+#endif
 
 
 // This is a list of valid responses for each CIS command.
@@ -275,6 +280,7 @@ enum cis_rsp_list
     CIS_RSP_NBR_CODE
 };
 
+#if MODEM_HAS_CIS
 // String commands as enumerated in AT_RSP_LIST;
 static BYTE CIS_RSPS[CIS_RSP_NBR_CODE][MAX_CMD_LINE_LEN] = 
 {
@@ -288,11 +294,13 @@ static BYTE CIS_RSPS[CIS_RSP_NBR_CODE][MAX_CMD_LINE_LEN] =
 };
 
 static BYTE CIS_RSPLEN[CIS_CMD_NBR_CODE];
+#endif
 
 
 typedef struct
 {
     BYTE   byMOStatus;
+    SBD_LINK_SAMPLE linkSample;
     MAILBOXCHECK_RSP byMTStatus;
     char   szMOMSN[STR_SIZE];
     char   szMTMSN[STR_SIZE];
@@ -313,7 +321,7 @@ typedef struct
 {
     WORD  wMsgCheckSum;
     WORD  wMTType;
-    BYTE  byBuffer[MAX_RX_FILE_LEN];
+    BYTE  byBuffer[MODEM_MT_BUF_LEN];
 } MT_MSG_FORMAT;
 
 typedef struct
@@ -442,7 +450,7 @@ static  char                szRxFilename[MAX_FILENAME_LEN];
 static  char                szRxPathFilename[EMAXPATH];
 
 static  MODEM_INFO_STRUCT   modemInfo;
-static  BYTE                byBinMsgBuffer[MAX_FILE_LEN]; // Buffer to hold the incomming binary message.
+static  BYTE                byBinMsgBuffer[MODEM_MO_BUF_LEN]; // Buffer to hold the incomming binary message.
 
 static  char                szIMEI[IMEI_SIZE]; 
 static  char                szModemSWVersion[MODEM_SW_VER_SIZE];
@@ -451,6 +459,13 @@ static  BOOL                bHaveIMEI;
 static  WORD                wSatelliteTimeout;
 static char                 szErrString[MAX_SYSTEM_LOG_STR];
 
+// MT messages stay in the modem buffer, so a corrupt read is re-read
+// over the serial port rather than resent over the air.
+static  BYTE                byMTReadRetries;
+static  BYTE                byMTReadAttempt;
+static  DWORD               dwMTReReads;
+static  DWORD               dwMTReadRescues;
+
 #ifdef __BORLANDC__
 AnsiString                  sErrorStr;
 static  COMMINFO_TYPE       ciModemCommPort;
@@ -465,9 +480,11 @@ static  COMMINFO_TYPE       ciModemCommPort;
 static void                 SendCommand( AT_CMD_LIST cmd );
 static void                 SendWriteBinaryMsgCmd( void );
 static void                 SendBinaryDataBuffer( void );
+#if MODEM_HAS_CIS
 static BOOL                 SendCISPortCmd( void );
 static BOOL                 SendCISLoadConfigLineCmd( void );
 static void                 RecoverFromBadCISCmd( void );
+#endif
 
 
 // Response helper functions
@@ -483,11 +500,13 @@ static MODEM_RESPONSES      GetIMEIRsp( void );
 static MODEM_RESPONSES      GetModemVerRsp( void );
 static MODEM_RESPONSES      GetRxBinaryDataBufferRsp( void );
 static BOOL                 GetDualResponse( BYTE FirstEOL, BYTE SecondEOL );
+#if MODEM_HAS_CIS
 static MODEM_RESPONSES      GetCISPortRsp( void );
 static MODEM_RESPONSES      GetRingerStatusRsp( void );
 static MODEM_RESPONSES      GetRelayStatusRsp( void );
 static BOOL                 CaptureCISOutput( void );
 static MODEM_RESPONSES      GetCISVersionStatusRsp( void );
+#endif
 
 static MTMDIR_RETURN_TYPE   DefineMsgTypeDestPath( WORD* pwMsg, DEVICE_DIR* pDeviceDir, SUBDIR_NAME* pSubDir );
 static void                 ClearBuffers( CIS_PORT portState );
@@ -525,6 +544,7 @@ void InitModem( void )
         AT_CMDLEN[wCmdIndex] = (BYTE)StringLen( (char*)AT_CMDS[wCmdIndex] );
     }
 
+#if MODEM_HAS_CIS
     for( wCmdIndex = 0; wCmdIndex < CIS_CMD_NBR_CODE; wCmdIndex++ )
     {
         CIS_CMDLEN[wCmdIndex] = (BYTE)StringLen( (char*)CIS_CMDS[wCmdIndex] );
@@ -534,6 +554,7 @@ void InitModem( void )
     {
         CIS_RSPLEN[wCmdIndex] = (BYTE)StringLen( (char*)CIS_RSPS[wCmdIndex] );
     }
+#endif
 
     // State init.
     subState        = SUBSTATE_NONE;
@@ -551,6 +572,10 @@ void InitModem( void )
     StringCpy( szIMEI, ERROR_IMEI );
     bHaveIMEI = FALSE;
     wSatelliteTimeout = SATELLITE_RSP_TIMEOUT;
+    byMTReadRetries   = DEFAULT_MT_READ_RETRIES;
+    byMTReadAttempt   = 0;
+    dwMTReReads       = 0;
+    dwMTReadRescues   = 0;
 
     // Initialize command response timer
     thRespTimeOut    = RegisterTimer();
@@ -625,13 +650,18 @@ void SetIMEI( AnsiString ModemSN )
 
 void SendTransparentStr( AnsiString sBuffer )
 {
-    CommSend( &ciModemCommPort, sBuffer.c_str(), sBuffer.Length() );
+    BridgeMtceToModem( (BYTE*)sBuffer.c_str(), (WORD)sBuffer.Length() );
 }
 
 
 DWORD ReceiveTransparentStr( BYTE* pbyStr, DWORD dwMaxBytes )
 {
-    return CommRecv( &ciModemCommPort, pbyStr, dwMaxBytes );
+    if( dwMaxBytes > 0xFFFF )
+    {
+        dwMaxBytes = 0xFFFF;
+    }
+
+    return BridgeModemToMtce( pbyStr, (WORD)dwMaxBytes );
 }
 
 void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength )
@@ -639,11 +669,48 @@ void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength )
     CommSend( &ciModemCommPort, pBuffer, wLength );
 }
 
+WORD ModemPortReceiveBuffer( BYTE* pBuffer, WORD wMaxLength )
+{
+    return (WORD)CommRecv( &ciModemCommPort, pBuffer, wMaxLength );
+}
+
 BOOL GetModemPortChar( BYTE* byData )
 {
     CommRecv( &ciModemCommPort, byData, 1 );
 }
 
+
+//******************************************************************************
+//
+//  Function: GetModemPortRxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD 0; received bytes stay in the PC comm port driver until
+//           ReceiveTransparentStr() takes them.
+//
+//******************************************************************************
+WORD GetModemPortRxCount( void )
+{
+    return 0;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortTxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD 0; sent bytes go straight to the PC comm port.
+//
+//******************************************************************************
+WORD GetModemPortTxCount( void )
+{
+    return 0;
+}
+
+
 BOOL IsModemRunning( void )
 {
     return IsPortConnected( &ciModemCommPort );
@@ -781,9 +848,9 @@ BOOL SendBinaryFile( char *szPathfileName )
 
     // make sure the file length does not exceed the max size. 
     // Trucate the message if it exceeds max length
-    if( modemInfo.dwTxMsgLen > MAX_FILE_LEN )
+    if( modemInfo.dwTxMsgLen > MODEM_MO_BUF_LEN )
     {
-        modemInfo.dwTxMsgLen = MAX_FILE_LEN;
+        modemInfo.dwTxMsgLen = MODEM_MO_BUF_LEN;
         errorCodeRsp = MEC_TRUNCATED_FILE;
     }
     else if( modemInfo.dwTxMsgLen <= 0 )
@@ -793,7 +860,7 @@ BOOL SendBinaryFile( char *szPathfileName )
     }
 
     // Clear the buffer before using it.
-    MemSet( byBinMsgBuffer, 0, MAX_FILE_LEN );
+    MemSet( byBinMsgBuffer, 0, MODEM_MO_BUF_LEN );
 
     // Try to open the file
     // FOR RULESIM ONLY - PCMCIA driver ignores this tag.
@@ -823,6 +890,9 @@ BOOL SendBinaryFile( char *szPathfileName )
 
     fileClose( fd );
 
+    // Reports go out with a packed header when the ground supports it
+    modemInfo.dwTxMsgLen = PackReportHdr( byBinMsgBuffer, (WORD)modemInfo.dwTxMsgLen, MODEM_MO_BUF_LEN );
+
     SendWriteBinaryMsgCmd();
 
     ATCmdState = AT_CMD_SENDING;
@@ -862,9 +932,9 @@ BOOL SendBinaryBuffer( const BYTE *pbyDataBuf, WORD wMsgSize )
 
     // make sure the file length does not exceed the max size. 
     // Trucate the message if it exceeds max length
-    if( modemInfo.dwTxMsgLen > MAX_FILE_LEN )
+    if( modemInfo.dwTxMsgLen > MODEM_MO_BUF_LEN )
     {
-        modemInfo.dwTxMsgLen = MAX_FILE_LEN;
+        modemInfo.dwTxMsgLen = MODEM_MO_BUF_LEN;
         errorCodeRsp = MEC_TRUNCATED_FILE;
     }
     else if( modemInfo.dwTxMsgLen <= 0 )
@@ -874,7 +944,7 @@ BOOL SendBinaryBuffer( const BYTE *pbyDataBuf, WORD wMsgSize )
     }
 
     // Clear the buffer before copying the actual data in.
-    MemSet( byBinMsgBuffer, 0, MAX_FILE_LEN );
+    MemSet( byBinMsgBuffer, 0, MODEM_MO_BUF_LEN );
     MemCpy( byBinMsgBuffer, pbyDataBuf, (WORD)modemInfo.dwTxMsgLen );
 
     SendWriteBinaryMsgCmd();
@@ -1010,6 +1080,8 @@ BOOL SendReadBinaryFileCmd( void )
     SendCommand( AT_CMD_SBD_READ_BIN );
     
     ClearRxBinaryDataVars();
+
+    byMTReadAttempt = 0;
     
     ATCmdState = AT_CMD_RCVING;
     subState = GET_DATA;
@@ -1029,10 +1101,14 @@ BOOL SendReadBinaryFileCmd( void )
 //
 //  Description: Queries the modem for its current call status.
 //               Should only be called if upper layer has been turned off.
+//               Refused on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL SendCLCCCmd( void )
 {
+#if !MODEM_HAS_VOICE
+    return FALSE;
+#else
     // Ensure the modem is not currently busy first
     if( ATCmdState != AT_CMD_IDLE )
     {
@@ -1048,6 +1124,7 @@ BOOL SendCLCCCmd( void )
     subState = SEND_MODEM_STATE_CMD;
 
     return TRUE;
+#endif
 }
 
 
@@ -1061,10 +1138,14 @@ BOOL SendCLCCCmd( void )
 //           FALSE if ATCmdState not in idle mode.
 //
 //  Description: Sends the hangup command to the modem.
+//               Refused on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL SendCallHangupCmd( void )
 {
+#if !MODEM_HAS_VOICE
+    return FALSE;
+#else
     // Ensure the modem is not currently busy first
     if( ATCmdState != AT_CMD_IDLE )
     {
@@ -1077,6 +1158,7 @@ BOOL SendCallHangupCmd( void )
     subState = SEND_HANGUP_CALL_CMD;
 
     return TRUE;
+#endif
 }
 
 
@@ -1108,6 +1190,7 @@ BOOL SendCREGCmd( void )
 }
 
 
+#if MODEM_HAS_CIS
 //******************************************************************************
 //
 //  Function: SendDownloadCISCmd
@@ -1448,6 +1531,56 @@ BOOL SendGetRelayStatusCmd( BYTE byRelayNbr )
     return bRet_val;
 }
 
+#else
+
+//******************************************************************************
+//
+//  Built without a CIS (MODEM_HAS_CIS is 0): the CIS commands are refused
+//  so the upper layer never waits on a CIS response.
+//
+//******************************************************************************
+BOOL SendDownloadCISCmd( void )
+{
+    return FALSE;
+}
+
+
+BOOL SendProgramCISCmd( void )
+{
+    return FALSE;
+}
+
+
+BOOL SendCISResetCmd( void )
+{
+    return FALSE;
+}
+
+
+BOOL SendSetRingerCmd( BOOL bRingerState )
+{
+    return FALSE;
+}
+
+
+BOOL SendGetRingerStatusCmd( void )
+{
+    return FALSE;
+}
+
+
+BOOL SendSetRelayCmd( BYTE byRelayNbr, BOOL bRelayState )
+{
+    return FALSE;
+}
+
+
+BOOL SendGetRelayStatusCmd( BYTE byRelayNbr )
+{
+    return FALSE;
+}
+#endif // MODEM_HAS_CIS
+
 
 //******************************************************************************
 //
@@ -1685,6 +1818,7 @@ void UpdateModemState( void )
         StopTimer( thRespTimeOut );
     }
 
+#if MODEM_HAS_CIS
     // If at any time we lose power to the CIS, then immediately
     // go into the power down state.
     if( !CISPowered() )
@@ -1721,6 +1855,7 @@ void UpdateModemState( void )
 
         StopTimer( thCISRespTimeOut );
     }
+#endif
 
     // Update modem states.
 
@@ -1825,7 +1960,11 @@ void UpdateModemState( void )
                         case MR_SUCCESS:
 
                             StopTimer( thRespTimeOut );
+#if MODEM_HAS_RING_ALERT
                             subState = SEND_SBD_AUTOREG_CMD;
+#else
+                            subState = SEND_SBD_DOWNLOAD_CMD;
+#endif
                             break;
 
                         case MR_FAILED:
@@ -1840,6 +1979,7 @@ void UpdateModemState( void )
 
                     break;
 
+#if MODEM_HAS_RING_ALERT
                 case SEND_SBD_AUTOREG_CMD:
 
                     if( InVoiceCall() )
@@ -1889,6 +2029,8 @@ void UpdateModemState( void )
 
                     break;
 
+#endif
+
                 case SEND_SBD_DOWNLOAD_CMD:
 
                     if( InVoiceCall() )
@@ -2379,6 +2521,7 @@ void UpdateModemState( void )
 
             break;
 
+#if MODEM_HAS_CIS
         case AT_CMD_PGMING:
 
             switch( subState )
@@ -2659,6 +2802,7 @@ void UpdateModemState( void )
                 default:
                     break;
            }
+#endif
 
         case AT_CMD_FAILED:
         case AT_CMD_SUCCESS:
@@ -2778,6 +2922,28 @@ MAILBOXCHECK_RSP GetSBDStatus( void )
 }
 
 
+//******************************************************************************
+//
+//  Function: GetSBDLinkSample
+//
+//  Arguments: void.
+//
+//  Returns: SBD_LINK_SAMPLE of the last +SBDIX session.
+//
+//  Description: Lets the upper layer use an SBD session as a link quality
+//               sample. The sample is cleared after reading.
+//
+//******************************************************************************
+SBD_LINK_SAMPLE GetSBDLinkSample( void )
+{
+    SBD_LINK_SAMPLE sample = modemInfo.linkSample;
+
+    modemInfo.linkSample = SBD_LINK_NO_SAMPLE;
+
+    return sample;
+}
+
+
 //******************************************************************************
 //
 //  Function: GetModemSignalStrength
@@ -2979,6 +3145,121 @@ char* GetMTMSN( void )
 }
 
 
+//******************************************************************************
+//
+//  Function: SetMTReadRetries
+//
+//  Arguments:
+//    IN  byRetries - Number of +SBDRB re-reads of a corrupt MT message
+//                    (0 to disable, default 3).
+//
+//  Returns: void.
+//
+//  Description: An MT message that fails its checksum or length check is
+//               read again from the modem buffer before it is written to
+//               the error directory.
+//
+//******************************************************************************
+void SetMTReadRetries( BYTE byRetries )
+{
+    byMTReadRetries = byRetries;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetMTReadRetries
+//
+//  Arguments: void.
+//
+//  Returns: BYTE number of +SBDRB re-reads of a corrupt MT message.
+//
+//  Description: See SetMTReadRetries.
+//
+//******************************************************************************
+BYTE GetMTReadRetries( void )
+{
+    return byMTReadRetries;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetMTReReadCount
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of +SBDRB re-reads issued since power up.
+//
+//  Description: MT read statistics.
+//
+//******************************************************************************
+DWORD GetMTReReadCount( void )
+{
+    return dwMTReReads;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetMTReadRescues
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of corrupt MT reads that a re-read recovered.
+//
+//  Description: MT read statistics. Each one is a message the ground did
+//               not have to resend over the air.
+//
+//******************************************************************************
+DWORD GetMTReadRescues( void )
+{
+    return dwMTReadRescues;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemModelName
+//
+//  Arguments: void.
+//
+//  Returns: const char* name of the transceiver the driver was built for.
+//
+//  Description: See ModemModel.h.
+//
+//******************************************************************************
+const char* GetModemModelName( void )
+{
+    return MODEM_MODEL_NAME;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemModelRAM
+//
+//  Arguments: void.
+//
+//  Returns: DWORD bytes of static RAM used by the SBD buffers and the CIS
+//           tables in this build.
+//
+//  Description: Lets the variants be compared on target. Code size is not
+//               known at run time; take it from the linker map.
+//
+//******************************************************************************
+DWORD GetModemModelRAM( void )
+{
+    DWORD dwBytes = sizeof( byBinMsgBuffer ) + sizeof( RxMsg );
+
+#if MODEM_HAS_CIS
+    dwBytes += sizeof( CIS_CMDS ) + sizeof( CIS_CMDLEN ) + sizeof( CIS_RSPS ) + sizeof( CIS_RSPLEN );
+#endif
+
+    return dwBytes;
+}
+
+
 //------------------------------------------------------------------------------
 //  PRIVATE FUNCTIONS
 //------------------------------------------------------------------------------
@@ -3011,11 +3292,13 @@ void SendCommand( AT_CMD_LIST cmd )
     }
     else
     {
+#if MODEM_HAS_RING_ALERT
         if( modemInfo.byRAFlag == AT_RSP_SBD_STATUS_RA )
         {
             cmd = AT_CMD_SBD_INITIATE_ALERT_SESSION;
         }
         else
+#endif
         {
             cmd = AT_CMD_SBD_INITIATE_SESSION;
         }
@@ -3116,6 +3399,7 @@ void SendBinaryDataBuffer( void )
 }
 
 
+#if MODEM_HAS_CIS
 //******************************************************************************
 //
 //  Function: SendCISPortCmd
@@ -3221,6 +3505,7 @@ void RecoverFromBadCISCmd( void )
     // Now we're able to start again from scratch.
     ResetCISConfigIndex();
 }
+#endif
 
 
 //******************************************************************************
@@ -3489,6 +3774,24 @@ MODEM_RESPONSES GetInitiateSBDSessionRsp( void )
         modemInfo.byMOStatus   = (BYTE)StringToInt( szMOStatus );
         modemInfo.byMTStatus   = (MAILBOXCHECK_RSP)StringToInt( szMTStatus );
 
+        // Anything up to SBD blocked was decided by the gateway.
+        if( modemInfo.byMOStatus <= AT_RSP_SBDI_FAILURE_SBD_BLOCKED )
+        {
+            modemInfo.linkSample = SBD_LINK_UP;
+        }
+        else if( ( modemInfo.byMOStatus == AT_RSP_SBDI_FAILURE_NO_RSP )
+                 ||
+                 ( modemInfo.byMOStatus == AT_RSP_SBDI_FAILURE_NO_CONNECTION )
+                 ||
+                 ( modemInfo.byMOStatus == AT_RSP_SBDI_FAILURE_NO_NETWORK ) )
+        {
+            modemInfo.linkSample = SBD_LINK_DOWN;
+        }
+        else
+        {
+            modemInfo.linkSample = SBD_LINK_NO_SAMPLE;
+        }
+
         switch( modemInfo.byMOStatus )
         {
             case AT_RSP_SBDI_SUCCESS:
@@ -4085,6 +4388,7 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
     static WORD wRxDataCount = 0;
     BYTE    byRxData = 0;
     WORD_BUFF rxChecksum;
+    BOOL    bLengthOk;
     
     // Keep on receiving until size(2) + msg(modemInfo.wMTLength) + checksum(2) is received
     while( wRxDataCount < ( modemInfo.wMTLength + WORD_SIZE * 2 ) )
@@ -4102,7 +4406,14 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
             wCalculatedCheckSum += byRxData;
         }
 
-        RxMsg.pbyRxMsg[wRxDataCount++] = byRxData;
+        // The buffer is sized for this transceiver; anything longer is
+        // caught by the length check below.
+        if( wRxDataCount < MAX_RX_SIZE )
+        {
+            RxMsg.pbyRxMsg[wRxDataCount] = byRxData;
+        }
+
+        wRxDataCount++;
     }
 
     // Get the stray 0 or 4
@@ -4111,6 +4422,29 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
     rxChecksum.byData[0] = RxMsg.pbyRxMsg[wRxDataCount-2];
     rxChecksum.byData[1] = RxMsg.pbyRxMsg[wRxDataCount-1];
 
+    bLengthOk = ( RxMsg.rxMsg.wRxMsgLen == modemInfo.wMTLength );
+
+    // The message is still in the modem's MT buffer - on a checksum or
+    // length mismatch read it again (local, no satellite time) before
+    // declaring it lost.
+    if( ( modemInfo.wMTLength != 0 )
+        &&
+        ( ( wCalculatedCheckSum != rxChecksum.wData ) || !bLengthOk )
+        &&
+        ( byMTReadAttempt < byMTReadRetries ) )
+    {
+        print( "\r\n(GetRxBinaryDataBufferRsp) Re-reading MT buffer" );
+
+        byMTReadAttempt++;
+        dwMTReReads++;
+        wRxDataCount = 0;
+
+        SendCommand( AT_CMD_SBD_READ_BIN );
+        ClearRxBinaryDataVars();
+
+        return MR_WAITING;
+    }
+
     if( RxMsg.rxMsg.wRxMsgLen == 0 )
     {
         // Notify upper layer
@@ -4121,7 +4455,7 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
 
     // The modem should check for this; this is an unlikely event, but we must
     // be sure
-    else if( RxMsg.rxMsg.wRxMsgLen > MAX_RX_FILE_LEN )
+    else if( RxMsg.rxMsg.wRxMsgLen > MODEM_MT_BUF_LEN )
     {
         errorCodeRsp = MEC_RX_BAD_FILELENGTH;
         RxMsg.rxMsg.wRxMsgLen = modemInfo.wMTLength;
@@ -4136,6 +4470,11 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
         output_hex( rxChecksum.wData, 2 );
         modemResponse = MR_FAILED;
     }
+    else if( ( byMTReadAttempt != 0 ) && bLengthOk )
+    {
+        // A re-read saved the ground from resending the message.
+        dwMTReadRescues++;
+    }
 
     wRxDataCount = 0;
 
@@ -4148,6 +4487,14 @@ MODEM_RESPONSES GetRxBinaryDataBufferRsp( void )
     // **Write the buffer to a file, even if it has an error, but only if we have data to write out**
     if( modemInfo.wMTLength != 0 )
     {
+#ifdef MODEM_HOST_IPC
+        // Host clients get every good message, as well as the file below.
+        if( modemResponse == MR_SUCCESS )
+        {
+            PublishModemIpcMT( (BYTE*)&RxMsg.rxMsg.MTMessage, modemInfo.wMTLength );
+        }
+#endif
+
         // Define, based on message type ranges, where the file will be moved to
         // at the upper layer.
         mtmReturn = DefineMsgTypeDestPath( (WORD*)&RxMsg.rxMsg.MTMessage, &deviceDir, &subDir );
@@ -4661,6 +5008,7 @@ BOOL GetDualResponse( BYTE FirstEOL, BYTE SecondEOL )
 }
 
 
+#if MODEM_HAS_CIS
 //******************************************************************************
 //
 //  Function: GetCISPortRsp
@@ -4977,6 +5325,7 @@ MODEM_RESPONSES GetCISVersionStatusRsp( void )
 
     return MR_FAILED;
 }
+#endif
 
 
 //******************************************************************************
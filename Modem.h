@@ -33,6 +33,7 @@
 
 #include "typedefs.h"
 #include "ATInterface.h"
+#include "ModemModel.h"
 
 //------------------------------------------------------------------------------
 //  CONSTANT & MACRO DEFINITIONS
@@ -67,6 +68,16 @@ enum call_status_rsp
     AT_RSP_IDLE_CALL_STATUS,
     CALL_STATUS_WAITING_FOR_RSP
 };
+
+
+// What the last +SBDIX outcome says about the satellite link
+typedef BYTE    SBD_LINK_SAMPLE;
+enum sbd_link_sample
+{
+    SBD_LINK_NO_SAMPLE = 0,       // No session, or the outcome says nothing of the link
+    SBD_LINK_UP,                  // The gateway was reached
+    SBD_LINK_DOWN                 // No network, RF drop or no answer from the gateway
+};
 /*artltyp-*/
 
 
@@ -340,6 +351,7 @@ BOOL SendReadBinaryFileCmd( void );
 //
 //  Description: Queries the modem for its current call status.
 //               Should only be called if upper layer has been turned off.
+//               Refused on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL SendCLCCCmd( void );
@@ -355,6 +367,7 @@ BOOL SendCLCCCmd( void );
 //           FALSE if ATCmdState not in idle mode.
 //
 //  Description: Sends the hangup command to the modem.
+//               Refused on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL SendCallHangupCmd( void );
@@ -703,6 +716,23 @@ MAILBOXCHECK_RSP GetSBDStatus( void );
 /*artlx-*/
 
 
+/*artl+*/
+//******************************************************************************
+//
+//  Function: GetSBDLinkSample
+//
+//  Arguments: void.
+//
+//  Returns: SBD_LINK_SAMPLE of the last +SBDIX session.
+//
+//  Description: Lets the upper layer use an SBD session as a link quality
+//               sample. The sample is cleared after reading.
+//
+//******************************************************************************
+SBD_LINK_SAMPLE GetSBDLinkSample( void );
+/*artl-*/
+
+
 /*artl+*/
 //******************************************************************************
 //
@@ -837,6 +867,97 @@ char* GetMOMSN( void );
 //
 //******************************************************************************
 char* GetMTMSN( void );
+
+
+//******************************************************************************
+//
+//  Function: SetMTReadRetries
+//
+//  Arguments:
+//    IN  byRetries - Number of +SBDRB re-reads of a corrupt MT message
+//                    (0 to disable, default 3).
+//
+//  Returns: void.
+//
+//  Description: An MT message that fails its checksum or length check is
+//               read again from the modem buffer before it is written to
+//               the error directory.
+//
+//******************************************************************************
+void SetMTReadRetries( BYTE byRetries );
+
+
+//******************************************************************************
+//
+//  Function: GetMTReadRetries
+//
+//  Arguments: void.
+//
+//  Returns: BYTE number of +SBDRB re-reads of a corrupt MT message.
+//
+//  Description: See SetMTReadRetries.
+//
+//******************************************************************************
+BYTE GetMTReadRetries( void );
+
+
+//******************************************************************************
+//
+//  Function: GetMTReReadCount
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of +SBDRB re-reads issued since power up.
+//
+//  Description: MT read statistics.
+//
+//******************************************************************************
+DWORD GetMTReReadCount( void );
+
+
+//******************************************************************************
+//
+//  Function: GetMTReadRescues
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of corrupt MT reads that a re-read recovered.
+//
+//  Description: MT read statistics. Each one is a message the ground did
+//               not have to resend over the air.
+//
+//******************************************************************************
+DWORD GetMTReadRescues( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemModelName
+//
+//  Arguments: void.
+//
+//  Returns: const char* name of the transceiver the driver was built for.
+//
+//  Description: See ModemModel.h.
+//
+//******************************************************************************
+const char* GetModemModelName( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemModelRAM
+//
+//  Arguments: void.
+//
+//  Returns: DWORD bytes of static RAM used by the SBD buffers and the CIS
+//           tables in this build.
+//
+//  Description: Lets the variants be compared on target. Code size is not
+//               known at run time; take it from the linker map.
+//
+//******************************************************************************
+DWORD GetModemModelRAM( void );
 /*artlx-*/
 
 
@@ -45,13 +45,19 @@
     #include "EEPROMApi.h"
     #include "FileTransfer.h"
     #include "FileUtils.h"
+    #include "LinkMap.h"
     #include "ModemAPI.h"
+    #include "ModemBridge.h"
+    #include "ModemData.h"
+    #include "ModemGround.h"
     #include "ModemSerial.h"
     #include "ModemLog.h"
     #include "MsgHandler.h"
+    #include "MtcePort.h"
     #include "pcmciaAPI.h"
     #include "PowerManager.h"
     #include "queue.h"
+    #include "ReportHdrCodec.h"
     #include "RulesBin.h"
     #include "SystemLog.h"
     #include "timer.h"
@@ -79,6 +85,57 @@
 
 #define MDM_Q_LEN                       10
 
+#define DEFAULT_SLEEP_POLL_RATE         150000  // Batched poll deadline while asleep
+#define DEFAULT_OUTBOX_CHECK_RATE       2000    // Outbox scan rate while asleep
+#define DEFAULT_WAKE_SETTLE_DELAY       1000    // Time for the modem to come out of sleep
+#define DEFAULT_WAKE_HOLD_TIME          300000L // Stays awake this long for a message not resubmitted
+#define DEFAULT_ENERGY_SAMPLE_RATE      1000    // Energy model resolution (1 second)
+
+#define POLL_CLOCK_RES                  250     // Poll scheduler resolution
+#define POLL_MIN_DIVISOR                2       // Fastest poll is half the base rate
+#define POLL_MAX_MULTIPLIER             4       // Slowest poll is 4 times the base rate
+#define POLL_COALESCE_DIVISOR           4       // Polls due within 1/4 interval run together
+#define POLL_STATS_PERIOD               3600000L// Polls per hour (1 hour)
+
+#define PHASE_CSQ_SAMPLES               3       // CSQ samples for a sustained level
+#define PHASE_GOOD_CSQ                  3       // Sustained at or above: stable link
+#define PHASE_SWING_CSQ                 2       // Swing at or above: changing link
+#define PHASE_NO_SIGNAL_CSQ             0       // Sustained at or below: no coverage
+#define PHASE_RECOVER_CSQ               2       // Leaves no coverage
+#define PHASE_FAIL_STREAK               6       // Link down sessions for no coverage
+#define PHASE_DELIVERY_RUN              5       // Back to back deliveries: stable link
+#define PHASE_IDLE_SECS                 1800    // No delivery for 30 minutes: parked
+
+#define DEDUP_TABLE_SIZE                16      // Recently delivered report hashes
+#define DEDUP_MAX_OPT_OUTS              8       // Report types always sent
+#define DEDUP_READ_CHUNK                64      // Bytes read at a time, >= a report header
+#define DEDUP_DEFAULT_MAX_AGE           1800000L // in ms, oldest copy that retires a report
+#define DEDUP_HASH_SEED                 0x811C9DC5L // FNV-1a offset basis
+#define DEDUP_HASH_PRIME                0x01000193L // FNV-1a prime
+#define DEDUP_CHECK_MOD                 255     // Fletcher-16 modulus
+#define DEDUP_HEAD_BYTES                8       // Leading bytes compared as well
+
+#define DEFAULT_MAX_COVERAGE_DEFERRAL   900000L // 15 minutes
+#define MAX_COVERAGE_HELD_FILES         16      // Non-urgent files held back at once
+#define COVERAGE_HELD_FILENAME          "DEFERRED.DAT" // Held back files, kept over a reset
+#define COVERAGE_GOOD_CALL_WAIT         4       // Call delay divisor in good cells
+
+#define MODEM_SUPPLY_MILLIVOLTS         5000    // Used to convert mA-seconds into mJ
+
+#define DEFAULT_MAX_TRANSPARENT_PAUSE   30000   // Longest SBD slice taken from the technician
+#define TRANSPARENT_QUIET_TIME          500     // No bridge traffic for this long = boundary
+#define TRANSPARENT_CMD_TIMEOUT         90000   // Technician command assumed done (SBDIX < 90s)
+#define TRANSPARENT_SLICE_GAP           10000   // Technician keeps the port at least this long
+#define TRANSPARENT_RSP_LEN             8       // Longest final result code tracked
+
+// Default current draw estimates (in mA) for each MODEM_POWER_STATES enum.
+#define DEFAULT_PWR_OFF_MA              0
+#define DEFAULT_PWR_SLEEP_MA            10
+#define DEFAULT_PWR_IDLE_MA             150
+#define DEFAULT_PWR_LOCAL_CMD_MA        160
+#define DEFAULT_PWR_SBD_SESSION_MA      450
+#define DEFAULT_PWR_VOICE_CALL_MA       400
+
 
 // These can only be reset by embedded rules!
 // Initialized to default values.
@@ -95,6 +152,19 @@ typedef struct
     DWORD dwRetryDelay;
 
     char  szKeepFileList[MAX_PRIORITY_FLAGS];
+
+    BOOL  bSleepEnabled;
+    DWORD dwSleepPollRate;
+    WORD  wCurrentDraw[NBR_MODEM_PWR_STATES];  // in mA
+
+    BOOL  bTransparentSlicing;
+    DWORD dwMaxTransparentPause;
+
+    BOOL  bAdaptivePolling;
+
+    BOOL  bCoverageScheduling;
+    char  szUrgentFileList[MAX_PRIORITY_FLAGS];
+    DWORD dwMaxCoverageDeferral;
 } MODEM_CONFIGURABLES;
 
 // Flags are reset every initialization.
@@ -130,20 +200,175 @@ typedef struct
     MODEM_STATES modemState;
     MODEM_STATES prevModemState;    // Only used if we access the modem state machine while it is in powered down state.
                                     // This only occurs for CIS commands.
+
+    BOOL  bModemAsleep;             // DTR is low - no AT commands can be sent.
+    BOOL  bWakeRequested;           // A message was submitted while asleep - stay awake until accepted.
+    BOOL  bWakeSettling;            // DTR raised, waiting for the modem to settle.
+
+    BOOL  bInBulkTransfer;          // A data call or SBD fragmenting owns the modem port.
+
+    BOOL  bCoverageDeferring;       // Non-urgent reports held back in a poor cell.
 } MODEM_OPTIONS;
 
 
+// Energy model accumulators. Reset on request only.
+typedef struct
+{
+    DWORD dwChargeInState[NBR_MODEM_PWR_STATES];   // in mA-seconds
+    DWORD dwSecsInState[NBR_MODEM_PWR_STATES];
+    DWORD dwMsgsDelivered;
+} MODEM_ENERGY_STATS;
+
+
+// Tracks the technician's session while in time-sliced transparent mode.
+typedef struct
+{
+    BOOL  bPaused;                  // The driver owns the port for an SBD slice.
+    BOOL  bTechCmdOpen;             // Technician has typed part of a command.
+    BOOL  bTechAwaitingRsp;         // Technician command sent, no final result yet.
+    BOOL  bTechTraffic;             // Technician used the port since the last slice.
+    BOOL  bOverrun;                 // Current slice outlasted the maximum pause.
+    char  szRspLine[TRANSPARENT_RSP_LEN];
+    WORD  wRspIndex;
+
+    DWORD dwPauseCount;
+    DWORD dwOverrunCount;
+} TRANSPARENT_SLICE;
+
+
+// Status polls run by the poll scheduler.
+typedef BYTE    POLL_TYPES;
+enum poll_types
+{
+    POLL_CSQ,                       // +CSQF
+    POLL_GATEWAY,                   // +SBDSX
+    POLL_CALL_STATUS,               // +CLCC, only while in a call
+    NBR_POLL_TYPES
+};
+
+
+// Single scheduler for all status polls. Intervals stretch while the
+// polled state is stable and tighten when it changes.
+typedef struct
+{
+    BOOL  bActive[NBR_POLL_TYPES];
+    DWORD dwDueAt[NBR_POLL_TYPES];      // Poll clock
+    DWORD dwInterval[NBR_POLL_TYPES];   // Current (adaptive) interval
+
+    DWORD dwClock;                      // in ms
+    DWORD dwPeriodStart;
+    BOOL  bFullPeriod;
+
+    short           iLastSignal;
+    CALL_STATUS_RSP lastCallStatus;
+    SBD_LINK_SAMPLE lastLinkSample;
+
+    DWORD dwPollsThisPeriod;
+    DWORD dwPollsLastPeriod;
+    DWORD dwPollsSkipped;               // Made redundant by an SBD session
+} POLL_SCHEDULER;
+
+
+// Scheduling parameters switched as a set by the flight phase profiles.
+typedef struct
+{
+    BYTE  byMaxRetries;
+    DWORD dwRetryDelay;
+    DWORD dwCheckSigStrengthRate;
+    DWORD dwWaitForCalls;
+    DWORD dwTimeoutDelay;
+} MODEM_PROFILE;
+
+
+typedef struct
+{
+    BOOL          bEnabled;
+    MODEM_PHASES  externalPhase;        // MODEM_PHASE_AUTO if inferred
+    MODEM_PHASES  activePhase;          // MODEM_PHASE_AUTO until one is applied
+    MODEM_PHASES  pendingPhase;         // Applied at the next safe point
+
+    MODEM_PROFILE profile[NBR_MODEM_PHASES];
+    MODEM_PROFILE rulesProfile;         // Restored when profiles are disabled
+
+    short iCSQ[PHASE_CSQ_SAMPLES];      // Most recent first
+    BYTE  byNbrCSQ;
+    BYTE  byLinkDownStreak;
+    BOOL  bLinkUp;
+    BYTE  byDeliveryRun;
+    DWORD dwSecsIdle;                   // Since the last delivery
+
+    DWORD dwTransitions;
+    DWORD dwSecsInPhase[NBR_MODEM_PHASES];
+    DWORD dwMsgsInPhase[NBR_MODEM_PHASES];
+} MODEM_PROFILES;
+
+
+// What two reports are matched on. The FNV-1a hash alone would let two
+// different reports of one length collide about once in 2^32 pairs; the
+// Fletcher sum and the leading bytes (the report header) must match too,
+// leaving a 1 in 2^48 chance for reports that share their header.
+typedef struct
+{
+    DWORD dwHash;
+    WORD  wCheck;
+    WORD  wLength;                      // 0 if the file was not read
+    BYTE  byHead[DEDUP_HEAD_BYTES];
+} REPORT_FINGERPRINT;
+
+
+// Fingerprints of the reports delivered recently, so a byte identical
+// copy queued later is retired without a session.
+typedef struct
+{
+    BOOL  bEnabled;
+
+    REPORT_FINGERPRINT recent[DEDUP_TABLE_SIZE];
+    DWORD dwDelivered[DEDUP_TABLE_SIZE]; // Poll clock when it was delivered
+    DWORD dwMaxAge;                     // in ms
+    BYTE  byNbrHashes;
+    BYTE  byNextHash;                   // Oldest entry once the table is full
+
+    WORD  wOptOut[DEDUP_MAX_OPT_OUTS];  // Report types never retired
+    BYTE  byNbrOptOuts;
+
+    BOOL  bPending;                     // File being sent has been read
+    REPORT_FINGERPRINT pending;
+    REPORT_FINGERPRINT held[MAX_COVERAGE_HELD_FILES]; // Files in coverageHeld, undelivered
+
+    DWORD dwSessionsSaved;
+} REPORT_DEDUP;
+
+
+// Non-urgent files moved out of the outbox while the aircraft is in a poor
+// cell, so the files queued behind them are not held back too. The list is
+// saved on the card, so a reset cannot strand them in the working directory.
+typedef struct
+{
+    char  szFileName[MAX_COVERAGE_HELD_FILES][MAX_FILENAME_LEN];  // In the working directory
+    BYTE  byNbrFiles;
+    BOOL  bRestored;                // Saved list from before a reset requeued
+} COVERAGE_HELD_FILES;
+
+
 //------------------------------------------------------------------------------
 //  GLOBAL DECLARATIONS
 //------------------------------------------------------------------------------
 
 
-static TIMERHANDLE  thCheckCSQ;
 static TIMERHANDLE  thCheckRetryDelay;
 static TIMERHANDLE  thWaitForCalls;
-static TIMERHANDLE  thCheckGateway;
-static TIMERHANDLE  thCheckCallStatus;
+static TIMERHANDLE  thPollClock;
 static TIMERHANDLE  thTimeout;
+static TIMERHANDLE  thSleepPoll;
+static TIMERHANDLE  thOutboxCheck;
+static TIMERHANDLE  thWakeSettle;
+static TIMERHANDLE  thWakeHold;
+static TIMERHANDLE  thEnergySample;
+static TIMERHANDLE  thTransparentQuiet;
+static TIMERHANDLE  thTransparentCmd;
+static TIMERHANDLE  thTransparentPause;
+static TIMERHANDLE  thTransparentGap;
+static TIMERHANDLE  thCoverageDefer;
 
 static QUEUE_BUFF   modemQBuff[MDM_Q_LEN];
 
@@ -156,6 +381,24 @@ static char         szErrString[MAX_SYSTEM_LOG_STR];
 static MODEM_FLAGS          modemFlags;
 static MODEM_OPTIONS        modemOptions;
 static MODEM_CONFIGURABLES  modemConfigurables;
+static MODEM_ENERGY_STATS   modemEnergy;
+static TRANSPARENT_SLICE    transparentSlice;
+static POLL_SCHEDULER       pollSched;
+static MODEM_PROFILES       modemProfiles;
+static REPORT_DEDUP         reportDedup;
+static BYTE                 byDedupChunk[DEDUP_READ_CHUNK];
+static COVERAGE_HELD_FILES  coverageHeld;
+
+// Ground/taxi, climb, cruise and no coverage. Climb rides through antenna
+// shadowing with more, slower retries; cruise polls less and shortens the
+// call window; no coverage backs off and does not reset the modem early.
+static const MODEM_PROFILE DEFAULT_MODEM_PROFILES[NBR_MODEM_PHASES] =
+{
+    { DEFAULT_RETRY_COUNT, DEFAULT_RETRY_DELAY, DEFAULT_SIGSTRENGTH_POLL_RATE, DEFAULT_WAIT_FOR_CALLS, DEFAULT_TIMEOUT_DELAY },
+    { 8,                   10000,               60000,                         15000,                  DEFAULT_TIMEOUT_DELAY },
+    { DEFAULT_RETRY_COUNT, DEFAULT_RETRY_DELAY, 300000,                        30000,                  DEFAULT_TIMEOUT_DELAY },
+    { 3,                   60000,               60000,                         DEFAULT_WAIT_FOR_CALLS, ( 30 * 60000 )        }
+};
 
 
 #if (DEBUG)
@@ -232,6 +475,141 @@ void HandleTimeouts( AT_CMD_STATES ATCmdState );
     // Ensures back-to-back timeouts are handled consistently.
 
 
+static void EnterModemSleep( void );
+    // Drops DTR to put the modem to sleep if there is nothing left to do.
+
+
+static void WakeModem( void );
+    // Raises DTR and holds off AT commands until the modem has settled.
+
+
+static BOOL ModemWakeRequired( void );
+    // Returns TRUE if a queued message, a ring alert or the sleep
+    // poll deadline requires the modem to be woken.
+
+
+static MODEM_POWER_STATES GetModemPowerState( void );
+    // Maps the current driver state onto the energy model power states.
+
+
+static void UpdateEnergyModel( void );
+    // Accumulates the current draw of the present power state.
+
+
+static void HandleBulkTransfer( void );
+    // Runs the data call transfer (or SBD fragmenting) of the file
+    // being sent and cleans up once it is complete.
+
+
+static void BulkTransferFailed( void );
+    // Schedules a retry of the data call, or falls back to SBD
+    // fragmenting once the retries are used up.
+
+
+static void RetireSentFile( void );
+    // Deletes the file being sent, or moves it to the sent directory
+    // if its priority flag is in the keep list.
+
+
+static BOOL TransparentSliceActive( void );
+    // Returns TRUE if the state machine may run while in transparent
+    // mode. Starts and ends the SBD slices.
+
+
+static BOOL UrgentSBDWorkPending( void );
+    // Returns TRUE if there is SBD or CIS work that should not wait
+    // for the technician to leave transparent mode.
+
+
+static BOOL AtTransparentCmdBoundary( void );
+    // Returns TRUE if the technician is between commands.
+
+
+static void ResumeTransparentBridge( void );
+    // Hands the modem port back to the technician.
+
+
+static void ServicePollScheduler( void );
+    // Runs the poll clock and the polls per hour statistics.
+
+
+static void SchedulePoll( POLL_TYPES poll, DWORD dwDelay );
+    // Makes a poll due dwDelay ms from now.
+
+
+static void StopPoll( POLL_TYPES poll );
+    // A stopped poll is never due.
+
+
+static BOOL PollDue( POLL_TYPES poll );
+    // Returns TRUE if the poll should be sent.
+
+
+static void PollSent( POLL_TYPES poll );
+    // Counts the poll, schedules the next one and pulls in the
+    // polls that are almost due so they share the busy period.
+
+
+static void AdaptPollRate( POLL_TYPES poll, BOOL bChanged );
+    // Tightens the poll interval if the polled state changed,
+    // stretches it otherwise, and reschedules the poll.
+
+
+static void TakeSBDLinkSample( void );
+    // Uses the outcome of the last SBD session as a link sample,
+    // deferring the CSQ and gateway polls it made redundant.
+
+
+static void NoteProfileCSQ( short iSignal );
+    // Adds a CSQ sample to the flight phase conditions.
+
+
+static void NoteProfileLinkSample( SBD_LINK_SAMPLE sample );
+    // Adds an SBD session outcome to the flight phase conditions.
+
+
+static void NoteProfileDelivery( void );
+    // Counts a delivered message against the active flight phase.
+
+
+static void EvaluateModemPhase( void );
+    // Works out which flight phase profile should be in effect.
+
+
+static void ApplyModemProfile( void );
+    // Switches to the pending flight phase profile, if any. Must only
+    // be called at a safe point of the state machine.
+
+
+static BOOL HashReportFile( const char* szPathFilename, REPORT_FINGERPRINT* pFingerprint, WORD* pwRptType );
+static BOOL SameReport( const REPORT_FINGERPRINT* pFirst, const REPORT_FINGERPRINT* pSecond );
+    // Content hash of an SBD sized report file.
+
+
+static BOOL RetireDuplicateReport( void );
+    // Retires the file about to be sent if it was delivered already.
+
+
+static void RememberDeliveredReport( void );
+    // Adds the hash of the file just delivered to the recent table.
+
+
+static BOOL DeferForCoverage( const char* szPathFilename );
+    // Holds back a non-urgent file while in a historically poor cell.
+
+
+static BOOL ReleaseCoverageFiles( void );
+    // Puts the held back files back in the outbox once the deferral is over.
+
+
+static BOOL SaveCoverageFiles( void );
+    // Writes the list of held back files to the card.
+
+
+static void RestoreCoverageFiles( void );
+    // Requeues the files still held back when the system was reset.
+
+
 //------------------------------------------------------------------------------
 //  PUBLIC FUNCTIONS
 //------------------------------------------------------------------------------
@@ -274,13 +652,28 @@ void InitModemAPI( void )
 
     // Initialize middle layer
     InitModem();
+    InitModemData();
+    InitModemBridge();
+    InitReportHdrCodec();
+    InitLinkMap();
+#ifdef MODEM_GROUND_LOOPBACK
+    InitModemGround();
+#endif
 
-    thCheckCSQ         = RegisterTimer();
     thCheckRetryDelay  = RegisterTimer();
     thWaitForCalls     = RegisterTimer();
-    thCheckGateway     = RegisterTimer();
-    thCheckCallStatus  = RegisterTimer();
+    thPollClock        = RegisterTimer();
     thTimeout          = RegisterTimer();
+    thSleepPoll        = RegisterTimer();
+    thOutboxCheck      = RegisterTimer();
+    thWakeSettle       = RegisterTimer();
+    thWakeHold         = RegisterTimer();
+    thEnergySample     = RegisterTimer();
+    thTransparentQuiet = RegisterTimer();
+    thTransparentCmd   = RegisterTimer();
+    thTransparentPause = RegisterTimer();
+    thTransparentGap   = RegisterTimer();
+    thCoverageDefer    = RegisterTimer();
 
     // Variables that cannot be reset once set:
     modemConfigurables.dwWaitForCalls          = DEFAULT_WAIT_FOR_CALLS;
@@ -296,6 +689,48 @@ void InitModemAPI( void )
     MemSet( modemConfigurables.szKeepFileList, DELETE_ALL_FILES, MAX_PRIORITY_FLAGS );
     MemSet( &modemFlags, 0, sizeof( MODEM_FLAGS ) );
 
+    modemConfigurables.bSleepEnabled           = FALSE;
+    modemConfigurables.dwSleepPollRate         = DEFAULT_SLEEP_POLL_RATE;
+
+    modemConfigurables.wCurrentDraw[MODEM_PWR_OFF]         = DEFAULT_PWR_OFF_MA;
+    modemConfigurables.wCurrentDraw[MODEM_PWR_SLEEP]       = DEFAULT_PWR_SLEEP_MA;
+    modemConfigurables.wCurrentDraw[MODEM_PWR_IDLE]        = DEFAULT_PWR_IDLE_MA;
+    modemConfigurables.wCurrentDraw[MODEM_PWR_LOCAL_CMD]   = DEFAULT_PWR_LOCAL_CMD_MA;
+    modemConfigurables.wCurrentDraw[MODEM_PWR_SBD_SESSION] = DEFAULT_PWR_SBD_SESSION_MA;
+    modemConfigurables.wCurrentDraw[MODEM_PWR_VOICE_CALL]  = DEFAULT_PWR_VOICE_CALL_MA;
+
+    MemSet( &modemEnergy, 0, sizeof( MODEM_ENERGY_STATS ) );
+
+    modemConfigurables.bTransparentSlicing     = FALSE;
+    modemConfigurables.dwMaxTransparentPause   = DEFAULT_MAX_TRANSPARENT_PAUSE;
+
+    MemSet( &transparentSlice, 0, sizeof( TRANSPARENT_SLICE ) );
+
+    modemConfigurables.bAdaptivePolling        = TRUE;
+
+    MemSet( &pollSched, 0, sizeof( POLL_SCHEDULER ) );
+    pollSched.dwInterval[POLL_CSQ]         = DEFAULT_SIGSTRENGTH_POLL_RATE;
+    pollSched.dwInterval[POLL_GATEWAY]     = DEFAULT_SBD_STATUS_DELAY;
+    pollSched.dwInterval[POLL_CALL_STATUS] = DEFAULT_SBD_STATUS_DELAY;
+    pollSched.iLastSignal                  = -1;
+    pollSched.lastCallStatus               = AT_RSP_IDLE_CALL_STATUS;
+    StartTimer( thPollClock, POLL_CLOCK_RES );
+
+    MemSet( &modemProfiles, 0, sizeof( MODEM_PROFILES ) );
+    MemCpy( modemProfiles.profile, (void*)DEFAULT_MODEM_PROFILES, sizeof( DEFAULT_MODEM_PROFILES ) );
+    modemProfiles.externalPhase = MODEM_PHASE_AUTO;
+    modemProfiles.activePhase   = MODEM_PHASE_AUTO;
+    modemProfiles.pendingPhase  = MODEM_PHASE_GROUND;
+
+    MemSet( &reportDedup, 0, sizeof( reportDedup ) );
+    reportDedup.dwMaxAge = DEDUP_DEFAULT_MAX_AGE;
+
+    modemConfigurables.bCoverageScheduling     = FALSE;
+    modemConfigurables.dwMaxCoverageDeferral   = DEFAULT_MAX_COVERAGE_DEFERRAL;
+    MemSet( modemConfigurables.szUrgentFileList, NULL, MAX_PRIORITY_FLAGS );
+    coverageHeld.byNbrFiles = 0;
+    coverageHeld.bRestored  = FALSE;
+
 //already initialized    InitQueue( &QueuedCISCmd, modemQBuff, MDM_Q_LEN );
 
     modemOptions.bSendingEnabled         = FALSE; // this is necessary to avoid accessing the PCMCIA from the timer ISR.
@@ -306,6 +741,15 @@ void InitModemAPI( void )
     modemOptions.bPrevHookState          = FALSE;
     modemOptions.bPrevRIState            = FALSE;
 
+    // The modem is always awake after a power up.
+    modemOptions.bModemAsleep            = FALSE;
+    modemOptions.bWakeRequested          = FALSE;
+    modemOptions.bWakeSettling           = FALSE;
+    SetModemPortDTRHigh();
+
+    modemOptions.bInBulkTransfer         = FALSE;
+    modemOptions.bCoverageDeferring      = FALSE;
+
     // Tracking variables:
     modemOptions.ModemCmd                = NO_CMD;
     
@@ -315,6 +759,7 @@ void InitModemAPI( void )
 
     // detect timeouts from init as well
     StartTimer( thTimeout, modemConfigurables.dwTimeoutDelay );                    
+    StartTimer( thEnergySample, DEFAULT_ENERGY_SAMPLE_RATE );
 
     // Ensure the modem has powered up correctly
     if( GetModemAtState() == AT_CMD_POWERED_DOWN )
@@ -435,6 +880,14 @@ BOOL SendTextMsgToModem( const char* szDataBuf, WORD wMsgLen )
         return FALSE;
     }
 
+    // The modem has to be woken up and settled first - caller will retry.
+    if( modemOptions.bModemAsleep || modemOptions.bWakeSettling )
+    {
+        modemOptions.bWakeRequested = TRUE;
+        StartTimer( thWakeHold, DEFAULT_WAKE_HOLD_TIME );
+        return FALSE;
+    }
+
     // Cannot send anything if there is an incoming or outgoing call
     if( InVoiceCall() )
     {
@@ -448,6 +901,7 @@ BOOL SendTextMsgToModem( const char* szDataBuf, WORD wMsgLen )
             return FALSE;
         }
 
+        modemOptions.bWakeRequested = FALSE;
         SetModemStateBusy( MAILBOX_CHECK );
         return TRUE;
     }
@@ -468,6 +922,7 @@ BOOL SendTextMsgToModem( const char* szDataBuf, WORD wMsgLen )
     }
 
     // Modem is idle - go ahead and send the message.
+    modemOptions.bWakeRequested = FALSE;
     SetModemStateBusy( TXING_TEXT );
 
     return TRUE;
@@ -526,6 +981,14 @@ BOOL SendBinMsgToModem( const BYTE* byDataBuf, WORD wMsgLen )
         return FALSE;
     }
 
+    // The modem has to be woken up and settled first - caller will retry.
+    if( modemOptions.bModemAsleep || modemOptions.bWakeSettling )
+    {
+        modemOptions.bWakeRequested = TRUE;
+        StartTimer( thWakeHold, DEFAULT_WAKE_HOLD_TIME );
+        return FALSE;
+    }
+
     // Cannot send anything
     if( InVoiceCall() )
     {
@@ -539,6 +1002,7 @@ BOOL SendBinMsgToModem( const BYTE* byDataBuf, WORD wMsgLen )
             return FALSE;
         }
 
+        modemOptions.bWakeRequested = FALSE;
         SetModemStateBusy( MAILBOX_CHECK );
         return TRUE;
     }
@@ -557,6 +1021,7 @@ BOOL SendBinMsgToModem( const BYTE* byDataBuf, WORD wMsgLen )
     }
 
     // Modem is idle - go ahead and send the message.
+    modemOptions.bWakeRequested = FALSE;
     SetModemStateBusy( TXING_BUFFER );
 
     return TRUE;
@@ -623,9 +1088,14 @@ MODEM_STATES GetCurrentModemState( void )
 //******************************************************************************
 void SetSignalStrengthPollRate( const DWORD dwPollRateInSeconds )
 {
-    if( dwPollRateInSeconds )
+    if( dwPollRateInSeconds && modemProfiles.bEnabled )
+    {
+        modemProfiles.rulesProfile.dwCheckSigStrengthRate = dwPollRateInSeconds * 1000;
+    }
+    else if( dwPollRateInSeconds )
     {
         modemConfigurables.dwCheckSigStrengthRate = dwPollRateInSeconds * 1000;
+        pollSched.dwInterval[POLL_CSQ]            = modemConfigurables.dwCheckSigStrengthRate;
     }
 }
 
@@ -641,10 +1111,17 @@ void SetSignalStrengthPollRate( const DWORD dwPollRateInSeconds )
 //
 //  Description: Allows embedded rules to get the polling rate (in secs)
 //               to check the modem signal strength.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetSignalStrengthPollRate( void )
 {
+    if( modemProfiles.bEnabled )
+    {
+        return modemProfiles.rulesProfile.dwCheckSigStrengthRate / 1000;
+    }
+
     return modemConfigurables.dwCheckSigStrengthRate / 1000;
 }
 
@@ -757,7 +1234,11 @@ DWORD GetCSQRetryDelay( void )
 //******************************************************************************
 void SetMsgRetryCount( const BYTE byRetryCount )
 {
-    if( byRetryCount )
+    if( byRetryCount && modemProfiles.bEnabled )
+    {
+        modemProfiles.rulesProfile.byMaxRetries = byRetryCount;
+    }
+    else if( byRetryCount )
     {
         modemConfigurables.byMaxRetries = byRetryCount;
     }
@@ -775,10 +1256,17 @@ void SetMsgRetryCount( const BYTE byRetryCount )
 //
 //  Description: Allows embedded rules to get the Max retry count when a
 //               file fails to be sent by the modem.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 BYTE GetMsgRetryCount( void )
 {
+    if( modemProfiles.bEnabled )
+    {
+        return modemProfiles.rulesProfile.byMaxRetries;
+    }
+
     return modemConfigurables.byMaxRetries;
 }
 
@@ -801,7 +1289,14 @@ BYTE GetMsgRetryCount( void )
 //******************************************************************************
 void SetMsgRetryDelay( const DWORD dwRetryDelay )
 {
-    modemConfigurables.dwRetryDelay = dwRetryDelay * 1000;
+    if( modemProfiles.bEnabled )
+    {
+        modemProfiles.rulesProfile.dwRetryDelay = dwRetryDelay * 1000;
+    }
+    else
+    {
+        modemConfigurables.dwRetryDelay = dwRetryDelay * 1000;
+    }
 }
 
 
@@ -816,10 +1311,17 @@ void SetMsgRetryDelay( const DWORD dwRetryDelay )
 //
 //  Description: Allows embedded rules to get the delay (in secs)
 //               for messages resent.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetMsgRetryDelay( void )
 {
+    if( modemProfiles.bEnabled )
+    {
+        return modemProfiles.rulesProfile.dwRetryDelay / 1000;
+    }
+
     return modemConfigurables.dwRetryDelay / 1000;
 }
 
@@ -843,7 +1345,14 @@ DWORD GetMsgRetryDelay( void )
 //******************************************************************************
 void SetModemIncomingCallDelay( const DWORD dwCallDelayInSeconds )
 {
-    modemConfigurables.dwWaitForCalls = dwCallDelayInSeconds * 1000;
+    if( modemProfiles.bEnabled )
+    {
+        modemProfiles.rulesProfile.dwWaitForCalls = dwCallDelayInSeconds * 1000;
+    }
+    else
+    {
+        modemConfigurables.dwWaitForCalls = dwCallDelayInSeconds * 1000;
+    }
 }
 
 
@@ -859,10 +1368,17 @@ void SetModemIncomingCallDelay( const DWORD dwCallDelayInSeconds )
 //  Description: Allows embedded rules to get the delay (in secs)
 //               to allow incoming calls. Use to check value previously
 //               set by rules or to check the default value.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetModemIncomingCallDelay( void )
 {
+    if( modemProfiles.bEnabled )
+    {
+        return modemProfiles.rulesProfile.dwWaitForCalls / 1000;
+    }
+
     return modemConfigurables.dwWaitForCalls / 1000;
 }
 
@@ -934,7 +1450,14 @@ DWORD GetModemDialingDelay( void )
 //******************************************************************************
 void SetModemTimeoutWait( const DWORD dwTimeoutDelayInSeconds )
 {
-    modemConfigurables.dwTimeoutDelay = dwTimeoutDelayInSeconds * 1000;
+    if( modemProfiles.bEnabled )
+    {
+        modemProfiles.rulesProfile.dwTimeoutDelay = dwTimeoutDelayInSeconds * 1000;
+    }
+    else
+    {
+        modemConfigurables.dwTimeoutDelay = dwTimeoutDelayInSeconds * 1000;
+    }
 }
 
 
@@ -950,10 +1473,17 @@ void SetModemTimeoutWait( const DWORD dwTimeoutDelayInSeconds )
 //  Description: Allows embedded rules to set the the amount
 //               of time (in seconds) to wait before resetting the CIS/modem 
 //               after discovering the modem communications is down or corrupt. 
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetModemTimeoutWait( void )
 {
+    if( modemProfiles.bEnabled )
+    {
+        return modemProfiles.rulesProfile.dwTimeoutDelay / 1000;
+    }
+
     return modemConfigurables.dwTimeoutDelay / 1000;
 }
 
@@ -1005,6 +1535,7 @@ void KeepSentFiles( char* pcPriorityList )
 //               call the using control signal line (DSR).
 //               DOES NOT DETECT INCOMING CALLS - after detecting errors with 
 //               Iridium and CIS, RI check was removed.
+//               Always FALSE on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL InVoiceCall( void )
@@ -1017,10 +1548,12 @@ BOOL InVoiceCall( void )
     // Negatives:
     // - possible race condition with incoming call and sending data at the same time.
     // The chances of that happening seem lower - integrity of the modem is paramount.
+#if MODEM_HAS_VOICE
     if( ReadModemPortDSRLine() ) // true (high) if phone is off hook
     {
         return TRUE;
     }
+#endif
 
     return FALSE;
 }
@@ -1499,15 +2032,55 @@ BOOL HangupCall( void )
 //  Returns: void.
 //
 //  Description: Notifies the middle driver not to empty the FIFO 
-//               as transparent mode is doing this!
+//               as transparent mode is doing this! With transparent
+//               slicing enabled, the driver may still pause the bridge
+//               between the technician's commands to run urgent SBD work.
 //
 //******************************************************************************
 void EnteredTransparentModemMode( BOOL bMode )
 {
+    // The technician needs a modem that is awake.
+    if( bMode && modemOptions.bModemAsleep )
+    {
+        WakeModem();
+    }
+
+    if( bMode != modemOptions.bInTransparentMode )
+    {
+        transparentSlice.bPaused          = FALSE;
+        transparentSlice.bTechCmdOpen     = FALSE;
+        transparentSlice.bTechAwaitingRsp = FALSE;
+        transparentSlice.bTechTraffic     = FALSE;
+        transparentSlice.wRspIndex        = 0;
+
+        StopTimer( thTransparentPause );
+        StopTimer( thTransparentCmd );
+        StartTimer( thTransparentQuiet, TRANSPARENT_QUIET_TIME );
+        StartTimer( thTransparentGap, TRANSPARENT_SLICE_GAP );
+    }
+
     modemOptions.bInTransparentMode = bMode;
 }
 
 
+//******************************************************************************
+//
+//  Function: InTransparentModemMode
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the driver is in transparent mode.
+//           FALSE otherwise.
+//
+//  Description: Lets the transparent bridge know it owns the modem port.
+//
+//******************************************************************************
+BOOL InTransparentModemMode( void )
+{
+    return modemOptions.bInTransparentMode;
+}
+
+
 //******************************************************************************
 //
 //  Function: ProcessModemStateMachine
@@ -1528,12 +2101,31 @@ void ProcessModemStateMachine( void )
     //static MODEM_STATES prevMdmState = MODEM_POWERED_DOWN;
     //static AT_CMD_STATES prevAtCmdState = AT_CMD_POWERED_DOWN;
 
-    if( modemOptions.bInTransparentMode )
+    // Energy is accounted for regardless of what the driver is doing.
+    UpdateEnergyModel();
+
+    ServicePollScheduler();
+
+    ServiceModemBridge();
+
+#ifdef MODEM_GROUND_LOOPBACK
+    // Sessions and commands are simulated even in transparent mode.
+    UpdateModemGround();
+#endif
+
+    if( modemOptions.bInTransparentMode && !TransparentSliceActive() )
     {
         // Do not process anything as we are in transparent mode!!
         return;
     }
 
+    if( modemOptions.bInBulkTransfer )
+    {
+        // The data call owns the modem port until it is hung up.
+        HandleBulkTransfer();
+        return;
+    }
+
     UpdateModemState();
 
     atCmdState = GetModemAtState();
@@ -1569,6 +2161,12 @@ void ProcessModemStateMachine( void )
         modemOptions.modemState = MODEM_POWERED_DOWN;
         RecordModemLogError( MODEMLOG_MODEM_POWERED_DOWN );
         MemSet( modemOptions.ModemRsp, (BYTE)MR_NO_RESP, NBR_MODEM_COMMANDS * sizeof( MODEM_RESPONSES ) );
+
+        // DTR must be up when the modem comes back.
+        if( modemOptions.bModemAsleep )
+        {
+            WakeModem();
+        }
     }
 
     // Now update the state machine.
@@ -1600,9 +2198,9 @@ void ProcessModemStateMachine( void )
                     // Ensure a signal strength is done on start-up
                     // and that we synchronize status with the CIS board.
                     StopTimer( thCheckRetryDelay );
-                    StartTimer( thCheckCSQ, 0 );
-                    StartTimer( thCheckGateway, DEFAULT_SBD_STATUS_DELAY );
-                    StartTimer( thCheckCallStatus, DEFAULT_SBD_STATUS_DELAY );
+                    SchedulePoll( POLL_CSQ, 0 );
+                    SchedulePoll( POLL_GATEWAY, DEFAULT_SBD_STATUS_DELAY );
+                    SchedulePoll( POLL_CALL_STATUS, DEFAULT_SBD_STATUS_DELAY );
                     ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );                    
 
                     AddNewDataToQueue( RINGER_STATUS );
@@ -1673,6 +2271,32 @@ void ProcessModemStateMachine( void )
                 break;
             }
 
+            // Nothing is in flight - a new profile can take effect.
+            ApplyModemProfile();
+
+            // Nothing can be sent to the modem while it is asleep.
+            if( modemOptions.bModemAsleep )
+            {
+                if( !ModemWakeRequired() )
+                {
+                    break;
+                }
+
+                WakeModem();
+            }
+
+            // Give the modem time to come out of sleep.
+            if( modemOptions.bWakeSettling )
+            {
+                if( !TimerExpired( thWakeSettle ) )
+                {
+                    break;
+                }
+
+                StopTimer( thWakeSettle );
+                modemOptions.bWakeSettling = FALSE;
+            }
+
             // This command is local and can be performed any time
             // (even in the absence of a satellite connection)
             if( GetMailboxStatus() )
@@ -1704,6 +2328,10 @@ void ProcessModemStateMachine( void )
                 // If we were previously off hook - report we're back to normal now.
                 RecordModemLogError( MODEMLOG_PHONE_BACK_ON_HOOK );
                 modemOptions.bPrevHookState = FALSE;
+
+                // The next call starts polling at the base rate.
+                pollSched.dwInterval[POLL_CALL_STATUS] = DEFAULT_SBD_STATUS_DELAY;
+                pollSched.lastCallStatus               = AT_RSP_IDLE_CALL_STATUS;
             }
 
             if( ReadModemPortRILine() )  // true (high) if Ring indicator is on
@@ -1724,15 +2352,15 @@ void ProcessModemStateMachine( void )
                 modemOptions.bPrevRIState = FALSE;
             }
 
-            if( TimerExpired( thCheckCSQ ) )
+            if( PollDue( POLL_CSQ ) )
             {
-                // Check signal quality and reset the timer.
+                // Check signal quality and reschedule the poll.
                 // Technically, this command doesn't need satellite - the value
                 // polled is stored locally on the modem (like the MT buffer).
                 if( SendCSQCmd() )
                 {
                     SetModemStateBusy( GETTING_CSQ );
-                    ResetTimer( thCheckCSQ, modemConfigurables.dwCheckSigStrengthRate );
+                    PollSent( POLL_CSQ );
                     break;
                 }
             }
@@ -1747,18 +2375,21 @@ void ProcessModemStateMachine( void )
                     break;
                 }
 
-                else if( TimerExpired( thCheckGateway ) )
+                else if( PollDue( POLL_GATEWAY ) )
                 {
                     // Do a gateway check (for free!)
                     if( CheckGateway() )
                     {
                         SetModemStateBusy( GATEWAY_CHECK );
-                        ResetTimer( thCheckGateway, DEFAULT_SBD_STATUS_DELAY );
+                        PollSent( POLL_GATEWAY );
                         break;
                     }
                 }
             }
 
+            // Fall through means there is nothing left to do - sleep if allowed.
+            EnterModemSleep();
+
             break;
 
         case MODEM_BUSY:
@@ -1821,10 +2452,10 @@ void ProcessModemStateMachine( void )
 
                     // Still powered down, wait here until we're back up.
                     HandleQueuedCommands();
-                    StopTimer( thCheckCSQ );
+                    StopPoll( POLL_CSQ );
                     StopTimer( thCheckRetryDelay );
-                    StopTimer( thCheckGateway );
-                    StopTimer( thCheckCallStatus );
+                    StopPoll( POLL_GATEWAY );
+                    StopPoll( POLL_CALL_STATUS );
                     ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );                    
 
                     break;
@@ -1858,854 +2489,3591 @@ void ProcessModemStateMachine( void )
 }
 
 
-//------------------------------------------------------------------------------
-//  PRIVATE FUNCTIONS
-//------------------------------------------------------------------------------
+//******************************************************************************
+//
+//  Function: SetModemSleepMode
+//
+//  Arguments:
+//    IN  bEnable - TRUE to let the driver sleep the modem (DTR low) when idle.
+//                  FALSE to keep the modem awake at all times.
+//                  DEFAULT: FALSE
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn the idle power mode on or off.
+//               While asleep, the modem is woken by a queued message, a ring
+//               alert or the sleep poll deadline. Turning sleep mode off
+//               wakes the modem immediately.
+//
+//******************************************************************************
+void SetModemSleepMode( const BOOL bEnable )
+{
+    modemConfigurables.bSleepEnabled = bEnable;
+
+    if( !bEnable && modemOptions.bModemAsleep )
+    {
+        WakeModem();
+    }
+}
 
 
 //******************************************************************************
 //
-//  Function: HandleQueuedCommands
+//  Function: GetModemSleepMode
 //
 //  Arguments: void.
 //
-//  Returns: TRUE if there is a queued command waiting.
+//  Returns: TRUE if the idle power mode is enabled.
 //           FALSE otherwise.
 //
-//  Description: This function initiates the CIS programming port commands
-//               sent by anywhere in the system or ELA.
+//  Description: Allows embedded rules to get the idle power mode setting.
 //
 //******************************************************************************
-BOOL HandleQueuedCommands( void )
+BOOL GetModemSleepMode( void )
 {
-    MODEM_COMMANDS mdmCmds = NO_CMD;
-    WORD wBackupReadIndex;
+    return modemConfigurables.bSleepEnabled;
+}
 
-    // First check if we have something q'd up
-    if( QueuedCISCmd.wWriteIndex == QueuedCISCmd.wReadIndex )
-    {
-        return FALSE;
-    }
 
-    // Since we verify the queue for duplicate commands,
-    // be sure to clear the command just read, to allow for 
-    // the command to be posted in the future.
-    wBackupReadIndex = QueuedCISCmd.wReadIndex;
-    mdmCmds = (MODEM_COMMANDS)GetDataFromQueue( &QueuedCISCmd );
-    modemQBuff[wBackupReadIndex] = NO_CMD;
-
-//    print( " q'd cmd: " );
-//    output_int( mdmCmds );
-
-    switch( mdmCmds )
+//******************************************************************************
+//
+//  Function: SetModemSleepPollRate
+//
+//  Arguments:
+//    IN  dwPollRateInSeconds - DWORD value indicating the maximum time the
+//                              modem is left asleep before the signal strength
+//                              and gateway polls are run (batched together).
+//                              Must be a value greater than zero! Previous value
+//                              maintained on a zero value.
+//                              DEFAULT: 150 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the sleep poll deadline (in secs).
+//
+//******************************************************************************
+void SetModemSleepPollRate( const DWORD dwPollRateInSeconds )
+{
+    if( dwPollRateInSeconds )
     {
-        case RINGER_ON:
-            TogglePhoneRinger( TRUE );
-            break;
-
-        case RINGER_OFF:
-            TogglePhoneRinger( FALSE );
-            break;
-
-        case RELAY1_ON:
-            ToggleRelayState( RELAY_1, TRUE );
-            break;
-
-        case RELAY1_OFF:
-            ToggleRelayState( RELAY_1, FALSE );
-            break;
-
-        case RELAY2_ON:
-            ToggleRelayState( RELAY_2, TRUE );
-            break;
-
-        case RELAY2_OFF:
-            ToggleRelayState( RELAY_2, FALSE );
-            break;
-
-        case RINGER_STATUS:
-            SendPhoneRingerStatusCmd();
-            break;
+        modemConfigurables.dwSleepPollRate = dwPollRateInSeconds * 1000;
+    }
+}
 
-        case RELAY1_STATUS:
-            SendOutputRelayStatusCmd( RELAY_1 );
-            break;
 
-        case RELAY2_STATUS:
-            SendOutputRelayStatusCmd( RELAY_2 );
-            break;
+//******************************************************************************
+//
+//  Function: GetModemSleepPollRate
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value indicating the sleep poll deadline in seconds.
+//
+//  Description: Allows embedded rules to get the sleep poll deadline (in secs).
+//
+//******************************************************************************
+DWORD GetModemSleepPollRate( void )
+{
+    return modemConfigurables.dwSleepPollRate / 1000;
+}
 
-        case RESET_CIS:
-            ResetCIS();
-            break;
 
-        case CONFIGURE_CIS:
-            ProgramCIS();
-            break;
+//******************************************************************************
+//
+//  Function: SetModemCurrentDraw
+//
+//  Arguments:
+//    IN  pwrState   - MODEM_POWER_STATES enum to set the current draw for.
+//    IN  wMilliAmps - Estimated average current drawn in that state (in mA).
+//
+//  Returns: void.
+//
+//  Description: Allows the energy model to be tuned to the fitted transceiver.
+//
+//******************************************************************************
+void SetModemCurrentDraw( const MODEM_POWER_STATES pwrState, const WORD wMilliAmps )
+{
+    if( pwrState < NBR_MODEM_PWR_STATES )
+    {
+        modemConfigurables.wCurrentDraw[pwrState] = wMilliAmps;
+    }
+}
 
-        case UPLOAD_CIS_CONFIG:
-            UploadCISConfig();
-            break;
 
-        case CALL_HANGUP:
-            // This command can only be sent if we're powered up.
-            if( modemOptions.modemState != MODEM_POWERED_DOWN )
-            {
-                HangupCall();
-                break;
-            }
+//******************************************************************************
+//
+//  Function: GetModemCurrentDraw
+//
+//  Arguments:
+//    IN  pwrState - MODEM_POWER_STATES enum to get the current draw for.
+//
+//  Returns: WORD value of the estimated current draw (in mA) for that state.
+//
+//  Description: Gets the energy model current draw for a power state.
+//
+//******************************************************************************
+WORD GetModemCurrentDraw( const MODEM_POWER_STATES pwrState )
+{
+    if( pwrState >= NBR_MODEM_PWR_STATES )
+    {
+        return 0;
+    }
 
-            // else fall through.
+    return modemConfigurables.wCurrentDraw[pwrState];
+}
 
-        case NO_CMD:
-        default:
-            return FALSE;
 
+//******************************************************************************
+//
+//  Function: GetModemTimeInPowerState
+//
+//  Arguments:
+//    IN  pwrState - MODEM_POWER_STATES enum to get the accumulated time for.
+//
+//  Returns: DWORD value of the seconds spent in that state since power up
+//           (or since the last ClearModemEnergyStats()).
+//
+//  Description: Gets the time the modem spent in a given power state.
+//
+//******************************************************************************
+DWORD GetModemTimeInPowerState( const MODEM_POWER_STATES pwrState )
+{
+    if( pwrState >= NBR_MODEM_PWR_STATES )
+    {
+        return 0;
     }
 
-    return TRUE;
+    return modemEnergy.dwSecsInState[pwrState];
 }
 
 
 //******************************************************************************
 //
-//  Function: GetMailboxStatus
+//  Function: GetModemEnergyPerMsg
 //
 //  Arguments: void.
 //
-//  Returns: TRUE if there is a message ready to receive from the modem.
-//           FALSE otherwise.
+//  Returns: DWORD value of the estimated energy (in millijoules) spent per
+//           delivered message. 0 if no message has been delivered yet.
 //
-//  Description: This function initiates the SendReadBinaryFileCmd() command,
-//               if there is a message to be received.
+//  Description: Reports the total modem energy divided by the number of
+//               messages successfully delivered.
 //
 //******************************************************************************
-BOOL GetMailboxStatus( void )
+DWORD GetModemEnergyPerMsg( void )
 {
-    if( GetSBDStatus() == SUCCESSFUL_MSG )
+    DWORD dwCharge = 0;
+    BYTE  byState;
+
+    if( modemEnergy.dwMsgsDelivered == 0 )
     {
-        // We have a message pending; 
-        // download it from the modem buffer,
-        if( SendReadBinaryFileCmd() )
-        {
-            // it's possible for this function to be called from an interrupt,
-            // however, a download must be performed before this function,
-            // and sending is only enabled after we're out of interrupt.
-            // Besides, this function writes the MT msg to a file, so,
-            // we'll be writing to a file regardless.
-            ModemLog( NO_RPT, MODEMLOG_RECEIVE );
-            SetModemStateBusy( RXING_FILE );
-            return TRUE;
-        }
+        return 0;
     }
 
-    // Fall through here means there are no pending messages to receive.
-    return FALSE;
+    for( byState = 0; byState < NBR_MODEM_PWR_STATES; byState++ )
+    {
+        dwCharge += modemEnergy.dwChargeInState[byState];
+    }
+
+    // mA-s * mV / 1000 = mJ. Divide first to avoid overflowing the DWORD.
+    return ( ( dwCharge / modemEnergy.dwMsgsDelivered ) * MODEM_SUPPLY_MILLIVOLTS ) / 1000;
 }
 
 
 //******************************************************************************
 //
-//  Function: SendFileToModem
+//  Function: GetModemEnergyPerHour
 //
 //  Arguments: void.
 //
-//  Returns: NOT_SENDING if there are no files to send 
-//           WAITING_TO_SEND if retry delay timer has yet to expire
-//           SENDING_FILE if the file was sent
+//  Returns: DWORD value of the estimated energy (in millijoules) spent per hour.
+//           0 if no time has been accounted yet.
 //
-//  Description: This function copies each byte of a specified summary report 
-//               into a buffer and sends that buffer to the satellite 
-//               modem port. 
+//  Description: Reports the average modem energy consumption per hour.
 //
 //******************************************************************************
-FILE_SEND_OPTIONS SendFileToModem( void )
+DWORD GetModemEnergyPerHour( void )
 {
-    // Nothing to send or there is no card...let's double check
-    if( modemOptions.bPCMCIAError )
+    DWORD dwCharge = 0;
+    DWORD dwSecs   = 0;
+    DWORD dwScale  = 36L * MODEM_SUPPLY_MILLIVOLTS;
+    DWORD dwAvg;
+    DWORD dwRem;
+    BYTE  byState;
+
+    for( byState = 0; byState < NBR_MODEM_PWR_STATES; byState++ )
     {
-        // Notify lower level that a buffer needs to be sent,
-        // instead of a file
-        if( SendBinaryBuffer( (BYTE*)CreateSystemLogBuffer( 0 ),
-                              SYSLOG_MSG_SIZE ) )
-        {
-            SetModemStateBusy( TXING_BUFFER );
-            modemOptions.bPCMCIAError = FALSE;
-            return SENDING_FILE;
-        }
+        dwCharge += modemEnergy.dwChargeInState[byState];
+        dwSecs   += modemEnergy.dwSecsInState[byState];
     }
 
-    // Is this a retry or not? Retry count is bumped up on a failure to transmit.
-    if( modemFlags.byFileSendRetryCount == 0 )
+    if( dwSecs == 0 )
     {
-        // Get the next file in the queue (have the all-filter
-        // turned on automatically)
-        modemOptions.szPathFileBeingSent[0] = NULL;
-
-        if( SortAscending( modemOptions.szPathFileBeingSent, GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ) ) == NULL )
-        {
-            return NOT_SENDING;
-        }
-
-        // If the file was successfully sent, log it and change states.
-        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND );
+        return 0;
     }
-    else
-    {
-        if( !TimerExpired( thCheckRetryDelay ) )
-        {
-            // Cannot resend yet.
-            return WAITING_TO_SEND;
-        }
 
-        StopTimer( thCheckRetryDelay );
-        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_RETRY_SEND );
-    }
+    // Average current (mA) * 3600 s * mV / 1000 = mJ per hour. The part of
+    // the average under 1 mA is scaled before it is divided, halving it and
+    // the time while the product would overflow.
+    dwAvg = dwCharge / dwSecs;
+    dwRem = dwCharge % dwSecs;
 
-    if( SendBinaryFile( modemOptions.szPathFileBeingSent ) )
+    if( dwAvg >= 0xFFFFFFFFL / dwScale )
     {
-        SetModemStateBusy( TXING_FILE );
-
-        return SENDING_FILE;
+        return 0xFFFFFFFFL / 10;
     }
-    else
+
+    while( dwRem > 0xFFFFFFFFL / dwScale )
     {
-        // Something is wrong with the file! Delete it to keep ELA from resending it over, and over and over....
-        if( deleteFile( modemOptions.szPathFileBeingSent ) )
-        {
-            // Ensure the file being deleted is logged
-            StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-            StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
-            SystemLog( szErrString );
-        }
-        else
-        {
-            // Report if file cannot be deleted.
-            StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-            StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
-            SystemLog( szErrString );
-            MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
-        }
+        dwRem  /= 2;
+        dwSecs /= 2;
     }
 
-    // Fall through means there were problems sending the file!
-    return NOT_SENDING;
+    return ( ( dwAvg * dwScale ) + ( ( dwRem * dwScale ) / dwSecs ) ) / 10;
 }
 
 
 //******************************************************************************
 //
-//  Function: SendCallStatusCmd
+//  Function: ClearModemEnergyStats
 //
 //  Arguments: void.
 //
-//  Returns: TRUE if the command was sent
-//           FALSE if the command was not sent 
-//                 if dialing timer has yet to expire
+//  Returns: void.
 //
-//  Description: This function checks on the modem status if we have detected
-//               an off-hook event or a "ring" (incoming call).
+//  Description: Clears the energy model accumulators and message count.
 //
 //******************************************************************************
-BOOL SendCallStatusCmd( void )
+void ClearModemEnergyStats( void )
 {
-    // Is this a retry or not? Retry count is bumped up on a failure,
-    // and set to 1 if the modem is busy dialing.
-    if( !TimerExpired( thCheckCallStatus ) )
-    {
-        return FALSE;
-    }
-
-    if( SendCLCCCmd() )
-    {
-        print( " sending CLCC cmd" );
-        SetModemStateBusy( CALL_STATUS );
-        ResetTimer( thCheckCallStatus, DEFAULT_SBD_STATUS_DELAY );
-        return TRUE;
-    }
-
-    // Fall through means there were problems sending the cmd!
-    return FALSE;
+    MemSet( &modemEnergy, 0, sizeof( MODEM_ENERGY_STATS ) );
 }
 
 
 //******************************************************************************
 //
-//  Function: CleanUpOnUnexpectedRsp
+//  Function: SetTransparentSlicing
 //
 //  Arguments:
-//    atCmdState - AT_CMD_STATES enum type to save to the modem log file.
+//    IN  bEnable - TRUE to let the driver pause the transparent bridge at
+//                  command boundaries to run urgent SBD work.
+//                  FALSE to leave the port to the technician (default).
 //
 //  Returns: void.
 //
-//  Description: Reports in the modem.log file that an unexpected result
-//               occured.
+//  Description: Allows embedded rules to enable time-sliced transparent mode.
 //
 //******************************************************************************
-void CleanUpOnUnexpectedRsp( AT_CMD_STATES atCmdState )
+void SetTransparentSlicing( const BOOL bEnable )
 {
-    RecordModemLogError( MODEMLOG_UNEXPECTED_RSP );
-
-    print( "\r\n" );
-    print( TEXT_MODEM_STATE[modemOptions.modemState] );
-    print( GetATCmdText( atCmdState ) );
-    print( " Unexpected response - going to init!" );
+    modemConfigurables.bTransparentSlicing = bEnable;
 }
 
 
 //******************************************************************************
 //
-//  Function: CleanUpOnIdle
+//  Function: GetTransparentSlicing
 //
-//  Arguments: void
+//  Arguments: void.
 //
-//  Returns: void.
+//  Returns: TRUE if time-sliced transparent mode is enabled.
+//           FALSE otherwise.
 //
-//  Description: Takes care of risidual tasks to be handled by upper layer
-//               (like notifying modem log, moving files to the correct
-//                directory, LEDs, setting/unsetting flags and handling
-//                retries).
+//  Description: Allows embedded rules to get the transparent slicing mode.
 //
 //******************************************************************************
-void CleanUpOnIdle( AT_CMD_STATES atCmdState )
+BOOL GetTransparentSlicing( void )
 {
-    static char szFileName[MAX_FILENAME_LEN];
-    BYTE byIndex;
-    char cPriorityFlag;
+    return modemConfigurables.bTransparentSlicing;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetMaxTransparentPause
+//
+//  Arguments:
+//    IN  dwPauseInSeconds - DWORD value indicating the longest the bridge is
+//                           paused for. No new SBD work is started once it
+//                           has elapsed; an SBD session or data call in
+//                           progress is completed, anything else is dropped.
+//                           Previous value maintained on a zero value.
+//                           DEFAULT: 30 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the maximum pause (in secs).
+//
+//******************************************************************************
+void SetMaxTransparentPause( const DWORD dwPauseInSeconds )
+{
+    if( dwPauseInSeconds != 0 )
+    {
+        modemConfigurables.dwMaxTransparentPause = dwPauseInSeconds * 1000;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetMaxTransparentPause
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value indicating the maximum pause in seconds.
+//
+//  Description: Allows embedded rules to get the maximum pause (in secs).
+//
+//******************************************************************************
+DWORD GetMaxTransparentPause( void )
+{
+    return modemConfigurables.dwMaxTransparentPause / 1000;
+}
+
+
+//******************************************************************************
+//
+//  Function: IsTransparentBridgePaused
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the driver owns the modem port for an SBD slice.
+//           FALSE otherwise.
+//
+//  Description: While TRUE, the transparent bridge must hold the technician's
+//               bytes and must not read from the modem port.
+//
+//******************************************************************************
+BOOL IsTransparentBridgePaused( void )
+{
+    return transparentSlice.bPaused;
+}
+
+
+//******************************************************************************
+//
+//  Function: NoteTransparentTraffic
+//
+//  Arguments:
+//    IN  pbyData  - Bytes that went across the transparent bridge.
+//    IN  wLength  - Number of bytes in pbyData.
+//    IN  bToModem - TRUE if the bytes went to the modem.
+//                   FALSE if they came from the modem.
+//
+//  Returns: void.
+//
+//  Description: The transparent bridge reports its traffic so the driver can
+//               tell when the technician is between commands: nothing half
+//               typed, the last command answered with a final result code
+//               and the line quiet.
+//
+//******************************************************************************
+void NoteTransparentTraffic( const BYTE* pbyData, const WORD wLength, const BOOL bToModem )
+{
+    WORD wIndex;
+
+    if( wLength == 0 )
+    {
+        return;
+    }
+
+    ResetTimer( thTransparentQuiet, TRANSPARENT_QUIET_TIME );
+
+    if( bToModem )
+    {
+        transparentSlice.bTechTraffic = TRUE;
+    }
+
+    for( wIndex = 0; wIndex < wLength; wIndex++ )
+    {
+        if( bToModem )
+        {
+            if( pbyData[wIndex] == '\r' )
+            {
+                transparentSlice.bTechCmdOpen     = FALSE;
+                transparentSlice.bTechAwaitingRsp = TRUE;
+                transparentSlice.wRspIndex        = 0;
+            }
+            else if( pbyData[wIndex] != '\n' )
+            {
+                transparentSlice.bTechCmdOpen = TRUE;
+            }
+
+            ResetTimer( thTransparentCmd, TRANSPARENT_CMD_TIMEOUT );
+        }
+        else if( ( pbyData[wIndex] == '\r' ) || ( pbyData[wIndex] == '\n' ) )
+        {
+            if( transparentSlice.wRspIndex != 0 )
+            {
+                transparentSlice.szRspLine[transparentSlice.wRspIndex] = NULL;
+                transparentSlice.wRspIndex = 0;
+
+                // Verbose or numeric OK/ERROR ends the command.
+                if( ( StringCmp( transparentSlice.szRspLine, "OK" ) == 0 )
+                    ||
+                    ( StringCmp( transparentSlice.szRspLine, "ERROR" ) == 0 )
+                    ||
+                    ( StringCmp( transparentSlice.szRspLine, "0" ) == 0 )
+                    ||
+                    ( StringCmp( transparentSlice.szRspLine, "4" ) == 0 ) )
+                {
+                    transparentSlice.bTechAwaitingRsp = FALSE;
+                }
+            }
+        }
+        else if( transparentSlice.wRspIndex < TRANSPARENT_RSP_LEN - 1 )
+        {
+            transparentSlice.szRspLine[transparentSlice.wRspIndex++] = pbyData[wIndex];
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetTransparentPauseCount
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of times the bridge was paused.
+//
+//  Description: Time-sliced transparent mode statistics.
+//
+//******************************************************************************
+DWORD GetTransparentPauseCount( void )
+{
+    return transparentSlice.dwPauseCount;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetTransparentPauseOverruns
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of pauses that outlasted the maximum
+//           pause because an SBD session was still in progress.
+//
+//  Description: Time-sliced transparent mode statistics.
+//
+//******************************************************************************
+DWORD GetTransparentPauseOverruns( void )
+{
+    return transparentSlice.dwOverrunCount;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetAdaptivePolling
+//
+//  Arguments:
+//    IN  bEnable - TRUE to adapt the status poll intervals (default).
+//                  FALSE to poll at the fixed base rates.
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn off the adaptive poll
+//               intervals, poll coalescing and the use of SBD sessions
+//               as link samples.
+//
+//******************************************************************************
+void SetAdaptivePolling( const BOOL bEnable )
+{
+    modemConfigurables.bAdaptivePolling = bEnable;
+
+    if( !bEnable )
+    {
+        pollSched.dwInterval[POLL_CSQ]         = modemConfigurables.dwCheckSigStrengthRate;
+        pollSched.dwInterval[POLL_GATEWAY]     = DEFAULT_SBD_STATUS_DELAY;
+        pollSched.dwInterval[POLL_CALL_STATUS] = DEFAULT_SBD_STATUS_DELAY;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetAdaptivePolling
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the status poll intervals adapt.
+//           FALSE if they are fixed.
+//
+//  Description: Allows embedded rules to get the polling mode.
+//
+//******************************************************************************
+BOOL GetAdaptivePolling( void )
+{
+    return modemConfigurables.bAdaptivePolling;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPollsPerHour
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of +CSQF, +SBDSX and +CLCC polls sent
+//           in the last full hour (the polls so far during the first hour).
+//
+//  Description: Polling statistics.
+//
+//******************************************************************************
+DWORD GetModemPollsPerHour( void )
+{
+    if( pollSched.bFullPeriod )
+    {
+        return pollSched.dwPollsLastPeriod;
+    }
+
+    return pollSched.dwPollsThisPeriod;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPollsSkipped
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of polls deferred because an SBD
+//           session had just sampled the link.
+//
+//  Description: Polling statistics.
+//
+//******************************************************************************
+DWORD GetModemPollsSkipped( void )
+{
+    return pollSched.dwPollsSkipped;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetModemProfiles
+//
+//  Arguments:
+//    IN  bEnable - TRUE to switch the scheduling parameters with the
+//                  flight phase.
+//                  FALSE to keep the values set by rules (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on the flight phase profiles.
+//               While they are on, the retry count and delay, signal
+//               strength poll rate, incoming call delay and timeout wait
+//               come from the profile of the active phase. The individual
+//               setters then change the values that are restored when the
+//               profiles are turned off.
+//
+//******************************************************************************
+void SetModemProfiles( const BOOL bEnable )
+{
+    if( bEnable == modemProfiles.bEnabled )
+    {
+        return;
+    }
+
+    if( bEnable )
+    {
+        modemProfiles.rulesProfile.byMaxRetries           = modemConfigurables.byMaxRetries;
+        modemProfiles.rulesProfile.dwRetryDelay           = modemConfigurables.dwRetryDelay;
+        modemProfiles.rulesProfile.dwCheckSigStrengthRate = modemConfigurables.dwCheckSigStrengthRate;
+        modemProfiles.rulesProfile.dwWaitForCalls         = modemConfigurables.dwWaitForCalls;
+        modemProfiles.rulesProfile.dwTimeoutDelay         = modemConfigurables.dwTimeoutDelay;
+
+        // Force the first profile in at the next safe point.
+        modemProfiles.bEnabled    = TRUE;
+        modemProfiles.activePhase = MODEM_PHASE_AUTO;
+        EvaluateModemPhase();
+    }
+    else
+    {
+        modemProfiles.bEnabled = FALSE;
+
+        modemConfigurables.byMaxRetries           = modemProfiles.rulesProfile.byMaxRetries;
+        modemConfigurables.dwRetryDelay           = modemProfiles.rulesProfile.dwRetryDelay;
+        modemConfigurables.dwCheckSigStrengthRate = modemProfiles.rulesProfile.dwCheckSigStrengthRate;
+        modemConfigurables.dwWaitForCalls         = modemProfiles.rulesProfile.dwWaitForCalls;
+        modemConfigurables.dwTimeoutDelay         = modemProfiles.rulesProfile.dwTimeoutDelay;
+        pollSched.dwInterval[POLL_CSQ]            = modemConfigurables.dwCheckSigStrengthRate;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemProfiles
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the flight phase profiles are on.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the profile mode.
+//
+//******************************************************************************
+BOOL GetModemProfiles( void )
+{
+    return modemProfiles.bEnabled;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetModemProfile
+//
+//  Arguments:
+//    IN  phase                   - MODEM_PHASES profile to set.
+//    IN  byRetryCount            - See SetMsgRetryCount (0 keeps the previous value).
+//    IN  dwRetryDelay            - See SetMsgRetryDelay (in seconds).
+//    IN  dwPollRateInSeconds     - See SetSignalStrengthPollRate (0 keeps the previous value).
+//    IN  dwCallDelayInSeconds    - See SetModemIncomingCallDelay.
+//    IN  dwTimeoutDelayInSeconds - See SetModemTimeoutWait (0 keeps the previous value).
+//
+//  Returns: TRUE if the profile was set.
+//           FALSE if the phase is not valid.
+//
+//  Description: Allows embedded rules to tune a flight phase profile. A
+//               change to the active profile takes effect at the next safe
+//               point.
+//
+//******************************************************************************
+BOOL SetModemProfile( const MODEM_PHASES phase, const BYTE byRetryCount, const DWORD dwRetryDelay,
+                      const DWORD dwPollRateInSeconds, const DWORD dwCallDelayInSeconds,
+                      const DWORD dwTimeoutDelayInSeconds )
+{
+    MODEM_PROFILE* pProfile;
+
+    if( phase >= NBR_MODEM_PHASES )
+    {
+        return FALSE;
+    }
+
+    pProfile = &modemProfiles.profile[phase];
+
+    if( byRetryCount )
+    {
+        pProfile->byMaxRetries = byRetryCount;
+    }
+
+    if( dwPollRateInSeconds )
+    {
+        pProfile->dwCheckSigStrengthRate = dwPollRateInSeconds * 1000;
+    }
+
+    if( dwTimeoutDelayInSeconds )
+    {
+        pProfile->dwTimeoutDelay = dwTimeoutDelayInSeconds * 1000;
+    }
+
+    pProfile->dwRetryDelay   = dwRetryDelay * 1000;
+    pProfile->dwWaitForCalls = dwCallDelayInSeconds * 1000;
+
+    // Re-apply if it is the one in effect.
+    if( modemProfiles.activePhase == phase )
+    {
+        modemProfiles.activePhase = MODEM_PHASE_AUTO;
+        EvaluateModemPhase();
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetModemFlightPhase
+//
+//  Arguments:
+//    IN  phase - MODEM_PHASES flight phase given by the aircraft, or
+//                MODEM_PHASE_AUTO to infer it from the link (default).
+//
+//  Returns: void.
+//
+//  Description: External phase signal (e.g. from weight on wheels and
+//               altitude). A sustained loss of coverage still overrides the
+//               given phase with the no coverage profile. Without it, the
+//               phase is inferred from the link: climb needs a swinging
+//               CSQ, cruise follows climb, and ground comes back after 30
+//               minutes with nothing delivered.
+//
+//******************************************************************************
+void SetModemFlightPhase( const MODEM_PHASES phase )
+{
+    if( ( phase < NBR_MODEM_PHASES ) || ( phase == MODEM_PHASE_AUTO ) )
+    {
+        modemProfiles.externalPhase = phase;
+        EvaluateModemPhase();
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemFlightPhase
+//
+//  Arguments: void.
+//
+//  Returns: MODEM_PHASES of the profile in effect.
+//           MODEM_PHASE_AUTO if the profiles are off.
+//
+//  Description: Allows embedded rules to get the active profile.
+//
+//******************************************************************************
+MODEM_PHASES GetModemFlightPhase( void )
+{
+    if( !modemProfiles.bEnabled )
+    {
+        return MODEM_PHASE_AUTO;
+    }
+
+    return modemProfiles.activePhase;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPhaseStats
+//
+//  Arguments:
+//    IN  phase    - MODEM_PHASES to report.
+//    OUT pdwSecs  - Seconds spent with the profile in effect.
+//    OUT pdwMsgs  - Messages delivered with the profile in effect.
+//
+//  Returns: TRUE if the phase is valid.
+//           FALSE otherwise.
+//
+//  Description: Throughput per flight phase, to compare the profiles with
+//               a single set of parameters. The default profiles are a
+//               starting point and have not been measured to deliver more;
+//               tune them from these counts on real flights.
+//
+//******************************************************************************
+BOOL GetModemPhaseStats( const MODEM_PHASES phase, DWORD* pdwSecs, DWORD* pdwMsgs )
+{
+    if( phase >= NBR_MODEM_PHASES )
+    {
+        return FALSE;
+    }
+
+    *pdwSecs = modemProfiles.dwSecsInPhase[phase];
+    *pdwMsgs = modemProfiles.dwMsgsInPhase[phase];
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPhaseTransitions
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of profile changes applied.
+//
+//  Description: Flight phase profile statistics.
+//
+//******************************************************************************
+DWORD GetModemPhaseTransitions( void )
+{
+    return modemProfiles.dwTransitions;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetReportDedup
+//
+//  Arguments:
+//    IN  bEnable - TRUE to retire queued copies of reports delivered
+//                  recently.
+//                  FALSE to send every file (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on the deduplication of
+//               outbound reports. Turning it off forgets the recent reports.
+//
+//******************************************************************************
+void SetReportDedup( const BOOL bEnable )
+{
+    if( !bEnable )
+    {
+        reportDedup.byNbrHashes = 0;
+        reportDedup.byNextHash  = 0;
+        reportDedup.bPending    = FALSE;
+        MemSet( reportDedup.held, 0, sizeof( reportDedup.held ) );
+    }
+
+    reportDedup.bEnabled = bEnable;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetReportDedup
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if outbound reports are deduplicated.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the deduplication mode.
+//
+//******************************************************************************
+BOOL GetReportDedup( void )
+{
+    return reportDedup.bEnabled;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetReportDedupOptOut
+//
+//  Arguments:
+//    IN  wRptType - Report type, as found in the report header.
+//    IN  bOptOut  - TRUE to always send reports of this type.
+//                   FALSE to deduplicate them again (default).
+//
+//  Returns: TRUE if the opt out list was updated.
+//           FALSE if the list is full (DEDUP_MAX_OPT_OUTS types).
+//
+//  Description: For reports whose repetition means something to the
+//               ground, e.g. a periodic status with no time stamp.
+//
+//******************************************************************************
+BOOL SetReportDedupOptOut( const WORD wRptType, const BOOL bOptOut )
+{
+    BYTE byIndex;
+
+    for( byIndex = 0; byIndex < reportDedup.byNbrOptOuts; byIndex++ )
+    {
+        if( reportDedup.wOptOut[byIndex] == wRptType )
+        {
+            break;
+        }
+    }
+
+    if( bOptOut )
+    {
+        if( byIndex < reportDedup.byNbrOptOuts )
+        {
+            return TRUE;
+        }
+
+        if( reportDedup.byNbrOptOuts >= DEDUP_MAX_OPT_OUTS )
+        {
+            return FALSE;
+        }
+
+        reportDedup.wOptOut[reportDedup.byNbrOptOuts++] = wRptType;
+    }
+    else if( byIndex < reportDedup.byNbrOptOuts )
+    {
+        // Keep the list packed.
+        reportDedup.wOptOut[byIndex] = reportDedup.wOptOut[--reportDedup.byNbrOptOuts];
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetReportDedupMaxAge
+//
+//  Arguments:
+//    IN  dwMaxAgeInSeconds - Age past which a delivered report no longer
+//                            retires its copies. Previous value
+//                            maintained on a zero value.
+//                            DEFAULT: 1800 seconds
+//
+//  Returns: void.
+//
+//  Description: A report repeated later than this is sent again.
+//
+//******************************************************************************
+void SetReportDedupMaxAge( const DWORD dwMaxAgeInSeconds )
+{
+    if( dwMaxAgeInSeconds )
+    {
+        reportDedup.dwMaxAge = dwMaxAgeInSeconds * 1000;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetReportDedupSessionsSaved
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of duplicate reports retired without a session.
+//
+//  Description: Report deduplication statistics.
+//
+//******************************************************************************
+DWORD GetReportDedupSessionsSaved( void )
+{
+    return reportDedup.dwSessionsSaved;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetCoverageScheduling
+//
+//  Arguments:
+//    IN  bEnable - TRUE to schedule reports by the link map.
+//                  FALSE to send them as they are queued (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on coverage aware scheduling.
+//               Non-urgent reports are held back in cells where sessions
+//               usually fail (see SetCoverageUrgentFiles), and the delay
+//               between reports is shortened in cells where they usually
+//               succeed. Needs the position from SetLinkMapPosition().
+//
+//******************************************************************************
+void SetCoverageScheduling( const BOOL bEnable )
+{
+    modemConfigurables.bCoverageScheduling = bEnable;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetCoverageScheduling
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if reports are scheduled by the link map.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the coverage scheduling mode.
+//
+//******************************************************************************
+BOOL GetCoverageScheduling( void )
+{
+    return modemConfigurables.bCoverageScheduling;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetCoverageUrgentFiles
+//
+//  Arguments:
+//    IN  pcPriorityList - Pointer to an array of characters, that list the
+//                         priority flags of files never held back.
+//
+//                  NOTE - NULL will let ALL files be held back.
+//                         ***DEFAULT SETTING***
+//                       - "*" (KEEP_ALL_FILES define ) will never hold
+//                         back a file.
+//                       - pcPriorityList must be MAX_PRIORITY_FLAGS in size
+//                         and be null terminated!
+//
+//  Returns: void.
+//
+//  Description: Held back files are moved out of the outbox, so the urgent
+//               files queued behind them still go out.
+//
+//******************************************************************************
+void SetCoverageUrgentFiles( char* pcPriorityList )
+{
+    if( pcPriorityList == NULL )
+    {
+        modemConfigurables.szUrgentFileList[0] = NULL;
+    }
+    else
+    {
+        StringCpy( modemConfigurables.szUrgentFileList, pcPriorityList );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: SetMaxCoverageDeferral
+//
+//  Arguments:
+//    IN  dwDeferralInSeconds - Longest a report is held back in a poor
+//                              cell (default 15 minutes, 0 keeps the
+//                              previous value).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to bound the delay added to reports.
+//
+//******************************************************************************
+void SetMaxCoverageDeferral( const DWORD dwDeferralInSeconds )
+{
+    if( dwDeferralInSeconds )
+    {
+        modemConfigurables.dwMaxCoverageDeferral = dwDeferralInSeconds * 1000;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: HandleQueuedCommands
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if there is a queued command waiting.
+//           FALSE otherwise.
+//
+//  Description: This function initiates the CIS programming port commands
+//               sent by anywhere in the system or ELA.
+//
+//******************************************************************************
+BOOL HandleQueuedCommands( void )
+{
+    MODEM_COMMANDS mdmCmds = NO_CMD;
+    WORD wBackupReadIndex;
+
+    // First check if we have something q'd up
+    if( QueuedCISCmd.wWriteIndex == QueuedCISCmd.wReadIndex )
+    {
+        return FALSE;
+    }
+
+    // Since we verify the queue for duplicate commands,
+    // be sure to clear the command just read, to allow for 
+    // the command to be posted in the future.
+    wBackupReadIndex = QueuedCISCmd.wReadIndex;
+    mdmCmds = (MODEM_COMMANDS)GetDataFromQueue( &QueuedCISCmd );
+    modemQBuff[wBackupReadIndex] = NO_CMD;
+
+//    print( " q'd cmd: " );
+//    output_int( mdmCmds );
+
+    switch( mdmCmds )
+    {
+        case RINGER_ON:
+            TogglePhoneRinger( TRUE );
+            break;
+
+        case RINGER_OFF:
+            TogglePhoneRinger( FALSE );
+            break;
+
+        case RELAY1_ON:
+            ToggleRelayState( RELAY_1, TRUE );
+            break;
+
+        case RELAY1_OFF:
+            ToggleRelayState( RELAY_1, FALSE );
+            break;
+
+        case RELAY2_ON:
+            ToggleRelayState( RELAY_2, TRUE );
+            break;
+
+        case RELAY2_OFF:
+            ToggleRelayState( RELAY_2, FALSE );
+            break;
+
+        case RINGER_STATUS:
+            SendPhoneRingerStatusCmd();
+            break;
+
+        case RELAY1_STATUS:
+            SendOutputRelayStatusCmd( RELAY_1 );
+            break;
+
+        case RELAY2_STATUS:
+            SendOutputRelayStatusCmd( RELAY_2 );
+            break;
+
+        case RESET_CIS:
+            ResetCIS();
+            break;
+
+        case CONFIGURE_CIS:
+            ProgramCIS();
+            break;
+
+        case UPLOAD_CIS_CONFIG:
+            UploadCISConfig();
+            break;
+
+        case CALL_HANGUP:
+            // This command can only be sent if we're powered up.
+            if( modemOptions.modemState != MODEM_POWERED_DOWN )
+            {
+                HangupCall();
+                break;
+            }
+
+            // else fall through.
+
+        case NO_CMD:
+        default:
+            return FALSE;
+
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetMailboxStatus
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if there is a message ready to receive from the modem.
+//           FALSE otherwise.
+//
+//  Description: This function initiates the SendReadBinaryFileCmd() command,
+//               if there is a message to be received.
+//
+//******************************************************************************
+BOOL GetMailboxStatus( void )
+{
+    if( GetSBDStatus() == SUCCESSFUL_MSG )
+    {
+        // We have a message pending; 
+        // download it from the modem buffer,
+        if( SendReadBinaryFileCmd() )
+        {
+            // it's possible for this function to be called from an interrupt,
+            // however, a download must be performed before this function,
+            // and sending is only enabled after we're out of interrupt.
+            // Besides, this function writes the MT msg to a file, so,
+            // we'll be writing to a file regardless.
+            ModemLog( NO_RPT, MODEMLOG_RECEIVE );
+            SetModemStateBusy( RXING_FILE );
+            return TRUE;
+        }
+    }
+
+    // Fall through here means there are no pending messages to receive.
+    return FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: SendFileToModem
+//
+//  Arguments: void.
+//
+//  Returns: NOT_SENDING if there are no files to send 
+//           WAITING_TO_SEND if retry delay timer has yet to expire
+//           SENDING_FILE if the file was sent
+//
+//  Description: This function copies each byte of a specified summary report 
+//               into a buffer and sends that buffer to the satellite 
+//               modem port. 
+//
+//******************************************************************************
+FILE_SEND_OPTIONS SendFileToModem( void )
+{
+    // Nothing to send or there is no card...let's double check
+    if( modemOptions.bPCMCIAError )
+    {
+        // Notify lower level that a buffer needs to be sent,
+        // instead of a file
+        if( SendBinaryBuffer( (BYTE*)CreateSystemLogBuffer( 0 ),
+                              SYSLOG_MSG_SIZE ) )
+        {
+            SetModemStateBusy( TXING_BUFFER );
+            modemOptions.bPCMCIAError = FALSE;
+            return SENDING_FILE;
+        }
+    }
+
+    // Is this a retry or not? Retry count is bumped up on a failure to transmit.
+    if( modemFlags.byFileSendRetryCount == 0 )
+    {
+        // Get the next file in the queue (have the all-filter
+        // turned on automatically)
+        modemOptions.szPathFileBeingSent[0] = NULL;
+
+        if( SortAscending( modemOptions.szPathFileBeingSent, GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ) ) == NULL )
+        {
+            // The backlog has been drained.
+            modemProfiles.byDeliveryRun = 0;
+            return NOT_SENDING;
+        }
+
+        // Copies of a report delivered already don't cost a session.
+        if( RetireDuplicateReport() )
+        {
+            return WAITING_TO_SEND;
+        }
+
+        // Non-urgent reports wait for a better part of the route.
+        if( DeferForCoverage( modemOptions.szPathFileBeingSent ) )
+        {
+            return WAITING_TO_SEND;
+        }
+
+        // If the file was successfully sent, log it and change states.
+        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND );
+    }
+    else
+    {
+        if( !TimerExpired( thCheckRetryDelay ) )
+        {
+            // Cannot resend yet.
+            return WAITING_TO_SEND;
+        }
+
+        StopTimer( thCheckRetryDelay );
+        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_RETRY_SEND );
+    }
+
+    // Files too big for a single SBD message go over a data call. A file
+    // that cannot be read goes the SBD way below, which disposes of it.
+    if( IsBulkFile( modemOptions.szPathFileBeingSent ) )
+    {
+        switch( StartDataCallTransfer( modemOptions.szPathFileBeingSent ) )
+        {
+            case DATA_XFER_WAITING:
+                modemOptions.bInBulkTransfer = TRUE;
+                return SENDING_FILE;
+
+            case DATA_XFER_BUSY:
+                // Not an attempt - try again on the next pass.
+                return WAITING_TO_SEND;
+
+            case DATA_XFER_OFF_HOOK:
+                // The phone is off hook - count it as a failed attempt.
+                BulkTransferFailed();
+                return modemOptions.bInBulkTransfer ? SENDING_FILE : WAITING_TO_SEND;
+
+            default:
+                break;
+        }
+    }
+
+    // Without a data call (SBD only transceiver, or no number set) a file
+    // too big for one SBD message goes as fragments rather than truncated.
+    if( ( FileLength( modemOptions.szPathFileBeingSent ) > MODEM_MO_BUF_LEN ) &&
+        StartSBDFragmenting( modemOptions.szPathFileBeingSent ) )
+    {
+        modemOptions.bInBulkTransfer = TRUE;
+        return SENDING_FILE;
+    }
+
+    if( SendBinaryFile( modemOptions.szPathFileBeingSent ) )
+    {
+        SetModemStateBusy( TXING_FILE );
+
+        return SENDING_FILE;
+    }
+    else
+    {
+        // Something is wrong with the file! Delete it to keep ELA from resending it over, and over and over....
+        if( deleteFile( modemOptions.szPathFileBeingSent ) )
+        {
+            // Ensure the file being deleted is logged
+            StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+            StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
+            SystemLog( szErrString );
+        }
+        else
+        {
+            // Report if file cannot be deleted.
+            StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+            StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
+            SystemLog( szErrString );
+            MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
+        }
+    }
+
+    // Fall through means there were problems sending the file!
+    return NOT_SENDING;
+}
+
+
+//******************************************************************************
+//
+//  Function: SendCallStatusCmd
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the command was sent
+//           FALSE if the command was not sent 
+//                 if dialing timer has yet to expire
+//
+//  Description: This function checks on the modem status if we have detected
+//               an off-hook event or a "ring" (incoming call).
+//
+//******************************************************************************
+BOOL SendCallStatusCmd( void )
+{
+    // Is this a retry or not? Retry count is bumped up on a failure,
+    // and set to 1 if the modem is busy dialing.
+    if( !PollDue( POLL_CALL_STATUS ) )
+    {
+        return FALSE;
+    }
+
+    if( SendCLCCCmd() )
+    {
+        print( " sending CLCC cmd" );
+        SetModemStateBusy( CALL_STATUS );
+        PollSent( POLL_CALL_STATUS );
+        return TRUE;
+    }
+
+    // Fall through means there were problems sending the cmd!
+    return FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: CleanUpOnUnexpectedRsp
+//
+//  Arguments:
+//    atCmdState - AT_CMD_STATES enum type to save to the modem log file.
+//
+//  Returns: void.
+//
+//  Description: Reports in the modem.log file that an unexpected result
+//               occured.
+//
+//******************************************************************************
+void CleanUpOnUnexpectedRsp( AT_CMD_STATES atCmdState )
+{
+    RecordModemLogError( MODEMLOG_UNEXPECTED_RSP );
+
+    print( "\r\n" );
+    print( TEXT_MODEM_STATE[modemOptions.modemState] );
+    print( GetATCmdText( atCmdState ) );
+    print( " Unexpected response - going to init!" );
+}
+
+
+//******************************************************************************
+//
+//  Function: CleanUpOnIdle
+//
+//  Arguments: void
+//
+//  Returns: void.
+//
+//  Description: Takes care of risidual tasks to be handled by upper layer
+//               (like notifying modem log, moving files to the correct
+//                directory, LEDs, setting/unsetting flags and handling
+//                retries).
+//
+//******************************************************************************
+void CleanUpOnIdle( AT_CMD_STATES atCmdState )
+{
+    if( atCmdState == AT_CMD_SUCCESS )
+    {
+        modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_SUCCESS;
+    }
+    else
+    {
+        modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_FAILED;
+    }
+
+    HandleTimeouts( atCmdState );
+
+    TakeSBDLinkSample();
+
+    //print( " -->" );
+    //output_int( modemOptions.ModemCmd );
+    //print( " " );
+    //output_int( modemOptions.ModemRsp[modemOptions.ModemCmd] );
+
+    switch( modemOptions.ModemCmd )
+    {
+        case RXING_FILE:
+
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = MODEM_IDLE;
+
+            switch( atCmdState )
+            {
+                case AT_CMD_TIMED_OUT:
+                    // At least notify the user what happened.
+                    RecordModemLogError( MODEMLOG_RECEIVE_FAILURE );
+
+                    // Try reading the buffer again...
+                    if( ++modemFlags.byFileReceiveRetryCount < modemConfigurables.byMaxRetries )
+                    {
+                        // We have a message pending; 
+                        // download it from the modem buffer,
+                        if( SendReadBinaryFileCmd() )
+                        {
+                            // no longer in idle!
+                            ModemLog( NO_RPT, MODEMLOG_RECEIVE );
+                            SetModemStateBusy( RXING_FILE );
+                        }
+
+                        break;
+                    }
+
+                    // else fall through..
+
+                default:
+                case AT_CMD_FAILED:
+                case AT_CMD_SUCCESS:
+
+                    // Wait for a bit before continuing.
+                    WaitForIncommingCalls();
+                    modemFlags.byFileReceiveRetryCount = 0;
+
+                    break;
+            }
+
+            break;
+
+        case TXING_FILE:
+
+            switch( atCmdState )
+            {
+                case AT_CMD_SUCCESS:
+                    // Reset retry count on success.
+                    modemFlags.byFileSendRetryCount = 0;
+                    modemOptions.ModemCmd = NO_CMD;
+
+                    // Ensure the file being deleted is logged
+                    ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_SUCCESSFUL );
+                    modemEnergy.dwMsgsDelivered++;
+                    NoteProfileDelivery();
+                    RecordLinkMapDelivery();
+                    CommitReportHdr();
+                    RememberDeliveredReport();
+
+                    RetireSentFile();
+
+                    if( InVoiceCall() ) // true (high) if phone is off hook
+                    {
+                        // Function call changes modemState and ModemCmd
+                        modemOptions.modemState = MODEM_IDLE;
+                        HangupCall();
+                        break;
+                    }
+
+                    // Only wait if there is nothing in the MT buffer
+                    if( !GetMailboxStatus() )
+                    {
+                        // Wait for a bit before continuing.
+                        WaitForIncommingCalls();
+                        modemOptions.modemState = MODEM_IDLE;
+                    }
+
+                    break;
+
+                case AT_CMD_TIMED_OUT:
+                case AT_CMD_FAILED:
+                default:
+                    // Increment the retry count on failure. Disable txingFile flag, as we 
+                    // don't know what will happen in between.
+                    modemOptions.modemState = MODEM_IDLE;
+                    modemOptions.ModemCmd   = NO_CMD;
+
+                    if( ++modemFlags.byFileSendRetryCount < modemConfigurables.byMaxRetries )
+                    {
+                        // Setup delay timer. 
+                        StartTimer( thCheckRetryDelay, modemConfigurables.dwRetryDelay );
+                    }
+                    else
+                    {
+                        // Reset retry count for next file to be sent and go into wait.
+                        modemFlags.byFileSendRetryCount = 0;
+                        WaitForIncommingCalls();
+                        
+                        if( MarkFileAsError( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
+                        {
+                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_FAILURE );
+                        }
+                        else
+                        {
+                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
+
+                            if( deleteFile( modemOptions.szPathFileBeingSent ) )
+                            {
+                                // Ensure the file being deleted is logged
+                                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+                                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
+                                SystemLog( szErrString );
+                            }
+                            else
+                            {
+                                // Report if file cannot be deleted.
+                                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+                                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
+                                SystemLog( szErrString );
+                            }
+                        }
+                    }
+
+                    break;
+            }
+
+            break;
+
+        case TXING_BUFFER:
+        case TXING_TEXT:
+
+            modemOptions.ModemCmd = NO_CMD;
+
+            if( atCmdState == AT_CMD_SUCCESS )
+            {
+                modemEnergy.dwMsgsDelivered++;
+                NoteProfileDelivery();
+                RecordLinkMapDelivery();
+
+                if( InVoiceCall() ) // true (high) if phone is off hook
+                {
+                    // Function call changes modemState and ModemCmd
+                    modemOptions.modemState = MODEM_IDLE;
+                    HangupCall();
+                    break;
+                }
+            }
+
+            // Only wait if there is nothing in the MT buffer
+            if( !GetMailboxStatus() )
+            {
+                // Wait for a bit before continuing.
+                WaitForIncommingCalls();
+                modemOptions.modemState = MODEM_IDLE;
+            }
+            
+            break;
+
+        case CALL_STATUS:
+
+            switch( atCmdState )
+            {
+                case AT_CMD_SUCCESS:
+                case AT_CMD_TIMED_OUT:
+                default:
+
+                    // Reset retry count on success.
+                    modemOptions.ModemCmd   = NO_CMD;
+                    modemOptions.modemState = MODEM_IDLE;
+
+                    AdaptPollRate( POLL_CALL_STATUS, GetCallStatus() != pollSched.lastCallStatus );
+                    pollSched.lastCallStatus = GetCallStatus();
+
+                    // Let the phone call complete
+                    WaitForIncommingCalls();
+
+                    break;
+            }
+
+            break;
+
+        case MAILBOX_CHECK:
+
+            modemOptions.ModemCmd = NO_CMD;
+
+            if( atCmdState == AT_CMD_SUCCESS )
+            {
+                // No need to reset timer, its done in the state machine.
+                RecordModemLogError( MODEMLOG_MAILBOXCHECK_SUCCESS );
+            }
+            else
+            {
+                // No need to reset timer, its done in the state machine.
+                RecordModemLogError( MODEMLOG_MAILBOXCHECK_FAILURE );
+            }
+
+            // Only wait if there is nothing in the MT buffer
+            if( !GetMailboxStatus() )
+            {
+                // Wait for a bit before continuing.
+                WaitForIncommingCalls();
+                modemOptions.modemState = MODEM_IDLE;
+            }
+
+            break;
+
+        case GATEWAY_CHECK:
+
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = MODEM_IDLE;
+
+            // Something waiting at the gateway is a change worth polling for.
+            AdaptPollRate( POLL_GATEWAY, atCmdState == AT_CMD_SUCCESS );
+
+            if( atCmdState == AT_CMD_SUCCESS )
+            {
+                // Do a manual mailbox check - msgs are queueued or waiting at the gateway
+                // We know the modem is idle, the command will go through
+                if( CheckMailbox() )
+                {
+                    SetModemStateBusy( MAILBOX_CHECK );
+                }
+            }
+
+            break;
+
+        case GETTING_CSQ:
+
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = MODEM_IDLE;
+
+            if( atCmdState == AT_CMD_SUCCESS )
+            {
+                modemFlags.byCSQDebounceCount = 0;
+            }
+            else
+            {
+                if( ++modemFlags.byCSQDebounceCount < modemConfigurables.byCSQMaxDebounceRetries )
+                {
+                    // On failure, keep trying to get a decent signal strength.
+                    SchedulePoll( POLL_CSQ, modemConfigurables.dwCSQDebounceDelay );
+                    break;
+                }
+                else
+                {
+                    // Ok, it's definately a failure, report it.
+                    modemFlags.byCSQDebounceCount = 0;
+                    ClearModemSignalStrength();
+            
+                    RecordModemLogError( MODEMLOG_SIGNALSTRENGTH_FAILURE );
+                    ReportSystemLogError( SYS_LOG_IRIDIUM_ERROR );
+                }
+            }
+
+            AdaptPollRate( POLL_CSQ, GetModemSignalStrength() != pollSched.iLastSignal );
+            pollSched.iLastSignal = GetModemSignalStrength();
+
+            NoteProfileCSQ( GetModemSignalStrength() );
+
+            break;
+
+        case CALL_HANGUP:
+
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = MODEM_IDLE;
+
+            // Wait for a bit before continuing.
+            WaitForIncommingCalls();
+
+            if( atCmdState == AT_CMD_SUCCESS )
+            {
+                RecordModemLogError( MODEMLOG_HUNG_UP_CALL_SUCCESS );
+            }
+            else
+            {
+                RecordModemLogError( MODEMLOG_HUNG_UP_CALL_FAILURE );
+            }
+        
+            break;
+
+            // These set of CIS commands are handled in a special way.
+            // First we retry commands if they've failed, and 
+            // secondly since they can be deployed from outside of idle,
+            // we need to know from where to return.
+        case RINGER_ON :
+        case RINGER_OFF:
+        case RELAY1_ON :
+        case RELAY1_OFF:
+        case RELAY2_ON :
+        case RELAY2_OFF:
+        case RINGER_STATUS:
+        case RELAY1_STATUS:
+        case RELAY2_STATUS:
+        case RESET_CIS:
+
+            if( atCmdState != AT_CMD_SUCCESS )
+            {
+                // Fall through means we have to resend the message.
+                AddNewDataToQueue( modemOptions.ModemCmd );  // Save data
+            }
+
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = modemOptions.prevModemState;
+
+            if( modemOptions.modemState != MODEM_IDLE )
+            {
+                SetATCmdStateInit();
+            }
+
+            break;
+
+        case UPLOAD_CIS_CONFIG:
+
+            // Regardless, continue.
+            print( " done!" );
+            modemOptions.bCISActionComplete = TRUE;
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = modemOptions.prevModemState;
+
+            if( modemOptions.modemState != MODEM_IDLE )
+            {
+                SetATCmdStateInit();
+            }
+
+            break;
+
+        case CONFIGURE_CIS:
+
+            if( atCmdState != AT_CMD_SUCCESS )
+            {
+                // On failure, we have to:
+                // 1. Write bogus data to the CIS area of the EEPROM (to allow for recovery)
+                // 2. Reset the CIS.
+                // CANNOT REPORT ERROR AS THIS IS RUNNING FROM INTERRUPT!
+                ReportSystemLogError( SYS_LOG_REMOTE_CONFIG_FAILED_CISCFG );
+                print( " failed programming CIS!" );
+                WriteConfigEepromByte( CIS_PRIMARY_EXT, INVALID_EXTENSION );
+                WriteConfigEepromByte( CIS_SECONDARY_EXT, INVALID_EXTENSION );
+            }
+#if (DEBUG)
+            else
+            {
+                print( " succeeded programming CIS!" );
+            }
+#endif
+
+            modemOptions.bCISActionComplete = TRUE;
+            modemOptions.ModemCmd = NO_CMD;
+            modemOptions.modemState = modemOptions.prevModemState;
+
+            if( modemOptions.modemState != MODEM_IDLE )
+            {
+                SetATCmdStateInit();
+            }
+
+            // We have to:
+            // 1. Reset the CIS.
+            // 2. Restore the states of the ringer and relays
+            PowerCycleCIS();
+
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: WaitForIncommingCalls
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Provides a wait state for the state machine to allow
+//               incomming calls.
+//
+//******************************************************************************
+void WaitForIncommingCalls( void )
+{
+    // Only reenable sending (after a delay), if it already is enabled.
+    if( modemOptions.bSendingEnabled )
+    {
+        modemOptions.bSendingEnabled = FALSE;
+
+        // Make the most of a good cell.
+        if( modemConfigurables.bCoverageScheduling && ( GetLinkMapQuality() == LINK_CELL_GOOD ) )
+        {
+            StartTimer( thWaitForCalls, modemConfigurables.dwWaitForCalls / COVERAGE_GOOD_CALL_WAIT );
+        }
+        else
+        {
+            StartTimer( thWaitForCalls, modemConfigurables.dwWaitForCalls );
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: AddNewDataToQueue
+//
+//  Arguments:
+//    IN Modemcommand - Command to queue up.
+//
+//  Returns: void.
+//
+//  Description: Adds new command to queue, but only if it doesn't already 
+//               exist in queue.
+//
+//******************************************************************************
+void AddNewDataToQueue( MODEM_COMMANDS Modemcommand )
+{
+    BYTE byIndex;
+
+//    print( " q'd cmd: " );
+//    output_int( Modemcommand );
+
+    for( byIndex = 0; byIndex < MDM_Q_LEN; byIndex++ )
+    {
+        if( modemQBuff[byIndex] == Modemcommand )
+        {
+            return;
+        }
+    }
+
+    AddDataToQueue( &QueuedCISCmd, Modemcommand );  // Save data and clear response
+    modemOptions.ModemRsp[Modemcommand] = MR_WAITING;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetModemStateBusy
+//
+//  Arguments:
+//    IN  cmd     - Specifies the command that is making the statemachine busy.
+//
+//  Returns: void.
+//
+//  Description: Sets all the correct variables when we go into busy state.
+//
+//******************************************************************************
+void SetModemStateBusy( MODEM_COMMANDS cmd )
+{
+    modemOptions.prevModemState   = modemOptions.modemState;
+    modemOptions.modemState       = MODEM_BUSY;
+    modemOptions.ModemCmd         = cmd;
+    modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_WAITING;
+}
+
+
+//******************************************************************************
+//
+//  Function: HandleTimeouts
+//
+//  Arguments:
+//    IN  ATCmdState - current middle-level state
+//
+//  Returns: void.
+//
+//  Description: Ensures back-to-back timeouts are handled consistently.
+//
+//******************************************************************************
+void HandleTimeouts( AT_CMD_STATES ATCmdState )
+{
+    if( ATCmdState == AT_CMD_TIMED_OUT )
+    {
+        if( TimerExpired( thTimeout ) )
+        {
+            if( !InVoiceCall() )
+            {
+                SystemLog( "Modem communications error detected - power cycling CIS" );
+
+                if( !PowerCycleCIS() )
+                {
+                    AddNewDataToQueue( RESET_CIS );  // Save data
+                }
+            }
+
+            ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+        }
+    }
+    else
+    {
+        ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: EnterModemSleep
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Drops DTR to put the modem to sleep if sleep mode is enabled
+//               and there is nothing left to do: no CIS command queued, no
+//               poll due and no message waiting to be resubmitted. The CSQ
+//               and gateway polls are deferred until the sleep poll
+//               deadline, where they are run back to back in a single wake
+//               period.
+//
+//******************************************************************************
+void EnterModemSleep( void )
+{
+    // A message that is never resubmitted does not keep the modem awake.
+    if( modemOptions.bWakeRequested && TimerExpired( thWakeHold ) )
+    {
+        StopTimer( thWakeHold );
+        modemOptions.bWakeRequested = FALSE;
+    }
+
+    if( !modemConfigurables.bSleepEnabled
+        ||
+        modemOptions.bModemAsleep
+        ||
+        modemOptions.bInTransparentMode )
+    {
+        return;
+    }
+
+    // Stay awake during the incoming call window, while a file is being
+    // retried, or if a message was just submitted.
+    if( !modemOptions.bSendingEnabled
+        ||
+        ( modemFlags.byFileSendRetryCount != 0 )
+        ||
+        modemOptions.bWakeRequested
+        ||
+        modemOptions.bPCMCIAError )
+    {
+        return;
+    }
+
+    if( InVoiceCall() || ReadModemPortRILine() )
+    {
+        return;
+    }
+
+    // A poll that could not be sent is tried again before sleeping.
+    if( ( QueuedCISCmd.wWriteIndex != QueuedCISCmd.wReadIndex )
+        ||
+        PollDue( POLL_CSQ )
+        ||
+        PollDue( POLL_GATEWAY ) )
+    {
+        return;
+    }
+
+    SetModemPortDTRLow();
+
+    modemOptions.bModemAsleep = TRUE;
+
+    StartTimer( thSleepPoll, modemConfigurables.dwSleepPollRate );
+    StartTimer( thOutboxCheck, DEFAULT_OUTBOX_CHECK_RATE );
+}
+
+
+//******************************************************************************
+//
+//  Function: WakeModem
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Raises DTR and holds off AT commands until the modem has
+//               settled. A wake request is kept until the message is
+//               resubmitted and accepted, so the modem does not go back to
+//               sleep first.
+//
+//******************************************************************************
+void WakeModem( void )
+{
+    SetModemPortDTRHigh();
+
+    modemOptions.bModemAsleep   = FALSE;
+    modemOptions.bWakeSettling  = TRUE;
+
+    StopTimer( thSleepPoll );
+    StopTimer( thOutboxCheck );
+    StartTimer( thWakeSettle, DEFAULT_WAKE_SETTLE_DELAY );
+
+    // No commands were sent while asleep - do not count that as a timeout.
+    ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+}
+
+
+//******************************************************************************
+//
+//  Function: ModemWakeRequired
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the modem must be woken up.
+//           FALSE if it can stay asleep.
+//
+//  Description: Checks the wake conditions: a message submitted through the
+//               API, a file in the outbox that is not held back for
+//               coverage, a ring alert (or the phone going off hook) and the
+//               sleep poll deadline. On the poll deadline the CSQ and
+//               gateway polls are both made due, so that they run in the
+//               same wake period.
+//
+//******************************************************************************
+BOOL ModemWakeRequired( void )
+{
+    static char szPathFilename[EMAXPATH];
+
+    if( modemOptions.bWakeRequested
+        ||
+        modemOptions.bPCMCIAError
+        ||
+        !modemConfigurables.bSleepEnabled )
+    {
+        return TRUE;
+    }
+
+    // Ring alert or incoming/outgoing call.
+    if( ReadModemPortRILine() || InVoiceCall() )
+    {
+        return TRUE;
+    }
+
+    if( TimerExpired( thSleepPoll ) )
+    {
+        // Batch all polls into this wake period.
+        SchedulePoll( POLL_CSQ, 0 );
+        SchedulePoll( POLL_GATEWAY, 0 );
+        return TRUE;
+    }
+
+    // Scanning the outbox is local and does not need the modem, nor does
+    // holding back a file for coverage.
+    if( TimerExpired( thOutboxCheck ) )
+    {
+        ResetTimer( thOutboxCheck, DEFAULT_OUTBOX_CHECK_RATE );
+
+        if( ReleaseCoverageFiles() )
+        {
+            return TRUE;
+        }
+
+        szPathFilename[0] = NULL;
+
+        if( ( SortAscending( szPathFilename, GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ) ) != NULL )
+            &&
+            !DeferForCoverage( szPathFilename ) )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPowerState
+//
+//  Arguments: void.
+//
+//  Returns: MODEM_POWER_STATES enum of the present power state.
+//
+//  Description: Maps the current driver state onto the energy model power
+//               states.
+//
+//******************************************************************************
+MODEM_POWER_STATES GetModemPowerState( void )
+{
+    if( modemOptions.modemState == MODEM_POWERED_DOWN )
+    {
+        return MODEM_PWR_OFF;
+    }
+
+    if( modemOptions.bModemAsleep )
+    {
+        return MODEM_PWR_SLEEP;
+    }
+
+    // A data call draws the same as a voice call.
+    if( InVoiceCall() || IsDataCallActive() )
+    {
+        return MODEM_PWR_VOICE_CALL;
+    }
+
+    if( modemOptions.modemState == MODEM_BUSY )
+    {
+        switch( modemOptions.ModemCmd )
+        {
+            case TXING_FILE:
+            case TXING_BUFFER:
+            case TXING_TEXT:
+            case MAILBOX_CHECK:
+                return MODEM_PWR_SBD_SESSION;
+
+            default:
+                return MODEM_PWR_LOCAL_CMD;
+        }
+    }
+
+    return MODEM_PWR_IDLE;
+}
+
+
+//******************************************************************************
+//
+//  Function: UpdateEnergyModel
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Once per DEFAULT_ENERGY_SAMPLE_RATE, accumulates the time
+//               and the charge (mA-seconds) of the present power state.
+//
+//******************************************************************************
+void UpdateEnergyModel( void )
+{
+    MODEM_POWER_STATES pwrState;
+
+    if( !TimerExpired( thEnergySample ) )
+    {
+        return;
+    }
+
+    ResetTimer( thEnergySample, DEFAULT_ENERGY_SAMPLE_RATE );
+
+    pwrState = GetModemPowerState();
+
+    modemEnergy.dwSecsInState[pwrState]++;
+    modemEnergy.dwChargeInState[pwrState] += modemConfigurables.wCurrentDraw[pwrState];
+
+    if( modemProfiles.bEnabled && ( modemProfiles.activePhase < NBR_MODEM_PHASES ) )
+    {
+        modemProfiles.dwSecsInPhase[modemProfiles.activePhase]++;
+    }
+
+    if( modemProfiles.dwSecsIdle < PHASE_IDLE_SECS )
+    {
+        // Going idle may take the inferred phase back to ground.
+        if( ++modemProfiles.dwSecsIdle == PHASE_IDLE_SECS )
+        {
+            EvaluateModemPhase();
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: HandleBulkTransfer
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Runs the data call transfer (or SBD fragmenting) of the
+//               file being sent and cleans up once it is complete. The AT
+//               layer is not updated until this is done, as the data call
+//               owns the modem port.
+//
+//******************************************************************************
+void HandleBulkTransfer( void )
+{
+    switch( ProcessDataTransfer() )
+    {
+        case DATA_XFER_WAITING:
+            return;
+
+        case DATA_XFER_SUCCESS:
+            modemFlags.byFileSendRetryCount = 0;
+            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DATA_CALL_SUCCESSFUL );
+            modemEnergy.dwMsgsDelivered++;
+            NoteProfileDelivery();
+            RecordLinkMapDelivery();
+            RetireSentFile();
+            WaitForIncommingCalls();
+            break;
+
+        case DATA_XFER_FRAGMENTED:
+            // The fragments now carry the file.
+            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DATA_CALL_FRAGMENTED );
+
+            if( !deleteFile( modemOptions.szPathFileBeingSent ) )
+            {
+                ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DELETE_FAILURE );
+                MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
+            }
+            break;
+
+        case DATA_XFER_FRAGMENT_ERROR:
+            if( !MarkFileAsError( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
+            {
+                ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
+                deleteFile( modemOptions.szPathFileBeingSent );
+            }
+            else
+            {
+                ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_FAILURE );
+            }
+            break;
+
+        case DATA_XFER_FAILED:
+        default:
+            BulkTransferFailed();
+
+            // Fragmenting may have been started.
+            if( modemOptions.bInBulkTransfer )
+            {
+                return;
+            }
+            break;
+    }
+
+    modemOptions.bInBulkTransfer = FALSE;
+
+    // The AT layer was idle throughout, don't count the call as a timeout.
+    ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+}
+
+
+//******************************************************************************
+//
+//  Function: BulkTransferFailed
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Schedules a retry of the data call (which resumes where the
+//               ground left off), or falls back to SBD fragmenting once the
+//               retries are used up.
+//
+//******************************************************************************
+void BulkTransferFailed( void )
+{
+    ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DATA_CALL_FAILURE );
+
+    modemOptions.bInBulkTransfer = FALSE;
+
+    if( ++modemFlags.byFileSendRetryCount < modemConfigurables.byMaxRetries )
+    {
+        StartTimer( thCheckRetryDelay, modemConfigurables.dwRetryDelay );
+        return;
+    }
+
+    modemFlags.byFileSendRetryCount = 0;
+
+    if( StartSBDFragmenting( modemOptions.szPathFileBeingSent ) )
+    {
+        modemOptions.bInBulkTransfer = TRUE;
+    }
+    else if( MarkFileAsError( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
+    {
+        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_FAILURE );
+    }
+    else
+    {
+        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
+        deleteFile( modemOptions.szPathFileBeingSent );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: RetireSentFile
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Deletes the file that was just sent, or moves it to the
+//               sent directory if its priority flag is in the keep list.
+//
+//******************************************************************************
+void RetireSentFile( void )
+{
+    static char szFileName[MAX_FILENAME_LEN];
+    BYTE byIndex;
+    char cPriorityFlag;
     BOOL bKeepFile;
 
-    if( atCmdState == AT_CMD_SUCCESS )
+    if( modemConfigurables.szKeepFileList[0] == DELETE_ALL_FILES )
+    {
+        if( !deleteFile( modemOptions.szPathFileBeingSent ) )
+        {
+            // Report if file cannot be deleted.
+            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DELETE_FAILURE );
+            MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
+        }
+        return;
+    }
+
+    szFileName[0] = NULL;
+    bKeepFile = FALSE;
+    cPriorityFlag = ExtractFileNameFromPath( modemOptions.szPathFileBeingSent, szFileName )[0];
+
+    for( byIndex = 0; byIndex < MAX_PRIORITY_FLAGS; byIndex++ )
+    {
+        // Look at the "keep" list
+        if( modemConfigurables.szKeepFileList[byIndex] == NULL )
+        {
+            break;
+        }
+        else if( modemConfigurables.szKeepFileList[byIndex] == cPriorityFlag )
+        {
+            bKeepFile = TRUE;
+            break;
+        }
+    }
+
+    if( bKeepFile || ( modemConfigurables.szKeepFileList[0] == KEEP_ALL_FILES ) )
+    {
+        if( !MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
+        {
+            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
+
+            if( deleteFile( modemOptions.szPathFileBeingSent ) )
+            {
+                // Ensure the file being deleted is logged
+                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
+                SystemLog( szErrString );
+            }
+            else
+            {
+                // Report if file cannot be deleted.
+                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
+                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
+                SystemLog( szErrString );
+            }
+        }
+    }
+    else if( !deleteFile( modemOptions.szPathFileBeingSent ) )
+    {
+        // Report if file cannot be deleted.
+        ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DELETE_FAILURE );
+        MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: TransparentSliceActive
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the state machine may run while in transparent mode.
+//           FALSE otherwise.
+//
+//  Description: Pauses the transparent bridge when urgent SBD work is
+//               pending and the technician is between commands. The slice
+//               ends as soon as the driver is idle and either the work is
+//               done or the maximum pause has elapsed. Past the maximum
+//               pause, only an SBD session or data call under way keeps the
+//               port; a modem that is powered down or still initializing
+//               is handed back, and re-initialized at the next slice.
+//
+//******************************************************************************
+BOOL TransparentSliceActive( void )
+{
+    char szSecs[12];
+
+    if( !modemConfigurables.bTransparentSlicing )
+    {
+        return FALSE;
+    }
+
+    if( transparentSlice.bPaused )
+    {
+        if( TimerExpired( thTransparentPause ) )
+        {
+            // A session already under way is never cut short.
+            if( ( modemOptions.modemState == MODEM_BUSY ) || IsDataCallActive() )
+            {
+                transparentSlice.bOverrun = TRUE;
+                return TRUE;
+            }
+
+            // The AT layer is left mid command; start it over next slice.
+            if( ( modemOptions.modemState != MODEM_IDLE ) || ( GetModemAtState() != AT_CMD_IDLE ) || modemOptions.bInBulkTransfer )
+            {
+                transparentSlice.bOverrun     = TRUE;
+                transparentSlice.bTechTraffic = TRUE;
+            }
+
+            ResumeTransparentBridge();
+            return FALSE;
+        }
+
+        // Never hand the port back in the middle of a command.
+        if( ( modemOptions.modemState != MODEM_IDLE ) || ( GetModemAtState() != AT_CMD_IDLE ) || modemOptions.bInBulkTransfer )
+        {
+            return TRUE;
+        }
+
+        if( UrgentSBDWorkPending() )
+        {
+            return TRUE;
+        }
+
+        ResumeTransparentBridge();
+        return FALSE;
+    }
+
+    if( !TimerExpired( thTransparentGap ) || !AtTransparentCmdBoundary() || !UrgentSBDWorkPending() )
+    {
+        return FALSE;
+    }
+
+    transparentSlice.bPaused  = TRUE;
+    transparentSlice.bOverrun = FALSE;
+    transparentSlice.dwPauseCount++;
+
+    StartTimer( thTransparentPause, modemConfigurables.dwMaxTransparentPause );
+
+    // Anything left from the technician's session would confuse the AT layer.
+    FlushModemSerialRxQueue();
+
+    // The technician may have changed echo or verbose settings.
+    if( transparentSlice.bTechTraffic )
+    {
+        transparentSlice.bTechTraffic = FALSE;
+        SetATCmdStateInit();
+        modemOptions.modemState = MODEM_INITTING;
+    }
+
+    IntToString( szSecs, modemConfigurables.dwMaxTransparentPause / 1000, 1 );
+    SendStringToMtcePort( "\r\n[MODEM PAUSED FOR SBD - MAX " );
+    SendStringToMtcePort( szSecs );
+    SendStringToMtcePort( " SECS]\r\n" );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: UrgentSBDWorkPending
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if there is work that should not wait for the technician.
+//           FALSE otherwise.
+//
+//  Description: Outbound files (once sending is enabled and any retry delay
+//               has elapsed), a PCMCIA error report, queued CIS commands and
+//               ring alerts for MT messages are urgent. Polls are not.
+//
+//******************************************************************************
+BOOL UrgentSBDWorkPending( void )
+{
+    static char szPathFilename[EMAXPATH];
+
+    if( modemOptions.bPCMCIAError )
+    {
+        return TRUE;
+    }
+
+    if( QueuedCISCmd.wWriteIndex != QueuedCISCmd.wReadIndex )
+    {
+        return TRUE;
+    }
+
+    if( ReadModemPortRILine() && !InVoiceCall() )
+    {
+        return TRUE;
+    }
+
+    if( !modemOptions.bSendingEnabled )
+    {
+        return FALSE;
+    }
+
+    if( modemFlags.byFileSendRetryCount != 0 )
+    {
+        return TimerExpired( thCheckRetryDelay );
+    }
+
+    szPathFilename[0] = NULL;
+
+    return ( SortAscending( szPathFilename, GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ) ) != NULL );
+}
+
+
+//******************************************************************************
+//
+//  Function: AtTransparentCmdBoundary
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the technician is between commands.
+//           FALSE otherwise.
+//
+//  Description: The technician is between commands when nothing is half
+//               typed, the last command got its final result code and the
+//               bridge has been quiet for TRANSPARENT_QUIET_TIME. A command
+//               left unfinished for TRANSPARENT_CMD_TIMEOUT is abandoned.
+//
+//******************************************************************************
+BOOL AtTransparentCmdBoundary( void )
+{
+    if( !TimerExpired( thTransparentQuiet ) )
+    {
+        return FALSE;
+    }
+
+    if( ( transparentSlice.bTechCmdOpen || transparentSlice.bTechAwaitingRsp )
+        &&
+        !TimerExpired( thTransparentCmd ) )
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ResumeTransparentBridge
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Hands the modem port back to the technician and keeps it
+//               theirs for at least TRANSPARENT_SLICE_GAP.
+//
+//******************************************************************************
+void ResumeTransparentBridge( void )
+{
+    if( transparentSlice.bOverrun )
+    {
+        transparentSlice.dwOverrunCount++;
+    }
+
+    transparentSlice.bPaused          = FALSE;
+    transparentSlice.bTechCmdOpen     = FALSE;
+    transparentSlice.bTechAwaitingRsp = FALSE;
+    transparentSlice.wRspIndex        = 0;
+
+    StopTimer( thTransparentPause );
+    StopTimer( thTransparentCmd );
+    StartTimer( thTransparentGap, TRANSPARENT_SLICE_GAP );
+
+    SendStringToMtcePort( "\r\n[MODEM RESUMED]\r\n" );
+}
+
+
+//******************************************************************************
+//
+//  Function: ServicePollScheduler
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Runs the poll clock and rolls the polls per hour count.
+//
+//******************************************************************************
+void ServicePollScheduler( void )
+{
+    if( !TimerExpired( thPollClock ) )
+    {
+        return;
+    }
+
+    ResetTimer( thPollClock, POLL_CLOCK_RES );
+
+    pollSched.dwClock += POLL_CLOCK_RES;
+
+    if( ( pollSched.dwClock - pollSched.dwPeriodStart ) >= POLL_STATS_PERIOD )
+    {
+        pollSched.dwPollsLastPeriod = pollSched.dwPollsThisPeriod;
+        pollSched.dwPollsThisPeriod = 0;
+        pollSched.dwPeriodStart     = pollSched.dwClock;
+        pollSched.bFullPeriod       = TRUE;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: SchedulePoll
+//
+//  Arguments:
+//    IN  poll    - POLL_TYPES poll to schedule.
+//    IN  dwDelay - ms from now (0 makes it due immediately).
+//
+//  Returns: void.
+//
+//  Description: Makes a poll due dwDelay ms from now.
+//
+//******************************************************************************
+void SchedulePoll( POLL_TYPES poll, DWORD dwDelay )
+{
+    pollSched.bActive[poll] = TRUE;
+    pollSched.dwDueAt[poll] = pollSched.dwClock + dwDelay;
+}
+
+
+//******************************************************************************
+//
+//  Function: StopPoll
+//
+//  Arguments:
+//    IN  poll - POLL_TYPES poll to stop.
+//
+//  Returns: void.
+//
+//  Description: A stopped poll is never due until it is scheduled again.
+//
+//******************************************************************************
+void StopPoll( POLL_TYPES poll )
+{
+    pollSched.bActive[poll] = FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: PollDue
+//
+//  Arguments:
+//    IN  poll - POLL_TYPES poll to check.
+//
+//  Returns: TRUE if the poll should be sent.
+//           FALSE otherwise.
+//
+//  Description: Wrap safe comparison against the poll clock.
+//
+//******************************************************************************
+BOOL PollDue( POLL_TYPES poll )
+{
+    return pollSched.bActive[poll]
+           &&
+           ( (long)( pollSched.dwClock - pollSched.dwDueAt[poll] ) >= 0 );
+}
+
+
+//******************************************************************************
+//
+//  Function: PollSent
+//
+//  Arguments:
+//    IN  poll - POLL_TYPES poll that was just sent.
+//
+//  Returns: void.
+//
+//  Description: Counts the poll and schedules the next one. Any other poll
+//               due within a quarter of its interval is made due now, so
+//               that the polls run back to back in one busy period instead
+//               of each waking the modem on its own.
+//
+//******************************************************************************
+void PollSent( POLL_TYPES poll )
+{
+    POLL_TYPES other;
+
+    pollSched.dwPollsThisPeriod++;
+
+    SchedulePoll( poll, pollSched.dwInterval[poll] );
+
+    if( !modemConfigurables.bAdaptivePolling )
     {
-        modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_SUCCESS;
+        return;
+    }
+
+    for( other = 0; other < NBR_POLL_TYPES; other++ )
+    {
+        if( ( other != poll )
+            &&
+            pollSched.bActive[other]
+            &&
+            ( ( pollSched.dwDueAt[other] - pollSched.dwClock ) <=
+              ( pollSched.dwInterval[other] / POLL_COALESCE_DIVISOR ) ) )
+        {
+            pollSched.dwDueAt[other] = pollSched.dwClock;
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: AdaptPollRate
+//
+//  Arguments:
+//    IN  poll     - POLL_TYPES poll whose result just came in.
+//    IN  bChanged - TRUE if the polled state changed since the last result.
+//
+//  Returns: void.
+//
+//  Description: Halves the interval (down to half the base rate) when the
+//               polled state changes, and stretches it by half (up to
+//               POLL_MAX_MULTIPLIER times the base rate) while it is
+//               stable. The poll is rescheduled from now.
+//
+//******************************************************************************
+void AdaptPollRate( POLL_TYPES poll, BOOL bChanged )
+{
+    DWORD dwBase = DEFAULT_SBD_STATUS_DELAY;
+
+    if( poll == POLL_CSQ )
+    {
+        dwBase = modemConfigurables.dwCheckSigStrengthRate;
+    }
+
+    if( !modemConfigurables.bAdaptivePolling )
+    {
+        pollSched.dwInterval[poll] = dwBase;
+    }
+    else if( bChanged )
+    {
+        pollSched.dwInterval[poll] /= 2;
+
+        if( pollSched.dwInterval[poll] < dwBase / POLL_MIN_DIVISOR )
+        {
+            pollSched.dwInterval[poll] = dwBase / POLL_MIN_DIVISOR;
+        }
     }
     else
     {
-        modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_FAILED;
+        pollSched.dwInterval[poll] += pollSched.dwInterval[poll] / 2;
+
+        if( pollSched.dwInterval[poll] > dwBase * POLL_MAX_MULTIPLIER )
+        {
+            pollSched.dwInterval[poll] = dwBase * POLL_MAX_MULTIPLIER;
+        }
     }
 
-    HandleTimeouts( atCmdState );
+    if( pollSched.bActive[poll] )
+    {
+        SchedulePoll( poll, pollSched.dwInterval[poll] );
+    }
+}
 
-    //print( " -->" );
-    //output_int( modemOptions.ModemCmd );
-    //print( " " );
-    //output_int( modemOptions.ModemRsp[modemOptions.ModemCmd] );
 
-    switch( modemOptions.ModemCmd )
+//******************************************************************************
+//
+//  Function: TakeSBDLinkSample
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: An SBD session that reached the gateway, or failed for lack
+//               of network, says as much about the link as a CSQ would, so
+//               the CSQ poll is treated as answered. A session that reached
+//               the gateway also reported the MT queue, which makes the next
+//               gateway check redundant.
+//
+//******************************************************************************
+void TakeSBDLinkSample( void )
+{
+    SBD_LINK_SAMPLE sample = GetSBDLinkSample();
+    DWORD           dwPrevDue;
+
+    if( sample == SBD_LINK_NO_SAMPLE )
     {
-        case RXING_FILE:
+        return;
+    }
 
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = MODEM_IDLE;
+    NoteProfileLinkSample( sample );
+    RecordLinkMapSession( sample == SBD_LINK_UP, GetModemSignalStrength() );
 
-            switch( atCmdState )
-            {
-                case AT_CMD_TIMED_OUT:
-                    // At least notify the user what happened.
-                    RecordModemLogError( MODEMLOG_RECEIVE_FAILURE );
+    if( !modemConfigurables.bAdaptivePolling )
+    {
+        return;
+    }
 
-                    // Try reading the buffer again...
-                    if( ++modemFlags.byFileReceiveRetryCount < modemConfigurables.byMaxRetries )
-                    {
-                        // We have a message pending; 
-                        // download it from the modem buffer,
-                        if( SendReadBinaryFileCmd() )
-                        {
-                            // no longer in idle!
-                            ModemLog( NO_RPT, MODEMLOG_RECEIVE );
-                            SetModemStateBusy( RXING_FILE );
-                        }
+    // Let a CSQ failure retry run its course.
+    if( pollSched.bActive[POLL_CSQ] && ( modemFlags.byCSQDebounceCount == 0 ) )
+    {
+        dwPrevDue = pollSched.dwDueAt[POLL_CSQ];
 
-                        break;
-                    }
+        AdaptPollRate( POLL_CSQ, sample != pollSched.lastLinkSample );
 
-                    // else fall through..
+        if( (long)( pollSched.dwDueAt[POLL_CSQ] - dwPrevDue ) > 0 )
+        {
+            pollSched.dwPollsSkipped++;
+        }
+    }
 
-                default:
-                case AT_CMD_FAILED:
-                case AT_CMD_SUCCESS:
+    if( ( sample == SBD_LINK_UP ) && pollSched.bActive[POLL_GATEWAY] )
+    {
+        dwPrevDue = pollSched.dwDueAt[POLL_GATEWAY];
 
-                    // Wait for a bit before continuing.
-                    WaitForIncommingCalls();
-                    modemFlags.byFileReceiveRetryCount = 0;
+        SchedulePoll( POLL_GATEWAY, pollSched.dwInterval[POLL_GATEWAY] );
 
-                    break;
-            }
+        if( (long)( pollSched.dwDueAt[POLL_GATEWAY] - dwPrevDue ) > 0 )
+        {
+            pollSched.dwPollsSkipped++;
+        }
+    }
 
-            break;
+    pollSched.lastLinkSample = sample;
+}
 
-        case TXING_FILE:
 
-            switch( atCmdState )
-            {
-                case AT_CMD_SUCCESS:
-                    // Reset retry count on success.
-                    modemFlags.byFileSendRetryCount = 0;
-                    modemOptions.ModemCmd = NO_CMD;
+//******************************************************************************
+//
+//  Function: NoteProfileCSQ
+//
+//  Arguments:
+//    IN  iSignal - Signal strength (0-5, -1 on failure).
+//
+//  Returns: void.
+//
+//  Description: Adds a CSQ sample to the flight phase conditions.
+//
+//******************************************************************************
+void NoteProfileCSQ( short iSignal )
+{
+    BYTE byIndex;
 
-                    // Ensure the file being deleted is logged
-                    ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_SUCCESSFUL );
+    for( byIndex = PHASE_CSQ_SAMPLES - 1; byIndex > 0; byIndex-- )
+    {
+        modemProfiles.iCSQ[byIndex] = modemProfiles.iCSQ[byIndex - 1];
+    }
 
-                    if( modemConfigurables.szKeepFileList[0] == DELETE_ALL_FILES )
-                    {
-                        if( !deleteFile( modemOptions.szPathFileBeingSent ) )
-                        {
-                            // Report if file cannot be deleted.
-                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DELETE_FAILURE );
-                            MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
-                        }
-                    }
-                    else
-                    {
-                        szFileName[0] = NULL;
-                        bKeepFile = FALSE;
-                        cPriorityFlag = ExtractFileNameFromPath( modemOptions.szPathFileBeingSent, szFileName )[0];
+    modemProfiles.iCSQ[0] = ( iSignal < 0 ) ? 0 : iSignal;
 
-                        for( byIndex = 0; byIndex < MAX_PRIORITY_FLAGS; byIndex++ )
-                        {
-                            // Look at the "keep" list
-                            if( modemConfigurables.szKeepFileList[byIndex] == NULL )
-                            {
-                                break;
-                            }
-                            else if( modemConfigurables.szKeepFileList[byIndex] == cPriorityFlag )
-                            {
-                                bKeepFile = TRUE;
-                                break;
-                            }
-                        }
+    if( modemProfiles.byNbrCSQ < PHASE_CSQ_SAMPLES )
+    {
+        modemProfiles.byNbrCSQ++;
+    }
 
-                        if( bKeepFile || ( modemConfigurables.szKeepFileList[0] == KEEP_ALL_FILES ) )
-                        {
-                            if( !MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
-                            {
-                                ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
-
-                                if( deleteFile( modemOptions.szPathFileBeingSent ) )
-                                {
-                                    // Ensure the file being deleted is logged
-                                    StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-                                    StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
-                                    SystemLog( szErrString );
-                                }
-                                else
-                                {
-                                    // Report if file cannot be deleted.
-                                    StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-                                    StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
-                                    SystemLog( szErrString );
-                                }
-                            }
-                        }
-                        else if( !deleteFile( modemOptions.szPathFileBeingSent ) )
-                        {
-                            // Report if file cannot be deleted.
-                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_DELETE_FAILURE );
-                            MarkFileAsSent( MODEM_DIR, modemOptions.szPathFileBeingSent );
-                        }
-                    }
+    EvaluateModemPhase();
+}
 
-                    if( InVoiceCall() ) // true (high) if phone is off hook
-                    {
-                        // Function call changes modemState and ModemCmd
-                        modemOptions.modemState = MODEM_IDLE;
-                        HangupCall();
-                        break;
-                    }
 
-                    // Only wait if there is nothing in the MT buffer
-                    if( !GetMailboxStatus() )
-                    {
-                        // Wait for a bit before continuing.
-                        WaitForIncommingCalls();
-                        modemOptions.modemState = MODEM_IDLE;
-                    }
+//******************************************************************************
+//
+//  Function: NoteProfileLinkSample
+//
+//  Arguments:
+//    IN  sample - SBD_LINK_SAMPLE of the last SBD session.
+//
+//  Returns: void.
+//
+//  Description: Counts the sessions that failed for lack of a link in a row.
+//
+//******************************************************************************
+void NoteProfileLinkSample( SBD_LINK_SAMPLE sample )
+{
+    if( sample == SBD_LINK_DOWN )
+    {
+        if( modemProfiles.byLinkDownStreak < 0xFF )
+        {
+            modemProfiles.byLinkDownStreak++;
+        }
 
-                    break;
+        modemProfiles.bLinkUp       = FALSE;
+        modemProfiles.byDeliveryRun = 0;
+    }
+    else
+    {
+        modemProfiles.byLinkDownStreak = 0;
+        modemProfiles.bLinkUp          = TRUE;
+    }
 
-                case AT_CMD_TIMED_OUT:
-                case AT_CMD_FAILED:
-                default:
-                    // Increment the retry count on failure. Disable txingFile flag, as we 
-                    // don't know what will happen in between.
-                    modemOptions.modemState = MODEM_IDLE;
-                    modemOptions.ModemCmd   = NO_CMD;
+    EvaluateModemPhase();
+}
+
+
+//******************************************************************************
+//
+//  Function: NoteProfileDelivery
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Counts a delivered message against the active phase, and
+//               towards the run of back to back deliveries that shows the
+//               backlog is being drained over a stable link.
+//
+//******************************************************************************
+void NoteProfileDelivery( void )
+{
+    if( modemProfiles.bEnabled && ( modemProfiles.activePhase < NBR_MODEM_PHASES ) )
+    {
+        modemProfiles.dwMsgsInPhase[modemProfiles.activePhase]++;
+    }
+
+    if( modemProfiles.byDeliveryRun < 0xFF )
+    {
+        modemProfiles.byDeliveryRun++;
+    }
 
-                    if( ++modemFlags.byFileSendRetryCount < modemConfigurables.byMaxRetries )
-                    {
-                        // Setup delay timer. 
-                        StartTimer( thCheckRetryDelay, modemConfigurables.dwRetryDelay );
-                    }
-                    else
-                    {
-                        // Reset retry count for next file to be sent and go into wait.
-                        modemFlags.byFileSendRetryCount = 0;
-                        WaitForIncommingCalls();
-                        
-                        if( MarkFileAsError( MODEM_DIR, modemOptions.szPathFileBeingSent ) )
-                        {
-                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_FAILURE );
-                        }
-                        else
-                        {
-                            ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_MOVE_FAILURE );
+    modemProfiles.dwSecsIdle = 0;
 
-                            if( deleteFile( modemOptions.szPathFileBeingSent ) )
-                            {
-                                // Ensure the file being deleted is logged
-                                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-                                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_DELETED ), MAX_SYSTEM_LOG_STR );
-                                SystemLog( szErrString );
-                            }
-                            else
-                            {
-                                // Report if file cannot be deleted.
-                                StringCpy( szErrString, modemOptions.szPathFileBeingSent );
-                                StringNCat( szErrString, GetSysLogMsg( SYS_LOG_FILE_CANNOT_BE_DELETED ), MAX_SYSTEM_LOG_STR );
-                                SystemLog( szErrString );
-                            }
-                        }
-                    }
+    EvaluateModemPhase();
+}
 
-                    break;
-            }
 
-            break;
+//******************************************************************************
+//
+//  Function: EvaluateModemPhase
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Works out the profile that should be in effect; it is only
+//               applied at the next safe point (see ApplyModemProfile).
+//
+//               Without an external phase, the phase is inferred from the
+//               link: a swinging CSQ means climb (or descent), and a
+//               sustained good CSQ or a run of deliveries after it means
+//               cruise. A steady link alone never leaves ground, so an
+//               aircraft parked in good coverage stays there. Climb or
+//               cruise go back to ground once nothing has been delivered
+//               for PHASE_IDLE_SECS; the link cannot tell a landing apart
+//               any sooner. The current phase is kept otherwise.
+//
+//               A sustained zero CSQ or a streak of sessions with no link
+//               means no coverage, whatever the phase; it is only left once
+//               the link is seen again.
+//
+//******************************************************************************
+void EvaluateModemPhase( void )
+{
+    MODEM_PHASES phase = modemProfiles.externalPhase;
+    short        iMin  = 5;
+    short        iMax  = 0;
+    BOOL         bFull = ( modemProfiles.byNbrCSQ == PHASE_CSQ_SAMPLES );
+    BOOL         bNoCoverage;
+    BYTE         byIndex;
+
+    if( !modemProfiles.bEnabled )
+    {
+        return;
+    }
 
-        case TXING_BUFFER:
-        case TXING_TEXT:
+    for( byIndex = 0; byIndex < modemProfiles.byNbrCSQ; byIndex++ )
+    {
+        if( modemProfiles.iCSQ[byIndex] < iMin )
+        {
+            iMin = modemProfiles.iCSQ[byIndex];
+        }
 
-            modemOptions.ModemCmd = NO_CMD;
+        if( modemProfiles.iCSQ[byIndex] > iMax )
+        {
+            iMax = modemProfiles.iCSQ[byIndex];
+        }
+    }
 
-            if( atCmdState == AT_CMD_SUCCESS )
-            {
-                if( InVoiceCall() ) // true (high) if phone is off hook
-                {
-                    // Function call changes modemState and ModemCmd
-                    modemOptions.modemState = MODEM_IDLE;
-                    HangupCall();
-                    break;
-                }
-            }
+    if( phase == MODEM_PHASE_AUTO )
+    {
+        phase = modemProfiles.activePhase;
 
-            // Only wait if there is nothing in the MT buffer
-            if( !GetMailboxStatus() )
-            {
-                // Wait for a bit before continuing.
-                WaitForIncommingCalls();
-                modemOptions.modemState = MODEM_IDLE;
-            }
-            
-            break;
+        if( bFull && ( ( iMax - iMin ) >= PHASE_SWING_CSQ ) )
+        {
+            phase = MODEM_PHASE_CLIMB;
+        }
+        else if( ( ( phase == MODEM_PHASE_CLIMB ) || ( phase == MODEM_PHASE_CRUISE ) )
+                 &&
+                 ( modemProfiles.dwSecsIdle >= PHASE_IDLE_SECS ) )
+        {
+            phase = MODEM_PHASE_GROUND;
+        }
+        else if( ( phase == MODEM_PHASE_CLIMB )
+                 &&
+                 ( ( bFull && ( iMin >= PHASE_GOOD_CSQ ) && ( ( iMax - iMin ) <= 1 ) )
+                   ||
+                   ( modemProfiles.byDeliveryRun >= PHASE_DELIVERY_RUN ) ) )
+        {
+            phase = MODEM_PHASE_CRUISE;
+        }
+        else if( ( phase == MODEM_PHASE_AUTO ) || ( phase == MODEM_PHASE_NO_COVERAGE ) )
+        {
+            phase = MODEM_PHASE_GROUND;
+        }
+    }
 
-        case CALL_STATUS:
+    bNoCoverage = ( modemProfiles.byLinkDownStreak >= PHASE_FAIL_STREAK )
+                  ||
+                  ( bFull && ( iMax <= PHASE_NO_SIGNAL_CSQ ) );
 
-            switch( atCmdState )
-            {
-                case AT_CMD_SUCCESS:
-                case AT_CMD_TIMED_OUT:
-                default:
+    if( !bNoCoverage && ( modemProfiles.activePhase == MODEM_PHASE_NO_COVERAGE ) )
+    {
+        // Hysteresis - stay until the link is actually back.
+        bNoCoverage = !modemProfiles.bLinkUp
+                      &&
+                      ( ( modemProfiles.byNbrCSQ == 0 ) || ( modemProfiles.iCSQ[0] < PHASE_RECOVER_CSQ ) );
+    }
 
-                    // Reset retry count on success.
-                    modemOptions.ModemCmd   = NO_CMD;
-                    modemOptions.modemState = MODEM_IDLE;
+    modemProfiles.pendingPhase = bNoCoverage ? MODEM_PHASE_NO_COVERAGE : phase;
+}
 
-                    // Let the phone call complete
-                    WaitForIncommingCalls();
 
-                    break;
-            }
+//******************************************************************************
+//
+//  Function: ApplyModemProfile
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Switches all the scheduling parameters to the pending
+//               profile in one go. Must only be called from the idle state
+//               with no command outstanding; a file being retried keeps the
+//               parameters it started with until it is done.
+//
+//******************************************************************************
+void ApplyModemProfile( void )
+{
+    static const char* const TEXT_MODEM_PHASE[NBR_MODEM_PHASES] =
+    {
+        " phase: ground",
+        " phase: climb",
+        " phase: cruise",
+        " phase: no coverage"
+    };
 
-            break;
+    MODEM_PROFILE* pProfile;
 
-        case MAILBOX_CHECK:
+    if( !modemProfiles.bEnabled
+        ||
+        ( modemProfiles.pendingPhase == modemProfiles.activePhase )
+        ||
+        ( modemFlags.byFileSendRetryCount != 0 ) )
+    {
+        return;
+    }
 
-            modemOptions.ModemCmd = NO_CMD;
+    pProfile = &modemProfiles.profile[modemProfiles.pendingPhase];
 
-            if( atCmdState == AT_CMD_SUCCESS )
-            {
-                // No need to reset timer, its done in the state machine.
-                RecordModemLogError( MODEMLOG_MAILBOXCHECK_SUCCESS );
-            }
-            else
-            {
-                // No need to reset timer, its done in the state machine.
-                RecordModemLogError( MODEMLOG_MAILBOXCHECK_FAILURE );
-            }
+    modemConfigurables.byMaxRetries           = pProfile->byMaxRetries;
+    modemConfigurables.dwRetryDelay           = pProfile->dwRetryDelay;
+    modemConfigurables.dwCheckSigStrengthRate = pProfile->dwCheckSigStrengthRate;
+    modemConfigurables.dwWaitForCalls         = pProfile->dwWaitForCalls;
+    modemConfigurables.dwTimeoutDelay         = pProfile->dwTimeoutDelay;
 
-            // Only wait if there is nothing in the MT buffer
-            if( !GetMailboxStatus() )
-            {
-                // Wait for a bit before continuing.
-                WaitForIncommingCalls();
-                modemOptions.modemState = MODEM_IDLE;
-            }
+    // The CSQ poll starts over from the new base rate.
+    pollSched.dwInterval[POLL_CSQ] = pProfile->dwCheckSigStrengthRate;
 
-            break;
+    if( pollSched.bActive[POLL_CSQ]
+        &&
+        ( (long)( pollSched.dwDueAt[POLL_CSQ] - pollSched.dwClock ) > (long)pProfile->dwCheckSigStrengthRate ) )
+    {
+        SchedulePoll( POLL_CSQ, pProfile->dwCheckSigStrengthRate );
+    }
 
-        case GATEWAY_CHECK:
+    modemProfiles.activePhase = modemProfiles.pendingPhase;
+    modemProfiles.dwTransitions++;
 
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = MODEM_IDLE;
+    print( TEXT_MODEM_PHASE[modemProfiles.activePhase] );
+}
 
-            if( atCmdState == AT_CMD_SUCCESS )
-            {
-                // Do a manual mailbox check - msgs are queueued or waiting at the gateway
-                // We know the modem is idle, the command will go through
-                if( CheckMailbox() )
-                {
-                    SetModemStateBusy( MAILBOX_CHECK );
-                }
-            }
 
-            break;
+//******************************************************************************
+//
+//  Function: HashReportFile
+//
+//  Arguments:
+//    IN  szPathFilename - Report file to hash.
+//    OUT pFingerprint   - FNV-1a hash and Fletcher-16 sum of the file
+//                         contents, its length and its leading bytes.
+//    OUT pwRptType      - Report type from the header (0 if not found).
+//
+//  Returns: TRUE if the file was hashed.
+//           FALSE if it could not be read, or is too big for one SBD
+//                 message (bulk files are not deduplicated).
+//
+//  Description: Hashes the file a chunk at a time; the SBD message buffer
+//               belongs to the AT layer and may not be used here.
+//
+//******************************************************************************
+BOOL HashReportFile( const char* szPathFilename, REPORT_FINGERPRINT* pFingerprint, WORD* pwRptType )
+{
+    PCFD  fd;
+    DWORD dwLength;
+    DWORD dwRptType;
+    DWORD dwHash = DEDUP_HASH_SEED;
+    WORD  wSum1  = 0;
+    WORD  wSum2  = 0;
+    WORD  wRead;
+    WORD  wChunk;
+    WORD  wIndex;
+
+    dwLength = FileLength( (char*)szPathFilename );
+
+    if( ( dwLength == 0 ) || ( dwLength > MODEM_MO_BUF_LEN ) )
+    {
+        return FALSE;
+    }
 
-        case GETTING_CSQ:
+    fd = fileOpen( (char*)szPathFilename, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
 
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = MODEM_IDLE;
+    if( fd == -1 )
+    {
+        return FALSE;
+    }
 
-            if( atCmdState == AT_CMD_SUCCESS )
-            {
-                modemFlags.byCSQDebounceCount = 0;
-            }
-            else
-            {
-                if( ++modemFlags.byCSQDebounceCount < modemConfigurables.byCSQMaxDebounceRetries )
-                {
-                    // On failure, keep trying to get a decent signal strength.
-                    ResetTimer( thCheckCSQ, modemConfigurables.dwCSQDebounceDelay );
-                }
-                else
-                {
-                    // Ok, it's definately a failure, report it.
-                    modemFlags.byCSQDebounceCount = 0;
-                    ClearModemSignalStrength();
-            
-                    RecordModemLogError( MODEMLOG_SIGNALSTRENGTH_FAILURE );
-                    ReportSystemLogError( SYS_LOG_IRIDIUM_ERROR );
-                }
-            }
+    *pwRptType = 0;
+    MemSet( pFingerprint->byHead, 0, DEDUP_HEAD_BYTES );
 
-            break;
+    for( wRead = 0; wRead < (WORD)dwLength; wRead += wChunk )
+    {
+        wChunk = (WORD)dwLength - wRead;
 
-        case CALL_HANGUP:
+        if( wChunk > DEDUP_READ_CHUNK )
+        {
+            wChunk = DEDUP_READ_CHUNK;
+        }
 
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = MODEM_IDLE;
+        if( fileRead( fd, byDedupChunk, wChunk ) != wChunk )
+        {
+            fileClose( fd );
+            return FALSE;
+        }
 
-            // Wait for a bit before continuing.
-            WaitForIncommingCalls();
+        if( wRead == 0 )
+        {
+            MemCpy( pFingerprint->byHead, byDedupChunk,
+                    ( wChunk < DEDUP_HEAD_BYTES ) ? wChunk : DEDUP_HEAD_BYTES );
 
-            if( atCmdState == AT_CMD_SUCCESS )
-            {
-                RecordModemLogError( MODEMLOG_HUNG_UP_CALL_SUCCESS );
-            }
-            else
+            if( GetReportHdrField( byDedupChunk, wChunk, RPT_HDR_FIELD_TYPE, &dwRptType ) )
             {
-                RecordModemLogError( MODEMLOG_HUNG_UP_CALL_FAILURE );
+                *pwRptType = (WORD)dwRptType;
             }
-        
-            break;
+        }
 
-            // These set of CIS commands are handled in a special way.
-            // First we retry commands if they've failed, and 
-            // secondly since they can be deployed from outside of idle,
-            // we need to know from where to return.
-        case RINGER_ON :
-        case RINGER_OFF:
-        case RELAY1_ON :
-        case RELAY1_OFF:
-        case RELAY2_ON :
-        case RELAY2_OFF:
-        case RINGER_STATUS:
-        case RELAY1_STATUS:
-        case RELAY2_STATUS:
-        case RESET_CIS:
+        for( wIndex = 0; wIndex < wChunk; wIndex++ )
+        {
+            dwHash = ( dwHash ^ byDedupChunk[wIndex] ) * DEDUP_HASH_PRIME;
+            wSum1  = ( wSum1 + byDedupChunk[wIndex] ) % DEDUP_CHECK_MOD;
+            wSum2  = ( wSum2 + wSum1 ) % DEDUP_CHECK_MOD;
+        }
+    }
 
-            if( atCmdState != AT_CMD_SUCCESS )
-            {
-                // Fall through means we have to resend the message.
-                AddNewDataToQueue( modemOptions.ModemCmd );  // Save data
-            }
+    fileClose( fd );
 
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = modemOptions.prevModemState;
+    pFingerprint->dwHash  = dwHash;
+    pFingerprint->wCheck  = ( wSum2 << 8 ) | wSum1;
+    pFingerprint->wLength = (WORD)dwLength;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: RetireDuplicateReport
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the file being sent was retired as a duplicate.
+//           FALSE if it must be sent.
+//
+//  Description: Called once per file, before its first attempt. A file
+//               matching (see SameReport) a report delivered within the
+//               dedup max age is retired as if it had been sent (see
+//               RetireSentFile), unless its report type has opted out.
+//               Otherwise its fingerprint is kept until it is delivered.
+//               Ages are taken from the poll scheduler clock.
+//
+//               The outbox is served a file at a time, so a copy is not
+//               picked while the first is being retried; it is retired once
+//               the first is delivered. A file held back for coverage has
+//               left the outbox undelivered though, so a copy queued behind
+//               it is retired here as well, the held file carrying the
+//               report.
+//
+//******************************************************************************
+BOOL RetireDuplicateReport( void )
+{
+    WORD wRptType;
+    BYTE byIndex;
+    BOOL bDuplicate = FALSE;
 
-            if( modemOptions.modemState != MODEM_IDLE )
-            {
-                SetATCmdStateInit();
-            }
+    reportDedup.bPending = FALSE;
 
-            break;
+    if( !reportDedup.bEnabled
+        ||
+        !HashReportFile( modemOptions.szPathFileBeingSent, &reportDedup.pending, &wRptType ) )
+    {
+        return FALSE;
+    }
 
-        case UPLOAD_CIS_CONFIG:
+    for( byIndex = 0; byIndex < reportDedup.byNbrOptOuts; byIndex++ )
+    {
+        if( reportDedup.wOptOut[byIndex] == wRptType )
+        {
+            return FALSE;
+        }
+    }
 
-            // Regardless, continue.
-            print( " done!" );
-            modemOptions.bCISActionComplete = TRUE;
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = modemOptions.prevModemState;
+    for( byIndex = 0; !bDuplicate && ( byIndex < reportDedup.byNbrHashes ); byIndex++ )
+    {
+        bDuplicate = SameReport( &reportDedup.recent[byIndex], &reportDedup.pending )
+                     &&
+                     ( pollSched.dwClock - reportDedup.dwDelivered[byIndex] <= reportDedup.dwMaxAge );
+    }
 
-            if( modemOptions.modemState != MODEM_IDLE )
-            {
-                SetATCmdStateInit();
-            }
+    for( byIndex = 0; !bDuplicate && ( byIndex < coverageHeld.byNbrFiles ); byIndex++ )
+    {
+        bDuplicate = SameReport( &reportDedup.held[byIndex], &reportDedup.pending );
+    }
 
-            break;
+    if( !bDuplicate )
+    {
+        reportDedup.bPending = TRUE;
+        return FALSE;
+    }
 
-        case CONFIGURE_CIS:
+    reportDedup.dwSessionsSaved++;
 
-            if( atCmdState != AT_CMD_SUCCESS )
-            {
-                // On failure, we have to:
-                // 1. Write bogus data to the CIS area of the EEPROM (to allow for recovery)
-                // 2. Reset the CIS.
-                // CANNOT REPORT ERROR AS THIS IS RUNNING FROM INTERRUPT!
-                ReportSystemLogError( SYS_LOG_REMOTE_CONFIG_FAILED_CISCFG );
-                print( " failed programming CIS!" );
-                WriteConfigEepromByte( CIS_PRIMARY_EXT, INVALID_EXTENSION );
-                WriteConfigEepromByte( CIS_SECONDARY_EXT, INVALID_EXTENSION );
-            }
-#if (DEBUG)
-            else
-            {
-                print( " succeeded programming CIS!" );
-            }
-#endif
+    ModemLog( modemOptions.szPathFileBeingSent, MODEMLOG_SEND_DUPLICATE );
+    RetireSentFile();
 
-            modemOptions.bCISActionComplete = TRUE;
-            modemOptions.ModemCmd = NO_CMD;
-            modemOptions.modemState = modemOptions.prevModemState;
+    return TRUE;
+}
 
-            if( modemOptions.modemState != MODEM_IDLE )
-            {
-                SetATCmdStateInit();
-            }
 
-            // We have to:
-            // 1. Reset the CIS.
-            // 2. Restore the states of the ringer and relays
-            PowerCycleCIS();
+//******************************************************************************
+//
+//  Function: SameReport
+//
+//  Arguments:
+//    IN  pFirst  - Fingerprint of one report.
+//    IN  pSecond - Fingerprint of the other.
+//
+//  Returns: TRUE if both hashes, the lengths and the leading bytes match.
+//           FALSE otherwise, or if either file could not be read.
+//
+//  Description: Compares two report fingerprints.
+//
+//******************************************************************************
+BOOL SameReport( const REPORT_FINGERPRINT* pFirst, const REPORT_FINGERPRINT* pSecond )
+{
+    BYTE byIndex;
 
-            break;
+    if( ( pFirst->wLength == 0 )
+        ||
+        ( pFirst->wLength != pSecond->wLength )
+        ||
+        ( pFirst->dwHash != pSecond->dwHash )
+        ||
+        ( pFirst->wCheck != pSecond->wCheck ) )
+    {
+        return FALSE;
+    }
 
-        default:
-            break;
+    for( byIndex = 0; byIndex < DEDUP_HEAD_BYTES; byIndex++ )
+    {
+        if( pFirst->byHead[byIndex] != pSecond->byHead[byIndex] )
+        {
+            return FALSE;
+        }
     }
+
+    return TRUE;
 }
 
 
 //******************************************************************************
 //
-//  Function: WaitForIncommingCalls
+//  Function: RememberDeliveredReport
 //
 //  Arguments: void.
 //
 //  Returns: void.
 //
-//  Description: Provides a wait state for the state machine to allow
-//               incomming calls.
+//  Description: Adds the fingerprint of the file just delivered to the
+//               table of recent reports, replacing the oldest once it is
+//               full.
 //
 //******************************************************************************
-void WaitForIncommingCalls( void )
+void RememberDeliveredReport( void )
 {
-    // Only reenable sending (after a delay), if it already is enabled.
-    if( modemOptions.bSendingEnabled )
+    if( !reportDedup.bPending )
     {
-        modemOptions.bSendingEnabled = FALSE;
-        StartTimer( thWaitForCalls, modemConfigurables.dwWaitForCalls );
+        return;
+    }
+
+    reportDedup.bPending = FALSE;
+
+    MemCpy( &reportDedup.recent[reportDedup.byNextHash], &reportDedup.pending, sizeof( REPORT_FINGERPRINT ) );
+    reportDedup.dwDelivered[reportDedup.byNextHash] = pollSched.dwClock;
+
+    if( ++reportDedup.byNextHash >= DEDUP_TABLE_SIZE )
+    {
+        reportDedup.byNextHash = 0;
+    }
+
+    if( reportDedup.byNbrHashes < DEDUP_TABLE_SIZE )
+    {
+        reportDedup.byNbrHashes++;
     }
 }
 
 
 //******************************************************************************
 //
-//  Function: AddNewDataToQueue
+//  Function: DeferForCoverage
 //
 //  Arguments:
-//    IN Modemcommand - Command to queue up.
+//    IN  szPathFilename - Outbox file about to be sent.
 //
-//  Returns: void.
+//  Returns: TRUE if the file was held back.
+//           FALSE if it can be sent.
 //
-//  Description: Adds new command to queue, but only if it doesn't already 
-//               exist in queue.
+//  Description: Non-urgent files are held back while the aircraft is in a
+//               cell where sessions usually fail, for at most
+//               dwMaxCoverageDeferral; after that they go out anyway until
+//               the aircraft leaves the cell. Urgent files are those whose
+//               priority flag is in the urgent list.
+//
+//               A held back file is moved to the working directory, so it
+//               is looked at once and the files queued behind it are not
+//               held back too. Only MAX_COVERAGE_HELD_FILES are held back
+//               at a time; the others go out. The file is listed on the
+//               card before it leaves the outbox.
 //
 //******************************************************************************
-void AddNewDataToQueue( MODEM_COMMANDS Modemcommand )
+BOOL DeferForCoverage( const char* szPathFilename )
 {
+    static char szFileName[MAX_FILENAME_LEN];
+    static char szHeldPathFilename[EMAXPATH];
     BYTE byIndex;
+    char cPriorityFlag;
 
-//    print( " q'd cmd: " );
-//    output_int( Modemcommand );
+    ReleaseCoverageFiles();
 
-    for( byIndex = 0; byIndex < MDM_Q_LEN; byIndex++ )
+    if( !modemConfigurables.bCoverageScheduling || ( GetLinkMapQuality() != LINK_CELL_POOR ) )
     {
-        if( modemQBuff[byIndex] == Modemcommand )
+        return FALSE;
+    }
+
+    if( modemConfigurables.szUrgentFileList[0] == KEEP_ALL_FILES )
+    {
+        return FALSE;
+    }
+
+    szFileName[0] = NULL;
+    cPriorityFlag = ExtractFileNameFromPath( (char*)szPathFilename, szFileName )[0];
+
+    for( byIndex = 0; byIndex < MAX_PRIORITY_FLAGS; byIndex++ )
+    {
+        if( modemConfigurables.szUrgentFileList[byIndex] == NULL )
         {
-            return;
+            break;
+        }
+        else if( modemConfigurables.szUrgentFileList[byIndex] == cPriorityFlag )
+        {
+            return FALSE;
         }
     }
 
-    AddDataToQueue( &QueuedCISCmd, Modemcommand );  // Save data and clear response
-    modemOptions.ModemRsp[Modemcommand] = MR_WAITING;
+    if( !modemOptions.bCoverageDeferring )
+    {
+        modemOptions.bCoverageDeferring = TRUE;
+        StartTimer( thCoverageDefer, modemConfigurables.dwMaxCoverageDeferral );
+        print( " deferring - poor coverage" );
+    }
+
+    // Don't hold the reports for the whole of a long poor stretch.
+    if( TimerExpired( thCoverageDefer ) || ( coverageHeld.byNbrFiles >= MAX_COVERAGE_HELD_FILES ) )
+    {
+        return FALSE;
+    }
+
+    BuildPath( szHeldPathFilename, GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ), szFileName );
+
+    if( !FileCpy( (char*)szPathFilename, szHeldPathFilename ) )
+    {
+        return FALSE;
+    }
+
+    // Copies queued behind it are retired while it is held.
+    if( reportDedup.bPending )
+    {
+        MemCpy( &reportDedup.held[coverageHeld.byNbrFiles], &reportDedup.pending, sizeof( REPORT_FINGERPRINT ) );
+    }
+    else
+    {
+        MemSet( &reportDedup.held[coverageHeld.byNbrFiles], 0, sizeof( REPORT_FINGERPRINT ) );
+    }
+
+    StringCpy( coverageHeld.szFileName[coverageHeld.byNbrFiles++], szFileName );
+
+    if( !SaveCoverageFiles() || !deleteFile( (char*)szPathFilename ) )
+    {
+        coverageHeld.byNbrFiles--;
+        SaveCoverageFiles();
+        deleteFile( szHeldPathFilename );
+        return FALSE;
+    }
+
+    reportDedup.bPending = FALSE;
+    RecordLinkMapDeferral();
+
+    return TRUE;
 }
 
 
 //******************************************************************************
 //
-//  Function: SetModemStateBusy
+//  Function: ReleaseCoverageFiles
 //
-//  Arguments:
-//    IN  cmd     - Specifies the command that is making the statemachine busy.
+//  Arguments: void.
 //
-//  Returns: void.
+//  Returns: TRUE if held back files were put back in the outbox.
+//           FALSE otherwise.
 //
-//  Description: Sets all the correct variables when we go into busy state.
+//  Description: The deferral ends when the aircraft leaves the poor cell
+//               (or coverage scheduling is turned off); the held back files
+//               go back to the outbox then, or once the deferral has run
+//               out. Files held back before a reset go back on the first
+//               call.
 //
 //******************************************************************************
-void SetModemStateBusy( MODEM_COMMANDS cmd )
+BOOL ReleaseCoverageFiles( void )
 {
-    modemOptions.prevModemState   = modemOptions.modemState;
-    modemOptions.modemState       = MODEM_BUSY;
-    modemOptions.ModemCmd         = cmd;
-    modemOptions.ModemRsp[modemOptions.ModemCmd] = MR_WAITING;
+    static char szHeldPathFilename[EMAXPATH];
+    BYTE byIndex;
+    BYTE byNbrFiles;
+
+    if( !coverageHeld.bRestored )
+    {
+        RestoreCoverageFiles();
+    }
+
+    byNbrFiles = coverageHeld.byNbrFiles;
+
+    if( !modemConfigurables.bCoverageScheduling || ( GetLinkMapQuality() != LINK_CELL_POOR ) )
+    {
+        if( modemOptions.bCoverageDeferring )
+        {
+            modemOptions.bCoverageDeferring = FALSE;
+            StopTimer( thCoverageDefer );
+        }
+    }
+    else if( !TimerExpired( thCoverageDefer ) )
+    {
+        return FALSE;
+    }
+
+    for( byIndex = 0; byIndex < byNbrFiles; byIndex++ )
+    {
+        BuildPath( szHeldPathFilename, GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ), coverageHeld.szFileName[byIndex] );
+        QueueFileForSend( MODEM_DIR, szHeldPathFilename );
+    }
+
+    if( byNbrFiles != 0 )
+    {
+        coverageHeld.byNbrFiles = 0;
+        SaveCoverageFiles();
+    }
+
+    return byNbrFiles != 0;
 }
 
 
 //******************************************************************************
 //
-//  Function: HandleTimeouts
+//  Function: SaveCoverageFiles
 //
-//  Arguments:
-//    IN  ATCmdState - current middle-level state
+//  Arguments: void.
+//
+//  Returns: TRUE if the list was written.
+//           FALSE otherwise.
+//
+//  Description: Writes the names of the held back files, with their CRC, to
+//               COVERAGE_HELD_FILENAME in the modem directory.
+//
+//******************************************************************************
+BOOL SaveCoverageFiles( void )
+{
+    static char szHeldListPath[EMAXPATH];
+    PCFD fd;
+    WORD wSize = coverageHeld.byNbrFiles * MAX_FILENAME_LEN;
+    WORD wCRC  = CalcCRC( (BYTE*)coverageHeld.szFileName, wSize );
+    BOOL bWritten;
+
+    BuildPath( szHeldListPath, GetPCMCIAPath( MODEM_DIR, NO_SUBDIR ), COVERAGE_HELD_FILENAME );
+
+    fd = fileOpen( szHeldListPath, PO_CREAT|PO_TRUNC|PO_WRONLY|PO_BINARY, PS_IREAD|PS_IWRITE );
+
+    if( fd == -1 )
+    {
+        return FALSE;
+    }
+
+    bWritten = ( fileWrite( fd, (BYTE*)&wCRC, sizeof( wCRC ) ) == sizeof( wCRC ) )
+               &&
+               ( fileWrite( fd, &coverageHeld.byNbrFiles, 1 ) == 1 )
+               &&
+               ( fileWrite( fd, (BYTE*)coverageHeld.szFileName, wSize ) == wSize );
+
+    fileClose( fd );
+
+    return bWritten;
+}
+
+
+//******************************************************************************
+//
+//  Function: RestoreCoverageFiles
+//
+//  Arguments: void.
 //
 //  Returns: void.
 //
-//  Description: Ensures back-to-back timeouts are handled consistently.
+//  Description: Reads the list saved by SaveCoverageFiles() and puts the
+//               files on it back in the outbox; the deferral they were held
+//               for did not survive the reset. A missing or corrupt list is
+//               ignored.
 //
 //******************************************************************************
-void HandleTimeouts( AT_CMD_STATES ATCmdState )
+void RestoreCoverageFiles( void )
 {
-    if( ATCmdState == AT_CMD_TIMED_OUT )
+    static char szHeldPathFilename[EMAXPATH];
+    PCFD fd;
+    WORD wCRC;
+    WORD wSize;
+    BYTE byNbrFiles = 0;
+    BYTE byIndex;
+
+    coverageHeld.bRestored = TRUE;
+
+    BuildPath( szHeldPathFilename, GetPCMCIAPath( MODEM_DIR, NO_SUBDIR ), COVERAGE_HELD_FILENAME );
+
+    fd = fileOpen( szHeldPathFilename, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
+
+    if( fd == -1 )
     {
-        if( TimerExpired( thTimeout ) )
-        {
-            if( !InVoiceCall() )
-            {
-                SystemLog( "Modem communications error detected - power cycling CIS" );
+        return;
+    }
 
-                if( !PowerCycleCIS() )
-                {
-                    AddNewDataToQueue( RESET_CIS );  // Save data
-                }
-            }
+    if( ( fileRead( fd, (BYTE*)&wCRC, sizeof( wCRC ) ) == sizeof( wCRC ) )
+        &&
+        ( fileRead( fd, &byNbrFiles, 1 ) == 1 )
+        &&
+        ( byNbrFiles <= MAX_COVERAGE_HELD_FILES ) )
+    {
+        wSize = byNbrFiles * MAX_FILENAME_LEN;
 
-            ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+        if( ( fileRead( fd, (BYTE*)coverageHeld.szFileName, wSize ) != wSize )
+            ||
+            ( CalcCRC( (BYTE*)coverageHeld.szFileName, wSize ) != wCRC ) )
+        {
+            byNbrFiles = 0;
         }
     }
     else
     {
-        ResetTimer( thTimeout, modemConfigurables.dwTimeoutDelay );
+        byNbrFiles = 0;
+    }
+
+    fileClose( fd );
+
+    for( byIndex = 0; byIndex < byNbrFiles; byIndex++ )
+    {
+        BuildPath( szHeldPathFilename, GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ), coverageHeld.szFileName[byIndex] );
+        QueueFileForSend( MODEM_DIR, szHeldPathFilename );
+    }
+
+    if( byNbrFiles != 0 )
+    {
+        SaveCoverageFiles();
     }
 }
 
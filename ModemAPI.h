@@ -61,6 +61,33 @@ enum modem_states
     MODEM_BUSY,         // Modem is busy sending data (and waiting for response)
     NBR_MODEM_STATES
 } ;
+
+// Transceiver power states used by the energy model. Each state has its own
+// estimated current draw (see SetModemCurrentDraw()).
+typedef BYTE    MODEM_POWER_STATES;
+enum modem_power_states
+{
+    MODEM_PWR_OFF,          // Transceiver is not powered.
+    MODEM_PWR_SLEEP,        // DTR dropped, transceiver asleep between polls.
+    MODEM_PWR_IDLE,         // Awake and registered, no command outstanding.
+    MODEM_PWR_LOCAL_CMD,    // Local AT command (CSQ, SBDSX, CLCC, SBDRB...).
+    MODEM_PWR_SBD_SESSION,  // Satellite session (SBDIX) in progress.
+    MODEM_PWR_VOICE_CALL,   // Phone off hook.
+    NBR_MODEM_PWR_STATES
+} ;
+
+// Flight phases, each with its own set of scheduling parameters
+// (see SetModemProfile()).
+typedef BYTE    MODEM_PHASES;
+enum modem_phases
+{
+    MODEM_PHASE_GROUND,     // Ground and taxi.
+    MODEM_PHASE_CLIMB,      // Climb and descent, the link is changing.
+    MODEM_PHASE_CRUISE,     // Stable link.
+    MODEM_PHASE_NO_COVERAGE,// No network (e.g. polar routes).
+    NBR_MODEM_PHASES,
+    MODEM_PHASE_AUTO        // Phase inferred from the link.
+} ;
 /*artltyp-*/
 
 
@@ -286,6 +313,8 @@ void SetSignalStrengthPollRate( const DWORD dwPollRateInSeconds );
 //
 //  Description: Allows embedded rules to get the polling rate (in secs)
 //               to check the modem signal strength.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetSignalStrengthPollRate( void );
@@ -396,6 +425,8 @@ void SetMsgRetryCount( const BYTE byRetryCount );
 //
 //  Description: Allows embedded rules to get the Max retry count when a
 //               file fails to be sent by the modem.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 BYTE GetMsgRetryCount( void );
@@ -431,6 +462,8 @@ void SetMsgRetryDelay( const DWORD dwRetryDelayInSeconds );
 //
 //  Description: Allows embedded rules to get the delay (in secs)
 //               for messages resent.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetMsgRetryDelay( void );
@@ -468,6 +501,8 @@ void SetModemIncomingCallDelay( const DWORD dwCallDelayInSeconds );
 //  Description: Allows embedded rules to get the delay (in secs)
 //               to allow incoming calls. Use to check value previously
 //               set by rules or to check the default value.
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetModemIncomingCallDelay( void );
@@ -547,6 +582,8 @@ void SetModemTimeoutWait( const DWORD dwTimeoutDelayInSeconds );
 //  Description: Allows embedded rules to set the the amount
 //               of time (in seconds) to wait before resetting the CIS/modem 
 //               after discovering the modem communications is down or corrupt. 
+//               While the flight phase profiles are on, this is the value
+//               set by rules, not the one of the active profile.
 //
 //******************************************************************************
 DWORD GetModemTimeoutWait( void );
@@ -589,6 +626,7 @@ void KeepSentFiles( char* pcPriorityList );
 //               call the using control signal line (DSR).
 //               DOES NOT DETECT INCOMING CALLS - after detecting errors with 
 //               Iridium and CIS, RI check was removed.
+//               Always FALSE on a transceiver without voice (MODEM_HAS_VOICE).
 //
 //******************************************************************************
 BOOL InVoiceCall( void );
@@ -666,6 +704,21 @@ BOOL HangupCall( void );
 void EnteredTransparentModemMode( BOOL bMode );
 
 
+//******************************************************************************
+//
+//  Function: InTransparentModemMode
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the driver is in transparent mode.
+//           FALSE otherwise.
+//
+//  Description: Lets the transparent bridge know it owns the modem port.
+//
+//******************************************************************************
+BOOL InTransparentModemMode( void );
+
+
 //******************************************************************************
 //
 //  Function: ProcessModemStateMachine
@@ -681,6 +734,651 @@ void EnteredTransparentModemMode( BOOL bMode );
 //
 //******************************************************************************
 void ProcessModemStateMachine( void );
+
+
+//******************************************************************************
+//
+//  Function: SetModemSleepMode
+//
+//  Arguments:
+//    IN  bEnable - TRUE to let the driver sleep the modem (DTR low) when idle.
+//                  FALSE to keep the modem awake at all times.
+//                  DEFAULT: FALSE
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn the idle power mode on or off.
+//               While asleep, the modem is woken by a queued message, a ring
+//               alert or the sleep poll deadline. A message refused because
+//               the modem was asleep keeps it awake until the message is
+//               resubmitted, for up to 5 minutes. Turning sleep mode off
+//               wakes the modem immediately.
+//
+//******************************************************************************
+void SetModemSleepMode( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetModemSleepMode
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the idle power mode is enabled.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the idle power mode setting.
+//
+//******************************************************************************
+BOOL GetModemSleepMode( void );
+
+
+//******************************************************************************
+//
+//  Function: SetModemSleepPollRate
+//
+//  Arguments:
+//    IN  dwPollRateInSeconds - DWORD value indicating the maximum time the
+//                              modem is left asleep before the signal strength
+//                              and gateway polls are run (batched together).
+//                              Must be a value greater than zero! Previous value
+//                              maintained on a zero value.
+//                              DEFAULT: 150 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the sleep poll deadline (in secs).
+//
+//******************************************************************************
+void SetModemSleepPollRate( const DWORD dwPollRateInSeconds );
+
+
+//******************************************************************************
+//
+//  Function: GetModemSleepPollRate
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value indicating the sleep poll deadline in seconds.
+//
+//  Description: Allows embedded rules to get the sleep poll deadline (in secs).
+//
+//******************************************************************************
+DWORD GetModemSleepPollRate( void );
+
+
+//******************************************************************************
+//
+//  Function: SetModemCurrentDraw
+//
+//  Arguments:
+//    IN  pwrState   - MODEM_POWER_STATES enum to set the current draw for.
+//    IN  wMilliAmps - Estimated average current drawn in that state (in mA).
+//
+//  Returns: void.
+//
+//  Description: Allows the energy model to be tuned to the fitted transceiver.
+//
+//******************************************************************************
+void SetModemCurrentDraw( const MODEM_POWER_STATES pwrState, const WORD wMilliAmps );
+
+
+//******************************************************************************
+//
+//  Function: GetModemCurrentDraw
+//
+//  Arguments:
+//    IN  pwrState - MODEM_POWER_STATES enum to get the current draw for.
+//
+//  Returns: WORD value of the estimated current draw (in mA) for that state.
+//
+//  Description: Gets the energy model current draw for a power state.
+//
+//******************************************************************************
+WORD GetModemCurrentDraw( const MODEM_POWER_STATES pwrState );
+
+
+//******************************************************************************
+//
+//  Function: GetModemTimeInPowerState
+//
+//  Arguments:
+//    IN  pwrState - MODEM_POWER_STATES enum to get the accumulated time for.
+//
+//  Returns: DWORD value of the seconds spent in that state since power up
+//           (or since the last ClearModemEnergyStats()).
+//
+//  Description: Gets the time the modem spent in a given power state.
+//
+//******************************************************************************
+DWORD GetModemTimeInPowerState( const MODEM_POWER_STATES pwrState );
+
+
+//******************************************************************************
+//
+//  Function: GetModemEnergyPerMsg
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the estimated energy (in millijoules) spent per
+//           delivered message. 0 if no message has been delivered yet.
+//
+//  Description: Reports the total modem energy divided by the number of
+//               messages successfully delivered.
+//
+//******************************************************************************
+DWORD GetModemEnergyPerMsg( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemEnergyPerHour
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the estimated energy (in millijoules) spent per hour.
+//           0 if no time has been accounted yet.
+//
+//  Description: Reports the average modem energy consumption per hour.
+//
+//******************************************************************************
+DWORD GetModemEnergyPerHour( void );
+
+
+//******************************************************************************
+//
+//  Function: ClearModemEnergyStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the energy model accumulators and message count.
+//
+//******************************************************************************
+void ClearModemEnergyStats( void );
+
+//******************************************************************************
+//
+//  Function: SetTransparentSlicing
+//
+//  Arguments:
+//    IN  bEnable - TRUE to let the driver pause the transparent bridge at
+//                  command boundaries to run urgent SBD work.
+//                  FALSE to leave the port to the technician (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to enable time-sliced transparent mode.
+//
+//******************************************************************************
+void SetTransparentSlicing( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetTransparentSlicing
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if time-sliced transparent mode is enabled.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the transparent slicing mode.
+//
+//******************************************************************************
+BOOL GetTransparentSlicing( void );
+
+
+//******************************************************************************
+//
+//  Function: SetMaxTransparentPause
+//
+//  Arguments:
+//    IN  dwPauseInSeconds - DWORD value indicating the longest the bridge is
+//                           paused for. No new SBD work is started once it
+//                           has elapsed; an SBD session or data call in
+//                           progress is completed, anything else is dropped.
+//                           Previous value maintained on a zero value.
+//                           DEFAULT: 30 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the maximum pause (in secs).
+//
+//******************************************************************************
+void SetMaxTransparentPause( const DWORD dwPauseInSeconds );
+
+
+//******************************************************************************
+//
+//  Function: GetMaxTransparentPause
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value indicating the maximum pause in seconds.
+//
+//  Description: Allows embedded rules to get the maximum pause (in secs).
+//
+//******************************************************************************
+DWORD GetMaxTransparentPause( void );
+
+
+//******************************************************************************
+//
+//  Function: IsTransparentBridgePaused
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the driver owns the modem port for an SBD slice.
+//           FALSE otherwise.
+//
+//  Description: While TRUE, the transparent bridge must hold the technician's
+//               bytes and must not read from the modem port.
+//
+//******************************************************************************
+BOOL IsTransparentBridgePaused( void );
+
+
+//******************************************************************************
+//
+//  Function: NoteTransparentTraffic
+//
+//  Arguments:
+//    IN  pbyData  - Bytes that went across the transparent bridge.
+//    IN  wLength  - Number of bytes in pbyData.
+//    IN  bToModem - TRUE if the bytes went to the modem.
+//                   FALSE if they came from the modem.
+//
+//  Returns: void.
+//
+//  Description: The transparent bridge (ModemBridge) reports its traffic so
+//               the driver can tell when the technician is between commands.
+//
+//******************************************************************************
+void NoteTransparentTraffic( const BYTE* pbyData, const WORD wLength, const BOOL bToModem );
+
+
+//******************************************************************************
+//
+//  Function: GetTransparentPauseCount
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of times the bridge was paused.
+//
+//  Description: Time-sliced transparent mode statistics.
+//
+//******************************************************************************
+DWORD GetTransparentPauseCount( void );
+
+
+//******************************************************************************
+//
+//  Function: GetTransparentPauseOverruns
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of pauses that outlasted the maximum
+//           pause because an SBD session was still in progress.
+//
+//  Description: Time-sliced transparent mode statistics.
+//
+//******************************************************************************
+DWORD GetTransparentPauseOverruns( void );
+
+
+//******************************************************************************
+//
+//  Function: SetAdaptivePolling
+//
+//  Arguments:
+//    IN  bEnable - TRUE to adapt the status poll intervals (default).
+//                  FALSE to poll at the fixed base rates.
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn off the adaptive poll
+//               intervals, poll coalescing and the use of SBD sessions
+//               as link samples.
+//
+//******************************************************************************
+void SetAdaptivePolling( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetAdaptivePolling
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the status poll intervals adapt.
+//           FALSE if they are fixed.
+//
+//  Description: Allows embedded rules to get the polling mode.
+//
+//******************************************************************************
+BOOL GetAdaptivePolling( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPollsPerHour
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of +CSQF, +SBDSX and +CLCC polls sent
+//           in the last full hour (the polls so far during the first hour).
+//
+//  Description: Polling statistics.
+//
+//******************************************************************************
+DWORD GetModemPollsPerHour( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPollsSkipped
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the number of polls deferred because an SBD
+//           session had just sampled the link.
+//
+//  Description: Polling statistics.
+//
+//******************************************************************************
+DWORD GetModemPollsSkipped( void );
+
+//******************************************************************************
+//
+//  Function: SetModemProfiles
+//
+//  Arguments:
+//    IN  bEnable - TRUE to switch the scheduling parameters with the
+//                  flight phase.
+//                  FALSE to keep the values set by rules (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on the flight phase profiles.
+//               While they are on, the retry count and delay, signal
+//               strength poll rate, incoming call delay and timeout wait
+//               come from the profile of the active phase. The individual
+//               setters then change the values that are restored when the
+//               profiles are turned off.
+//
+//******************************************************************************
+void SetModemProfiles( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetModemProfiles
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the flight phase profiles are on.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the profile mode.
+//
+//******************************************************************************
+BOOL GetModemProfiles( void );
+
+
+//******************************************************************************
+//
+//  Function: SetModemProfile
+//
+//  Arguments:
+//    IN  phase                   - MODEM_PHASES profile to set.
+//    IN  byRetryCount            - See SetMsgRetryCount (0 keeps the previous value).
+//    IN  dwRetryDelay            - See SetMsgRetryDelay (in seconds).
+//    IN  dwPollRateInSeconds     - See SetSignalStrengthPollRate (0 keeps the previous value).
+//    IN  dwCallDelayInSeconds    - See SetModemIncomingCallDelay.
+//    IN  dwTimeoutDelayInSeconds - See SetModemTimeoutWait (0 keeps the previous value).
+//
+//  Returns: TRUE if the profile was set.
+//           FALSE if the phase is not valid.
+//
+//  Description: Allows embedded rules to tune a flight phase profile. A
+//               change to the active profile takes effect at the next safe
+//               point.
+//
+//******************************************************************************
+BOOL SetModemProfile( const MODEM_PHASES phase, const BYTE byRetryCount, const DWORD dwRetryDelay,
+                      const DWORD dwPollRateInSeconds, const DWORD dwCallDelayInSeconds,
+                      const DWORD dwTimeoutDelayInSeconds );
+
+
+//******************************************************************************
+//
+//  Function: SetModemFlightPhase
+//
+//  Arguments:
+//    IN  phase - MODEM_PHASES flight phase given by the aircraft, or
+//                MODEM_PHASE_AUTO to infer it from the link (default).
+//
+//  Returns: void.
+//
+//  Description: External phase signal (e.g. from weight on wheels and
+//               altitude). A sustained loss of coverage still overrides the
+//               given phase with the no coverage profile. Without it, the
+//               phase is inferred from the link: climb needs a swinging
+//               CSQ, cruise follows climb, and ground comes back after 30
+//               minutes with nothing delivered.
+//
+//******************************************************************************
+void SetModemFlightPhase( const MODEM_PHASES phase );
+
+
+//******************************************************************************
+//
+//  Function: GetModemFlightPhase
+//
+//  Arguments: void.
+//
+//  Returns: MODEM_PHASES of the profile in effect.
+//           MODEM_PHASE_AUTO if the profiles are off.
+//
+//  Description: Allows embedded rules to get the active profile.
+//
+//******************************************************************************
+MODEM_PHASES GetModemFlightPhase( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPhaseStats
+//
+//  Arguments:
+//    IN  phase    - MODEM_PHASES to report.
+//    OUT pdwSecs  - Seconds spent with the profile in effect.
+//    OUT pdwMsgs  - Messages delivered with the profile in effect.
+//
+//  Returns: TRUE if the phase is valid.
+//           FALSE otherwise.
+//
+//  Description: Throughput per flight phase, to compare the profiles with
+//               a single set of parameters. The default profiles are a
+//               starting point and have not been measured to deliver more;
+//               tune them from these counts on real flights.
+//
+//******************************************************************************
+BOOL GetModemPhaseStats( const MODEM_PHASES phase, DWORD* pdwSecs, DWORD* pdwMsgs );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPhaseTransitions
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of profile changes applied.
+//
+//  Description: Flight phase profile statistics.
+//
+//******************************************************************************
+DWORD GetModemPhaseTransitions( void );
+
+//******************************************************************************
+//
+//  Function: SetReportDedup
+//
+//  Arguments:
+//    IN  bEnable - TRUE to retire queued copies of reports delivered
+//                  recently.
+//                  FALSE to send every file (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on the deduplication of
+//               outbound reports. Turning it off forgets the recent reports.
+//
+//******************************************************************************
+void SetReportDedup( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetReportDedup
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if outbound reports are deduplicated.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the deduplication mode.
+//
+//******************************************************************************
+BOOL GetReportDedup( void );
+
+
+//******************************************************************************
+//
+//  Function: SetReportDedupOptOut
+//
+//  Arguments:
+//    IN  wRptType - Report type, as found in the report header.
+//    IN  bOptOut  - TRUE to always send reports of this type.
+//                   FALSE to deduplicate them again (default).
+//
+//  Returns: TRUE if the opt out list was updated.
+//           FALSE if the list is full (DEDUP_MAX_OPT_OUTS types).
+//
+//  Description: For reports whose repetition means something to the
+//               ground, e.g. a periodic status with no time stamp.
+//
+//******************************************************************************
+BOOL SetReportDedupOptOut( const WORD wRptType, const BOOL bOptOut );
+
+
+//******************************************************************************
+//
+//  Function: SetReportDedupMaxAge
+//
+//  Arguments:
+//    IN  dwMaxAgeInSeconds - Age past which a delivered report no longer
+//                            retires its copies. Previous value
+//                            maintained on a zero value.
+//                            DEFAULT: 1800 seconds
+//
+//  Returns: void.
+//
+//  Description: A report repeated later than this is sent again.
+//
+//******************************************************************************
+void SetReportDedupMaxAge( const DWORD dwMaxAgeInSeconds );
+
+
+//******************************************************************************
+//
+//  Function: GetReportDedupSessionsSaved
+//
+//  Arguments: void.
+//
+//  Returns: DWORD number of duplicate reports retired without a session.
+//
+//  Description: Report deduplication statistics.
+//
+//******************************************************************************
+DWORD GetReportDedupSessionsSaved( void );
+
+//******************************************************************************
+//
+//  Function: SetCoverageScheduling
+//
+//  Arguments:
+//    IN  bEnable - TRUE to schedule reports by the link map.
+//                  FALSE to send them as they are queued (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to turn on coverage aware scheduling.
+//               Non-urgent reports are held back in cells where sessions
+//               usually fail (see SetCoverageUrgentFiles), and the delay
+//               between reports is shortened in cells where they usually
+//               succeed. Needs the position from SetLinkMapPosition().
+//
+//******************************************************************************
+void SetCoverageScheduling( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetCoverageScheduling
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if reports are scheduled by the link map.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the coverage scheduling mode.
+//
+//******************************************************************************
+BOOL GetCoverageScheduling( void );
+
+
+//******************************************************************************
+//
+//  Function: SetCoverageUrgentFiles
+//
+//  Arguments:
+//    IN  pcPriorityList - Pointer to an array of characters, that list the
+//                         priority flags of files never held back.
+//
+//                  NOTE - NULL will let ALL files be held back.
+//                         ***DEFAULT SETTING***
+//                       - "*" (KEEP_ALL_FILES define ) will never hold
+//                         back a file.
+//                       - pcPriorityList must be MAX_PRIORITY_FLAGS in size
+//                         and be null terminated!
+//
+//  Returns: void.
+//
+//  Description: Held back files are moved out of the outbox, so the urgent
+//               files queued behind them still go out.
+//
+//******************************************************************************
+void SetCoverageUrgentFiles( char* pcPriorityList );
+
+
+//******************************************************************************
+//
+//  Function: SetMaxCoverageDeferral
+//
+//  Arguments:
+//    IN  dwDeferralInSeconds - Longest a report is held back in a poor
+//                              cell (default 15 minutes, 0 keeps the
+//                              previous value).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to bound the delay added to reports.
+//
+//******************************************************************************
+void SetMaxCoverageDeferral( const DWORD dwDeferralInSeconds );
 /*artlx-*/
 
 
@@ -0,0 +1,632 @@
+//******************************************************************************
+//
+//  ModemBridge.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module bridges the maintenance port and the modem port while
+//  the driver is in transparent mode. Data is moved as spans straight
+//  between the port queues, with flow control on both sides and
+//  latency and throughput counters.
+//
+//  Latency is tracked per byte: each batch of bytes entering the bridge
+//  is stamped with the bridge clock and the stamp is retired, byte for
+//  byte, as the bytes leave the queue (shifted out to the modem, or
+//  taken by the maintenance port).
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+    #include "artl.h"
+    #include "artlx.h"
+    #ifdef __BORLANDC__
+        #include "Stubfunctions.h"
+        #include "DebugOut.h"
+    #endif
+#else
+    #include "ModemAPI.h"
+    #include "ModemBridge.h"
+    #include "ModemSerial.h"
+    #include "timer.h"
+    #include "utils.h"
+#endif
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define BRIDGE_CLOCK_RES        10      // Latency resolution in ms
+#define BRIDGE_MARKS            16      // Outstanding latency stamps per direction
+#define BRIDGE_LATENCY_CAP      0x3FFFFFFFL // Largest ms * bytes added in one go
+
+// RTS hysteresis on the 4096 byte modem RX queue.
+#define BRIDGE_RTS_OFF_LEVEL    3072
+#define BRIDGE_RTS_ON_LEVEL     1024
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef struct
+{
+    DWORD dwSeq;                    // Stamp covers bytes up to this sequence
+    DWORD dwTime;                   // Bridge clock when they entered
+
+} BRIDGE_MARK;
+
+
+typedef struct
+{
+    BRIDGE_MARK marks[BRIDGE_MARKS];
+    BYTE  byTail;
+    BYTE  byCount;
+
+    DWORD dwSeqIn;                  // Bytes that entered this direction
+    DWORD dwSeqRetired;             // Bytes whose latency was accounted
+
+    DWORD dwLatencySum;             // ms * bytes
+    DWORD dwLatencyBytes;
+    WORD  wMaxLatency;
+
+} BRIDGE_DIRECTION;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static BRIDGE_DIRECTION     toModem;
+static BRIDGE_DIRECTION     fromModem;
+
+static DWORD                dwFromModemOut;
+static DWORD                dwBridgeClock;
+static DWORD                dwActiveMs;
+static BOOL                 bRTSHeld;
+
+static MODEM_BRIDGE_STATS   bridgeStats;
+
+static TIMERHANDLE          thBridgeClock;
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static BOOL  BridgeOpen( void );
+static void  AddLatencyMark( BRIDGE_DIRECTION* pDir, DWORD dwSeq );
+static void  RetireLatencyMarks( BRIDGE_DIRECTION* pDir, DWORD dwSeqDone );
+static void  UpdateFromModemMarks( void );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitModemBridge
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables and timers.
+//
+//******************************************************************************
+void InitModemBridge( void )
+{
+    MemSet( &toModem, 0, sizeof( BRIDGE_DIRECTION ) );
+    MemSet( &fromModem, 0, sizeof( BRIDGE_DIRECTION ) );
+    MemSet( &bridgeStats, 0, sizeof( MODEM_BRIDGE_STATS ) );
+
+    dwFromModemOut = 0;
+    dwBridgeClock  = 0;
+    dwActiveMs     = 0;
+    bRTSHeld       = FALSE;
+
+    thBridgeClock = RegisterTimer();
+    StartTimer( thBridgeClock, BRIDGE_CLOCK_RES );
+}
+
+
+//******************************************************************************
+//
+//  Function: ServiceModemBridge
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Must be called periodically. Runs the latency clock, the
+//               RTS flow control towards the modem and the counters.
+//
+//******************************************************************************
+void ServiceModemBridge( void )
+{
+    WORD wRxCount;
+    WORD wTxCount;
+
+    if( TimerExpired( thBridgeClock ) )
+    {
+        ResetTimer( thBridgeClock, BRIDGE_CLOCK_RES );
+        dwBridgeClock += BRIDGE_CLOCK_RES;
+
+        if( InTransparentModemMode() )
+        {
+            dwActiveMs += BRIDGE_CLOCK_RES;
+        }
+    }
+
+    if( !BridgeOpen() )
+    {
+        // The AT layer drains the queue itself.
+        if( bRTSHeld )
+        {
+            SetModemPortRTSHigh();
+            bRTSHeld = FALSE;
+        }
+
+        // Bytes the AT layer takes never cross the bridge.
+        fromModem.byCount      = 0;
+        fromModem.dwSeqIn      = dwFromModemOut;
+        fromModem.dwSeqRetired = dwFromModemOut;
+        return;
+    }
+
+    // Hold the modem off before its data has to be thrown away.
+    wRxCount = GetModemPortRxCount();
+
+    if( !bRTSHeld && ( wRxCount >= BRIDGE_RTS_OFF_LEVEL ) )
+    {
+        SetModemPortRTSLow();
+        bRTSHeld = TRUE;
+        bridgeStats.dwRTSHolds++;
+    }
+    else if( bRTSHeld && ( wRxCount <= BRIDGE_RTS_ON_LEVEL ) )
+    {
+        SetModemPortRTSHigh();
+        bRTSHeld = FALSE;
+    }
+
+    UpdateFromModemMarks();
+
+    // Whatever is no longer in the TX queue has been shifted out. Skip
+    // while AT layer bytes from an SBD slice are still queued ahead.
+    wTxCount = GetModemPortTxCount();
+
+    if( wTxCount <= toModem.dwSeqIn - toModem.dwSeqRetired )
+    {
+        RetireLatencyMarks( &toModem, toModem.dwSeqIn - wTxCount );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: BridgeMtceToModem
+//
+//  Arguments:
+//    IN  pbySpan - Bytes received on the maintenance port.
+//    IN  wLength - Number of bytes in pbySpan.
+//
+//  Returns: WORD number of bytes accepted. The rest must be kept by the
+//           caller (and the technician held off) and offered again.
+//
+//  Description: Copies the span straight into the modem TX queue. Nothing
+//               is accepted outside transparent mode, while the driver has
+//               paused the bridge, or while the modem drops CTS.
+//
+//******************************************************************************
+WORD BridgeMtceToModem( const BYTE* pbySpan, WORD wLength )
+{
+    WORD  wAccepted = 0;
+#ifndef __BORLANDC__
+    BYTE* pbyTxSpan;
+    WORD  wChunk;
+#endif
+
+    if( wLength == 0 )
+    {
+        return 0;
+    }
+
+    if( !BridgeOpen() || !ReadModemPortCTSLine() )
+    {
+        bridgeStats.dwToModemStalls++;
+        return 0;
+    }
+
+#ifdef __BORLANDC__
+    // The PC comm port driver queues the span itself.
+    ModemPortSendBuffer( (BYTE*)pbySpan, wLength );
+    wAccepted = wLength;
+#else
+    // At most two copies: up to the end of the queue, then from its start.
+    while( wAccepted < wLength )
+    {
+        wChunk = GetModemPortTxSpan( &pbyTxSpan );
+
+        if( wChunk == 0 )
+        {
+            bridgeStats.dwToModemStalls++;
+            break;
+        }
+
+        if( wChunk > wLength - wAccepted )
+        {
+            wChunk = wLength - wAccepted;
+        }
+
+        MemCpy( pbyTxSpan, &pbySpan[wAccepted], wChunk );
+        CommitModemPortTxSpan( wChunk );
+
+        wAccepted += wChunk;
+    }
+#endif
+
+    if( wAccepted != 0 )
+    {
+        toModem.dwSeqIn += wAccepted;
+        bridgeStats.dwBytesToModem += wAccepted;
+
+        AddLatencyMark( &toModem, toModem.dwSeqIn );
+        NoteTransparentTraffic( pbySpan, wAccepted, TRUE );
+    }
+
+    return wAccepted;
+}
+
+
+//******************************************************************************
+//
+//  Function: BridgeModemToMtce
+//
+//  Arguments:
+//    OUT pbyBuffer - Filled with bytes received from the modem.
+//    IN  wMaxBytes - Size of pbyBuffer.
+//
+//  Returns: WORD number of bytes placed in pbyBuffer.
+//
+//  Description: Copying form of GetBridgeModemSpan()/ReleaseBridgeModemSpan()
+//               for a maintenance port driver that needs its own buffer.
+//
+//******************************************************************************
+WORD BridgeModemToMtce( BYTE* pbyBuffer, WORD wMaxBytes )
+{
+    WORD  wTaken = 0;
+#ifndef __BORLANDC__
+    BYTE* pbySpan;
+    WORD  wChunk;
+#endif
+
+    if( !BridgeOpen() )
+    {
+        return 0;
+    }
+
+#ifdef __BORLANDC__
+    // The PC comm port driver owns the RX queue, so read straight into the
+    // caller's buffer. The bytes enter and leave the bridge together.
+    wTaken = ModemPortReceiveBuffer( pbyBuffer, wMaxBytes );
+
+    if( wTaken != 0 )
+    {
+        fromModem.dwSeqIn += wTaken;
+        AddLatencyMark( &fromModem, fromModem.dwSeqIn );
+        NoteTransparentTraffic( pbyBuffer, wTaken, FALSE );
+
+        dwFromModemOut += wTaken;
+        bridgeStats.dwBytesFromModem += wTaken;
+
+        RetireLatencyMarks( &fromModem, dwFromModemOut );
+    }
+#else
+    // At most two copies: up to the end of the queue, then from its start.
+    while( wTaken < wMaxBytes )
+    {
+        wChunk = GetBridgeModemSpan( &pbySpan );
+
+        if( wChunk == 0 )
+        {
+            break;
+        }
+
+        if( wChunk > wMaxBytes - wTaken )
+        {
+            wChunk = wMaxBytes - wTaken;
+        }
+
+        MemCpy( &pbyBuffer[wTaken], pbySpan, wChunk );
+        ReleaseBridgeModemSpan( wChunk );
+
+        wTaken += wChunk;
+    }
+#endif
+
+    return wTaken;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetBridgeModemSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the oldest byte received from the modem.
+//
+//  Returns: WORD number of contiguous bytes at *ppbySpan (0 if none, outside
+//           transparent mode or while the bridge is paused).
+//
+//  Description: Lets the maintenance port transmit straight out of the
+//               modem RX queue. The PC build has no queue to expose; use
+//               BridgeModemToMtce() there.
+//
+//******************************************************************************
+WORD GetBridgeModemSpan( BYTE** ppbySpan )
+{
+#ifdef __BORLANDC__
+    *ppbySpan = NULL;
+
+    return 0;
+#else
+    if( !BridgeOpen() )
+    {
+        return 0;
+    }
+
+    UpdateFromModemMarks();
+
+    return GetModemPortRxSpan( ppbySpan );
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: ReleaseBridgeModemSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes of the span the maintenance port took.
+//
+//  Returns: void.
+//
+//  Description: Frees the bytes taken from the span returned by
+//               GetBridgeModemSpan().
+//
+//******************************************************************************
+void ReleaseBridgeModemSpan( WORD wLength )
+{
+#ifndef __BORLANDC__
+    BYTE* pbySpan;
+
+    if( wLength == 0 )
+    {
+        return;
+    }
+
+    // The span is still intact until it is released.
+    GetModemPortRxSpan( &pbySpan );
+    NoteTransparentTraffic( pbySpan, wLength, FALSE );
+
+    ReleaseModemPortRxSpan( wLength );
+
+    dwFromModemOut += wLength;
+    bridgeStats.dwBytesFromModem += wLength;
+
+    RetireLatencyMarks( &fromModem, dwFromModemOut );
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemBridgeStats
+//
+//  Arguments:
+//    OUT pStats - Filled with the bridge counters.
+//
+//  Returns: void.
+//
+//  Description: Reports bridge throughput and latency.
+//
+//******************************************************************************
+void GetModemBridgeStats( MODEM_BRIDGE_STATS* pStats )
+{
+    bridgeStats.dwSecsActive = dwActiveMs / 1000;
+
+    bridgeStats.wMaxLatencyToModem   = toModem.wMaxLatency;
+    bridgeStats.wMaxLatencyFromModem = fromModem.wMaxLatency;
+
+    bridgeStats.wAvgLatencyToModem   = ( toModem.dwLatencyBytes == 0 ) ? 0 :
+                                       (WORD)( toModem.dwLatencySum / toModem.dwLatencyBytes );
+    bridgeStats.wAvgLatencyFromModem = ( fromModem.dwLatencyBytes == 0 ) ? 0 :
+                                       (WORD)( fromModem.dwLatencySum / fromModem.dwLatencyBytes );
+
+    MemCpy( pStats, &bridgeStats, sizeof( MODEM_BRIDGE_STATS ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: ClearModemBridgeStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the bridge counters.
+//
+//******************************************************************************
+void ClearModemBridgeStats( void )
+{
+    MemSet( &bridgeStats, 0, sizeof( MODEM_BRIDGE_STATS ) );
+
+    dwActiveMs = 0;
+
+    toModem.dwLatencySum     = 0;
+    toModem.dwLatencyBytes   = 0;
+    toModem.wMaxLatency      = 0;
+    fromModem.dwLatencySum   = 0;
+    fromModem.dwLatencyBytes = 0;
+    fromModem.wMaxLatency    = 0;
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: BridgeOpen
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if data may cross the bridge.
+//           FALSE otherwise.
+//
+//  Description: The bridge only owns the modem port in transparent mode,
+//               and not while the driver runs an SBD slice.
+//
+//******************************************************************************
+BOOL BridgeOpen( void )
+{
+    return InTransparentModemMode() && !IsTransparentBridgePaused();
+}
+
+
+//******************************************************************************
+//
+//  Function: AddLatencyMark
+//
+//  Arguments:
+//    IN/OUT pDir  - Direction the bytes entered.
+//    IN     dwSeq - Sequence number just past the new bytes.
+//
+//  Returns: void.
+//
+//  Description: Stamps the bytes up to dwSeq with the bridge clock. When
+//               all stamps are in use the newest one is extended, which
+//               can only overstate the latency of those bytes.
+//
+//******************************************************************************
+void AddLatencyMark( BRIDGE_DIRECTION* pDir, DWORD dwSeq )
+{
+    BYTE byIndex;
+
+    if( pDir->byCount == BRIDGE_MARKS )
+    {
+        byIndex = ( pDir->byTail + BRIDGE_MARKS - 1 ) % BRIDGE_MARKS;
+        pDir->marks[byIndex].dwSeq = dwSeq;
+        return;
+    }
+
+    byIndex = ( pDir->byTail + pDir->byCount ) % BRIDGE_MARKS;
+
+    pDir->marks[byIndex].dwSeq  = dwSeq;
+    pDir->marks[byIndex].dwTime = dwBridgeClock;
+    pDir->byCount++;
+}
+
+
+//******************************************************************************
+//
+//  Function: RetireLatencyMarks
+//
+//  Arguments:
+//    IN/OUT pDir      - Direction the bytes left.
+//    IN     dwSeqDone - Sequence number just past the last byte that left.
+//
+//  Returns: void.
+//
+//  Description: Accounts the latency of every byte up to dwSeqDone against
+//               the stamp it entered with. A run too long for the sums is
+//               counted with fewer bytes at the same latency.
+//
+//******************************************************************************
+void RetireLatencyMarks( BRIDGE_DIRECTION* pDir, DWORD dwSeqDone )
+{
+    BRIDGE_MARK* pMark;
+    DWORD        dwBytes;
+    DWORD        dwWeight;
+    DWORD        dwLatency;
+
+    while( ( pDir->byCount != 0 ) && ( dwSeqDone > pDir->dwSeqRetired ) )
+    {
+        pMark = &pDir->marks[pDir->byTail];
+
+        dwBytes   = ( ( dwSeqDone < pMark->dwSeq ) ? dwSeqDone : pMark->dwSeq ) - pDir->dwSeqRetired;
+        dwLatency = dwBridgeClock - pMark->dwTime;
+        dwLatency = ( dwLatency > 0xFFFF ) ? 0xFFFF : dwLatency;
+        dwWeight  = ( dwBytes > BRIDGE_LATENCY_CAP ) ? BRIDGE_LATENCY_CAP : dwBytes;
+
+        if( ( dwLatency != 0 ) && ( dwWeight > BRIDGE_LATENCY_CAP / dwLatency ) )
+        {
+            dwWeight = BRIDGE_LATENCY_CAP / dwLatency;
+        }
+
+        // Keep the running average from overflowing; after halving, adding
+        // up to the cap again still fits.
+        if( ( pDir->dwLatencySum > BRIDGE_LATENCY_CAP ) ||
+            ( pDir->dwLatencyBytes > BRIDGE_LATENCY_CAP ) )
+        {
+            pDir->dwLatencySum   /= 2;
+            pDir->dwLatencyBytes /= 2;
+        }
+
+        pDir->dwLatencySum   += dwLatency * dwWeight;
+        pDir->dwLatencyBytes += dwWeight;
+        pDir->dwSeqRetired   += dwBytes;
+
+        if( dwLatency > pDir->wMaxLatency )
+        {
+            pDir->wMaxLatency = (WORD)dwLatency;
+        }
+
+        if( pDir->dwSeqRetired < pMark->dwSeq )
+        {
+            // Part of this stamp is still in the queue.
+            break;
+        }
+
+        pDir->byTail = ( pDir->byTail + 1 ) % BRIDGE_MARKS;
+        pDir->byCount--;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: UpdateFromModemMarks
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Stamps the bytes the modem sent since the last look.
+//
+//******************************************************************************
+void UpdateFromModemMarks( void )
+{
+    DWORD dwSeen = dwFromModemOut + GetModemPortRxCount();
+
+    if( dwSeen > fromModem.dwSeqIn )
+    {
+        fromModem.dwSeqIn = dwSeen;
+        AddLatencyMark( &fromModem, dwSeen );
+    }
+}
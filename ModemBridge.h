@@ -0,0 +1,199 @@
+//******************************************************************************
+//
+//  ModemBridge.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module bridges the maintenance port and the modem port while
+//  the driver is in transparent mode. Data is moved as spans straight
+//  between the port queues, with flow control on both sides and
+//  latency and throughput counters.
+//
+//  The maintenance port driver pushes the spans it received with
+//  BridgeMtceToModem() and pulls spans to transmit with
+//  GetBridgeModemSpan()/ReleaseBridgeModemSpan(), or copies them out with
+//  BridgeModemToMtce(). On the PC, SendTransparentStr() and
+//  ReceiveTransparentStr() go through BridgeMtceToModem() and
+//  BridgeModemToMtce().
+//
+//******************************************************************************
+
+#ifndef _MODEMBRIDGE_H
+
+    #define _MODEMBRIDGE_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+/*artltyp+*/
+typedef struct
+{
+    DWORD dwBytesToModem;           // Maintenance port -> modem
+    DWORD dwBytesFromModem;         // Modem -> maintenance port
+    DWORD dwSecsActive;             // Time spent in transparent mode
+
+    WORD  wAvgLatencyToModem;       // in ms, per byte, until shifted out
+    WORD  wMaxLatencyToModem;
+    WORD  wAvgLatencyFromModem;     // in ms, per byte, until taken by the mtce port
+    WORD  wMaxLatencyFromModem;
+
+    DWORD dwToModemStalls;          // Spans refused: CTS low, queue full or paused
+    DWORD dwRTSHolds;               // Times the modem was held off with RTS
+
+} MODEM_BRIDGE_STATS;
+/*artltyp-*/
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+/*artlx+*/
+//******************************************************************************
+//
+//  Function: InitModemBridge
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables and timers.
+//
+//******************************************************************************
+void InitModemBridge( void );
+
+
+//******************************************************************************
+//
+//  Function: ServiceModemBridge
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Must be called periodically. Runs the latency clock, the
+//               RTS flow control towards the modem and the counters.
+//
+//******************************************************************************
+void ServiceModemBridge( void );
+
+
+//******************************************************************************
+//
+//  Function: BridgeMtceToModem
+//
+//  Arguments:
+//    IN  pbySpan - Bytes received on the maintenance port.
+//    IN  wLength - Number of bytes in pbySpan.
+//
+//  Returns: WORD number of bytes accepted. The rest must be kept by the
+//           caller (and the technician held off) and offered again.
+//
+//  Description: Copies the span straight into the modem TX queue. Nothing
+//               is accepted outside transparent mode, while the driver has
+//               paused the bridge, or while the modem drops CTS.
+//
+//******************************************************************************
+WORD BridgeMtceToModem( const BYTE* pbySpan, WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: BridgeModemToMtce
+//
+//  Arguments:
+//    OUT pbyBuffer - Filled with bytes received from the modem.
+//    IN  wMaxBytes - Size of pbyBuffer.
+//
+//  Returns: WORD number of bytes placed in pbyBuffer.
+//
+//  Description: Copying form of GetBridgeModemSpan()/ReleaseBridgeModemSpan()
+//               for a maintenance port driver that needs its own buffer.
+//
+//******************************************************************************
+WORD BridgeModemToMtce( BYTE* pbyBuffer, WORD wMaxBytes );
+
+
+//******************************************************************************
+//
+//  Function: GetBridgeModemSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the oldest byte received from the modem.
+//
+//  Returns: WORD number of contiguous bytes at *ppbySpan (0 if none, outside
+//           transparent mode or while the bridge is paused).
+//
+//  Description: Lets the maintenance port transmit straight out of the
+//               modem RX queue. The PC build has no queue to expose; use
+//               BridgeModemToMtce() there.
+//
+//******************************************************************************
+WORD GetBridgeModemSpan( BYTE** ppbySpan );
+
+
+//******************************************************************************
+//
+//  Function: ReleaseBridgeModemSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes of the span the maintenance port took.
+//
+//  Returns: void.
+//
+//  Description: Frees the bytes taken from the span returned by
+//               GetBridgeModemSpan().
+//
+//******************************************************************************
+void ReleaseBridgeModemSpan( WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: GetModemBridgeStats
+//
+//  Arguments:
+//    OUT pStats - Filled with the bridge counters.
+//
+//  Returns: void.
+//
+//  Description: Reports bridge throughput and latency.
+//
+//******************************************************************************
+void GetModemBridgeStats( MODEM_BRIDGE_STATS* pStats );
+
+
+//******************************************************************************
+//
+//  Function: ClearModemBridgeStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the bridge counters.
+//
+//******************************************************************************
+void ClearModemBridgeStats( void );
+/*artlx-*/
+
+
+#endif // _MODEMBRIDGE_H
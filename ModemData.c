@@ -0,0 +1,1762 @@
+//******************************************************************************
+//
+//  ModemData.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module transfers files that are too large for a single SBD
+//  message over an Iridium circuit-switched data call, and splits them
+//  into SBD fragments when the call cannot be completed.
+//
+//  Every frame exchanged while the call is connected has the format
+//  (multi-byte fields are big endian):
+//
+//      SYNC1 SYNC2 TYPE LEN_HI LEN_LO PAYLOAD[LEN] CRC_HI CRC_LO
+//
+//  where the CRC covers TYPE through the end of the PAYLOAD.
+//
+//      START (air->ground): file size (4), IMEI, file name (NULL term)
+//      DATA  (air->ground): file offset (4), file data
+//      END   (air->ground): file size (4)
+//      ACK   (ground->air): offset of the next byte the ground expects (4)
+//      NAK   (ground->air): offset of the next byte the ground expects (4)
+//
+//  The ground answers START with the offset it already holds for that
+//  file, so a transfer that was cut off resumes where it left off on
+//  the next call. Up to DATA_WINDOW_BYTES may be outstanding; anything
+//  beyond the last acknowledged offset is re-sent on a NAK or when no
+//  acknowledgement arrives in time (go-back-N).
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+    #include "artl.h"
+    #include "artlx.h"
+    #ifdef __BORLANDC__
+        #include "Stubfunctions.h"
+        #include "DebugOut.h"
+        #include "pcmciaAPIStub.h"
+    #endif
+#else
+    #include "ATInterface.h"
+    #include "FileTransfer.h"
+    #include "FileUtils.h"
+    #include "GpsPort.h"
+    #include "Modem.h"
+    #include "ModemAPI.h"
+    #include "ModemData.h"
+    #include "ModemSerial.h"
+    #include "pcmciaAPI.h"
+    #include "SystemLog.h"
+    #include "timer.h"
+    #include "utils.h"
+#endif
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define DEFAULT_DATA_CALL_THRESHOLD 16384L  // bytes
+
+#define DATA_DIAL_TIMEOUT           60000   // 60 seconds for CONNECT
+#define DATA_START_TIMEOUT          20000   // 20 seconds for the START ACK
+#define DATA_ACK_TIMEOUT            15000   // 15 seconds for a DATA ACK
+#define DATA_GUARD_TIME             1200    // Escape guard time (> S12)
+#define DATA_ESCAPE_TIMEOUT         3000    // Guard after +++ and OK
+#define DATA_DTR_DROP_TIME          500     // DTR drop used if +++ fails
+#define DATA_HANGUP_TIMEOUT         5000    // ATH response
+
+#define DATA_MAX_RETRIES            5       // Per window before giving up
+#define FRAG_NAME_TIMEOUT           5000    // Longest wait for a free fragment name
+
+#define DATA_SYNC_1                 0xA5
+#define DATA_SYNC_2                 0x5A
+
+#define DATA_FRAME_START            0x01
+#define DATA_FRAME_DATA             0x02
+#define DATA_FRAME_END              0x03
+#define DATA_FRAME_ACK              0x81
+#define DATA_FRAME_NAK              0x82
+
+#define DATA_FRAME_HDR_SIZE         5       // Sync, type and length
+#define DATA_FRAME_CRC_SIZE         2
+#define DATA_OFFSET_SIZE            4
+#define DATA_CHUNK_SIZE             256     // File bytes per DATA frame
+#define DATA_WINDOW_BYTES           ( 4 * DATA_CHUNK_SIZE )
+#define DATA_MAX_PAYLOAD            ( DATA_OFFSET_SIZE + DATA_CHUNK_SIZE )
+#define DATA_MAX_FRAME              ( DATA_FRAME_HDR_SIZE + DATA_MAX_PAYLOAD + DATA_FRAME_CRC_SIZE )
+
+#define DATA_RSP_LEN                32
+#define DATA_NO_NAK                 0xFFFFFFFFL
+
+// SBD fragment header (big endian):
+//  'B' 'F' xfer id (2) fragment nbr (2) nbr fragments (2) file size (4) data len (2)
+#define FRAG_MARKER_1               'B'
+#define FRAG_MARKER_2               'F'
+#define FRAG_HDR_SIZE               14
+#define FRAG_DATA_SIZE              ( MODEM_MO_BUF_LEN - FRAG_HDR_SIZE )
+
+#define PUT_WORD( pby, w )          { (pby)[0] = (BYTE)( (w) >> 8 ); (pby)[1] = (BYTE)(w); }
+#define PUT_DWORD( pby, dw )        { PUT_WORD( (pby), (WORD)( (dw) >> 16 ) ); PUT_WORD( &(pby)[2], (WORD)(dw) ); }
+#define GET_WORD( pby )             ( (WORD)( ( (WORD)(pby)[0] << 8 ) | (pby)[1] ) )
+#define GET_DWORD( pby )            ( ( (DWORD)GET_WORD( pby ) << 16 ) | GET_WORD( &(pby)[2] ) )
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef BYTE    DATA_STATES;
+enum data_states
+{
+    DATA_STATE_IDLE,
+    DATA_STATE_DIALING,
+    DATA_STATE_STARTING,
+    DATA_STATE_SENDING,
+    DATA_STATE_ENDING,
+    DATA_STATE_GUARD,
+    DATA_STATE_ESCAPING,
+    DATA_STATE_DTR_DROP,
+    DATA_STATE_HANGING_UP,
+    DATA_STATE_FRAGMENTING,
+    NBR_DATA_STATES
+};
+
+
+typedef BYTE    RX_FRAME_STATES;
+enum rx_frame_states
+{
+    RX_SYNC_1,
+    RX_SYNC_2,
+    RX_HEADER,
+    RX_PAYLOAD
+};
+
+
+typedef struct
+{
+    RX_FRAME_STATES state;
+    WORD            wIndex;
+    WORD            wLength;
+    BYTE            byFrame[DATA_MAX_FRAME];
+
+} DATA_RX_PARSER;
+
+
+typedef struct
+{
+    DATA_STATES      state;
+    DATA_XFER_STATUS result;
+    char             szPathFilename[EMAXPATH];
+    PCFD             fd;
+    DWORD            dwFileSize;
+    DWORD            dwFileOffset;   // Current read position in the file
+    DWORD            dwAckedOffset;  // Ground holds everything below this
+    DWORD            dwNextOffset;   // Next byte to put in a DATA frame
+    DWORD            dwLastNak;
+    BYTE             byRetries;
+    BYTE             byEndNaks;      // END frames NAK'ed back to sending
+    WORD             wXferId;
+    WORD             wFragNbr;
+    WORD             wNbrFrags;
+
+} DATA_XFER_INFO;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static DATA_XFER_INFO   dataXfer;
+static DATA_RX_PARSER   rxParser;
+
+static char             szDataCallNumber[MAX_DATA_CALL_NUMBER];
+static DWORD            dwDataCallThreshold;
+static DWORD            dwDataBytesSent;
+
+static char             szRspLine[DATA_RSP_LEN];
+static WORD             wRspIndex;
+
+static BYTE             byTxFrame[DATA_MAX_FRAME];
+static BYTE             byFragment[MODEM_MO_BUF_LEN];
+
+static TIMERHANDLE      thDataTimer;
+static TIMERHANDLE      thDataAckTimer;
+
+#ifdef MODEM_DATA_LOOPBACK
+#define LOOPBACK_Q_LEN      512
+
+static DATA_RX_PARSER   groundParser;
+static BOOL             bLoopbackOnline;
+static BOOL             bLoopbackCarrier;
+static char             szLoopbackCmd[DATA_RSP_LEN];
+static WORD             wLoopbackCmdIndex;
+static BYTE             byLoopbackQ[LOOPBACK_Q_LEN];
+static WORD             wLoopbackQHead;
+static WORD             wLoopbackQTail;
+static char             szGroundFile[MAX_FILENAME_LEN];
+static DWORD            dwGroundSize;
+static DWORD            dwGroundReceived;
+static DWORD            dwLoopbackUplinkBytes;
+static DWORD            dwLoopbackDropAfter;
+#endif
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static void  DataPortSend( BYTE* pBuffer, WORD wLength );
+static BOOL  DataPortGetChar( BYTE* byData );
+static BOOL  DataPortSending( void );
+static BOOL  DataCarrierDetected( void );
+static void  DataPortFlush( void );
+static BOOL  GetDataRspLine( void );
+static void  ProcessDialRsp( void );
+static void  ProcessConnectedCall( void );
+static void  HandleRxFrame( BYTE byType, BYTE* pbyPayload, WORD wLength );
+static BOOL  FeedFrameParser( DATA_RX_PARSER* parser, BYTE byData );
+static WORD  BuildFrame( BYTE* pbyFrame, BYTE byType, WORD wPayloadLen );
+static void  SendControlFrame( BYTE byType, DWORD dwValue );
+static void  SendStartFrame( void );
+static void  SendNextDataFrame( void );
+static BOOL  SeekDataFile( DWORD dwOffset );
+static void  BeginHangup( BOOL bSuccess );
+static void  CloseDataFile( void );
+static BOOL  WriteNextFragment( void );
+static BOOL  FragmentNameInUse( const char* szFilename );
+#ifdef MODEM_DATA_LOOPBACK
+static void  LoopbackUplink( BYTE* pBuffer, WORD wLength );
+static void  LoopbackDownlink( const BYTE* pBuffer, WORD wLength );
+static void  LoopbackGroundFrame( BYTE byType, BYTE* pbyPayload, WORD wLength );
+#endif
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitModemData
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables and timers.
+//
+//******************************************************************************
+void InitModemData( void )
+{
+    MemSet( &dataXfer, 0, sizeof( DATA_XFER_INFO ) );
+    MemSet( &rxParser, 0, sizeof( DATA_RX_PARSER ) );
+
+    dataXfer.state  = DATA_STATE_IDLE;
+    dataXfer.fd     = -1;
+
+    szDataCallNumber[0] = NULL;
+    dwDataCallThreshold = DEFAULT_DATA_CALL_THRESHOLD;
+    dwDataBytesSent     = 0;
+
+    thDataTimer    = RegisterTimer();
+    thDataAckTimer = RegisterTimer();
+
+#ifdef MODEM_DATA_LOOPBACK
+    MemSet( &groundParser, 0, sizeof( DATA_RX_PARSER ) );
+    bLoopbackOnline       = FALSE;
+    bLoopbackCarrier      = FALSE;
+    wLoopbackCmdIndex     = 0;
+    wLoopbackQHead        = 0;
+    wLoopbackQTail        = 0;
+    szGroundFile[0]       = NULL;
+    dwGroundSize          = 0;
+    dwGroundReceived      = 0;
+    dwLoopbackUplinkBytes = 0;
+    dwLoopbackDropAfter   = 0;
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: IsBulkFile
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to check.
+//
+//  Returns: TRUE if the file should be sent by data call.
+//           FALSE otherwise.
+//
+//  Description: A file is a bulk file when a data call number is configured
+//               and the file exceeds both the threshold and MODEM_MO_BUF_LEN.
+//               Fragments queued by StartSBDFragmenting() never exceed
+//               MODEM_MO_BUF_LEN, so they are never bulk files.
+//
+//******************************************************************************
+BOOL IsBulkFile( const char* szPathFilename )
+{
+    DWORD dwFileSize;
+
+    if( szDataCallNumber[0] == NULL )
+    {
+        return FALSE;
+    }
+
+    dwFileSize = FileLength( szPathFilename );
+
+    return ( dwFileSize > dwDataCallThreshold ) && ( dwFileSize > MODEM_MO_BUF_LEN );
+}
+
+
+//******************************************************************************
+//
+//  Function: StartDataCallTransfer
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to send.
+//
+//  Returns: DATA_XFER_WAITING if the data call was dialed.
+//           DATA_XFER_BUSY if the AT layer or another transfer is busy.
+//           DATA_XFER_OFF_HOOK if the phone is off hook.
+//           DATA_XFER_FILE_ERROR if the file is not a bulk file or could
+//                                not be read.
+//
+//  Description: Dials the data call for a bulk file. ProcessDataTransfer()
+//               must then be called until it stops returning
+//               DATA_XFER_WAITING.
+//
+//******************************************************************************
+DATA_XFER_STATUS StartDataCallTransfer( const char* szPathFilename )
+{
+    char  szDialCmd[MAX_DATA_CALL_NUMBER + 5];
+
+    if( ( dataXfer.state != DATA_STATE_IDLE ) || ( GetModemAtState() != AT_CMD_IDLE ) )
+    {
+        return DATA_XFER_BUSY;
+    }
+
+    if( !IsBulkFile( szPathFilename ) )
+    {
+        return DATA_XFER_FILE_ERROR;
+    }
+
+    // The voice call has priority over the data call; both
+    // need the one Iridium channel.
+    if( InVoiceCall() )
+    {
+        return DATA_XFER_OFF_HOOK;
+    }
+
+    StringCpy( dataXfer.szPathFilename, szPathFilename );
+    dataXfer.dwFileSize    = FileLength( szPathFilename );
+    dataXfer.dwFileOffset  = 0;
+    dataXfer.dwAckedOffset = 0;
+    dataXfer.dwNextOffset  = 0;
+    dataXfer.dwLastNak     = DATA_NO_NAK;
+    dataXfer.byRetries     = 0;
+    dataXfer.byEndNaks     = 0;
+    dataXfer.result        = DATA_XFER_WAITING;
+
+    if( !SeekDataFile( 0 ) )
+    {
+        return DATA_XFER_FILE_ERROR;
+    }
+
+    DataPortFlush();
+    MemSet( &rxParser, 0, sizeof( DATA_RX_PARSER ) );
+    wRspIndex = 0;
+
+    StringCpy( szDialCmd, "ATD" );
+    StringCat( szDialCmd, szDataCallNumber );
+    StringCat( szDialCmd, "\r" );
+    DataPortSend( (BYTE*)szDialCmd, StringLen( szDialCmd ) );
+
+    dataXfer.state = DATA_STATE_DIALING;
+    StartTimer( thDataTimer, DATA_DIAL_TIMEOUT );
+
+    return DATA_XFER_WAITING;
+}
+
+
+//******************************************************************************
+//
+//  Function: StartSBDFragmenting
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to fragment.
+//
+//  Returns: TRUE if fragmenting was started.
+//           FALSE if the file could not be opened.
+//
+//  Description: Splits the file into MODEM_MO_BUF_LEN sized fragments, one per
+//               call to ProcessDataTransfer(), and queues them to the modem
+//               outbox. The original file is left untouched.
+//
+//******************************************************************************
+BOOL StartSBDFragmenting( const char* szPathFilename )
+{
+    if( dataXfer.state != DATA_STATE_IDLE )
+    {
+        return FALSE;
+    }
+
+    StringCpy( dataXfer.szPathFilename, szPathFilename );
+    dataXfer.dwFileSize = FileLength( szPathFilename );
+
+    if( ( dataXfer.dwFileSize == 0 ) || !SeekDataFile( 0 ) )
+    {
+        return FALSE;
+    }
+
+    dataXfer.wXferId   = (WORD)GetGpsTime();
+    dataXfer.wFragNbr  = 0;
+    dataXfer.wNbrFrags = (WORD)( ( dataXfer.dwFileSize + FRAG_DATA_SIZE - 1 ) / FRAG_DATA_SIZE );
+    dataXfer.byRetries = 0;
+    dataXfer.result    = DATA_XFER_WAITING;
+    dataXfer.state     = DATA_STATE_FRAGMENTING;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ProcessDataTransfer
+//
+//  Arguments: void.
+//
+//  Returns: DATA_XFER_STATUS enum value.
+//
+//  Description: Must be called periodically while a transfer or fragmenting
+//               is in progress.
+//
+//******************************************************************************
+DATA_XFER_STATUS ProcessDataTransfer( void )
+{
+    switch( dataXfer.state )
+    {
+        case DATA_STATE_IDLE:
+            return dataXfer.result;
+
+        case DATA_STATE_DIALING:
+            ProcessDialRsp();
+            break;
+
+        case DATA_STATE_STARTING:
+        case DATA_STATE_SENDING:
+        case DATA_STATE_ENDING:
+            ProcessConnectedCall();
+            break;
+
+        case DATA_STATE_GUARD:
+            // The escape sequence needs a quiet line on both sides of it.
+            if( DataPortSending() )
+            {
+                ResetTimer( thDataTimer, DATA_GUARD_TIME );
+            }
+            else if( TimerExpired( thDataTimer ) )
+            {
+                DataPortFlush();
+                wRspIndex = 0;
+                DataPortSend( (BYTE*)"+++", 3 );
+                dataXfer.state = DATA_STATE_ESCAPING;
+                StartTimer( thDataTimer, DATA_GUARD_TIME + DATA_ESCAPE_TIMEOUT );
+            }
+            break;
+
+        case DATA_STATE_ESCAPING:
+            if( GetDataRspLine() && ( ( szRspLine[0] == '0' ) || ( FindSubStr( 0, szRspLine, "OK", wRspIndex ) != -1 ) ) )
+            {
+                wRspIndex = 0;
+                DataPortSend( (BYTE*)"ATH\r", 4 );
+                dataXfer.state = DATA_STATE_HANGING_UP;
+                StartTimer( thDataTimer, DATA_HANGUP_TIMEOUT );
+            }
+            else if( TimerExpired( thDataTimer ) )
+            {
+                // Modem did not drop to command mode; a DTR drop
+                // hangs the call up (&D2).
+                SetModemPortDTRLow();
+                dataXfer.state = DATA_STATE_DTR_DROP;
+                StartTimer( thDataTimer, DATA_DTR_DROP_TIME );
+            }
+            break;
+
+        case DATA_STATE_DTR_DROP:
+            if( TimerExpired( thDataTimer ) )
+            {
+                SetModemPortDTRHigh();
+                DataPortFlush();
+                wRspIndex = 0;
+                DataPortSend( (BYTE*)"ATH\r", 4 );
+                dataXfer.state = DATA_STATE_HANGING_UP;
+                StartTimer( thDataTimer, DATA_HANGUP_TIMEOUT );
+            }
+            break;
+
+        case DATA_STATE_HANGING_UP:
+            if( GetDataRspLine() || TimerExpired( thDataTimer ) )
+            {
+                StopTimer( thDataTimer );
+                StopTimer( thDataAckTimer );
+                DataPortFlush();
+                CloseDataFile();
+                dataXfer.state = DATA_STATE_IDLE;
+                return dataXfer.result;
+            }
+            break;
+
+        case DATA_STATE_FRAGMENTING:
+            if( !WriteNextFragment() )
+            {
+                CloseDataFile();
+                dataXfer.result = DATA_XFER_FRAGMENT_ERROR;
+                dataXfer.state = DATA_STATE_IDLE;
+                return dataXfer.result;
+            }
+
+            if( dataXfer.wFragNbr >= dataXfer.wNbrFrags )
+            {
+                CloseDataFile();
+                dataXfer.result = DATA_XFER_FRAGMENTED;
+                dataXfer.state = DATA_STATE_IDLE;
+                return dataXfer.result;
+            }
+            break;
+
+        default:
+            dataXfer.state = DATA_STATE_IDLE;
+            dataXfer.result = DATA_XFER_FAILED;
+            return dataXfer.result;
+    }
+
+    return DATA_XFER_WAITING;
+}
+
+
+//******************************************************************************
+//
+//  Function: IsDataCallActive
+//
+//  Arguments: void.
+//
+//  Returns: TRUE from the moment the call is dialed until it is hung up.
+//           FALSE otherwise.
+//
+//  Description: Lets the upper layer know the modem is in a data call.
+//
+//******************************************************************************
+BOOL IsDataCallActive( void )
+{
+    return ( dataXfer.state != DATA_STATE_IDLE ) && ( dataXfer.state != DATA_STATE_FRAGMENTING );
+}
+
+
+//******************************************************************************
+//
+//  Function: SetDataCallNumber
+//
+//  Arguments:
+//    IN  szNumber - Ground endpoint number to dial (digits only). An empty
+//                   string disables data call transfers (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the data call number.
+//               Ignored on an SBD only transceiver (MODEM_HAS_DATA_CALL).
+//
+//******************************************************************************
+void SetDataCallNumber( const char* szNumber )
+{
+#if MODEM_HAS_DATA_CALL
+    StringNCpy( szDataCallNumber, szNumber, MAX_DATA_CALL_NUMBER - 1 );
+    szDataCallNumber[MAX_DATA_CALL_NUMBER - 1] = NULL;
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallNumber
+//
+//  Arguments: void.
+//
+//  Returns: Pointer to the configured data call number.
+//
+//  Description: Allows embedded rules to get the data call number.
+//
+//******************************************************************************
+const char* GetDataCallNumber( void )
+{
+    return szDataCallNumber;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetDataCallThreshold
+//
+//  Arguments:
+//    IN  dwThresholdInBytes - Files larger than this (and MODEM_MO_BUF_LEN) are
+//                             sent by data call. Previous value maintained
+//                             on a zero value.
+//                             DEFAULT: 16384 bytes
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the bulk transfer threshold.
+//
+//******************************************************************************
+void SetDataCallThreshold( const DWORD dwThresholdInBytes )
+{
+    if( dwThresholdInBytes != 0 )
+    {
+        dwDataCallThreshold = dwThresholdInBytes;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallThreshold
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the bulk transfer threshold in bytes.
+//
+//  Description: Allows embedded rules to get the bulk transfer threshold.
+//
+//******************************************************************************
+DWORD GetDataCallThreshold( void )
+{
+    return dwDataCallThreshold;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallBytesSent
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the file bytes acknowledged by the ground over
+//           data calls since power up.
+//
+//  Description: Data call throughput counter.
+//
+//******************************************************************************
+DWORD GetDataCallBytesSent( void )
+{
+    return dwDataBytesSent;
+}
+
+
+#ifdef MODEM_DATA_LOOPBACK
+//******************************************************************************
+//
+//  Function: SetDataLoopbackDropAfter
+//
+//  Arguments:
+//    IN  dwBytes - Number of uplink bytes after which the stand-in drops
+//                  the call (0 to never drop).
+//
+//  Returns: void.
+//
+//  Description: Lets a test exercise the resume path of the protocol.
+//
+//******************************************************************************
+void SetDataLoopbackDropAfter( const DWORD dwBytes )
+{
+    dwLoopbackDropAfter = dwBytes;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetDataLoopbackBytesReceived
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the contiguous file bytes held by the stand-in.
+//
+//  Description: Lets a test verify what the ground endpoint received.
+//
+//******************************************************************************
+DWORD GetDataLoopbackBytesReceived( void )
+{
+    return dwGroundReceived;
+}
+#endif
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: DataPortSend
+//
+//  Arguments:
+//    IN  pBuffer - Bytes to send.
+//    IN  wLength - Number of bytes in pBuffer.
+//
+//  Returns: void.
+//
+//  Description: Sends to the modem port (or the loopback stand-in).
+//
+//******************************************************************************
+void DataPortSend( BYTE* pBuffer, WORD wLength )
+{
+#ifdef MODEM_DATA_LOOPBACK
+    LoopbackUplink( pBuffer, wLength );
+#else
+    ModemPortSendBuffer( pBuffer, wLength );
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: DataPortGetChar
+//
+//  Arguments:
+//    OUT byData - Received byte.
+//
+//  Returns: TRUE if a byte was received.
+//           FALSE otherwise.
+//
+//  Description: Reads from the modem port (or the loopback stand-in).
+//
+//******************************************************************************
+BOOL DataPortGetChar( BYTE* byData )
+{
+#ifdef MODEM_DATA_LOOPBACK
+    if( wLoopbackQHead == wLoopbackQTail )
+    {
+        return FALSE;
+    }
+
+    *byData = byLoopbackQ[wLoopbackQTail];
+    wLoopbackQTail = ( wLoopbackQTail + 1 ) % LOOPBACK_Q_LEN;
+
+    return TRUE;
+#else
+    return GetModemPortChar( byData );
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: DataPortSending
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the port is still shifting out data.
+//           FALSE otherwise.
+//
+//  Description: Used to pace frames so the TX queue never overflows.
+//
+//******************************************************************************
+BOOL DataPortSending( void )
+{
+#ifdef MODEM_DATA_LOOPBACK
+    return FALSE;
+#else
+    return ModemPortSending();
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: DataCarrierDetected
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the modem reports carrier (DCD).
+//           FALSE otherwise.
+//
+//  Description: Detects that the call was dropped.
+//
+//******************************************************************************
+BOOL DataCarrierDetected( void )
+{
+#ifdef MODEM_DATA_LOOPBACK
+    return bLoopbackCarrier;
+#else
+    return ReadModemPortDCDLine();
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: DataPortFlush
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Discards anything received from the modem.
+//
+//******************************************************************************
+void DataPortFlush( void )
+{
+#ifdef MODEM_DATA_LOOPBACK
+    wLoopbackQTail = wLoopbackQHead;
+#else
+    FlushModemSerialRxQueue();
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: GetDataRspLine
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if a complete, non empty response line is in szRspLine.
+//           FALSE otherwise.
+//
+//  Description: Collects a modem response terminated by <CR> while the
+//               modem is in command mode.
+//
+//******************************************************************************
+BOOL GetDataRspLine( void )
+{
+    BYTE byData;
+
+    while( DataPortGetChar( &byData ) )
+    {
+        if( ( byData == '\r' ) || ( byData == '\n' ) )
+        {
+            if( wRspIndex != 0 )
+            {
+                szRspLine[wRspIndex] = NULL;
+                return TRUE;
+            }
+        }
+        else if( wRspIndex < DATA_RSP_LEN - 1 )
+        {
+            szRspLine[wRspIndex++] = byData;
+        }
+    }
+
+    return FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ProcessDialRsp
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Waits for CONNECT (numeric 1 or 10 and up, or verbose) and
+//               sends the START frame. Any other final response means the
+//               call did not go through.
+//
+//******************************************************************************
+void ProcessDialRsp( void )
+{
+    WORD wCode;
+
+    if( GetDataRspLine() )
+    {
+        if( FindSubStr( 0, szRspLine, "AT", wRspIndex ) == 0 )
+        {
+            // Echo of the dial command.
+            wRspIndex = 0;
+            return;
+        }
+
+        if( ( szRspLine[0] >= '0' ) && ( szRspLine[0] <= '9' ) )
+        {
+            wCode = (WORD)StringToInt( szRspLine );
+        }
+        else
+        {
+            wCode = ( FindSubStr( 0, szRspLine, "CONNECT", wRspIndex ) != -1 ) ? 1 : 3;
+        }
+
+        wRspIndex = 0;
+
+        // 2 is RING, ignore it.
+        if( wCode == 2 )
+        {
+            return;
+        }
+
+        if( ( wCode == 1 ) || ( wCode >= 10 ) )
+        {
+            MemSet( &rxParser, 0, sizeof( DATA_RX_PARSER ) );
+            SendStartFrame();
+            dataXfer.state = DATA_STATE_STARTING;
+            StartTimer( thDataTimer, DATA_START_TIMEOUT );
+        }
+        else
+        {
+            // NO CARRIER, ERROR, NO DIALTONE, BUSY or NO ANSWER.
+            StopTimer( thDataTimer );
+            CloseDataFile();
+            dataXfer.result = DATA_XFER_FAILED;
+            dataXfer.state = DATA_STATE_IDLE;
+        }
+    }
+    else if( TimerExpired( thDataTimer ) )
+    {
+        // Any key press aborts the dial attempt.
+        DataPortSend( (BYTE*)"\r", 1 );
+        BeginHangup( FALSE );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: ProcessConnectedCall
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Handles the START, DATA and END phases of the transfer.
+//
+//******************************************************************************
+void ProcessConnectedCall( void )
+{
+    BYTE byData;
+
+    // Lost carrier or the crew picked up the handset; the ground keeps
+    // what it has acknowledged so far and the next call resumes from it.
+    if( !DataCarrierDetected() || InVoiceCall() )
+    {
+        BeginHangup( FALSE );
+        return;
+    }
+
+    while( DataPortGetChar( &byData ) )
+    {
+        if( FeedFrameParser( &rxParser, byData ) )
+        {
+            HandleRxFrame( rxParser.byFrame[2],
+                           &rxParser.byFrame[DATA_FRAME_HDR_SIZE],
+                           rxParser.wLength );
+
+            // A frame may have ended the transfer.
+            if( ( dataXfer.state != DATA_STATE_STARTING ) &&
+                ( dataXfer.state != DATA_STATE_SENDING ) &&
+                ( dataXfer.state != DATA_STATE_ENDING ) )
+            {
+                return;
+            }
+        }
+    }
+
+    switch( dataXfer.state )
+    {
+        case DATA_STATE_STARTING:
+        case DATA_STATE_ENDING:
+            if( TimerExpired( thDataTimer ) )
+            {
+                if( ++dataXfer.byRetries > DATA_MAX_RETRIES )
+                {
+                    BeginHangup( FALSE );
+                }
+                else if( dataXfer.state == DATA_STATE_STARTING )
+                {
+                    SendStartFrame();
+                    ResetTimer( thDataTimer, DATA_START_TIMEOUT );
+                }
+                else
+                {
+                    SendControlFrame( DATA_FRAME_END, dataXfer.dwFileSize );
+                    ResetTimer( thDataTimer, DATA_ACK_TIMEOUT );
+                }
+            }
+            break;
+
+        case DATA_STATE_SENDING:
+            if( dataXfer.dwAckedOffset >= dataXfer.dwFileSize )
+            {
+                StopTimer( thDataAckTimer );
+                dataXfer.byRetries = 0;
+                SendControlFrame( DATA_FRAME_END, dataXfer.dwFileSize );
+                dataXfer.state = DATA_STATE_ENDING;
+                StartTimer( thDataTimer, DATA_ACK_TIMEOUT );
+            }
+            else if( TimerExpired( thDataAckTimer ) )
+            {
+                // Go back to the last acknowledged offset.
+                if( ++dataXfer.byRetries > DATA_MAX_RETRIES )
+                {
+                    BeginHangup( FALSE );
+                }
+                else
+                {
+                    dataXfer.dwNextOffset = dataXfer.dwAckedOffset;
+                    ResetTimer( thDataAckTimer, DATA_ACK_TIMEOUT );
+                }
+            }
+            else
+            {
+                SendNextDataFrame();
+            }
+            break;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: HandleRxFrame
+//
+//  Arguments:
+//    IN  byType     - Frame type.
+//    IN  pbyPayload - Frame payload.
+//    IN  wLength    - Payload length.
+//
+//  Returns: void.
+//
+//  Description: Acts on an ACK or NAK from the ground. A NAK never moves
+//               the acknowledged offset back.
+//
+//******************************************************************************
+void HandleRxFrame( BYTE byType, BYTE* pbyPayload, WORD wLength )
+{
+    DWORD dwOffset;
+
+    if( wLength < DATA_OFFSET_SIZE )
+    {
+        return;
+    }
+
+    dwOffset = GET_DWORD( pbyPayload );
+
+    if( dwOffset > dataXfer.dwFileSize )
+    {
+        dwOffset = dataXfer.dwFileSize;
+    }
+
+    switch( dataXfer.state )
+    {
+        case DATA_STATE_STARTING:
+            if( byType == DATA_FRAME_ACK )
+            {
+                // Resume from whatever the ground already holds.
+                dataXfer.dwAckedOffset = dwOffset;
+                dataXfer.dwNextOffset  = dwOffset;
+                dataXfer.byRetries     = 0;
+                dataXfer.state         = DATA_STATE_SENDING;
+                StopTimer( thDataTimer );
+                StartTimer( thDataAckTimer, DATA_ACK_TIMEOUT );
+            }
+            break;
+
+        case DATA_STATE_SENDING:
+            if( ( dwOffset < dataXfer.dwAckedOffset ) || ( dwOffset > dataXfer.dwNextOffset ) )
+            {
+                break;
+            }
+
+            if( dwOffset > dataXfer.dwAckedOffset )
+            {
+                dwDataBytesSent += dwOffset - dataXfer.dwAckedOffset;
+                dataXfer.dwAckedOffset = dwOffset;
+                dataXfer.dwLastNak = DATA_NO_NAK;
+                dataXfer.byRetries = 0;
+                ResetTimer( thDataAckTimer, DATA_ACK_TIMEOUT );
+            }
+
+            // Every frame still in flight behind a gap is NAK'ed
+            // with the same offset; only go back once.
+            if( ( byType == DATA_FRAME_NAK ) && ( dwOffset != dataXfer.dwLastNak ) )
+            {
+                dataXfer.dwLastNak = dwOffset;
+                dataXfer.dwNextOffset = dwOffset;
+
+                if( ++dataXfer.byRetries > DATA_MAX_RETRIES )
+                {
+                    BeginHangup( FALSE );
+                }
+            }
+            break;
+
+        case DATA_STATE_ENDING:
+            if( ( byType == DATA_FRAME_ACK ) && ( dwOffset == dataXfer.dwFileSize ) )
+            {
+                BeginHangup( TRUE );
+            }
+            else if( ( byType == DATA_FRAME_NAK ) && ( dwOffset >= dataXfer.dwAckedOffset ) )
+            {
+                // The ACKs in between reset byRetries, so the round
+                // trips are counted on their own.
+                if( ++dataXfer.byEndNaks > DATA_MAX_RETRIES )
+                {
+                    BeginHangup( FALSE );
+                    break;
+                }
+
+                // Ground is missing data after all; go back.
+                dataXfer.dwAckedOffset = dwOffset;
+                dataXfer.dwNextOffset  = dwOffset;
+                dataXfer.state         = DATA_STATE_SENDING;
+                StopTimer( thDataTimer );
+                StartTimer( thDataAckTimer, DATA_ACK_TIMEOUT );
+            }
+            break;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: FeedFrameParser
+//
+//  Arguments:
+//    IN/OUT parser - Frame parser state.
+//    IN     byData - Next received byte.
+//
+//  Returns: TRUE if a complete frame with a good CRC is in parser->byFrame.
+//           FALSE otherwise.
+//
+//  Description: Frame receive state machine, shared by both ends of the
+//               link. Bad frames are dropped and the parser resyncs.
+//
+//******************************************************************************
+BOOL FeedFrameParser( DATA_RX_PARSER* parser, BYTE byData )
+{
+    WORD wCRC;
+
+    switch( parser->state )
+    {
+        case RX_SYNC_1:
+            if( byData == DATA_SYNC_1 )
+            {
+                parser->byFrame[0] = byData;
+                parser->state = RX_SYNC_2;
+            }
+            break;
+
+        case RX_SYNC_2:
+            if( byData == DATA_SYNC_2 )
+            {
+                parser->byFrame[1] = byData;
+                parser->wIndex = 2;
+                parser->state = RX_HEADER;
+            }
+            else if( byData != DATA_SYNC_1 )
+            {
+                parser->state = RX_SYNC_1;
+            }
+            break;
+
+        case RX_HEADER:
+            parser->byFrame[parser->wIndex++] = byData;
+
+            if( parser->wIndex == DATA_FRAME_HDR_SIZE )
+            {
+                parser->wLength = GET_WORD( &parser->byFrame[3] );
+                parser->state = ( parser->wLength > DATA_MAX_PAYLOAD ) ? RX_SYNC_1 : RX_PAYLOAD;
+            }
+            break;
+
+        case RX_PAYLOAD:
+            parser->byFrame[parser->wIndex++] = byData;
+
+            if( parser->wIndex == DATA_FRAME_HDR_SIZE + parser->wLength + DATA_FRAME_CRC_SIZE )
+            {
+                parser->state = RX_SYNC_1;
+
+                wCRC = CalcCRC( &parser->byFrame[2], parser->wLength + 3 );
+
+                return ( wCRC == GET_WORD( &parser->byFrame[parser->wIndex - DATA_FRAME_CRC_SIZE] ) );
+            }
+            break;
+
+        default:
+            parser->state = RX_SYNC_1;
+            break;
+    }
+
+    return FALSE;
+}
+
+
+//******************************************************************************
+//
+//  Function: BuildFrame
+//
+//  Arguments:
+//    IN/OUT pbyFrame    - Frame buffer, payload already in place.
+//    IN     byType      - Frame type.
+//    IN     wPayloadLen - Payload length.
+//
+//  Returns: WORD total length of the frame.
+//
+//  Description: Fills in the header and the CRC around the payload.
+//
+//******************************************************************************
+WORD BuildFrame( BYTE* pbyFrame, BYTE byType, WORD wPayloadLen )
+{
+    WORD wCRC;
+
+    pbyFrame[0] = DATA_SYNC_1;
+    pbyFrame[1] = DATA_SYNC_2;
+    pbyFrame[2] = byType;
+    PUT_WORD( &pbyFrame[3], wPayloadLen );
+
+    wCRC = CalcCRC( &pbyFrame[2], wPayloadLen + 3 );
+    PUT_WORD( &pbyFrame[DATA_FRAME_HDR_SIZE + wPayloadLen], wCRC );
+
+    return DATA_FRAME_HDR_SIZE + wPayloadLen + DATA_FRAME_CRC_SIZE;
+}
+
+
+//******************************************************************************
+//
+//  Function: SendControlFrame
+//
+//  Arguments:
+//    IN  byType  - Frame type.
+//    IN  dwValue - The DWORD carried by the frame.
+//
+//  Returns: void.
+//
+//  Description: Sends a frame whose only payload is a DWORD.
+//
+//******************************************************************************
+void SendControlFrame( BYTE byType, DWORD dwValue )
+{
+    PUT_DWORD( &byTxFrame[DATA_FRAME_HDR_SIZE], dwValue );
+
+    DataPortSend( byTxFrame, BuildFrame( byTxFrame, byType, DATA_OFFSET_SIZE ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: SendStartFrame
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Identifies the file to the ground by IMEI, name and size.
+//
+//******************************************************************************
+void SendStartFrame( void )
+{
+    BYTE* pbyPayload = &byTxFrame[DATA_FRAME_HDR_SIZE];
+    WORD  wLength;
+
+    PUT_DWORD( pbyPayload, dataXfer.dwFileSize );
+    wLength = DATA_OFFSET_SIZE;
+
+    StringCpy( (char*)&pbyPayload[wLength], GetIMEI() );
+    wLength += StringLen( GetIMEI() ) + 1;
+
+    ExtractFileNameFromPath( dataXfer.szPathFilename, (char*)&pbyPayload[wLength] );
+    wLength += StringLen( (char*)&pbyPayload[wLength] ) + 1;
+
+    DataPortSend( byTxFrame, BuildFrame( byTxFrame, DATA_FRAME_START, wLength ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: SendNextDataFrame
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Sends the next DATA frame if the window is open and the
+//               port has finished shifting out the previous one.
+//
+//******************************************************************************
+void SendNextDataFrame( void )
+{
+    BYTE* pbyPayload = &byTxFrame[DATA_FRAME_HDR_SIZE];
+    DWORD dwRemaining;
+    WORD  wChunk;
+
+    if( DataPortSending() )
+    {
+        return;
+    }
+
+    if( ( dataXfer.dwNextOffset >= dataXfer.dwFileSize ) ||
+        ( dataXfer.dwNextOffset - dataXfer.dwAckedOffset >= DATA_WINDOW_BYTES ) )
+    {
+        return;
+    }
+
+    if( ( dataXfer.dwFileOffset != dataXfer.dwNextOffset ) && !SeekDataFile( dataXfer.dwNextOffset ) )
+    {
+        BeginHangup( FALSE );
+        return;
+    }
+
+    dwRemaining = dataXfer.dwFileSize - dataXfer.dwNextOffset;
+    wChunk = ( dwRemaining > DATA_CHUNK_SIZE ) ? DATA_CHUNK_SIZE : (WORD)dwRemaining;
+
+    if( fileRead( dataXfer.fd, &pbyPayload[DATA_OFFSET_SIZE], wChunk ) != wChunk )
+    {
+        BeginHangup( FALSE );
+        return;
+    }
+
+    PUT_DWORD( pbyPayload, dataXfer.dwNextOffset );
+
+    DataPortSend( byTxFrame, BuildFrame( byTxFrame, DATA_FRAME_DATA, DATA_OFFSET_SIZE + wChunk ) );
+
+    dataXfer.dwNextOffset += wChunk;
+    dataXfer.dwFileOffset += wChunk;
+}
+
+
+//******************************************************************************
+//
+//  Function: SeekDataFile
+//
+//  Arguments:
+//    IN  dwOffset - File offset to position at.
+//
+//  Returns: TRUE if the file is open and positioned at dwOffset.
+//           FALSE otherwise.
+//
+//  Description: The file system has no seek, so the file is reopened and
+//               read forward. Only used on a resume or a go back.
+//
+//******************************************************************************
+BOOL SeekDataFile( DWORD dwOffset )
+{
+    WORD wChunk;
+
+    CloseDataFile();
+
+    dataXfer.fd = fileOpen( dataXfer.szPathFilename, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
+
+    if( dataXfer.fd == -1 )
+    {
+        return FALSE;
+    }
+
+    dataXfer.dwFileOffset = 0;
+
+    while( dataXfer.dwFileOffset < dwOffset )
+    {
+        wChunk = ( dwOffset - dataXfer.dwFileOffset > MODEM_MO_BUF_LEN ) ? MODEM_MO_BUF_LEN : (WORD)( dwOffset - dataXfer.dwFileOffset );
+
+        if( fileRead( dataXfer.fd, byFragment, wChunk ) != wChunk )
+        {
+            CloseDataFile();
+            return FALSE;
+        }
+
+        dataXfer.dwFileOffset += wChunk;
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: BeginHangup
+//
+//  Arguments:
+//    IN  bSuccess - TRUE if the ground holds the whole file.
+//
+//  Returns: void.
+//
+//  Description: Records the result and starts hanging up the call.
+//
+//******************************************************************************
+void BeginHangup( BOOL bSuccess )
+{
+    dataXfer.result = bSuccess ? DATA_XFER_SUCCESS : DATA_XFER_FAILED;
+
+    StopTimer( thDataAckTimer );
+
+    if( DataCarrierDetected() )
+    {
+        // Still online, escape to command mode first.
+        dataXfer.state = DATA_STATE_GUARD;
+        StartTimer( thDataTimer, DATA_GUARD_TIME );
+    }
+    else
+    {
+        // Carrier is gone so the modem is back in command mode.
+        DataPortFlush();
+        wRspIndex = 0;
+        DataPortSend( (BYTE*)"ATH\r", 4 );
+        dataXfer.state = DATA_STATE_HANGING_UP;
+        StartTimer( thDataTimer, DATA_HANGUP_TIMEOUT );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: CloseDataFile
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Closes the file being transferred, if open.
+//
+//******************************************************************************
+void CloseDataFile( void )
+{
+    if( dataXfer.fd != -1 )
+    {
+        fileClose( dataXfer.fd );
+        dataXfer.fd = -1;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: WriteNextFragment
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the fragment was written and queued, or is waiting for
+//                a free name.
+//           FALSE otherwise.
+//
+//  Description: Builds the next SBD fragment of the file in the working
+//               directory and queues it to the modem outbox. Each fragment
+//               keeps the priority flag of the file. CreateNewFileName()
+//               only made the name unique with its own flag, so a name
+//               already taken with the file's flag is tried again on a
+//               later call, for up to FRAG_NAME_TIMEOUT.
+//
+//******************************************************************************
+BOOL WriteNextFragment( void )
+{
+    static char szFragPathFilename[EMAXPATH];
+    static char szFragFilename[MAX_FILENAME_LEN];
+    char        szFileName[MAX_FILENAME_LEN];
+    PCFD        fd;
+    DWORD       dwRemaining;
+    WORD        wChunk;
+    BOOL        bWritten;
+
+    CreateNewFileName( szFragPathFilename,                          // pathfilename
+                       szFragFilename,                              // filename
+                       GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ),  // build dir
+                       GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ),   // search dir
+                       FALSE,                                       // no time adjustment
+                       0 );                                         // 0 adjust time
+
+    szFileName[0]         = NULL;
+    szFragFilename[0]     = ExtractFileNameFromPath( dataXfer.szPathFilename, szFileName )[0];
+    szFragPathFilename[0] = NULL;
+    BuildPath( szFragPathFilename, GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ), szFragFilename );
+
+    if( FragmentNameInUse( szFragFilename ) )
+    {
+        if( dataXfer.byRetries == 0 )
+        {
+            dataXfer.byRetries = 1;
+            StartTimer( thDataTimer, FRAG_NAME_TIMEOUT );
+        }
+
+        return !TimerExpired( thDataTimer );
+    }
+
+    if( dataXfer.byRetries != 0 )
+    {
+        dataXfer.byRetries = 0;
+        StopTimer( thDataTimer );
+    }
+
+    dwRemaining = dataXfer.dwFileSize - dataXfer.dwFileOffset;
+    wChunk = ( dwRemaining > FRAG_DATA_SIZE ) ? FRAG_DATA_SIZE : (WORD)dwRemaining;
+
+    if( fileRead( dataXfer.fd, &byFragment[FRAG_HDR_SIZE], wChunk ) != wChunk )
+    {
+        return FALSE;
+    }
+
+    dataXfer.dwFileOffset += wChunk;
+
+    byFragment[0] = FRAG_MARKER_1;
+    byFragment[1] = FRAG_MARKER_2;
+    PUT_WORD( &byFragment[2], dataXfer.wXferId );
+    PUT_WORD( &byFragment[4], dataXfer.wFragNbr );
+    PUT_WORD( &byFragment[6], dataXfer.wNbrFrags );
+    PUT_DWORD( &byFragment[8], dataXfer.dwFileSize );
+    PUT_WORD( &byFragment[12], wChunk );
+
+    fd = fileOpen( szFragPathFilename, PO_CREAT|PO_TRUNC|PO_WRONLY|PO_BINARY, PS_IREAD|PS_IWRITE );
+
+    if( fd == -1 )
+    {
+        return FALSE;
+    }
+
+    bWritten = ( fileWrite( fd, byFragment, FRAG_HDR_SIZE + wChunk ) == FRAG_HDR_SIZE + wChunk );
+
+    fileClose( fd );
+
+    if( !bWritten )
+    {
+        deleteFile( szFragPathFilename );
+        return FALSE;
+    }
+
+    QueueFileForSend( MODEM_DIR, szFragPathFilename );
+
+    dataXfer.wFragNbr++;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: FragmentNameInUse
+//
+//  Arguments:
+//    IN  szFilename - Fragment file name, with the priority flag of the file.
+//
+//  Returns: TRUE if a file of that name is in the working directory or the
+//                outbox.
+//           FALSE otherwise.
+//
+//******************************************************************************
+BOOL FragmentNameInUse( const char* szFilename )
+{
+    static char szPathFilename[EMAXPATH];
+    PCFD        fd;
+
+    szPathFilename[0] = NULL;
+    BuildPath( szPathFilename, GetPCMCIAPath( MODEM_DIR, WORKING_SUBDIR ), (char*)szFilename );
+
+    fd = fileOpen( szPathFilename, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
+
+    if( fd == -1 )
+    {
+        szPathFilename[0] = NULL;
+        BuildPath( szPathFilename, GetPCMCIAPath( MODEM_DIR, OUTBOX_SUBDIR ), (char*)szFilename );
+
+        fd = fileOpen( szPathFilename, PO_RDONLY | PO_BINARY, PS_IREAD | PS_IWRITE );
+    }
+
+    if( fd == -1 )
+    {
+        return FALSE;
+    }
+
+    fileClose( fd );
+
+    return TRUE;
+}
+
+
+#ifdef MODEM_DATA_LOOPBACK
+//******************************************************************************
+//
+//  Function: LoopbackUplink
+//
+//  Arguments:
+//    IN  pBuffer - Bytes the driver sent to the "modem".
+//    IN  wLength - Number of bytes in pBuffer.
+//
+//  Returns: void.
+//
+//  Description: Stands in for the modem and the ground endpoint. In
+//               command mode ATD connects, ATH hangs up; online, "+++"
+//               escapes and everything else is fed to the ground side.
+//
+//******************************************************************************
+void LoopbackUplink( BYTE* pBuffer, WORD wLength )
+{
+    WORD i;
+
+    if( bLoopbackOnline )
+    {
+        if( ( wLength == 3 ) && ( pBuffer[0] == '+' ) && ( pBuffer[1] == '+' ) && ( pBuffer[2] == '+' ) )
+        {
+            bLoopbackOnline = FALSE;
+            LoopbackDownlink( (BYTE*)"0\r", 2 );
+            return;
+        }
+
+        for( i = 0; i < wLength; i++ )
+        {
+            if( ( dwLoopbackDropAfter != 0 ) && ( ++dwLoopbackUplinkBytes > dwLoopbackDropAfter ) )
+            {
+                // Simulated loss of the link.
+                bLoopbackOnline = FALSE;
+                bLoopbackCarrier = FALSE;
+                dwLoopbackUplinkBytes = 0;
+                dwLoopbackDropAfter = 0;
+                LoopbackDownlink( (BYTE*)"3\r", 2 );
+                return;
+            }
+
+            if( FeedFrameParser( &groundParser, pBuffer[i] ) )
+            {
+                LoopbackGroundFrame( groundParser.byFrame[2],
+                                     &groundParser.byFrame[DATA_FRAME_HDR_SIZE],
+                                     groundParser.wLength );
+            }
+        }
+        return;
+    }
+
+    for( i = 0; i < wLength; i++ )
+    {
+        if( pBuffer[i] != '\r' )
+        {
+            if( wLoopbackCmdIndex < DATA_RSP_LEN - 1 )
+            {
+                szLoopbackCmd[wLoopbackCmdIndex++] = pBuffer[i];
+            }
+            continue;
+        }
+
+        szLoopbackCmd[wLoopbackCmdIndex] = NULL;
+
+        if( FindSubStr( 0, szLoopbackCmd, "ATD", wLoopbackCmdIndex ) == 0 )
+        {
+            bLoopbackOnline = TRUE;
+            bLoopbackCarrier = TRUE;
+            MemSet( &groundParser, 0, sizeof( DATA_RX_PARSER ) );
+            LoopbackDownlink( (BYTE*)"CONNECT 19200\r\n", 15 );
+        }
+        else if( wLoopbackCmdIndex != 0 )
+        {
+            bLoopbackCarrier = FALSE;
+            LoopbackDownlink( (BYTE*)"0\r", 2 );
+        }
+
+        wLoopbackCmdIndex = 0;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: LoopbackDownlink
+//
+//  Arguments:
+//    IN  pBuffer - Bytes the "modem" sends to the driver.
+//    IN  wLength - Number of bytes in pBuffer.
+//
+//  Returns: void.
+//
+//  Description: Queues bytes for DataPortGetChar(). Oldest data is
+//               overwritten if the driver is not reading.
+//
+//******************************************************************************
+void LoopbackDownlink( const BYTE* pBuffer, WORD wLength )
+{
+    WORD i;
+
+    for( i = 0; i < wLength; i++ )
+    {
+        byLoopbackQ[wLoopbackQHead] = pBuffer[i];
+        wLoopbackQHead = ( wLoopbackQHead + 1 ) % LOOPBACK_Q_LEN;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: LoopbackGroundFrame
+//
+//  Arguments:
+//    IN  byType     - Frame type.
+//    IN  pbyPayload - Frame payload.
+//    IN  wLength    - Payload length.
+//
+//  Returns: void.
+//
+//  Description: The ground endpoint. Keeps the received offset for the
+//               current file across calls so the resume path can be run.
+//
+//******************************************************************************
+void LoopbackGroundFrame( BYTE byType, BYTE* pbyPayload, WORD wLength )
+{
+    static BYTE byAckFrame[DATA_FRAME_HDR_SIZE + DATA_OFFSET_SIZE + DATA_FRAME_CRC_SIZE];
+    const char* szName;
+    DWORD       dwOffset;
+    BYTE        byReply = DATA_FRAME_ACK;
+
+    if( wLength < DATA_OFFSET_SIZE )
+    {
+        return;
+    }
+
+    dwOffset = GET_DWORD( pbyPayload );
+
+    switch( byType )
+    {
+        case DATA_FRAME_START:
+            // Skip the IMEI to get to the file name.
+            szName = (const char*)&pbyPayload[DATA_OFFSET_SIZE];
+            szName += StringLen( szName ) + 1;
+
+            if( ( dwOffset != dwGroundSize ) || ( StringCmp( szName, szGroundFile ) != 0 ) )
+            {
+                StringNCpy( szGroundFile, szName, MAX_FILENAME_LEN - 1 );
+                szGroundFile[MAX_FILENAME_LEN - 1] = NULL;
+                dwGroundSize = dwOffset;
+                dwGroundReceived = 0;
+            }
+            break;
+
+        case DATA_FRAME_DATA:
+            if( dwOffset == dwGroundReceived )
+            {
+                dwGroundReceived += wLength - DATA_OFFSET_SIZE;
+            }
+            else if( dwOffset > dwGroundReceived )
+            {
+                byReply = DATA_FRAME_NAK;
+            }
+            break;
+
+        case DATA_FRAME_END:
+            if( dwGroundReceived != dwGroundSize )
+            {
+                byReply = DATA_FRAME_NAK;
+            }
+            break;
+
+        default:
+            return;
+    }
+
+    PUT_DWORD( &byAckFrame[DATA_FRAME_HDR_SIZE], dwGroundReceived );
+
+    LoopbackDownlink( byAckFrame, BuildFrame( byAckFrame, byReply, DATA_OFFSET_SIZE ) );
+}
+#endif
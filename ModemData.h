@@ -0,0 +1,287 @@
+//******************************************************************************
+//
+//  ModemData.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module transfers files that are too large for a single SBD
+//  message over an Iridium circuit-switched data call. The call is
+//  dialed, the file is sent with a windowed framing protocol that the
+//  ground endpoint can resume from, and the call is hung up.
+//
+//  If the file cannot be sent by data call, it can instead be split
+//  into SBD sized fragments which are queued to the modem outbox.
+//
+//  The module owns the modem port from the moment the call is dialed
+//  until it is hung up; the AT command state machine must be idle
+//  and must not be updated in the meantime.
+//
+//  Build with MODEM_DATA_LOOPBACK defined to replace the modem port
+//  with a local stand-in for the ground endpoint.
+//
+//******************************************************************************
+
+#ifndef _MODEMDATA_H
+
+    #define _MODEMDATA_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+/*artldef+*/
+#define MAX_DATA_CALL_NUMBER        20      // Includes NULL
+/*artldef-*/
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+/*artltyp+*/
+// Result of a bulk transfer, as returned by ProcessDataTransfer() and
+// StartDataCallTransfer().
+typedef BYTE    DATA_XFER_STATUS;
+enum data_xfer_status
+{
+    DATA_XFER_WAITING,          // Transfer (or fragmenting) still in progress.
+    DATA_XFER_SUCCESS,          // Ground acknowledged the whole file.
+    DATA_XFER_FAILED,           // Call failed or dropped - may be resumed.
+    DATA_XFER_FRAGMENTED,       // File was queued as SBD fragments.
+    DATA_XFER_FRAGMENT_ERROR,   // File could not be fragmented.
+    DATA_XFER_BUSY,             // AT layer or another transfer busy - try later.
+    DATA_XFER_OFF_HOOK,         // Voice call holds the channel.
+    DATA_XFER_FILE_ERROR        // Not a bulk file, or it could not be read.
+};
+/*artltyp-*/
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+/*artlx+*/
+//******************************************************************************
+//
+//  Function: InitModemData
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables and timers.
+//
+//******************************************************************************
+void InitModemData( void );
+
+
+//******************************************************************************
+//
+//  Function: IsBulkFile
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to check.
+//
+//  Returns: TRUE if the file should be sent by data call.
+//           FALSE otherwise.
+//
+//  Description: A file is a bulk file when a data call number is configured
+//               and the file exceeds both the threshold and MODEM_MO_BUF_LEN.
+//
+//******************************************************************************
+BOOL IsBulkFile( const char* szPathFilename );
+
+
+//******************************************************************************
+//
+//  Function: StartDataCallTransfer
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to send.
+//
+//  Returns: DATA_XFER_WAITING if the data call was dialed.
+//           DATA_XFER_BUSY if the AT layer or another transfer is busy.
+//           DATA_XFER_OFF_HOOK if the phone is off hook.
+//           DATA_XFER_FILE_ERROR if the file is not a bulk file or could
+//                                not be read.
+//
+//  Description: Dials the data call for a bulk file. ProcessDataTransfer()
+//               must then be called until it stops returning
+//               DATA_XFER_WAITING.
+//
+//******************************************************************************
+DATA_XFER_STATUS StartDataCallTransfer( const char* szPathFilename );
+
+
+//******************************************************************************
+//
+//  Function: StartSBDFragmenting
+//
+//  Arguments:
+//    IN  szPathFilename - Path and file name of the file to fragment.
+//
+//  Returns: TRUE if fragmenting was started.
+//           FALSE if the file could not be opened.
+//
+//  Description: Splits the file into MODEM_MO_BUF_LEN sized fragments, one per
+//               call to ProcessDataTransfer(), and queues them to the modem
+//               outbox. The original file is left untouched.
+//
+//******************************************************************************
+BOOL StartSBDFragmenting( const char* szPathFilename );
+
+
+//******************************************************************************
+//
+//  Function: ProcessDataTransfer
+//
+//  Arguments: void.
+//
+//  Returns: DATA_XFER_STATUS enum value.
+//
+//  Description: Must be called periodically while a transfer or fragmenting
+//               is in progress.
+//
+//******************************************************************************
+DATA_XFER_STATUS ProcessDataTransfer( void );
+
+
+//******************************************************************************
+//
+//  Function: IsDataCallActive
+//
+//  Arguments: void.
+//
+//  Returns: TRUE from the moment the call is dialed until it is hung up.
+//           FALSE otherwise.
+//
+//  Description: Lets the upper layer know the modem is in a data call.
+//
+//******************************************************************************
+BOOL IsDataCallActive( void );
+
+
+//******************************************************************************
+//
+//  Function: SetDataCallNumber
+//
+//  Arguments:
+//    IN  szNumber - Ground endpoint number to dial (digits only). An empty
+//                   string disables data call transfers (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the data call number.
+//               Ignored on an SBD only transceiver (MODEM_HAS_DATA_CALL).
+//
+//******************************************************************************
+void SetDataCallNumber( const char* szNumber );
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallNumber
+//
+//  Arguments: void.
+//
+//  Returns: Pointer to the configured data call number.
+//
+//  Description: Allows embedded rules to get the data call number.
+//
+//******************************************************************************
+const char* GetDataCallNumber( void );
+
+
+//******************************************************************************
+//
+//  Function: SetDataCallThreshold
+//
+//  Arguments:
+//    IN  dwThresholdInBytes - Files larger than this (and MODEM_MO_BUF_LEN) are
+//                             sent by data call. Previous value maintained
+//                             on a zero value.
+//                             DEFAULT: 16384 bytes
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the bulk transfer threshold.
+//
+//******************************************************************************
+void SetDataCallThreshold( const DWORD dwThresholdInBytes );
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallThreshold
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the bulk transfer threshold in bytes.
+//
+//  Description: Allows embedded rules to get the bulk transfer threshold.
+//
+//******************************************************************************
+DWORD GetDataCallThreshold( void );
+
+
+//******************************************************************************
+//
+//  Function: GetDataCallBytesSent
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the file bytes acknowledged by the ground over
+//           data calls since power up.
+//
+//  Description: Data call throughput counter.
+//
+//******************************************************************************
+DWORD GetDataCallBytesSent( void );
+/*artlx-*/
+
+
+#ifdef MODEM_DATA_LOOPBACK
+//******************************************************************************
+//
+//  Function: SetDataLoopbackDropAfter
+//
+//  Arguments:
+//    IN  dwBytes - Number of uplink bytes after which the stand-in drops
+//                  the call (0 to never drop).
+//
+//  Returns: void.
+//
+//  Description: Lets a test exercise the resume path of the protocol.
+//
+//******************************************************************************
+void SetDataLoopbackDropAfter( const DWORD dwBytes );
+
+
+//******************************************************************************
+//
+//  Function: GetDataLoopbackBytesReceived
+//
+//  Arguments: void.
+//
+//  Returns: DWORD value of the contiguous file bytes held by the stand-in.
+//
+//  Description: Lets a test verify what the ground endpoint received.
+//
+//******************************************************************************
+DWORD GetDataLoopbackBytesReceived( void );
+#endif
+
+
+#endif // _MODEMDATA_H
@@ -0,0 +1,1303 @@
+//******************************************************************************
+//
+//  ModemGround.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module stands in for the transceiver, the Iridium gateway and the
+//  ground endpoint. It is only built with MODEM_GROUND_LOOPBACK defined.
+//
+//  The simulated transceiver answers the AT commands the driver uses, with
+//  numeric result codes and no echo:
+//
+//      +SBDWB, +SBDWT, +SBDD0, +SBDIX(A), +SBDSX, +SBDRB,
+//      +CSQF, +CREG?, +CGSN, +CGMR, +CLCC, +CHUP, +SBDMTA, +SBDAREG
+//
+//  An SBD session takes the configured session time. It delivers the MO
+//  buffer to the ground endpoint and moves the next queued MT message, if
+//  any, into the MT buffer. Outside coverage the session fails with no
+//  network service (+SBDIX MO status 32).
+//
+//  The ground endpoint sends commands as REQ_MSG, with a date/time token
+//  that increases strictly. The unit echoes it as the time requested of
+//  the acknowledgement report, so each report delivered is expanded and
+//  its time requested looked up in the commands awaiting an ack.
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#ifdef MODEM_GROUND_LOOPBACK
+
+#include "FileUtils.h"
+#include "GpsPort.h"
+#include "Modem.h"
+#include "ModemGround.h"
+#include "ModemSerial.h"
+#include "MsgHandler.h"
+#include "MtcePort.h"
+#include "ReportHdrCodec.h"
+#include "timer.h"
+#include "utils.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define GROUND_MT_Q_LEN             16      // Messages queued at the gateway
+#define GROUND_MAX_MT_LEN           64      // Commands are short
+#define GROUND_MAX_PENDING          32      // Commands awaiting an ack
+#define GROUND_CMD_LINE_LEN         160     // +SBDWT carries up to 120 chars
+#define GROUND_RSP_LEN              64
+#define GROUND_NO_PENDING           0xFF
+
+#define GROUND_DEFAULT_COVERAGE     100     // in percent
+#define GROUND_DEFAULT_SESSION_SECS 8
+#define GROUND_COVERAGE_PERIOD      60000   // in ms, coverage is redrawn
+#define GROUND_TICK                 1000    // in ms, ack timeout check
+#define GROUND_ACK_TIMEOUT          7200    // in seconds, counted as lost
+
+#define GROUND_IMEI                 "300234010000000"
+#define GROUND_SW_REV               "LB00001"
+
+#define GROUND_CHECKSUM_SIZE        2
+
+// +SBDIX MO and MT status
+#define SBDI_MO_SUCCESS             0
+#define SBDI_MO_NO_NETWORK          32
+#define SBDI_MT_NONE                0
+#define SBDI_MT_RECEIVED            1
+#define SBDI_MT_ERROR               2
+
+// As read by DefineMsgTypeDestPath()
+#define MT_TYPE_WORD_OFFSET         1
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef BYTE    GROUND_RX_MODES;
+enum ground_rx_modes
+{
+    GROUND_RX_COMMAND,
+    GROUND_RX_BINARY
+};
+
+
+typedef struct
+{
+    WORD  wLength;
+    BYTE  byPending;                // Index into pendingCmds, if tracked
+    BYTE  byMsg[GROUND_MAX_MT_LEN];
+
+} GROUND_MT_MSG;
+
+
+typedef struct
+{
+    BOOL  bInUse;
+    BYTE  byStats;                  // Index into latencyStats
+    DWORD dwToken;                  // REQ_MSG date/time
+    DWORD dwQueued;
+    DWORD dwDownloaded;             // Zero until it reaches the MT buffer
+
+} GROUND_PENDING_CMD;
+
+
+// Simulated transceiver
+typedef struct
+{
+    GROUND_RX_MODES rxMode;
+    char  szCmd[GROUND_CMD_LINE_LEN];
+    WORD  wCmdIndex;
+    WORD  wBinExpected;             // Message plus checksum
+    WORD  wBinIndex;
+    BYTE  byMO[MODEM_MO_BUF_LEN + GROUND_CHECKSUM_SIZE];
+    WORD  wMOLen;
+    BYTE  byMT[GROUND_MAX_MT_LEN];
+    WORD  wMTLen;
+    WORD  wMOMSN;
+    WORD  wMTMSN;
+    BYTE  byMTWaiting;              // Queued count from the last session
+    BOOL  bRingAlert;
+    BOOL  bInCoverage;
+
+} GROUND_ISU;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static GROUND_ISU           isu;
+
+static GROUND_MT_MSG        mtQueue[GROUND_MT_Q_LEN];
+static BYTE                 byMTHead;
+static BYTE                 byMTCount;
+
+static GROUND_PENDING_CMD   pendingCmds[GROUND_MAX_PENDING];
+static GROUND_LATENCY_STATS latencyStats[GROUND_NBR_CMD_TYPES];
+static HDR_CODEC_STATE      groundHdr;
+static BYTE                 byExpanded[MODEM_MO_BUF_LEN + MAX_HDR_CODEC_REF_SIZE];
+
+static const WORD           wBenchCmds[GROUND_NBR_CMD_TYPES] =
+{
+    EEPROM_CFG_REQ,
+    POWER_CYCLE_CIS,
+    ROIACK_MSG_TYPE
+};
+
+// Upper bound of each bucket but the last, in seconds
+static const WORD           wBucketLimit[GROUND_NBR_BUCKETS - 1] =
+{
+    15, 30, 60, 120, 300, 600, 1800
+};
+
+static BYTE                 byCoverage;
+static WORD                 wBenchLoad;
+static BYTE                 bySessionSecs;
+static BYTE                 byNextCmd;
+static DWORD                dwLastToken;
+static DWORD                dwRandSeed;
+static BOOL                 bNoTimeReqReported;
+
+static TIMERHANDLE          thSession;
+static TIMERHANDLE          thCoverage;
+static TIMERHANDLE          thNextCmd;
+static TIMERHANDLE          thTick;
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static void  ProcessCommandLine( void );
+static void  ProcessBinaryByte( BYTE byData );
+static void  RunSession( void );
+static void  ReportSBDStatus( void );
+static void  ReadMTBuffer( void );
+static void  DrawCoverage( void );
+static void  Respond( const char* szRsp );
+static void  AppendValue( char* szRsp, DWORD dwValue, BOOL bLast );
+static WORD  SumBytes( const BYTE* pbyData, WORD wLength );
+static BOOL  QueueMT( const BYTE* pbyMsg, WORD wLength, BYTE byPending );
+static void  MatchAck( const BYTE* pbyMsg, WORD wLength );
+static void  RecordLatency( GROUND_PENDING_CMD* pCmd, DWORD dwNow );
+static void  ExpireCommands( DWORD dwNow );
+static BYTE  FindStats( WORD wMsgType );
+static DWORD LatencyPercentile( const GROUND_LATENCY_STATS* pStats, BYTE byPercent );
+static DWORD NextCmdInterval( void );
+static WORD  GroundRandom( WORD wRange );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitModemGround
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables. Coverage starts at
+//               100% and the benchmark load at zero (off).
+//
+//******************************************************************************
+void InitModemGround( void )
+{
+    MemSet( &isu, 0, sizeof( isu ) );
+    isu.bInCoverage = TRUE;
+
+    MemSet( mtQueue, 0, sizeof( mtQueue ) );
+    byMTHead  = 0;
+    byMTCount = 0;
+
+    MemSet( pendingCmds, 0, sizeof( pendingCmds ) );
+    MemSet( latencyStats, 0, sizeof( latencyStats ) );
+    InitHdrCodecState( &groundHdr );
+
+    byCoverage    = GROUND_DEFAULT_COVERAGE;
+    wBenchLoad    = 0;
+    bySessionSecs = GROUND_DEFAULT_SESSION_SECS;
+    byNextCmd     = 0;
+    dwLastToken   = 0;
+    dwRandSeed    = GetGpsTime();
+
+    bNoTimeReqReported = FALSE;
+
+    thSession  = RegisterTimer();
+    thCoverage = RegisterTimer();
+    thNextCmd  = RegisterTimer();
+    thTick     = RegisterTimer();
+
+    StartTimer( thCoverage, GROUND_COVERAGE_PERIOD );
+    StartTimer( thTick, GROUND_TICK );
+}
+
+
+//******************************************************************************
+//
+//  Function: UpdateModemGround
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Runs the simulated session timing, coverage and benchmark
+//               load. Must be called periodically.
+//
+//******************************************************************************
+void UpdateModemGround( void )
+{
+    if( TimerExpired( thSession ) )
+    {
+        StopTimer( thSession );
+        RunSession();
+    }
+
+    if( TimerExpired( thCoverage ) )
+    {
+        ResetTimer( thCoverage, GROUND_COVERAGE_PERIOD );
+        DrawCoverage();
+    }
+
+    if( TimerExpired( thNextCmd ) )
+    {
+        ResetTimer( thNextCmd, NextCmdInterval() );
+
+        // A full gateway queue is counted by the backlog it leaves, not
+        // as a lost command.
+        if( InjectGroundCommand( wBenchCmds[byNextCmd] ) )
+        {
+            byNextCmd = ( byNextCmd + 1 ) % GROUND_NBR_CMD_TYPES;
+        }
+    }
+
+    if( TimerExpired( thTick ) )
+    {
+        ResetTimer( thTick, GROUND_TICK );
+        ExpireCommands( GetGpsTime() );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: ModemGroundUplink
+//
+//  Arguments:
+//    IN  pBuffer - Bytes sent to the modem port.
+//    IN  wLength - Number of bytes.
+//
+//  Returns: void.
+//
+//  Description: Takes the bytes the driver writes to the modem port, in
+//               place of the UART. Responses are added to the modem port
+//               receive queue.
+//
+//******************************************************************************
+void ModemGroundUplink( const BYTE* pBuffer, WORD wLength )
+{
+    WORD wIndex;
+
+    for( wIndex = 0; wIndex < wLength; wIndex++ )
+    {
+        if( isu.rxMode == GROUND_RX_BINARY )
+        {
+            ProcessBinaryByte( pBuffer[wIndex] );
+        }
+        else if( pBuffer[wIndex] == '\r' )
+        {
+            isu.szCmd[isu.wCmdIndex] = NULL;
+
+            if( isu.wCmdIndex != 0 )
+            {
+                ProcessCommandLine();
+            }
+
+            isu.wCmdIndex = 0;
+        }
+        else if( ( pBuffer[wIndex] != '\n' ) &&
+                 ( isu.wCmdIndex < GROUND_CMD_LINE_LEN - 1 ) )
+        {
+            isu.szCmd[isu.wCmdIndex++] = pBuffer[wIndex];
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: InjectGroundMT
+//
+//  Arguments:
+//    IN  pbyMsg  - MT message, as sent by the ground endpoint.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message was queued at the gateway.
+//           FALSE if the gateway queue is full or the message too long.
+//
+//  Description: Queues an MT message for the unit. The message is not
+//               tracked for an acknowledgement.
+//
+//******************************************************************************
+BOOL InjectGroundMT( const BYTE* pbyMsg, WORD wLength )
+{
+    return QueueMT( pbyMsg, wLength, GROUND_NO_PENDING );
+}
+
+
+//******************************************************************************
+//
+//  Function: InjectGroundCommand
+//
+//  Arguments:
+//    IN  wMsgType - Command to send (e.g. EEPROM_CFG_REQ).
+//
+//  Returns: TRUE if the command was queued at the gateway.
+//           FALSE if the gateway queue is full or too many commands are
+//                 awaiting an acknowledgement.
+//
+//  Description: Queues a command for the unit and times it until its
+//               acknowledgement is received.
+//
+//******************************************************************************
+BOOL InjectGroundCommand( WORD wMsgType )
+{
+    REQ_MSG reqMsg;
+    WORD*   pwMsg = (WORD*)&reqMsg;
+    DWORD   dwNow = GetGpsTime();
+    BYTE    byStats;
+    BYTE    byPending;
+
+    byStats = FindStats( wMsgType );
+
+    if( byStats == GROUND_NBR_CMD_TYPES )
+    {
+        return FALSE;
+    }
+
+    for( byPending = 0; byPending < GROUND_MAX_PENDING; byPending++ )
+    {
+        if( !pendingCmds[byPending].bInUse )
+        {
+            break;
+        }
+    }
+
+    if( byPending == GROUND_MAX_PENDING )
+    {
+        return FALSE;
+    }
+
+    // The token must be unique among the commands awaiting an ack, so two
+    // commands in the same second are a second apart.
+    dwLastToken = ( dwNow > dwLastToken ) ? dwNow : dwLastToken + 1;
+
+    MemSet( &reqMsg, 0, sizeof( REQ_MSG ) );
+    pwMsg[MT_TYPE_WORD_OFFSET] = wMsgType;
+    reqMsg.dwDateTime          = dwLastToken;
+
+    // Not checked by the unit, but set as the ground endpoint would.
+    pwMsg[0] = CalcCRC( (BYTE*)&pwMsg[1], sizeof( REQ_MSG ) - sizeof( WORD ) );
+
+    if( !QueueMT( (BYTE*)&reqMsg, sizeof( REQ_MSG ), byPending ) )
+    {
+        return FALSE;
+    }
+
+    pendingCmds[byPending].bInUse       = TRUE;
+    pendingCmds[byPending].byStats      = byStats;
+    pendingCmds[byPending].dwToken      = dwLastToken;
+    pendingCmds[byPending].dwQueued     = dwNow;
+    pendingCmds[byPending].dwDownloaded = 0;
+
+    latencyStats[byStats].wMsgType = wMsgType;
+    latencyStats[byStats].dwSent++;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: SetGroundCoverage
+//
+//  Arguments:
+//    IN  byPercent - Share of the time the unit is in coverage (0-100).
+//                    DEFAULT: 100
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the simulated coverage.
+//
+//******************************************************************************
+void SetGroundCoverage( const BYTE byPercent )
+{
+    byCoverage = ( byPercent > 100 ) ? 100 : byPercent;
+
+    DrawCoverage();
+}
+
+
+//******************************************************************************
+//
+//  Function: SetGroundLoad
+//
+//  Arguments:
+//    IN  wCmdsPerHour - Commands the benchmark sends per hour, cycling
+//                       through EEPROM_CFG_REQ, POWER_CYCLE_CIS and
+//                       ROIACK_MSG_TYPE. Zero stops the benchmark.
+//                       DEFAULT: 0
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to start the latency benchmark. The
+//               arrivals are spread at random around the mean interval.
+//
+//******************************************************************************
+void SetGroundLoad( const WORD wCmdsPerHour )
+{
+    wBenchLoad = wCmdsPerHour;
+
+    if( wBenchLoad != 0 )
+    {
+        StartTimer( thNextCmd, NextCmdInterval() );
+    }
+    else
+    {
+        StopTimer( thNextCmd );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: SetGroundSessionTime
+//
+//  Arguments:
+//    IN  bySeconds - Time the simulated +SBDIX session takes. Previous
+//                    value maintained on a zero value.
+//                    DEFAULT: 8 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the simulated session time.
+//
+//******************************************************************************
+void SetGroundSessionTime( const BYTE bySeconds )
+{
+    if( bySeconds != 0 )
+    {
+        bySessionSecs = bySeconds;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetGroundLatencyStats
+//
+//  Arguments:
+//    IN  byIndex - 0 to GROUND_NBR_CMD_TYPES-1.
+//    OUT pStats  - Latency of one command type.
+//
+//  Returns: TRUE if the entry is in use.
+//           FALSE otherwise.
+//
+//  Description: The histogram buckets end at 15, 30, 60, 120, 300, 600 and
+//               1800 seconds; the last bucket holds everything longer.
+//
+//******************************************************************************
+BOOL GetGroundLatencyStats( BYTE byIndex, GROUND_LATENCY_STATS* pStats )
+{
+    if( ( byIndex >= GROUND_NBR_CMD_TYPES ) ||
+        ( latencyStats[byIndex].dwSent == 0 ) )
+    {
+        return FALSE;
+    }
+
+    MemCpy( pStats, &latencyStats[byIndex], sizeof( GROUND_LATENCY_STATS ) );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ClearGroundLatencyStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the latency statistics and forgets the commands
+//               still awaiting an acknowledgement.
+//
+//******************************************************************************
+void ClearGroundLatencyStats( void )
+{
+    BYTE byIndex;
+
+    MemSet( pendingCmds, 0, sizeof( pendingCmds ) );
+    MemSet( latencyStats, 0, sizeof( latencyStats ) );
+
+    // Commands still at the gateway are no longer tracked.
+    for( byIndex = 0; byIndex < GROUND_MT_Q_LEN; byIndex++ )
+    {
+        mtQueue[byIndex].byPending = GROUND_NO_PENDING;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: DisplayGroundLatencyStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Prints the count, mean, 50th/90th/99th percentile (bucket
+//               upper bound) and maximum latency of each command type to
+//               the mtce port.
+//
+//******************************************************************************
+void DisplayGroundLatencyStats( void )
+{
+    GROUND_LATENCY_STATS* pStats;
+    char szValue[12];
+    BYTE byIndex;
+
+    SendStringToMtcePort( "\r\n[GROUND] coverage " );
+    IntToString( szValue, byCoverage, 1 );
+    SendStringToMtcePort( szValue );
+    SendStringToMtcePort( "% load " );
+    IntToString( szValue, wBenchLoad, 1 );
+    SendStringToMtcePort( szValue );
+    SendStringToMtcePort( "/h queued " );
+    IntToString( szValue, byMTCount, 1 );
+    SendStringToMtcePort( szValue );
+
+    for( byIndex = 0; byIndex < GROUND_NBR_CMD_TYPES; byIndex++ )
+    {
+        pStats = &latencyStats[byIndex];
+
+        if( pStats->dwSent == 0 )
+        {
+            continue;
+        }
+
+        SendStringToMtcePort( "\r\n[GROUND] type " );
+        IntToString( szValue, pStats->wMsgType, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( " sent " );
+        IntToString( szValue, pStats->dwSent, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( " acked " );
+        IntToString( szValue, pStats->dwAcked, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( " lost " );
+        IntToString( szValue, pStats->dwLost, 1 );
+        SendStringToMtcePort( szValue );
+
+        if( pStats->dwAcked == 0 )
+        {
+            continue;
+        }
+
+        SendStringToMtcePort( "\r\n[GROUND]   min " );
+        IntToString( szValue, pStats->dwMinSecs, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s mean " );
+        IntToString( szValue, pStats->dwTotalSecs / pStats->dwAcked, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s (mt " );
+        IntToString( szValue, pStats->dwTotalMTSecs / pStats->dwAcked, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s) p50 " );
+        IntToString( szValue, LatencyPercentile( pStats, 50 ), 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s p90 " );
+        IntToString( szValue, LatencyPercentile( pStats, 90 ), 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s p99 " );
+        IntToString( szValue, LatencyPercentile( pStats, 99 ), 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s max " );
+        IntToString( szValue, pStats->dwMaxSecs, 1 );
+        SendStringToMtcePort( szValue );
+        SendStringToMtcePort( "s" );
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: ProcessCommandLine
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Answers one AT command line, held in isu.szCmd without its
+//               carriage return.
+//
+//******************************************************************************
+void ProcessCommandLine( void )
+{
+    char szRsp[GROUND_RSP_LEN];
+    WORD wLength;
+
+    if( FindSubStr( 0, isu.szCmd, "AT+SBDWB=", isu.wCmdIndex ) == 0 )
+    {
+        wLength = (WORD)StringToInt( &isu.szCmd[9] );
+
+        if( ( wLength == 0 ) || ( wLength > MODEM_MO_BUF_LEN ) )
+        {
+            Respond( "3\r\n" );
+            return;
+        }
+
+        isu.rxMode       = GROUND_RX_BINARY;
+        isu.wBinExpected = wLength + GROUND_CHECKSUM_SIZE;
+        isu.wBinIndex    = 0;
+        Respond( "READY\r\n" );
+    }
+    else if( FindSubStr( 0, isu.szCmd, "AT+SBDWT=", isu.wCmdIndex ) == 0 )
+    {
+        isu.wMOLen = isu.wCmdIndex - 9;
+        MemCpy( isu.byMO, &isu.szCmd[9], isu.wMOLen );
+        Respond( "0\r" );
+    }
+    else if( ( StringCmp( isu.szCmd, "AT+SBDIX" ) == 0 ) ||
+             ( StringCmp( isu.szCmd, "AT+SBDIXA" ) == 0 ) )
+    {
+        // Answered when the session ends
+        StartTimer( thSession, (DWORD)bySessionSecs * 1000 );
+    }
+    else if( StringCmp( isu.szCmd, "AT+SBDSX" ) == 0 )
+    {
+        ReportSBDStatus();
+    }
+    else if( StringCmp( isu.szCmd, "AT+SBDRB" ) == 0 )
+    {
+        ReadMTBuffer();
+    }
+    else if( StringCmp( isu.szCmd, "AT+SBDD0" ) == 0 )
+    {
+        isu.wMOLen = 0;
+        Respond( "0\r\n0\r" );
+    }
+    else if( StringCmp( isu.szCmd, "AT+CSQF" ) == 0 )
+    {
+        StringCpy( szRsp, "+CSQF:" );
+        AppendValue( szRsp, isu.bInCoverage ? 3 + GroundRandom( 3 ) : 0, TRUE );
+        StringCat( szRsp, "\r\n0\r" );
+        Respond( szRsp );
+    }
+    else if( StringCmp( isu.szCmd, "AT+CREG?" ) == 0 )
+    {
+        Respond( isu.bInCoverage ? "+CREG:000,001\r\n0\r" : "+CREG:000,002\r\n0\r" );
+    }
+    else if( StringCmp( isu.szCmd, "AT+CGSN" ) == 0 )
+    {
+        Respond( GROUND_IMEI "\r\n0\r" );
+    }
+    else if( StringCmp( isu.szCmd, "AT+CGMR" ) == 0 )
+    {
+        Respond( "Call Processor Version: " GROUND_SW_REV "\r\n0\r" );
+    }
+    else if( StringCmp( isu.szCmd, "AT+CLCC" ) == 0 )
+    {
+        // No call in progress
+        Respond( "+CLCC:006\r\n0\r" );
+    }
+#if MODEM_HAS_RING_ALERT
+    else if( FindSubStr( 0, isu.szCmd, "AT+SBDAREG=", isu.wCmdIndex ) == 0 )
+    {
+        Respond( "0\r" );
+    }
+#endif
+    else if( ( FindSubStr( 0, isu.szCmd, "AT+SBDMTA=", isu.wCmdIndex ) == 0 ) ||
+             ( StringCmp( isu.szCmd, "AT+CHUP" ) == 0 ) )
+    {
+        Respond( "0\r" );
+    }
+    else
+    {
+        Respond( "4\r" );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: ProcessBinaryByte
+//
+//  Arguments:
+//    IN  byData - Next byte of an +SBDWB message or its checksum.
+//
+//  Returns: void.
+//
+//  Description: Stores the byte; once the checksum is in, the message is
+//               kept as the MO buffer if the checksum matches.
+//
+//******************************************************************************
+void ProcessBinaryByte( BYTE byData )
+{
+    WORD wLength;
+    WORD wCheckSum;
+
+    isu.byMO[isu.wBinIndex++] = byData;
+
+    if( isu.wBinIndex < isu.wBinExpected )
+    {
+        return;
+    }
+
+    isu.rxMode = GROUND_RX_COMMAND;
+    wLength    = isu.wBinExpected - GROUND_CHECKSUM_SIZE;
+    wCheckSum  = ( (WORD)isu.byMO[wLength] << 8 ) | isu.byMO[wLength + 1];
+
+    if( wCheckSum != SumBytes( isu.byMO, wLength ) )
+    {
+        isu.wMOLen = 0;
+        Respond( "2\r\n" );
+        return;
+    }
+
+    isu.wMOLen = wLength;
+    Respond( "0\r\n0\r" );
+}
+
+
+//******************************************************************************
+//
+//  Function: RunSession
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Ends an +SBDIX session: the MO buffer is delivered to the
+//               ground endpoint and the next MT message downloaded.
+//
+//******************************************************************************
+void RunSession( void )
+{
+    GROUND_MT_MSG* pMT;
+    char  szRsp[GROUND_RSP_LEN];
+    BYTE  byMTStatus = SBDI_MT_NONE;
+
+    StringCpy( szRsp, "+SBDIX: " );
+
+    if( !isu.bInCoverage )
+    {
+        AppendValue( szRsp, SBDI_MO_NO_NETWORK, FALSE );
+        AppendValue( szRsp, isu.wMOMSN, FALSE );
+        AppendValue( szRsp, SBDI_MT_ERROR, FALSE );
+        AppendValue( szRsp, isu.wMTMSN, FALSE );
+        AppendValue( szRsp, 0, FALSE );
+        AppendValue( szRsp, 0, TRUE );
+        StringCat( szRsp, "\r\n0\r" );
+        Respond( szRsp );
+        return;
+    }
+
+    if( isu.wMOLen != 0 )
+    {
+        MatchAck( isu.byMO, isu.wMOLen );
+        isu.wMOMSN++;
+    }
+
+    if( byMTCount != 0 )
+    {
+        pMT = &mtQueue[byMTHead];
+
+        MemCpy( isu.byMT, pMT->byMsg, pMT->wLength );
+        isu.wMTLen = pMT->wLength;
+        isu.wMTMSN++;
+        byMTStatus = SBDI_MT_RECEIVED;
+
+        if( ( pMT->byPending != GROUND_NO_PENDING ) &&
+            pendingCmds[pMT->byPending].bInUse )
+        {
+            pendingCmds[pMT->byPending].dwDownloaded = GetGpsTime();
+        }
+
+        byMTHead = ( byMTHead + 1 ) % GROUND_MT_Q_LEN;
+        byMTCount--;
+    }
+
+    isu.byMTWaiting = byMTCount;
+    isu.bRingAlert  = FALSE;
+
+    AppendValue( szRsp, SBDI_MO_SUCCESS, FALSE );
+    AppendValue( szRsp, isu.wMOMSN, FALSE );
+    AppendValue( szRsp, byMTStatus, FALSE );
+    AppendValue( szRsp, isu.wMTMSN, FALSE );
+    AppendValue( szRsp, ( byMTStatus == SBDI_MT_RECEIVED ) ? isu.wMTLen : 0, FALSE );
+    AppendValue( szRsp, isu.byMTWaiting, TRUE );
+    StringCat( szRsp, "\r\n0\r" );
+    Respond( szRsp );
+}
+
+
+//******************************************************************************
+//
+//  Function: ReportSBDStatus
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Answers +SBDSX with the buffer flags, the ring alert and
+//               the MT queued count from the last session.
+//
+//******************************************************************************
+void ReportSBDStatus( void )
+{
+    char szRsp[GROUND_RSP_LEN];
+
+    StringCpy( szRsp, "+SBDSX: " );
+    AppendValue( szRsp, isu.wMOLen != 0, FALSE );
+    AppendValue( szRsp, isu.wMOMSN, FALSE );
+    AppendValue( szRsp, isu.wMTLen != 0, FALSE );
+    AppendValue( szRsp, isu.wMTMSN, FALSE );
+    AppendValue( szRsp, isu.bRingAlert, FALSE );
+    AppendValue( szRsp, isu.byMTWaiting, TRUE );
+    StringCat( szRsp, "\r\n0\r" );
+    Respond( szRsp );
+}
+
+
+//******************************************************************************
+//
+//  Function: ReadMTBuffer
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Answers +SBDRB: length, message and checksum, the length
+//               and checksum MSB first.
+//
+//******************************************************************************
+void ReadMTBuffer( void )
+{
+    BYTE byField[2];
+    WORD wCheckSum;
+
+    wCheckSum = SumBytes( isu.byMT, isu.wMTLen );
+
+    byField[0] = HIBYTE( isu.wMTLen );
+    byField[1] = LOBYTE( isu.wMTLen );
+    LoopbackModemPortRx( byField, sizeof( byField ) );
+    LoopbackModemPortRx( isu.byMT, isu.wMTLen );
+
+    byField[0] = HIBYTE( wCheckSum );
+    byField[1] = LOBYTE( wCheckSum );
+    LoopbackModemPortRx( byField, sizeof( byField ) );
+
+    Respond( "0\r" );
+}
+
+
+//******************************************************************************
+//
+//  Function: DrawCoverage
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Draws whether the unit is in coverage for the next period.
+//               The ring alert is raised on entering coverage with MT
+//               messages queued.
+//
+//******************************************************************************
+void DrawCoverage( void )
+{
+    isu.bInCoverage = GroundRandom( 100 ) < byCoverage;
+
+#if MODEM_HAS_RING_ALERT
+    if( isu.bInCoverage && ( byMTCount != 0 ) )
+    {
+        isu.bRingAlert = TRUE;
+    }
+#endif
+}
+
+
+//******************************************************************************
+//
+//  Function: Respond
+//
+//  Arguments:
+//    IN  szRsp - Response from the simulated transceiver.
+//
+//  Returns: void.
+//
+//  Description: Adds the response to the modem port receive queue.
+//
+//******************************************************************************
+void Respond( const char* szRsp )
+{
+    LoopbackModemPortRx( (const BYTE*)szRsp, StringLen( szRsp ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: AppendValue
+//
+//  Arguments:
+//    IN/OUT  szRsp   - Response being built.
+//    IN      dwValue - Value to append.
+//    IN      bLast   - FALSE to follow the value with ", ".
+//
+//  Returns: void.
+//
+//******************************************************************************
+void AppendValue( char* szRsp, DWORD dwValue, BOOL bLast )
+{
+    char szValue[12];
+
+    IntToString( szValue, dwValue, 1 );
+    StringCat( szRsp, szValue );
+
+    if( !bLast )
+    {
+        StringCat( szRsp, ", " );
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: SumBytes
+//
+//  Arguments:
+//    IN  pbyData - Message.
+//    IN  wLength - Length of the message.
+//
+//  Returns: The least significant 16 bits of the byte sum, as the SBD
+//           checksum.
+//
+//******************************************************************************
+WORD SumBytes( const BYTE* pbyData, WORD wLength )
+{
+    WORD wSum = 0;
+    WORD wIndex;
+
+    for( wIndex = 0; wIndex < wLength; wIndex++ )
+    {
+        wSum += pbyData[wIndex];
+    }
+
+    return wSum;
+}
+
+
+//******************************************************************************
+//
+//  Function: QueueMT
+//
+//  Arguments:
+//    IN  pbyMsg    - MT message.
+//    IN  wLength   - Length of the message.
+//    IN  byPending - Index into pendingCmds, or GROUND_NO_PENDING.
+//
+//  Returns: TRUE if the message was queued at the gateway.
+//           FALSE if the gateway queue is full or the message too long.
+//
+//******************************************************************************
+BOOL QueueMT( const BYTE* pbyMsg, WORD wLength, BYTE byPending )
+{
+    GROUND_MT_MSG* pMT;
+
+    if( ( byMTCount == GROUND_MT_Q_LEN ) || ( wLength == 0 ) ||
+        ( wLength > GROUND_MAX_MT_LEN ) || ( wLength > MODEM_MT_BUF_LEN ) )
+    {
+        return FALSE;
+    }
+
+    pMT = &mtQueue[( byMTHead + byMTCount ) % GROUND_MT_Q_LEN];
+    MemCpy( pMT->byMsg, (void*)pbyMsg, wLength );
+    pMT->wLength   = wLength;
+    pMT->byPending = byPending;
+    byMTCount++;
+
+#if MODEM_HAS_RING_ALERT
+    if( isu.bInCoverage )
+    {
+        isu.bRingAlert = TRUE;
+    }
+#endif
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: MatchAck
+//
+//  Arguments:
+//    IN  pbyMsg  - Report delivered by an SBD session.
+//    IN  wLength - Length of the report.
+//
+//  Returns: void.
+//
+//  Description: Expands the report header and completes the command whose
+//               token is the report's time requested. Acks of commands
+//               already completed or expired are ignored. If the report
+//               header has no time requested field, this is reported once
+//               on the mtce port.
+//
+//******************************************************************************
+void MatchAck( const BYTE* pbyMsg, WORD wLength )
+{
+    DWORD dwToken;
+    BYTE  byIndex;
+
+    wLength = ExpandReportHdr( &groundHdr, pbyMsg, wLength, byExpanded,
+                               sizeof( byExpanded ) );
+
+    if( !GetReportHdrField( byExpanded, wLength, RPT_HDR_FIELD_TIME_REQUESTED, &dwToken ) )
+    {
+        if( !bNoTimeReqReported )
+        {
+            SendStringToMtcePort( "\r\n[GROUND] report time requested not found - acks cannot be matched" );
+            bNoTimeReqReported = TRUE;
+        }
+        return;
+    }
+
+    if( dwToken == 0 )
+    {
+        return;
+    }
+
+    for( byIndex = 0; byIndex < GROUND_MAX_PENDING; byIndex++ )
+    {
+        if( pendingCmds[byIndex].bInUse &&
+            ( pendingCmds[byIndex].dwToken == dwToken ) )
+        {
+            RecordLatency( &pendingCmds[byIndex], GetGpsTime() );
+            pendingCmds[byIndex].bInUse = FALSE;
+            return;
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: RecordLatency
+//
+//  Arguments:
+//    IN  pCmd  - Command acknowledged.
+//    IN  dwNow - GPS time of the acknowledgement.
+//
+//  Returns: void.
+//
+//******************************************************************************
+void RecordLatency( GROUND_PENDING_CMD* pCmd, DWORD dwNow )
+{
+    GROUND_LATENCY_STATS* pStats = &latencyStats[pCmd->byStats];
+    DWORD dwSecs   = dwNow - pCmd->dwQueued;
+    DWORD dwMTSecs = dwSecs;
+    BYTE  byBucket;
+
+    if( pCmd->dwDownloaded != 0 )
+    {
+        dwMTSecs = pCmd->dwDownloaded - pCmd->dwQueued;
+    }
+
+    if( ( pStats->dwAcked == 0 ) || ( dwSecs < pStats->dwMinSecs ) )
+    {
+        pStats->dwMinSecs = dwSecs;
+    }
+
+    if( dwSecs > pStats->dwMaxSecs )
+    {
+        pStats->dwMaxSecs = dwSecs;
+    }
+
+    pStats->dwAcked++;
+    pStats->dwTotalSecs   += dwSecs;
+    pStats->dwTotalMTSecs += dwMTSecs;
+
+    for( byBucket = 0; byBucket < GROUND_NBR_BUCKETS - 1; byBucket++ )
+    {
+        if( dwSecs <= wBucketLimit[byBucket] )
+        {
+            break;
+        }
+    }
+
+    pStats->dwBucket[byBucket]++;
+}
+
+
+//******************************************************************************
+//
+//  Function: ExpireCommands
+//
+//  Arguments:
+//    IN  dwNow - GPS time.
+//
+//  Returns: void.
+//
+//  Description: Counts the commands not acknowledged within
+//               GROUND_ACK_TIMEOUT as lost.
+//
+//******************************************************************************
+void ExpireCommands( DWORD dwNow )
+{
+    BYTE byIndex;
+
+    for( byIndex = 0; byIndex < GROUND_MAX_PENDING; byIndex++ )
+    {
+        if( pendingCmds[byIndex].bInUse &&
+            ( dwNow - pendingCmds[byIndex].dwQueued > GROUND_ACK_TIMEOUT ) )
+        {
+            latencyStats[pendingCmds[byIndex].byStats].dwLost++;
+            pendingCmds[byIndex].bInUse = FALSE;
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: FindStats
+//
+//  Arguments:
+//    IN  wMsgType - Command type.
+//
+//  Returns: Index into latencyStats for the type, a free entry if the
+//           type has none yet, or GROUND_NBR_CMD_TYPES if all are taken.
+//
+//******************************************************************************
+BYTE FindStats( WORD wMsgType )
+{
+    BYTE byFree = GROUND_NBR_CMD_TYPES;
+    BYTE byIndex;
+
+    for( byIndex = 0; byIndex < GROUND_NBR_CMD_TYPES; byIndex++ )
+    {
+        if( latencyStats[byIndex].dwSent == 0 )
+        {
+            if( byFree == GROUND_NBR_CMD_TYPES )
+            {
+                byFree = byIndex;
+            }
+        }
+        else if( latencyStats[byIndex].wMsgType == wMsgType )
+        {
+            return byIndex;
+        }
+    }
+
+    return byFree;
+}
+
+
+//******************************************************************************
+//
+//  Function: LatencyPercentile
+//
+//  Arguments:
+//    IN  pStats    - Latency of one command type, with acks recorded.
+//    IN  byPercent - Percentile wanted.
+//
+//  Returns: Upper bound of the bucket holding the percentile, in seconds,
+//           capped at the maximum.
+//
+//******************************************************************************
+DWORD LatencyPercentile( const GROUND_LATENCY_STATS* pStats, BYTE byPercent )
+{
+    DWORD dwCount = 0;
+    DWORD dwWanted;
+    BYTE  byBucket;
+
+    dwWanted = ( pStats->dwAcked * byPercent + 99 ) / 100;
+
+    for( byBucket = 0; byBucket < GROUND_NBR_BUCKETS - 1; byBucket++ )
+    {
+        dwCount += pStats->dwBucket[byBucket];
+
+        if( dwCount >= dwWanted )
+        {
+            return ( wBucketLimit[byBucket] < pStats->dwMaxSecs ) ?
+                   wBucketLimit[byBucket] : pStats->dwMaxSecs;
+        }
+    }
+
+    return pStats->dwMaxSecs;
+}
+
+
+//******************************************************************************
+//
+//  Function: NextCmdInterval
+//
+//  Arguments: void.
+//
+//  Returns: Time to the next benchmark command, in ms, drawn evenly from
+//           half to one and a half times the mean interval.
+//
+//******************************************************************************
+DWORD NextCmdInterval( void )
+{
+    DWORD dwMeanSecs = 3600 / wBenchLoad;
+
+    if( dwMeanSecs == 0 )
+    {
+        dwMeanSecs = 1;
+    }
+
+    return ( dwMeanSecs / 2 + GroundRandom( (WORD)dwMeanSecs + 1 ) ) * 1000;
+}
+
+
+//******************************************************************************
+//
+//  Function: GroundRandom
+//
+//  Arguments:
+//    IN  wRange - Number of values wanted.
+//
+//  Returns: A pseudo random value from 0 to wRange-1.
+//
+//******************************************************************************
+WORD GroundRandom( WORD wRange )
+{
+    dwRandSeed = dwRandSeed * 1103515245L + 12345;
+
+    return (WORD)( ( dwRandSeed >> 16 ) % wRange );
+}
+
+#endif // MODEM_GROUND_LOOPBACK
@@ -0,0 +1,260 @@
+//******************************************************************************
+//
+//  ModemGround.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module stands in for the transceiver, the Iridium gateway and the
+//  ground endpoint, so the time from a ground command being queued to its
+//  acknowledgement being received can be measured without air time. It is
+//  only built with MODEM_GROUND_LOOPBACK defined; the modem port is then
+//  connected to the simulated transceiver instead of the UART.
+//
+//  Commands are queued at the simulated gateway and reach the driver by
+//  its own mailbox checks and gateway polls. The acknowledgement report is
+//  matched to its command by the time requested in the report header,
+//  which is the command's date/time echoed back.
+//
+//  Coverage is drawn once a minute from the configured percentage; SBD
+//  sessions outside coverage fail with no network service.
+//
+//******************************************************************************
+
+#ifndef _MODEMGROUND_H
+
+    #define _MODEMGROUND_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+#ifdef MODEM_GROUND_LOOPBACK
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define GROUND_NBR_CMD_TYPES        3       // Command types the benchmark sends
+#define GROUND_NBR_BUCKETS          8       // Latency histogram buckets
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+// Command to acknowledgement latency of one command type, in seconds.
+typedef struct
+{
+    WORD  wMsgType;
+    DWORD dwSent;                   // Commands queued at the gateway
+    DWORD dwAcked;
+    DWORD dwLost;                   // Not acknowledged within the ack timeout
+    DWORD dwMinSecs;
+    DWORD dwMaxSecs;
+    DWORD dwTotalSecs;              // Queued to acknowledged
+    DWORD dwTotalMTSecs;            // Queued to downloaded by the unit
+    DWORD dwBucket[GROUND_NBR_BUCKETS];
+
+} GROUND_LATENCY_STATS;
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitModemGround
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables. Coverage starts at
+//               100% and the benchmark load at zero (off).
+//
+//******************************************************************************
+void InitModemGround( void );
+
+
+//******************************************************************************
+//
+//  Function: UpdateModemGround
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Runs the simulated session timing, coverage and benchmark
+//               load. Must be called periodically.
+//
+//******************************************************************************
+void UpdateModemGround( void );
+
+
+//******************************************************************************
+//
+//  Function: ModemGroundUplink
+//
+//  Arguments:
+//    IN  pBuffer - Bytes sent to the modem port.
+//    IN  wLength - Number of bytes.
+//
+//  Returns: void.
+//
+//  Description: Takes the bytes the driver writes to the modem port, in
+//               place of the UART. Responses are added to the modem port
+//               receive queue.
+//
+//******************************************************************************
+void ModemGroundUplink( const BYTE* pBuffer, WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: InjectGroundMT
+//
+//  Arguments:
+//    IN  pbyMsg  - MT message, as sent by the ground endpoint.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message was queued at the gateway.
+//           FALSE if the gateway queue is full or the message too long.
+//
+//  Description: Queues an MT message for the unit. The message is not
+//               tracked for an acknowledgement.
+//
+//******************************************************************************
+BOOL InjectGroundMT( const BYTE* pbyMsg, WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: InjectGroundCommand
+//
+//  Arguments:
+//    IN  wMsgType - Command to send (e.g. EEPROM_CFG_REQ).
+//
+//  Returns: TRUE if the command was queued at the gateway.
+//           FALSE if the gateway queue is full or too many commands are
+//                 awaiting an acknowledgement.
+//
+//  Description: Queues a command for the unit and times it until its
+//               acknowledgement is received.
+//
+//******************************************************************************
+BOOL InjectGroundCommand( WORD wMsgType );
+
+
+//******************************************************************************
+//
+//  Function: SetGroundCoverage
+//
+//  Arguments:
+//    IN  byPercent - Share of the time the unit is in coverage (0-100).
+//                    DEFAULT: 100
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the simulated coverage.
+//
+//******************************************************************************
+void SetGroundCoverage( const BYTE byPercent );
+
+
+//******************************************************************************
+//
+//  Function: SetGroundLoad
+//
+//  Arguments:
+//    IN  wCmdsPerHour - Commands the benchmark sends per hour, cycling
+//                       through EEPROM_CFG_REQ, POWER_CYCLE_CIS and
+//                       ROIACK_MSG_TYPE. Zero stops the benchmark.
+//                       DEFAULT: 0
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to start the latency benchmark. The
+//               arrivals are spread at random around the mean interval.
+//
+//******************************************************************************
+void SetGroundLoad( const WORD wCmdsPerHour );
+
+
+//******************************************************************************
+//
+//  Function: SetGroundSessionTime
+//
+//  Arguments:
+//    IN  bySeconds - Time the simulated +SBDIX session takes. Previous
+//                    value maintained on a zero value.
+//                    DEFAULT: 8 seconds
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to set the simulated session time.
+//
+//******************************************************************************
+void SetGroundSessionTime( const BYTE bySeconds );
+
+
+//******************************************************************************
+//
+//  Function: GetGroundLatencyStats
+//
+//  Arguments:
+//    IN  byIndex - 0 to GROUND_NBR_CMD_TYPES-1.
+//    OUT pStats  - Latency of one command type.
+//
+//  Returns: TRUE if the entry is in use.
+//           FALSE otherwise.
+//
+//  Description: The histogram buckets end at 15, 30, 60, 120, 300, 600 and
+//               1800 seconds; the last bucket holds everything longer.
+//
+//******************************************************************************
+BOOL GetGroundLatencyStats( BYTE byIndex, GROUND_LATENCY_STATS* pStats );
+
+
+//******************************************************************************
+//
+//  Function: ClearGroundLatencyStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the latency statistics and forgets the commands
+//               still awaiting an acknowledgement.
+//
+//******************************************************************************
+void ClearGroundLatencyStats( void );
+
+
+//******************************************************************************
+//
+//  Function: DisplayGroundLatencyStats
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Prints the count, mean, 50th/90th/99th percentile (bucket
+//               upper bound) and maximum latency of each command type to
+//               the mtce port.
+//
+//******************************************************************************
+void DisplayGroundLatencyStats( void );
+
+#endif // MODEM_GROUND_LOOPBACK
+
+
+#endif // _MODEMGROUND_H
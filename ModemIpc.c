@@ -0,0 +1,1327 @@
+//******************************************************************************
+//
+//  ModemIpc.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module lets other processes on a Linux host share the modem
+//  through shared memory. It is only built for the host, with
+//  MODEM_HOST_IPC defined.
+//
+//  The shared memory holds a header, a status snapshot and one slot per
+//  client. Each slot has two single producer, single consumer rings:
+//
+//      MO ring - written by the client, read by the driver
+//      MT ring - written by the driver, read by the client
+//
+//  Each ring entry is:
+//
+//      IPC_ENTRY_HDR PAYLOAD, padded to 8
+//
+//  An entry never wraps; IPC_RING_WRAP in LENGTH sends the reader back
+//  to the start of the ring. Head and tail are free running byte counts,
+//  each written by one side only (release) and read by the other
+//  (acquire), so no locks are taken. The status snapshot is a sequence
+//  lock: odd while it is being written.
+//
+//  Clients ring the driver's doorbell (an eventfd) after queueing an MO
+//  message; the driver rings the client's eventfd after queueing an MT
+//  message. A client attaches by connecting to the driver's unix socket
+//  (abstract name, same as the shared memory object); the driver picks
+//  the slot and passes both eventfds over it. The connection stays open
+//  while the client is attached, so the slot is freed when it closes,
+//  even if the client dies.
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#ifdef MODEM_HOST_IPC
+
+#define _GNU_SOURCE                 // accept4()
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "Modem.h"
+#include "ModemAPI.h"
+#include "ModemIpc.h"
+#include "utils.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define IPC_MAGIC               0x4D495043L // "MIPC"
+#define IPC_VERSION             1
+
+#define IPC_RING_SIZE           8192        // Power of 2, holds 4 full messages
+#define IPC_RING_MASK           ( IPC_RING_SIZE - 1 )
+#define IPC_RING_WRAP           0xFFFF
+#define IPC_CACHE_LINE          64
+
+#define IPC_NO_SLOT             0xFF
+
+#define IPC_ENTRY_SIZE( w )     ( ( sizeof( IPC_ENTRY_HDR ) + (w) + 7 ) & ~7 )
+
+#define IPC_LOAD( p )           __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define IPC_STORE( p, v )       __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef struct
+{
+    WORD  wLength;                  // IPC_RING_WRAP: go back to the start
+    WORD  wReserved;
+    DWORD dwStamp;                  // Time queued, in us
+
+} IPC_ENTRY_HDR;
+
+
+typedef struct
+{
+    DWORD dwHead;                   // Written by the producer only
+    BYTE  byPad1[IPC_CACHE_LINE - sizeof( DWORD )];
+    DWORD dwTail;                   // Written by the consumer only
+    BYTE  byPad2[IPC_CACHE_LINE - sizeof( DWORD )];
+    BYTE  byData[IPC_RING_SIZE];
+
+} IPC_RING;
+
+
+typedef struct
+{
+    DWORD    dwInUse;               // Written by the driver only
+    IPC_RING moRing;
+    IPC_RING mtRing;
+
+} IPC_CLIENT_SLOT;
+
+
+typedef struct
+{
+    DWORD dwMagic;                  // Written last, once all is set
+    DWORD dwVersion;
+
+    DWORD            dwStatusLock;  // Odd while the snapshot is written
+    MODEM_IPC_STATUS status;
+
+    IPC_CLIENT_SLOT  clients[MODEM_IPC_MAX_CLIENTS];
+
+} IPC_SHARED;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static IPC_SHARED*      pIpc = NULL;
+static char             szIpcName[64];
+static BYTE             byNextClient;
+
+static int              iListenFd;
+static int              iDoorbellFd;
+static int              iClientEventFd[MODEM_IPC_MAX_CLIENTS];
+static int              iClientLinkFd[MODEM_IPC_MAX_CLIENTS];  // -1 if the slot is free
+
+static MODEM_IPC_STATS  ipcStats;
+static DWORD            dwLatencySum;       // us, over dwLatencyCount messages
+static DWORD            dwLatencyCount;
+
+static BYTE                byMOSlot;        // Slot whose MO is in the modem, IPC_NO_SLOT if none
+static BYTE                byMOTries[MODEM_IPC_MAX_CLIENTS];
+static MODEM_IPC_MO_RESULT moResult[MODEM_IPC_MAX_CLIENTS];
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static DWORD  IpcTimeNow( void );
+static void   ResetIpcSlot( IPC_CLIENT_SLOT* pSlot );
+static BOOL   RingPush( IPC_RING* pRing, const BYTE* pbyMsg, WORD wLength );
+static BYTE*  RingPeek( IPC_RING* pRing, WORD* pwLength, DWORD* pdwStamp );
+static void   RingPop( IPC_RING* pRing, WORD wLength );
+static void   RingBell( int iFd );
+static void   DrainBell( int iFd );
+static BOOL   FinishIpcMO( void );
+static void   CloseIpcEvents( void );
+static void   PublishIpcStatus( void );
+static void   AcceptIpcClient( void );
+static void   CheckIpcClients( void );
+static void   FreeIpcSlot( BYTE bySlot );
+static IPC_SHARED* MapIpc( const char* szName, BOOL bCreate );
+static BOOL   IpcAddress( const char* szName, struct sockaddr_un* pAddr, socklen_t* pLen );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: OpenModemIpc
+//
+//  Arguments:
+//    IN  szName - Shared memory object name (e.g. "/iridium").
+//
+//  Returns: TRUE if the interface was created.
+//           FALSE otherwise.
+//
+//  Description: Driver side. Creates the shared memory, the doorbell and
+//               the client event counters.
+//
+//******************************************************************************
+BOOL OpenModemIpc( const char* szName )
+{
+    struct sockaddr_un addr;
+    socklen_t          addrLen;
+    BOOL               bEventsOk;
+    BYTE               bySlot;
+
+    if( pIpc != NULL )
+    {
+        return TRUE;
+    }
+
+    if( !IpcAddress( szName, &addr, &addrLen ) )
+    {
+        return FALSE;
+    }
+
+    iListenFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+    if( iListenFd == -1 )
+    {
+        return FALSE;
+    }
+
+    if( ( bind( iListenFd, (struct sockaddr*)&addr, addrLen ) == -1 )
+        ||
+        ( listen( iListenFd, MODEM_IPC_MAX_CLIENTS ) == -1 ) )
+    {
+        close( iListenFd );
+        return FALSE;
+    }
+
+    bEventsOk   = TRUE;
+    iDoorbellFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if( iDoorbellFd == -1 )
+    {
+        bEventsOk = FALSE;
+    }
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        iClientEventFd[bySlot] = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        iClientLinkFd[bySlot]  = -1;
+
+        if( iClientEventFd[bySlot] == -1 )
+        {
+            bEventsOk = FALSE;
+        }
+    }
+
+    if( !bEventsOk )
+    {
+        CloseIpcEvents();
+        close( iListenFd );
+        return FALSE;
+    }
+
+    pIpc = MapIpc( szName, TRUE );
+
+    if( pIpc == NULL )
+    {
+        CloseIpcEvents();
+        close( iListenFd );
+        return FALSE;
+    }
+
+    snprintf( szIpcName, sizeof( szIpcName ), "%s", szName );
+
+    MemSet( pIpc, 0, sizeof( IPC_SHARED ) );
+    MemSet( &ipcStats, 0, sizeof( MODEM_IPC_STATS ) );
+    MemSet( moResult, 0, sizeof( moResult ) );
+    MemSet( byMOTries, 0, sizeof( byMOTries ) );
+    dwLatencySum   = 0;
+    dwLatencyCount = 0;
+    byNextClient   = 0;
+    byMOSlot       = IPC_NO_SLOT;
+
+    pIpc->dwVersion = IPC_VERSION;
+
+    PublishIpcStatus();
+
+    // Clients may attach from now on.
+    IPC_STORE( &pIpc->dwMagic, IPC_MAGIC );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: CloseModemIpc
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Removes the shared memory object.
+//
+//******************************************************************************
+void CloseModemIpc( void )
+{
+    BYTE bySlot;
+
+    if( pIpc == NULL )
+    {
+        return;
+    }
+
+    IPC_STORE( &pIpc->dwMagic, 0 );
+
+    close( iListenFd );
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        FreeIpcSlot( bySlot );
+    }
+
+    CloseIpcEvents();
+
+    munmap( pIpc, sizeof( IPC_SHARED ) );
+    shm_unlink( szIpcName );
+
+    pIpc = NULL;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemIpcDoorbell
+//
+//  Arguments: void.
+//
+//  Returns: File descriptor that becomes readable when a client submits a
+//           message, or -1 if the interface is not open.
+//
+//  Description: Driver side. Lets the host main loop sleep in poll().
+//
+//******************************************************************************
+int GetModemIpcDoorbell( void )
+{
+    return ( pIpc == NULL ) ? -1 : iDoorbellFd;
+}
+
+
+//******************************************************************************
+//
+//  Function: ServiceModemIpc
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Attaches new clients, frees the slots of those
+//               gone, hands the next MO message (clients served in turn)
+//               to the modem when it can take one and publishes the status
+//               snapshot.
+//
+//******************************************************************************
+void ServiceModemIpc( void )
+{
+    IPC_CLIENT_SLOT* pSlot;
+    BYTE*            pbyMsg;
+    WORD             wLength;
+    DWORD            dwStamp;
+    BYTE             byCount;
+    BYTE             bySlot;
+
+    if( pIpc == NULL )
+    {
+        return;
+    }
+
+    DrainBell( iDoorbellFd );
+
+    AcceptIpcClient();
+    CheckIpcClients();
+
+    // The message in the modem stays queued until its session is over.
+    if( ( byMOSlot != IPC_NO_SLOT ) && !FinishIpcMO() )
+    {
+        PublishIpcStatus();
+        return;
+    }
+
+    // One message at a time; the next client goes first next time.
+    for( byCount = 0; byCount < MODEM_IPC_MAX_CLIENTS; byCount++ )
+    {
+        bySlot = ( byNextClient + byCount ) % MODEM_IPC_MAX_CLIENTS;
+        pSlot  = &pIpc->clients[bySlot];
+
+        if( iClientLinkFd[bySlot] == -1 )
+        {
+            continue;
+        }
+
+        pbyMsg = RingPeek( &pSlot->moRing, &wLength, &dwStamp );
+
+        if( pbyMsg == NULL )
+        {
+            continue;
+        }
+
+        // The modem may not take it now - it stays queued.
+        if( SendBinMsgToModem( pbyMsg, wLength ) )
+        {
+            byMOSlot     = bySlot;
+            byNextClient = ( bySlot + 1 ) % MODEM_IPC_MAX_CLIENTS;
+        }
+
+        break;
+    }
+
+    PublishIpcStatus();
+}
+
+
+//******************************************************************************
+//
+//  Function: PublishModemIpcMT
+//
+//  Arguments:
+//    IN  pbyMsg  - MT message received from the gateway.
+//    IN  wLength - Length of the message.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Copies an MT message to every client.
+//
+//******************************************************************************
+void PublishModemIpcMT( const BYTE* pbyMsg, WORD wLength )
+{
+    IPC_CLIENT_SLOT* pSlot;
+    BYTE             bySlot;
+
+    if( pIpc == NULL )
+    {
+        return;
+    }
+
+    if( wLength > MODEM_IPC_MAX_MSG_LEN )
+    {
+        wLength = MODEM_IPC_MAX_MSG_LEN;
+    }
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        pSlot = &pIpc->clients[bySlot];
+
+        if( iClientLinkFd[bySlot] == -1 )
+        {
+            continue;
+        }
+
+        if( RingPush( &pSlot->mtRing, pbyMsg, wLength ) )
+        {
+            ipcStats.dwMTDelivered++;
+            RingBell( iClientEventFd[bySlot] );
+        }
+        else
+        {
+            ipcStats.dwMTDropped++;
+        }
+    }
+
+    PublishIpcStatus();
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemIpcStats
+//
+//  Arguments:
+//    OUT pStats - MODEM_IPC_STATS since the interface was opened.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Latency and throughput counters.
+//
+//******************************************************************************
+void GetModemIpcStats( MODEM_IPC_STATS* pStats )
+{
+    MemCpy( pStats, &ipcStats, sizeof( MODEM_IPC_STATS ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: AttachModemIpc
+//
+//  Arguments:
+//    IN  szName  - Shared memory object name given to OpenModemIpc().
+//    OUT pClient - Client handle.
+//
+//  Returns: TRUE if a client slot was taken.
+//           FALSE if the driver is not running or all slots are taken.
+//
+//  Description: Client side. The driver must be calling ServiceModemIpc(),
+//               which hands out the slot and the event counters.
+//
+//******************************************************************************
+BOOL AttachModemIpc( const char* szName, MODEM_IPC_CLIENT* pClient )
+{
+    struct sockaddr_un addr;
+    socklen_t          addrLen;
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct cmsghdr*    pCmsg;
+    char               byControl[CMSG_SPACE( 2 * sizeof( int ) )];
+    int                iFds[2];
+
+    pClient->pShared     = NULL;
+    pClient->iLinkFd     = -1;
+    pClient->iDoorbellFd = -1;
+    pClient->iEventFd    = -1;
+
+    if( !IpcAddress( szName, &addr, &addrLen ) )
+    {
+        return FALSE;
+    }
+
+    pClient->pShared = MapIpc( szName, FALSE );
+
+    if( ( pClient->pShared == NULL )
+        ||
+        ( IPC_LOAD( &( (IPC_SHARED*)pClient->pShared )->dwMagic ) != IPC_MAGIC )
+        ||
+        ( ( (IPC_SHARED*)pClient->pShared )->dwVersion != IPC_VERSION ) )
+    {
+        DetachModemIpc( pClient );
+        return FALSE;
+    }
+
+    pClient->iLinkFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+
+    if( ( pClient->iLinkFd == -1 )
+        ||
+        ( connect( pClient->iLinkFd, (struct sockaddr*)&addr, addrLen ) == -1 ) )
+    {
+        DetachModemIpc( pClient );
+        return FALSE;
+    }
+
+    // Wait for the driver to give us a slot and the event counters; it
+    // closes the connection if they are all taken.
+    MemSet( &msg, 0, sizeof( msg ) );
+    iov.iov_base       = &pClient->bySlot;
+    iov.iov_len        = sizeof( pClient->bySlot );
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = byControl;
+    msg.msg_controllen = sizeof( byControl );
+
+    if( recvmsg( pClient->iLinkFd, &msg, MSG_CMSG_CLOEXEC ) != sizeof( pClient->bySlot ) )
+    {
+        DetachModemIpc( pClient );
+        return FALSE;
+    }
+
+    pCmsg = CMSG_FIRSTHDR( &msg );
+
+    if( ( pCmsg == NULL )
+        ||
+        ( pCmsg->cmsg_type != SCM_RIGHTS )
+        ||
+        ( pCmsg->cmsg_len != CMSG_LEN( sizeof( iFds ) ) ) )
+    {
+        DetachModemIpc( pClient );
+        return FALSE;
+    }
+
+    memcpy( iFds, CMSG_DATA( pCmsg ), sizeof( iFds ) );
+    pClient->iDoorbellFd = iFds[0];
+    pClient->iEventFd    = iFds[1];
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: DetachModemIpc
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//
+//  Returns: void.
+//
+//  Description: Client side. Gives up the slot.
+//
+//******************************************************************************
+void DetachModemIpc( MODEM_IPC_CLIENT* pClient )
+{
+    // Closing the link is what frees the slot.
+    if( pClient->iLinkFd != -1 )
+    {
+        close( pClient->iLinkFd );
+    }
+
+    if( pClient->iDoorbellFd != -1 )
+    {
+        close( pClient->iDoorbellFd );
+    }
+
+    if( pClient->iEventFd != -1 )
+    {
+        close( pClient->iEventFd );
+    }
+
+    if( pClient->pShared != NULL )
+    {
+        munmap( pClient->pShared, sizeof( IPC_SHARED ) );
+    }
+
+    pClient->pShared     = NULL;
+    pClient->iLinkFd     = -1;
+    pClient->iDoorbellFd = -1;
+    pClient->iEventFd    = -1;
+}
+
+
+//******************************************************************************
+//
+//  Function: SubmitModemIpcMO
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//    IN  pbyMsg  - MO message to send.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message was queued.
+//           FALSE if the MO ring is full or the message too long.
+//
+//  Description: Client side. Messages are sent in the order submitted.
+//
+//******************************************************************************
+BOOL SubmitModemIpcMO( MODEM_IPC_CLIENT* pClient, const BYTE* pbyMsg, WORD wLength )
+{
+    IPC_SHARED* pShared = (IPC_SHARED*)pClient->pShared;
+
+    if( ( wLength == 0 ) || ( wLength > MODEM_IPC_MAX_MSG_LEN ) )
+    {
+        return FALSE;
+    }
+
+    if( !RingPush( &pShared->clients[pClient->bySlot].moRing, pbyMsg, wLength ) )
+    {
+        return FALSE;
+    }
+
+    RingBell( pClient->iDoorbellFd );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: ReceiveModemIpcMT
+//
+//  Arguments:
+//    IN  pClient    - Client handle.
+//    OUT pbyMsg     - Buffer for the MT message.
+//    IN  wMaxLength - Size of the buffer.
+//
+//  Returns: WORD length of the message received, 0 if there is none.
+//
+//  Description: Client side. Block in poll() on pClient->iEventFd to wait
+//               for one, then call until it returns 0. A message too big
+//               for the buffer is truncated.
+//
+//******************************************************************************
+WORD ReceiveModemIpcMT( MODEM_IPC_CLIENT* pClient, BYTE* pbyMsg, WORD wMaxLength )
+{
+    IPC_SHARED* pShared = (IPC_SHARED*)pClient->pShared;
+    IPC_RING*   pRing   = &pShared->clients[pClient->bySlot].mtRing;
+    BYTE*       pbyEntry;
+    WORD        wLength;
+    DWORD       dwStamp;
+
+    DrainBell( pClient->iEventFd );
+
+    pbyEntry = RingPeek( pRing, &wLength, &dwStamp );
+
+    if( pbyEntry == NULL )
+    {
+        return 0;
+    }
+
+    MemCpy( pbyMsg, pbyEntry, ( wLength < wMaxLength ) ? wLength : wMaxLength );
+    RingPop( pRing, wLength );
+
+    return ( wLength < wMaxLength ) ? wLength : wMaxLength;
+}
+
+
+//******************************************************************************
+//
+//  Function: ReadModemIpcStatus
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//    OUT pStatus - Latest MODEM_IPC_STATUS.
+//
+//  Returns: void.
+//
+//  Description: Client side. Reads a consistent snapshot.
+//
+//******************************************************************************
+void ReadModemIpcStatus( MODEM_IPC_CLIENT* pClient, MODEM_IPC_STATUS* pStatus )
+{
+    IPC_SHARED* pShared = (IPC_SHARED*)pClient->pShared;
+    DWORD       dwLock;
+
+    do
+    {
+        dwLock = IPC_LOAD( &pShared->dwStatusLock );
+
+        MemCpy( pStatus, &pShared->status, sizeof( MODEM_IPC_STATUS ) );
+        __atomic_thread_fence( __ATOMIC_ACQUIRE );
+
+    } while( ( dwLock & 1 ) || ( dwLock != IPC_LOAD( &pShared->dwStatusLock ) ) );
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: IpcTimeNow
+//
+//  Arguments: void.
+//
+//  Returns: DWORD monotonic time in us (wraps every 71 minutes).
+//
+//  Description: Time stamp shared by all processes on the host.
+//
+//******************************************************************************
+DWORD IpcTimeNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (DWORD)( now.tv_sec * 1000000UL + now.tv_nsec / 1000 );
+}
+
+
+//******************************************************************************
+//
+//  Function: ResetIpcSlot
+//
+//  Arguments:
+//    IN  pSlot - Client slot.
+//
+//  Returns: void.
+//
+//  Description: Empties both rings of a slot that is being given up.
+//
+//******************************************************************************
+void ResetIpcSlot( IPC_CLIENT_SLOT* pSlot )
+{
+    IPC_STORE( &pSlot->moRing.dwTail, IPC_LOAD( &pSlot->moRing.dwHead ) );
+    IPC_STORE( &pSlot->mtRing.dwTail, IPC_LOAD( &pSlot->mtRing.dwHead ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: RingPush
+//
+//  Arguments:
+//    IN  pRing   - Ring written by this process only.
+//    IN  pbyMsg  - Message.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message was queued.
+//           FALSE if there is no room.
+//
+//  Description: Producer side of an SPSC ring. The entry is stamped with
+//               the time it was queued.
+//
+//******************************************************************************
+BOOL RingPush( IPC_RING* pRing, const BYTE* pbyMsg, WORD wLength )
+{
+    DWORD dwHead  = pRing->dwHead;
+    DWORD dwTail  = IPC_LOAD( &pRing->dwTail );
+    DWORD dwSize  = IPC_ENTRY_SIZE( wLength );
+    DWORD dwToEnd = IPC_RING_SIZE - ( dwHead & IPC_RING_MASK );
+    IPC_ENTRY_HDR* pEntry;
+
+    // Skip the end of the ring if the entry doesn't fit there.
+    if( dwSize > dwToEnd )
+    {
+        if( ( dwHead + dwToEnd + dwSize - dwTail ) > IPC_RING_SIZE )
+        {
+            return FALSE;
+        }
+
+        pEntry = (IPC_ENTRY_HDR*)&pRing->byData[dwHead & IPC_RING_MASK];
+        pEntry->wLength = IPC_RING_WRAP;
+        dwHead += dwToEnd;
+    }
+    else if( ( dwHead + dwSize - dwTail ) > IPC_RING_SIZE )
+    {
+        return FALSE;
+    }
+
+    pEntry = (IPC_ENTRY_HDR*)&pRing->byData[dwHead & IPC_RING_MASK];
+
+    pEntry->wLength   = wLength;
+    pEntry->wReserved = 0;
+    pEntry->dwStamp   = IpcTimeNow();
+    MemCpy( &pEntry[1], (void*)pbyMsg, wLength );
+
+    IPC_STORE( &pRing->dwHead, dwHead + dwSize );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: RingPeek
+//
+//  Arguments:
+//    IN  pRing    - Ring read by this process only.
+//    OUT pwLength - Length of the oldest message.
+//    OUT pdwStamp - Time it was queued (us).
+//
+//  Returns: Pointer to the oldest message, or NULL if the ring is empty.
+//
+//  Description: Consumer side of an SPSC ring. The message stays queued
+//               until RingPop(). The ring is shared with another process:
+//               a head that cannot be right is ignored, and an entry length
+//               that cannot be right empties the ring.
+//
+//******************************************************************************
+BYTE* RingPeek( IPC_RING* pRing, WORD* pwLength, DWORD* pdwStamp )
+{
+    DWORD          dwTail = pRing->dwTail;
+    DWORD          dwHead = IPC_LOAD( &pRing->dwHead );
+    IPC_ENTRY_HDR* pEntry;
+    WORD           wLength;
+
+    if( dwTail == dwHead )
+    {
+        return NULL;
+    }
+
+    if( ( ( dwHead - dwTail ) > IPC_RING_SIZE ) || ( dwHead & 7 ) )
+    {
+        return NULL;
+    }
+
+    pEntry = (IPC_ENTRY_HDR*)&pRing->byData[dwTail & IPC_RING_MASK];
+
+    if( pEntry->wLength == IPC_RING_WRAP )
+    {
+        dwTail += IPC_RING_SIZE - ( dwTail & IPC_RING_MASK );
+
+        if( ( dwHead - dwTail ) > IPC_RING_SIZE )
+        {
+            IPC_STORE( &pRing->dwTail, dwHead );
+            return NULL;
+        }
+
+        IPC_STORE( &pRing->dwTail, dwTail );
+
+        if( dwTail == dwHead )
+        {
+            return NULL;
+        }
+
+        pEntry = (IPC_ENTRY_HDR*)&pRing->byData[0];
+    }
+
+    wLength = pEntry->wLength;
+
+    if( ( wLength > MODEM_IPC_MAX_MSG_LEN )
+        ||
+        ( IPC_ENTRY_SIZE( wLength ) > ( dwHead - dwTail ) )
+        ||
+        ( ( dwTail & IPC_RING_MASK ) + IPC_ENTRY_SIZE( wLength ) > IPC_RING_SIZE ) )
+    {
+        IPC_STORE( &pRing->dwTail, dwHead );
+        return NULL;
+    }
+
+    *pwLength = wLength;
+    *pdwStamp = pEntry->dwStamp;
+
+    return (BYTE*)&pEntry[1];
+}
+
+
+//******************************************************************************
+//
+//  Function: RingPop
+//
+//  Arguments:
+//    IN  pRing   - Ring read by this process only.
+//    IN  wLength - Length returned by RingPeek().
+//
+//  Returns: void.
+//
+//  Description: Frees the oldest message for the producer.
+//
+//******************************************************************************
+void RingPop( IPC_RING* pRing, WORD wLength )
+{
+    IPC_STORE( &pRing->dwTail, pRing->dwTail + IPC_ENTRY_SIZE( wLength ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: RingBell
+//
+//  Arguments:
+//    IN  iFd - eventfd to signal.
+//
+//  Returns: void.
+//
+//  Description: Wakes the other side. A full counter is already a wake up.
+//
+//******************************************************************************
+void RingBell( int iFd )
+{
+    unsigned long long qwOne = 1;
+
+    if( write( iFd, &qwOne, sizeof( qwOne ) ) != sizeof( qwOne ) )
+    {
+        return;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: DrainBell
+//
+//  Arguments:
+//    IN  iFd - eventfd to clear.
+//
+//  Returns: void.
+//
+//  Description: Clears the counter before the ring is looked at, so no
+//               wake up can be lost.
+//
+//******************************************************************************
+void DrainBell( int iFd )
+{
+    unsigned long long qwCount;
+
+    if( read( iFd, &qwCount, sizeof( qwCount ) ) != sizeof( qwCount ) )
+    {
+        return;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: FinishIpcMO
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if the session of the MO message in the modem is over.
+//           FALSE while it is still going.
+//
+//  Description: A sent message is popped. A failed one stays queued for
+//               its next turn, and is popped as failed after
+//               MODEM_IPC_MAX_MO_TRIES sessions. Either way the outcome
+//               goes to the slot's MODEM_IPC_MO_RESULT.
+//
+//******************************************************************************
+BOOL FinishIpcMO( void )
+{
+    IPC_RING*       pRing;
+    BYTE*           pbyMsg;
+    WORD            wLength;
+    DWORD           dwStamp;
+    DWORD           dwLatency;
+    MODEM_RESPONSES rsp;
+
+    rsp = GetBinMsgRspFromModem();
+
+    if( rsp == MR_WAITING )
+    {
+        return FALSE;
+    }
+
+    pRing  = &pIpc->clients[byMOSlot].moRing;
+    pbyMsg = RingPeek( pRing, &wLength, &dwStamp );
+
+    if( pbyMsg == NULL )
+    {
+        byMOSlot = IPC_NO_SLOT;
+        return TRUE;
+    }
+
+    if( rsp == MR_SUCCESS )
+    {
+        dwLatency = IpcTimeNow() - dwStamp;
+
+        ipcStats.dwMOAccepted++;
+        ipcStats.dwMOBytes += wLength;
+
+        if( dwLatency > ipcStats.dwMaxMOLatency )
+        {
+            ipcStats.dwMaxMOLatency = dwLatency;
+        }
+
+        dwLatencySum += dwLatency;
+        dwLatencyCount++;
+        ipcStats.dwAvgMOLatency = dwLatencySum / dwLatencyCount;
+
+        // Keep the average meaningful over a long run.
+        if( dwLatencyCount >= 1024 )
+        {
+            dwLatencySum   /= 2;
+            dwLatencyCount /= 2;
+        }
+
+        moResult[byMOSlot].dwMODone++;
+    }
+    else if( ++byMOTries[byMOSlot] >= MODEM_IPC_MAX_MO_TRIES )
+    {
+        ipcStats.dwMOFailed++;
+
+        moResult[byMOSlot].dwMODone++;
+        moResult[byMOSlot].dwMOFailed++;
+        moResult[byMOSlot].dwLastFailed = moResult[byMOSlot].dwMODone;
+    }
+    else
+    {
+        // Tried again on the slot's next turn.
+        byMOSlot = IPC_NO_SLOT;
+        return TRUE;
+    }
+
+    RingPop( pRing, wLength );
+    byMOTries[byMOSlot] = 0;
+    byMOSlot = IPC_NO_SLOT;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: CloseIpcEvents
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Closes the doorbell and the client event counters that
+//               were created.
+//
+//******************************************************************************
+void CloseIpcEvents( void )
+{
+    BYTE bySlot;
+
+    if( iDoorbellFd != -1 )
+    {
+        close( iDoorbellFd );
+        iDoorbellFd = -1;
+    }
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        if( iClientEventFd[bySlot] != -1 )
+        {
+            close( iClientEventFd[bySlot] );
+            iClientEventFd[bySlot] = -1;
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: PublishIpcStatus
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Writes the status snapshot under the sequence lock.
+//
+//******************************************************************************
+void PublishIpcStatus( void )
+{
+    DWORD dwLock = pIpc->dwStatusLock;
+
+    IPC_STORE( &pIpc->dwStatusLock, dwLock + 1 );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    pIpc->status.dwSeq++;
+    pIpc->status.iSignal          = GetModemSignalStrength();
+    pIpc->status.bSendingEnabled  = IsModemSendingEnabled();
+    pIpc->status.bTransparentMode = InTransparentModemMode();
+    pIpc->status.dwMOAccepted     = ipcStats.dwMOAccepted;
+    pIpc->status.dwMTDelivered    = ipcStats.dwMTDelivered;
+    MemCpy( pIpc->status.moResult, moResult, sizeof( moResult ) );
+
+    IPC_STORE( &pIpc->dwStatusLock, dwLock + 2 );
+}
+
+
+//******************************************************************************
+//
+//  Function: AcceptIpcClient
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Gives a connecting client a free slot, with empty rings,
+//               and passes it the doorbell and its event counter.
+//
+//******************************************************************************
+void AcceptIpcClient( void )
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr* pCmsg;
+    char            byControl[CMSG_SPACE( 2 * sizeof( int ) )];
+    int             iFds[2];
+    int             iLinkFd;
+    BYTE            bySlot;
+
+    iLinkFd = accept4( iListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+    if( iLinkFd == -1 )
+    {
+        return;
+    }
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        if( iClientLinkFd[bySlot] == -1 )
+        {
+            break;
+        }
+    }
+
+    if( bySlot >= MODEM_IPC_MAX_CLIENTS )
+    {
+        close( iLinkFd );
+        return;
+    }
+
+    ResetIpcSlot( &pIpc->clients[bySlot] );
+    DrainBell( iClientEventFd[bySlot] );
+    MemSet( &moResult[bySlot], 0, sizeof( MODEM_IPC_MO_RESULT ) );
+    byMOTries[bySlot] = 0;
+
+    iFds[0] = iDoorbellFd;
+    iFds[1] = iClientEventFd[bySlot];
+
+    MemSet( &msg, 0, sizeof( msg ) );
+    MemSet( byControl, 0, sizeof( byControl ) );
+    iov.iov_base       = &bySlot;
+    iov.iov_len        = sizeof( bySlot );
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = byControl;
+    msg.msg_controllen = sizeof( byControl );
+
+    pCmsg             = CMSG_FIRSTHDR( &msg );
+    pCmsg->cmsg_level = SOL_SOCKET;
+    pCmsg->cmsg_type  = SCM_RIGHTS;
+    pCmsg->cmsg_len   = CMSG_LEN( sizeof( iFds ) );
+    memcpy( CMSG_DATA( pCmsg ), iFds, sizeof( iFds ) );
+
+    if( sendmsg( iLinkFd, &msg, MSG_NOSIGNAL ) != sizeof( bySlot ) )
+    {
+        close( iLinkFd );
+        return;
+    }
+
+    iClientLinkFd[bySlot] = iLinkFd;
+    IPC_STORE( &pIpc->clients[bySlot].dwInUse, TRUE );
+    ipcStats.byClients++;
+}
+
+
+//******************************************************************************
+//
+//  Function: CheckIpcClients
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Frees the slot of every client whose link was closed.
+//
+//******************************************************************************
+void CheckIpcClients( void )
+{
+    BYTE bySlot;
+    BYTE byData;
+
+    for( bySlot = 0; bySlot < MODEM_IPC_MAX_CLIENTS; bySlot++ )
+    {
+        if( ( iClientLinkFd[bySlot] != -1 )
+            &&
+            ( recv( iClientLinkFd[bySlot], &byData, sizeof( byData ), MSG_DONTWAIT ) == 0 ) )
+        {
+            FreeIpcSlot( bySlot );
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: FreeIpcSlot
+//
+//  Arguments:
+//    IN  bySlot - Client slot.
+//
+//  Returns: void.
+//
+//  Description: Drops the client of a slot and whatever it left queued.
+//
+//******************************************************************************
+void FreeIpcSlot( BYTE bySlot )
+{
+    if( iClientLinkFd[bySlot] == -1 )
+    {
+        return;
+    }
+
+    close( iClientLinkFd[bySlot] );
+    iClientLinkFd[bySlot] = -1;
+
+    // The outcome of a session still going is of no use to anyone.
+    if( byMOSlot == bySlot )
+    {
+        byMOSlot = IPC_NO_SLOT;
+    }
+
+    IPC_STORE( &pIpc->clients[bySlot].dwInUse, FALSE );
+    ResetIpcSlot( &pIpc->clients[bySlot] );
+
+    ipcStats.byClients--;
+}
+
+
+//******************************************************************************
+//
+//  Function: IpcAddress
+//
+//  Arguments:
+//    IN  szName   - Shared memory object name.
+//    OUT pAddr    - Abstract unix socket address of the same name.
+//    OUT pLen     - Length of the address.
+//
+//  Returns: TRUE if the name fits.
+//           FALSE otherwise.
+//
+//  Description: The attach socket lives in the abstract namespace, so
+//               there is no file to clean up.
+//
+//******************************************************************************
+BOOL IpcAddress( const char* szName, struct sockaddr_un* pAddr, socklen_t* pLen )
+{
+    size_t nameLen = strlen( szName );
+
+    if( ( nameLen == 0 ) || ( nameLen >= sizeof( pAddr->sun_path ) ) )
+    {
+        return FALSE;
+    }
+
+    MemSet( pAddr, 0, sizeof( struct sockaddr_un ) );
+    pAddr->sun_family = AF_UNIX;
+    memcpy( &pAddr->sun_path[1], szName, nameLen );
+
+    *pLen = (socklen_t)( offsetof( struct sockaddr_un, sun_path ) + 1 + nameLen );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: MapIpc
+//
+//  Arguments:
+//    IN  szName  - Shared memory object name.
+//    IN  bCreate - TRUE for the driver, FALSE for a client.
+//
+//  Returns: Pointer to the shared memory, or NULL on failure.
+//
+//  Description: Opens (or creates) and maps the shared memory object.
+//
+//******************************************************************************
+IPC_SHARED* MapIpc( const char* szName, BOOL bCreate )
+{
+    void* pShared;
+    int   iFd;
+
+    iFd = shm_open( szName, bCreate ? ( O_CREAT | O_RDWR ) : O_RDWR, 0660 );
+
+    if( iFd == -1 )
+    {
+        return NULL;
+    }
+
+    if( bCreate && ( ftruncate( iFd, sizeof( IPC_SHARED ) ) == -1 ) )
+    {
+        close( iFd );
+        return NULL;
+    }
+
+    pShared = mmap( NULL, sizeof( IPC_SHARED ), PROT_READ | PROT_WRITE, MAP_SHARED, iFd, 0 );
+
+    close( iFd );
+
+    return ( pShared == MAP_FAILED ) ? NULL : (IPC_SHARED*)pShared;
+}
+
+#endif // MODEM_HOST_IPC
@@ -0,0 +1,288 @@
+//******************************************************************************
+//
+//  ModemIpc.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module lets other processes on a Linux host share the modem
+//  through shared memory, instead of linking the driver in or dropping
+//  files in the modem directories. It is only built for the host, with
+//  MODEM_HOST_IPC defined.
+//
+//  The driver process calls OpenModemIpc() once and ServiceModemIpc()
+//  from its main loop (e.g. when GetModemIpcDoorbell() is readable).
+//  Client processes use AttachModemIpc() and the client functions below.
+//
+//******************************************************************************
+
+#ifndef _MODEMIPC_H
+
+    #define _MODEMIPC_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+#ifdef MODEM_HOST_IPC
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define MODEM_IPC_MAX_CLIENTS       4
+#define MODEM_IPC_MAX_MSG_LEN       1960    // Largest MO or MT payload (SBD MO limit)
+#define MODEM_IPC_MAX_MO_TRIES      3       // SBD sessions before an MO is given up on
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+// Outcome of the MO messages of one client slot, counted since it attached.
+// Messages finish in the order submitted, so dwLastFailed names the last
+// one given up on by its position.
+typedef struct
+{
+    DWORD dwMODone;                 // Messages sent or given up on
+    DWORD dwMOFailed;               // Given up on after MODEM_IPC_MAX_MO_TRIES sessions
+    DWORD dwLastFailed;             // dwMODone of the last one given up on, 0 if none
+
+} MODEM_IPC_MO_RESULT;
+
+
+// Snapshot of the driver published to the clients.
+typedef struct
+{
+    DWORD dwSeq;                    // Bumped by every snapshot
+    short iSignal;                  // Last CSQ (0-5, -1 if unknown)
+    BOOL  bSendingEnabled;
+    BOOL  bTransparentMode;
+    DWORD dwMOAccepted;
+    DWORD dwMTDelivered;
+    MODEM_IPC_MO_RESULT moResult[MODEM_IPC_MAX_CLIENTS];   // Indexed by client slot
+
+} MODEM_IPC_STATUS;
+
+
+typedef struct
+{
+    DWORD dwMOAccepted;             // Messages sent by the modem
+    DWORD dwMOFailed;               // Messages given up on
+    DWORD dwMOBytes;
+    DWORD dwMTDelivered;            // Messages pushed to the clients
+    DWORD dwMTDropped;              // Client MT ring full
+    DWORD dwAvgMOLatency;           // in us, submit to sent by the modem
+    DWORD dwMaxMOLatency;
+    BYTE  byClients;                // Clients attached
+
+} MODEM_IPC_STATS;
+
+
+// Client side handle.
+typedef struct
+{
+    void* pShared;
+    BYTE  bySlot;
+    int   iLinkFd;                  // Attach connection, held while attached
+    int   iDoorbellFd;              // Rung on MO submission
+    int   iEventFd;                 // Rung on MT delivery
+
+} MODEM_IPC_CLIENT;
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: OpenModemIpc
+//
+//  Arguments:
+//    IN  szName - Shared memory object name (e.g. "/iridium").
+//
+//  Returns: TRUE if the interface was created.
+//           FALSE otherwise.
+//
+//  Description: Driver side. Creates the shared memory, the doorbell and
+//               the client event counters.
+//
+//******************************************************************************
+BOOL OpenModemIpc( const char* szName );
+
+
+//******************************************************************************
+//
+//  Function: CloseModemIpc
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Removes the shared memory object.
+//
+//******************************************************************************
+void CloseModemIpc( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemIpcDoorbell
+//
+//  Arguments: void.
+//
+//  Returns: File descriptor that becomes readable when a client submits a
+//           message, or -1 if the interface is not open.
+//
+//  Description: Driver side. Lets the host main loop sleep in poll().
+//
+//******************************************************************************
+int GetModemIpcDoorbell( void );
+
+
+//******************************************************************************
+//
+//  Function: ServiceModemIpc
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Attaches new clients, frees the slots of those
+//               gone, hands the next MO message (clients served in turn)
+//               to the modem when it can take one and publishes the status
+//               snapshot. A message stays queued until its SBD session
+//               succeeds, or has failed MODEM_IPC_MAX_MO_TRIES times.
+//
+//******************************************************************************
+void ServiceModemIpc( void );
+
+
+//******************************************************************************
+//
+//  Function: PublishModemIpcMT
+//
+//  Arguments:
+//    IN  pbyMsg  - MT message received from the gateway.
+//    IN  wLength - Length of the message.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Copies an MT message to every client.
+//
+//******************************************************************************
+void PublishModemIpcMT( const BYTE* pbyMsg, WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: GetModemIpcStats
+//
+//  Arguments:
+//    OUT pStats - MODEM_IPC_STATS since the interface was opened.
+//
+//  Returns: void.
+//
+//  Description: Driver side. Latency and throughput counters.
+//
+//******************************************************************************
+void GetModemIpcStats( MODEM_IPC_STATS* pStats );
+
+
+//******************************************************************************
+//
+//  Function: AttachModemIpc
+//
+//  Arguments:
+//    IN  szName  - Shared memory object name given to OpenModemIpc().
+//    OUT pClient - Client handle.
+//
+//  Returns: TRUE if a client slot was taken.
+//           FALSE if the driver is not running or all slots are taken.
+//
+//  Description: Client side. The driver must be calling ServiceModemIpc(),
+//               which hands out the slot and the event counters.
+//
+//******************************************************************************
+BOOL AttachModemIpc( const char* szName, MODEM_IPC_CLIENT* pClient );
+
+
+//******************************************************************************
+//
+//  Function: DetachModemIpc
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//
+//  Returns: void.
+//
+//  Description: Client side. Gives up the slot.
+//
+//******************************************************************************
+void DetachModemIpc( MODEM_IPC_CLIENT* pClient );
+
+
+//******************************************************************************
+//
+//  Function: SubmitModemIpcMO
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//    IN  pbyMsg  - MO message to send.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message was queued.
+//           FALSE if the MO ring is full or the message too long.
+//
+//  Description: Client side. Messages are sent in the order submitted;
+//               ReadModemIpcStatus() reports how each one went.
+//
+//******************************************************************************
+BOOL SubmitModemIpcMO( MODEM_IPC_CLIENT* pClient, const BYTE* pbyMsg, WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: ReceiveModemIpcMT
+//
+//  Arguments:
+//    IN  pClient    - Client handle.
+//    OUT pbyMsg     - Buffer for the MT message.
+//    IN  wMaxLength - Size of the buffer.
+//
+//  Returns: WORD length of the message received, 0 if there is none.
+//
+//  Description: Client side. Block in poll() on pClient->iEventFd to wait
+//               for one, then call until it returns 0. A message too big
+//               for the buffer is truncated.
+//
+//******************************************************************************
+WORD ReceiveModemIpcMT( MODEM_IPC_CLIENT* pClient, BYTE* pbyMsg, WORD wMaxLength );
+
+
+//******************************************************************************
+//
+//  Function: ReadModemIpcStatus
+//
+//  Arguments:
+//    IN  pClient - Client handle.
+//    OUT pStatus - Latest MODEM_IPC_STATUS.
+//
+//  Returns: void.
+//
+//  Description: Client side. Reads a consistent snapshot.
+//
+//******************************************************************************
+void ReadModemIpcStatus( MODEM_IPC_CLIENT* pClient, MODEM_IPC_STATUS* pStatus );
+
+#endif // MODEM_HOST_IPC
+
+
+#endif // _MODEMIPC_H
@@ -0,0 +1,716 @@
+//******************************************************************************
+//
+//  ModemIpcBench.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  Host benchmark of the two ways a host process can hand an MO message
+//  to the driver: the ModemIpc rings, and a file dropped in the modem
+//  outbox. It is a program of its own, built only with MODEM_HOST_IPC and
+//  MODEM_IPC_BENCH defined, and linked with ModemIpc.c and the host
+//  utils library:
+//
+//      cc -O2 -DMODEM_HOST_IPC -DMODEM_IPC_BENCH -o ModemIpcBench \
+//          ModemIpcBench.c ModemIpc.c <host utils> -lrt
+//
+//      ModemIpcBench [backlog msgs] [paced msgs] [outbox scan ms] [outbox dir]
+//
+//  The modem is a stand-in that takes each message at once, so only the
+//  path into the driver is timed. Each path is run twice:
+//
+//      backlog - the client queues messages as fast as they are taken;
+//                gives messages per second.
+//      paced   - the client waits for each message to be taken, then
+//                for a random time up to the scan time (at least
+//                BENCH_MIN_GAP ms); gives submit to modem latency.
+//
+//  The outbox is served the way SendFileToModem() serves it: the lowest
+//  name, one file per scan. The driver scans on every idle pass while
+//  awake (run with a scan time of 0) and every DEFAULT_OUTBOX_CHECK_RATE
+//  (2000 ms) while asleep.
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#if defined( MODEM_HOST_IPC ) && defined( MODEM_IPC_BENCH )
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "Modem.h"
+#include "ModemAPI.h"
+#include "ModemIpc.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define BENCH_IPC_NAME          "/iridium-bench"
+#define BENCH_OUTBOX_DIR        "/tmp/iridium-bench-outbox"
+
+#define BENCH_BACKLOG_MSGS      5000
+#define BENCH_PACED_MSGS        20
+#define BENCH_OUTBOX_SCAN       2000    // ms, DEFAULT_OUTBOX_CHECK_RATE
+#define BENCH_MSG_LEN           340     // Typical SBD report
+#define BENCH_LOOP_MS           10      // Driver loop wait for the doorbell
+#define BENCH_MIN_GAP           100     // ms, shortest paced gap bound
+#define BENCH_RUN_LIMIT         300     // s, a run is abandoned after this
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef struct
+{
+    DWORD dwMsgs;                   // Messages handed to the modem
+    DWORD dwElapsed;                // us, first to last
+    DWORD dwAvgLatency;             // us, submit to modem
+    DWORD dwMaxLatency;
+
+} BENCH_RESULT;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+static DWORD    dwModemMsgs;
+static DWORD    dwFirstTaken;
+static DWORD    dwLastTaken;
+static double   dLatencySum;
+static DWORD    dwLatencyMax;
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static DWORD  BenchTimeNow( void );
+static void   ResetBenchModem( void );
+static void   GetBenchResult( BENCH_RESULT* pResult );
+static void   WaitBenchGap( DWORD dwScanMs );
+static BOOL   RunIpcBench( DWORD dwMsgs, BOOL bPaced, BENCH_RESULT* pResult );
+static void   IpcBenchClient( DWORD dwMsgs, BOOL bPaced );
+static BOOL   RunFileBench( const char* szDir, DWORD dwMsgs, DWORD dwScanMs, BOOL bPaced, BENCH_RESULT* pResult );
+static void   FileBenchClient( const char* szDir, DWORD dwMsgs, DWORD dwScanMs, BOOL bPaced );
+static WORD   TakeOldestFile( const char* szDir, BYTE* pbyMsg, WORD wMaxLength );
+static void   PrintBenchResult( const char* szPath, const BENCH_RESULT* pResult );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: main
+//
+//  Arguments:
+//    IN  argc - Number of arguments.
+//    IN  argv - [backlog msgs] [paced msgs] [outbox scan ms] [outbox dir]
+//
+//  Returns: int 0 if every run finished, 1 otherwise.
+//
+//  Description: Runs the IPC path, the outbox scanned continuously and
+//               the outbox scanned every scan time, and prints a line for
+//               each run.
+//
+//******************************************************************************
+int main( int argc, char* argv[] )
+{
+    BENCH_RESULT result;
+    DWORD        dwBacklogMsgs = BENCH_BACKLOG_MSGS;
+    DWORD        dwPacedMsgs   = BENCH_PACED_MSGS;
+    DWORD        dwScanMs      = BENCH_OUTBOX_SCAN;
+    const char*  szDir         = BENCH_OUTBOX_DIR;
+    char         szPath[64];
+    BOOL         bOk = TRUE;
+
+    if( argc > 1 )
+    {
+        dwBacklogMsgs = strtoul( argv[1], NULL, 10 );
+    }
+
+    if( argc > 2 )
+    {
+        dwPacedMsgs = strtoul( argv[2], NULL, 10 );
+    }
+
+    if( argc > 3 )
+    {
+        dwScanMs = strtoul( argv[3], NULL, 10 );
+    }
+
+    if( argc > 4 )
+    {
+        szDir = argv[4];
+    }
+
+    srand( (unsigned int)BenchTimeNow() );
+    mkdir( szDir, 0700 );
+
+    printf( "%d byte messages\n", BENCH_MSG_LEN );
+    printf( "%-28s %6s %9s %10s %10s\n", "path", "msgs", "msg/s", "avg us", "max us" );
+
+    bOk &= RunIpcBench( dwBacklogMsgs, FALSE, &result );
+    PrintBenchResult( "ipc backlog", &result );
+
+    bOk &= RunIpcBench( dwPacedMsgs, TRUE, &result );
+    PrintBenchResult( "ipc paced", &result );
+
+    bOk &= RunFileBench( szDir, dwBacklogMsgs, 0, FALSE, &result );
+    PrintBenchResult( "outbox backlog, scan 0 ms", &result );
+
+    bOk &= RunFileBench( szDir, dwPacedMsgs, 0, TRUE, &result );
+    PrintBenchResult( "outbox paced, scan 0 ms", &result );
+
+    if( dwScanMs != 0 )
+    {
+        sprintf( szPath, "outbox backlog, scan %lu ms", dwScanMs );
+        bOk &= RunFileBench( szDir, dwPacedMsgs, dwScanMs, FALSE, &result );
+        PrintBenchResult( szPath, &result );
+
+        sprintf( szPath, "outbox paced, scan %lu ms", dwScanMs );
+        bOk &= RunFileBench( szDir, dwPacedMsgs, dwScanMs, TRUE, &result );
+        PrintBenchResult( szPath, &result );
+    }
+
+    rmdir( szDir );
+
+    return bOk ? 0 : 1;
+}
+
+
+//------------------------------------------------------------------------------
+//  MODEM STAND-INS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: SendBinMsgToModem
+//
+//  Arguments:
+//    IN  byDataBuf - Message, starting with the client's submit stamp.
+//    IN  wMsgLen   - Length of the message.
+//
+//  Returns: TRUE, the stand-in modem takes every message.
+//
+//  Description: Records the latency of the message.
+//
+//******************************************************************************
+BOOL SendBinMsgToModem( const BYTE* byDataBuf, WORD wMsgLen )
+{
+    DWORD dwStamp;
+    DWORD dwLatency;
+
+    dwLastTaken = BenchTimeNow();
+
+    if( dwModemMsgs == 0 )
+    {
+        dwFirstTaken = dwLastTaken;
+    }
+
+    if( wMsgLen >= sizeof( DWORD ) )
+    {
+        memcpy( &dwStamp, byDataBuf, sizeof( DWORD ) );
+
+        dwLatency    = dwLastTaken - dwStamp;
+        dLatencySum += dwLatency;
+
+        if( dwLatency > dwLatencyMax )
+        {
+            dwLatencyMax = dwLatency;
+        }
+    }
+
+    dwModemMsgs++;
+
+    return TRUE;
+}
+
+
+MODEM_RESPONSES GetBinMsgRspFromModem( void )
+{
+    return MR_SUCCESS;
+}
+
+
+short GetModemSignalStrength( void )
+{
+    return 5;
+}
+
+
+BOOL IsModemSendingEnabled( void )
+{
+    return TRUE;
+}
+
+
+BOOL InTransparentModemMode( void )
+{
+    return FALSE;
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: BenchTimeNow
+//
+//  Arguments: void.
+//
+//  Returns: DWORD monotonic time in us, the clock ModemIpc stamps with.
+//
+//******************************************************************************
+DWORD BenchTimeNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (DWORD)( now.tv_sec * 1000000UL + now.tv_nsec / 1000 );
+}
+
+
+//******************************************************************************
+//
+//  Function: ResetBenchModem
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Clears the stand-in modem counters before a run.
+//
+//******************************************************************************
+void ResetBenchModem( void )
+{
+    dwModemMsgs  = 0;
+    dwFirstTaken = 0;
+    dwLastTaken  = 0;
+    dLatencySum  = 0;
+    dwLatencyMax = 0;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetBenchResult
+//
+//  Arguments:
+//    OUT pResult - Filled from the stand-in modem counters.
+//
+//  Returns: void.
+//
+//******************************************************************************
+void GetBenchResult( BENCH_RESULT* pResult )
+{
+    pResult->dwMsgs       = dwModemMsgs;
+    pResult->dwElapsed    = dwLastTaken - dwFirstTaken;
+    pResult->dwAvgLatency = ( dwModemMsgs == 0 ) ? 0 : (DWORD)( dLatencySum / dwModemMsgs );
+    pResult->dwMaxLatency = dwLatencyMax;
+}
+
+
+//******************************************************************************
+//
+//  Function: WaitBenchGap
+//
+//  Arguments:
+//    IN  dwScanMs - Outbox scan time of the run, 0 if not scanned.
+//
+//  Returns: void.
+//
+//  Description: Client side. Waits a random time up to the scan time, so
+//               paced messages land anywhere in the scan cycle.
+//
+//******************************************************************************
+void WaitBenchGap( DWORD dwScanMs )
+{
+    DWORD dwBound = ( dwScanMs > BENCH_MIN_GAP ) ? dwScanMs : BENCH_MIN_GAP;
+
+    usleep( ( rand() % dwBound ) * 1000 );
+}
+
+
+//******************************************************************************
+//
+//  Function: RunIpcBench
+//
+//  Arguments:
+//    IN  dwMsgs  - Messages to send.
+//    IN  bPaced  - TRUE to send one at a time.
+//    OUT pResult - Filled with the outcome.
+//
+//  Returns: TRUE if all messages reached the modem.
+//           FALSE otherwise.
+//
+//  Description: Driver side of the IPC run. Serves the rings the way a
+//               driver main loop would: on the doorbell, or every
+//               BENCH_LOOP_MS.
+//
+//******************************************************************************
+BOOL RunIpcBench( DWORD dwMsgs, BOOL bPaced, BENCH_RESULT* pResult )
+{
+    struct pollfd bell;
+    pid_t         pid;
+    time_t        start;
+    DWORD         dwTaken;
+    BOOL          bMore = FALSE;
+
+    ResetBenchModem();
+
+    if( !OpenModemIpc( BENCH_IPC_NAME ) )
+    {
+        GetBenchResult( pResult );
+        return FALSE;
+    }
+
+    pid = fork();
+
+    if( pid == 0 )
+    {
+        IpcBenchClient( dwMsgs, bPaced );
+        _exit( 0 );
+    }
+
+    bell.fd     = GetModemIpcDoorbell();
+    bell.events = POLLIN;
+    start       = time( NULL );
+
+    while( ( dwModemMsgs < dwMsgs ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) )
+    {
+        // One message is taken per call; go round again at once while the
+        // rings may hold more, as a driver with work pending would.
+        dwTaken = dwModemMsgs;
+
+        poll( &bell, 1, bMore ? 0 : BENCH_LOOP_MS );
+        ServiceModemIpc();
+
+        bMore = ( dwModemMsgs != dwTaken );
+    }
+
+    // Let the client see the last one accepted before it detaches.
+    while( waitpid( pid, NULL, WNOHANG ) == 0 )
+    {
+        poll( &bell, 1, BENCH_LOOP_MS );
+        ServiceModemIpc();
+    }
+
+    CloseModemIpc();
+    GetBenchResult( pResult );
+
+    return dwModemMsgs == dwMsgs;
+}
+
+
+//******************************************************************************
+//
+//  Function: IpcBenchClient
+//
+//  Arguments:
+//    IN  dwMsgs - Messages to send.
+//    IN  bPaced - TRUE to send one at a time.
+//
+//  Returns: void.
+//
+//  Description: Client process of the IPC run.
+//
+//******************************************************************************
+void IpcBenchClient( DWORD dwMsgs, BOOL bPaced )
+{
+    MODEM_IPC_CLIENT client;
+    MODEM_IPC_STATUS status;
+    BYTE             byMsg[BENCH_MSG_LEN];
+    DWORD            dwSent = 0;
+    DWORD            dwStamp;
+    time_t           start = time( NULL );
+
+    memset( byMsg, 0x5A, sizeof( byMsg ) );
+
+    if( !AttachModemIpc( BENCH_IPC_NAME, &client ) )
+    {
+        return;
+    }
+
+    while( ( dwSent < dwMsgs ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) )
+    {
+        dwStamp = BenchTimeNow();
+        memcpy( byMsg, &dwStamp, sizeof( DWORD ) );
+
+        if( !SubmitModemIpcMO( &client, byMsg, sizeof( byMsg ) ) )
+        {
+            // Ring full, the driver is behind.
+            usleep( 10 );
+            continue;
+        }
+
+        dwSent++;
+
+        if( bPaced )
+        {
+            do
+            {
+                usleep( 100 );
+                ReadModemIpcStatus( &client, &status );
+
+            } while( ( status.dwMOAccepted < dwSent ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) );
+
+            WaitBenchGap( 0 );
+        }
+    }
+
+    // Stay attached until the driver has taken everything.
+    do
+    {
+        usleep( 1000 );
+        ReadModemIpcStatus( &client, &status );
+
+    } while( ( status.dwMOAccepted < dwSent ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) );
+
+    DetachModemIpc( &client );
+}
+
+
+//******************************************************************************
+//
+//  Function: RunFileBench
+//
+//  Arguments:
+//    IN  szDir    - Outbox directory.
+//    IN  dwMsgs   - Messages to send.
+//    IN  dwScanMs - Outbox scan time, 0 to scan continuously.
+//    IN  bPaced   - TRUE to send one at a time.
+//    OUT pResult  - Filled with the outcome.
+//
+//  Returns: TRUE if all messages reached the modem.
+//           FALSE otherwise.
+//
+//  Description: Driver side of the outbox run. Each scan takes the file
+//               with the lowest name, reads it and deletes it.
+//
+//******************************************************************************
+BOOL RunFileBench( const char* szDir, DWORD dwMsgs, DWORD dwScanMs, BOOL bPaced, BENCH_RESULT* pResult )
+{
+    BYTE   byMsg[BENCH_MSG_LEN];
+    WORD   wLength;
+    pid_t  pid;
+    time_t start;
+
+    ResetBenchModem();
+
+    pid = fork();
+
+    if( pid == 0 )
+    {
+        FileBenchClient( szDir, dwMsgs, dwScanMs, bPaced );
+        _exit( 0 );
+    }
+
+    start = time( NULL );
+
+    while( ( dwModemMsgs < dwMsgs ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) )
+    {
+        if( dwScanMs != 0 )
+        {
+            usleep( dwScanMs * 1000 );
+        }
+
+        wLength = TakeOldestFile( szDir, byMsg, sizeof( byMsg ) );
+
+        if( wLength != 0 )
+        {
+            SendBinMsgToModem( byMsg, wLength );
+        }
+    }
+
+    waitpid( pid, NULL, 0 );
+    GetBenchResult( pResult );
+
+    return dwModemMsgs == dwMsgs;
+}
+
+
+//******************************************************************************
+//
+//  Function: FileBenchClient
+//
+//  Arguments:
+//    IN  szDir    - Outbox directory.
+//    IN  dwMsgs   - Messages to send.
+//    IN  dwScanMs - Outbox scan time of the run.
+//    IN  bPaced   - TRUE to send one at a time.
+//
+//  Returns: void.
+//
+//  Description: Client process of the outbox run. Each message is written
+//               under a hidden name and renamed into place, so the driver
+//               never reads a part written file.
+//
+//******************************************************************************
+void FileBenchClient( const char* szDir, DWORD dwMsgs, DWORD dwScanMs, BOOL bPaced )
+{
+    BYTE   byMsg[BENCH_MSG_LEN];
+    char   szTemp[256];
+    char   szPath[256];
+    DWORD  dwSent;
+    DWORD  dwStamp;
+    int    iFd;
+    time_t start = time( NULL );
+
+    memset( byMsg, 0x5A, sizeof( byMsg ) );
+    snprintf( szTemp, sizeof( szTemp ), "%s/.bench", szDir );
+
+    for( dwSent = 0; dwSent < dwMsgs; dwSent++ )
+    {
+        snprintf( szPath, sizeof( szPath ), "%s/B%08lu.DAT", szDir, dwSent );
+
+        dwStamp = BenchTimeNow();
+        memcpy( byMsg, &dwStamp, sizeof( DWORD ) );
+
+        iFd = open( szTemp, O_CREAT | O_WRONLY | O_TRUNC, 0600 );
+
+        if( iFd == -1 )
+        {
+            return;
+        }
+
+        write( iFd, byMsg, sizeof( byMsg ) );
+        close( iFd );
+        rename( szTemp, szPath );
+
+        if( bPaced )
+        {
+            while( ( access( szPath, F_OK ) == 0 ) && ( time( NULL ) - start < BENCH_RUN_LIMIT ) )
+            {
+                usleep( 100 );
+            }
+
+            WaitBenchGap( dwScanMs );
+        }
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: TakeOldestFile
+//
+//  Arguments:
+//    IN  szDir      - Outbox directory.
+//    OUT pbyMsg     - Filled with the file contents.
+//    IN  wMaxLength - Size of pbyMsg.
+//
+//  Returns: WORD bytes read, 0 if the outbox is empty.
+//
+//  Description: Lists the whole directory to find the lowest name, as
+//               SortAscending() does, then reads and deletes that file.
+//
+//******************************************************************************
+WORD TakeOldestFile( const char* szDir, BYTE* pbyMsg, WORD wMaxLength )
+{
+    DIR*           pDir;
+    struct dirent* pEntry;
+    char           szName[256];
+    char           szPath[512];
+    ssize_t        iRead;
+    int            iFd;
+
+    pDir = opendir( szDir );
+
+    if( pDir == NULL )
+    {
+        return 0;
+    }
+
+    szName[0] = '\0';
+
+    while( ( pEntry = readdir( pDir ) ) != NULL )
+    {
+        if( pEntry->d_name[0] == '.' )
+        {
+            continue;
+        }
+
+        if( ( szName[0] == '\0' ) || ( strcmp( pEntry->d_name, szName ) < 0 ) )
+        {
+            strncpy( szName, pEntry->d_name, sizeof( szName ) - 1 );
+            szName[sizeof( szName ) - 1] = '\0';
+        }
+    }
+
+    closedir( pDir );
+
+    if( szName[0] == '\0' )
+    {
+        return 0;
+    }
+
+    snprintf( szPath, sizeof( szPath ), "%s/%s", szDir, szName );
+
+    iFd = open( szPath, O_RDONLY );
+
+    if( iFd == -1 )
+    {
+        return 0;
+    }
+
+    iRead = read( iFd, pbyMsg, wMaxLength );
+    close( iFd );
+    unlink( szPath );
+
+    return ( iRead > 0 ) ? (WORD)iRead : 0;
+}
+
+
+//******************************************************************************
+//
+//  Function: PrintBenchResult
+//
+//  Arguments:
+//    IN  szPath  - Name of the run.
+//    IN  pResult - Outcome of the run.
+//
+//  Returns: void.
+//
+//******************************************************************************
+void PrintBenchResult( const char* szPath, const BENCH_RESULT* pResult )
+{
+    double dRate = 0;
+
+    if( pResult->dwElapsed != 0 )
+    {
+        dRate = ( pResult->dwMsgs - 1 ) * 1000000.0 / pResult->dwElapsed;
+    }
+
+    printf( "%-28s %6lu %9.1f %10lu %10lu\n", szPath, pResult->dwMsgs, dRate,
+            pResult->dwAvgLatency, pResult->dwMaxLatency );
+    fflush( stdout );
+}
+
+#endif
@@ -133,6 +133,10 @@ static char TEXT_MODEMLOG_ERR_CODE[MODEMLOG_NBR_CODES][MAX_MODEM_LOG_MSG] =
  /* MODEMLOG_INCOMING_CALL_COMPLETE */ " incoming call complete",
  /* MODEMLOG_MUTE_BTN_PRESSED       */ " Mute button pressed.",
  /* MODEMLOG_MUTE_BTN_RELEASED      */ " Mute button released.",
+ /* MODEMLOG_DATA_CALL_SUCCESSFUL   */ " file sent by data call",
+ /* MODEMLOG_DATA_CALL_FAILURE      */ " data call transfer failed",
+ /* MODEMLOG_DATA_CALL_FRAGMENTED   */ " file queued as SBD fragments",
+ /* MODEMLOG_SEND_DUPLICATE         */ " duplicate report - not sent",
 };
 
 
@@ -64,6 +64,10 @@ enum modemlog_err_code
     MODEMLOG_INCOMING_CALL_COMPLETE,
     MODEMLOG_MUTE_BTN_PRESSED,
     MODEMLOG_MUTE_BTN_RELEASED,
+    MODEMLOG_DATA_CALL_SUCCESSFUL,
+    MODEMLOG_DATA_CALL_FAILURE,
+    MODEMLOG_DATA_CALL_FRAGMENTED,
+    MODEMLOG_SEND_DUPLICATE,
     MODEMLOG_NBR_CODES
 
 };
@@ -0,0 +1,111 @@
+//******************************************************************************
+//
+//  ModemModel.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module describes the capabilities of the Iridium transceiver the
+//  driver is built for. Select the transceiver with MODEM_MODEL and the
+//  CIS board with MODEM_HAS_CIS on the compiler command line, e.g.:
+//
+//      -DMODEM_MODEL=MODEM_MODEL_960X
+//      -DMODEM_MODEL=MODEM_MODEL_9523 -DMODEM_HAS_CIS=0
+//
+//  Each capability defaults from the model but may be overridden on its
+//  own (e.g. -DMODEM_HAS_RING_ALERT=1 for a 9602 or 9603; the 960x default
+//  suits the 9601). Buffers are sized from the capabilities and the paths
+//  a variant cannot use are compiled out, so the choice is made at build
+//  time and not by runtime branches.
+//
+//  The default build is a 9522 with a CIS, as before.
+//
+//******************************************************************************
+
+#ifndef _MODEM_MODEL_H
+
+    #define _MODEM_MODEL_H
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+/*artldef+*/
+// Supported transceivers
+#define MODEM_MODEL_9522            1   // L-band transceiver - voice, data and SBD
+#define MODEM_MODEL_9523            2   // Core module of the 9555 - voice, data and SBD
+#define MODEM_MODEL_960X            3   // 9601/9602/9603 - SBD only
+
+#ifndef MODEM_MODEL
+    #define MODEM_MODEL             MODEM_MODEL_9522
+#endif
+
+#if ( MODEM_MODEL == MODEM_MODEL_9522 ) || ( MODEM_MODEL == MODEM_MODEL_9523 )
+
+    #define MODEM_MODEL_NAME            "9522"
+    #define MODEM_MO_MAX_LEN            1960    // +SBDWB limit
+    #define MODEM_MT_MAX_LEN            1890    // +SBDRB limit
+    #define MODEM_DEFAULT_HAS_VOICE     1       // +CLCC/+CHUP and the CIS ringers
+    #define MODEM_DEFAULT_HAS_DATA_CALL 1       // ATD circuit-switched data
+    #define MODEM_DEFAULT_HAS_CIS       1
+    #define MODEM_DEFAULT_HAS_RING_ALERT 1      // +SBDAREG and +SBDIXA
+    #define MODEM_STD_RSP_TIMEOUT       5000    // in ms
+    #define MODEM_SBD_SESSION_TIMEOUT   65000   // in ms
+
+    #if MODEM_MODEL == MODEM_MODEL_9523
+        #undef  MODEM_MODEL_NAME
+        #define MODEM_MODEL_NAME        "9523"
+    #endif
+
+#elif MODEM_MODEL == MODEM_MODEL_960X
+
+    #define MODEM_MODEL_NAME            "960x"
+    #define MODEM_MO_MAX_LEN            340
+    #define MODEM_MT_MAX_LEN            270
+    #define MODEM_DEFAULT_HAS_VOICE     0
+    #define MODEM_DEFAULT_HAS_DATA_CALL 0
+    #define MODEM_DEFAULT_HAS_CIS       0       // There is no handset to switch
+    #define MODEM_DEFAULT_HAS_RING_ALERT 0      // The 9601 has none; 9602/9603 do
+    #define MODEM_STD_RSP_TIMEOUT       5000    // in ms
+    #define MODEM_SBD_SESSION_TIMEOUT   65000   // in ms
+
+#else
+    #error "Unknown MODEM_MODEL"
+#endif
+
+#ifndef MODEM_HAS_RING_ALERT
+    #define MODEM_HAS_RING_ALERT    MODEM_DEFAULT_HAS_RING_ALERT
+#endif
+
+#ifndef MODEM_HAS_VOICE
+    #define MODEM_HAS_VOICE         MODEM_DEFAULT_HAS_VOICE
+#endif
+
+#ifndef MODEM_HAS_DATA_CALL
+    #define MODEM_HAS_DATA_CALL     MODEM_DEFAULT_HAS_DATA_CALL
+#endif
+
+#ifndef MODEM_HAS_CIS
+    #define MODEM_HAS_CIS           MODEM_DEFAULT_HAS_CIS
+#endif
+
+#if MODEM_HAS_CIS && !MODEM_HAS_VOICE
+    #error "The CIS needs a voice capable transceiver"
+#endif
+
+// Largest SBD message the build can send or receive. MAX_FILE_LEN and
+// MAX_RX_FILE_LEN (FileUtils.h) bound them on the file system side.
+#define MODEM_MIN_LEN( a, b )       ( ( (a) < (b) ) ? (a) : (b) )
+#define MODEM_MO_BUF_LEN            MODEM_MIN_LEN( MAX_FILE_LEN, MODEM_MO_MAX_LEN )
+#define MODEM_MT_BUF_LEN            MODEM_MIN_LEN( MAX_RX_FILE_LEN, MODEM_MT_MAX_LEN )
+/*artldef-*/
+
+
+#endif // _MODEM_MODEL_H
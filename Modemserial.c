@@ -26,6 +26,7 @@
 #include "afirs.h"
 #include "timer.h"
 #include "CISAPI.h"
+#include "ModemGround.h"
 
 //------------------------------------------------------------------------------
 //  CONSTANT & MACRO DEFINITIONS
@@ -62,6 +63,10 @@ static PCOMMQUEUE         pModemRxQueue = &ModemRxQueue;
 static QUEUE_BUFF         txQBuff[Modem_Q_LEN];
 static QUEUE_BUFF         rxQBuff[Modem_Q_LEN];
 
+// The span functions hand the queue storage out as a BYTE array. This fails
+// to compile if QUEUE_BUFF is ever widened.
+typedef char QUEUE_BUFF_IS_ONE_BYTE[ ( sizeof( QUEUE_BUFF ) == 1 ) ? 1 : -1 ];
+
 
 //------------------------------------------------------------------------------
 //  PRIVATE FUNCTION PROTOTYPES
@@ -452,6 +457,11 @@ void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength )
 {
     WORD wIndex;
 
+#ifdef MODEM_GROUND_LOOPBACK
+    ModemGroundUplink( pBuffer, wLength );
+    return;
+#endif
+
     for( wIndex = 0; wIndex < wLength; wIndex++ )
     {
         // Add data to queue.
@@ -466,6 +476,37 @@ void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength )
 }
 
 
+//******************************************************************************
+//
+//  Function: ModemPortReceiveBuffer
+//
+//  Arguments:
+//    OUT pBuffer    - Filled with the bytes received from the modem.
+//    IN  wMaxLength - Size of pBuffer.
+//
+//  Returns: WORD number of bytes placed in pBuffer.
+//
+//  Description: Call this function to take as many received bytes as fit
+//               in one call rather than one GetModemPortChar() at a time.
+//
+//******************************************************************************
+WORD ModemPortReceiveBuffer( BYTE* pBuffer, WORD wMaxLength )
+{
+    WORD wCount = 0;
+
+    DisableInts();
+
+    while( ( wCount < wMaxLength ) && HAVE_RX_Q_DATA() )
+    {
+        pBuffer[wCount++] = (BYTE)GetDataFromQueue( pModemRxQueue );
+    }
+
+    EnableInts();
+
+    return wCount;
+}
+
+
 //******************************************************************************
 //
 //  Function: ModemPortSending
@@ -485,6 +526,244 @@ BOOL ModemPortSending( void )
 }
 
 
+//******************************************************************************
+//
+//  Function: GetModemPortRxSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the oldest received byte in the RX queue.
+//
+//  Returns: WORD number of contiguous received bytes at *ppbySpan.
+//
+//  Description: Gives direct access to the RX queue so received data can be
+//               moved without a per byte call. The span stays valid until
+//               ReleaseModemPortRxSpan() is called. A wrapped queue is
+//               returned as two spans over two calls.
+//
+//******************************************************************************
+WORD GetModemPortRxSpan( BYTE** ppbySpan )
+{
+    WORD wWriteIndex;
+    WORD wReadIndex;
+
+    DisableInts();
+
+    wWriteIndex = ModemRxQueue.wWriteIndex;
+    wReadIndex  = ModemRxQueue.wReadIndex;
+
+    EnableInts();
+
+    *ppbySpan = (BYTE*)&rxQBuff[wReadIndex];
+
+    if( wWriteIndex >= wReadIndex )
+    {
+        return wWriteIndex - wReadIndex;
+    }
+
+    return Modem_Q_LEN - wReadIndex;
+}
+
+
+//******************************************************************************
+//
+//  Function: ReleaseModemPortRxSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes of the span that were consumed.
+//
+//  Returns: void.
+//
+//  Description: Removes wLength bytes from the front of the RX queue. The
+//               bytes are taken out through the queue library so its
+//               indexes are never moved behind its back.
+//
+//******************************************************************************
+void ReleaseModemPortRxSpan( WORD wLength )
+{
+    WORD wIndex;
+
+    DisableInts();
+
+    for( wIndex = 0; ( wIndex < wLength ) && HAVE_RX_Q_DATA(); wIndex++ )
+    {
+        GetDataFromQueue( pModemRxQueue );
+    }
+
+    EnableInts();
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortTxSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the first free byte in the TX queue.
+//
+//  Returns: WORD number of contiguous free bytes at *ppbySpan.
+//
+//  Description: Gives direct access to the TX queue so data can be written
+//               in place. Nothing is sent until CommitModemPortTxSpan().
+//               One byte is always kept free so a full queue is never
+//               mistaken for an empty one.
+//
+//******************************************************************************
+WORD GetModemPortTxSpan( BYTE** ppbySpan )
+{
+    WORD wWriteIndex;
+    WORD wReadIndex;
+
+    DisableInts();
+
+    wWriteIndex = ModemTxQueue.wWriteIndex;
+    wReadIndex  = ModemTxQueue.wReadIndex;
+
+    EnableInts();
+
+    *ppbySpan = (BYTE*)&txQBuff[wWriteIndex];
+
+    if( wReadIndex > wWriteIndex )
+    {
+        return wReadIndex - wWriteIndex - 1;
+    }
+
+    if( wReadIndex == 0 )
+    {
+        return Modem_Q_LEN - wWriteIndex - 1;
+    }
+
+    return Modem_Q_LEN - wWriteIndex;
+}
+
+
+//******************************************************************************
+//
+//  Function: CommitModemPortTxSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes written into the span.
+//
+//  Returns: void.
+//
+//  Description: Adds the bytes written in place to the TX queue and starts
+//               the transmission. Each byte is added again through the
+//               queue library; it lands on the slot it already occupies, so
+//               the queue indexes are only ever moved by the library.
+//
+//******************************************************************************
+void CommitModemPortTxSpan( WORD wLength )
+{
+    BYTE* pbySpan;
+    WORD  wIndex;
+
+    if( wLength == 0 )
+    {
+        return;
+    }
+
+    pbySpan = (BYTE*)&txQBuff[ModemTxQueue.wWriteIndex];
+
+#ifdef MODEM_GROUND_LOOPBACK
+    // The span is handed over as it is and never queued.
+    ModemGroundUplink( pbySpan, wLength );
+    return;
+#endif
+
+    DisableInts();
+
+    for( wIndex = 0; wIndex < wLength; wIndex++ )
+    {
+        AddDataToQueue( pModemTxQueue, pbySpan[wIndex] );
+    }
+
+    EnableInts();
+
+    // enable the interrupt
+    SCCR1 |= SCCR1_EN_INTERPT;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortRxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD number of bytes waiting in the RX queue.
+//
+//  Description: Used for flow control and latency accounting.
+//
+//******************************************************************************
+WORD GetModemPortRxCount( void )
+{
+    WORD wCount;
+
+    DisableInts();
+
+    wCount = ( ModemRxQueue.wWriteIndex + Modem_Q_LEN - ModemRxQueue.wReadIndex ) % Modem_Q_LEN;
+
+    EnableInts();
+
+    return wCount;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortTxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD number of bytes still waiting to be sent.
+//
+//  Description: Used for flow control and latency accounting.
+//
+//******************************************************************************
+WORD GetModemPortTxCount( void )
+{
+    WORD wCount;
+
+    DisableInts();
+
+    wCount = ( ModemTxQueue.wWriteIndex + Modem_Q_LEN - ModemTxQueue.wReadIndex ) % Modem_Q_LEN;
+
+    EnableInts();
+
+    return wCount;
+}
+
+
+#ifdef MODEM_GROUND_LOOPBACK
+//******************************************************************************
+//
+//  Function: LoopbackModemPortRx
+//
+//  Arguments:
+//    IN  pBuffer - Bytes from the simulated transceiver.
+//    IN  wLength - Number of bytes.
+//
+//  Returns: void.
+//
+//  Description: Adds the bytes to the RX queue as if they had been
+//               received on the UART.
+//
+//******************************************************************************
+void LoopbackModemPortRx( const BYTE* pBuffer, WORD wLength )
+{
+    WORD wIndex;
+
+    DisableInts();
+
+    for( wIndex = 0; wIndex < wLength; wIndex++ )
+    {
+        AddDataToQueue( pModemRxQueue, pBuffer[wIndex] );
+    }
+
+    EnableInts();
+}
+#endif
+
+
 //******************************************************************************
 //
 //  Function: ReadModemPortRILine
@@ -502,6 +781,11 @@ BOOL ModemPortSending( void )
 //******************************************************************************
 BOOL ReadModemPortRILine( void )
 {
+#ifdef MODEM_GROUND_LOOPBACK
+    // The simulated transceiver has no call or carrier.
+    return FALSE;
+#endif
+
     // The Pin Level line returns 0-15 bits of buffered states
     // on channel 5.  We only want the most recent pin level
     // hence, only check bit 15
@@ -531,6 +815,11 @@ BOOL ReadModemPortRILine( void )
 //******************************************************************************
 BOOL ReadModemPortDCDLine( void )
 {
+#ifdef MODEM_GROUND_LOOPBACK
+    // The simulated transceiver has no call or carrier.
+    return FALSE;
+#endif
+
     // The Pin Level line returns 0-15 bits of buffered states
     // on channel 4.  We only want the most recent pin level
     // hence, only check bit 15
@@ -560,6 +849,11 @@ BOOL ReadModemPortDCDLine( void )
 //******************************************************************************
 BOOL ReadModemPortDSRLine( void )
 {
+#ifdef MODEM_GROUND_LOOPBACK
+    // The simulated transceiver has no call or carrier.
+    return FALSE;
+#endif
+
     // The Pin Level line returns 0-15 bits of buffered states
     // on channel 2.  We only want the most recent pin level
     // hence, only check bit 15
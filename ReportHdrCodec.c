@@ -0,0 +1,1570 @@
+//******************************************************************************
+//
+//  ReportHdrCodec.c: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module packs the RPT_HEADER_STRUCT at the front of outbound SBD
+//  reports, and expands it again on the ground.
+//
+//  The header is described by a schema table (hdrSchema) so that each
+//  field can be coded by what it holds. The table is built from the real
+//  RPT_HEADER_STRUCT the first time it is needed: the CRC is found with
+//  offsetof(), and the report type, size and time requested by having
+//  GenerateHeader() fill a header with marker values. Whatever is left
+//  (time generated, aircraft identification) is coded as CONSTANT runs.
+//  If the markers are not found the codec stays off, and says so in the
+//  system log when it is enabled. Header fields are read big endian, as
+//  laid out by the target.
+//
+//      CRC      - elided, the ground recomputes it
+//      SIZE     - elided, the ground knows the length of the message
+//      ENUM     - 1 bit when unchanged, otherwise 6 or 16 bits
+//      TIME     - 2 bit tag: zero, zig-zag varint delta to the reference,
+//                 zig-zag varint delta to the previous time field or raw
+//      CONSTANT - 1 bit when unchanged, otherwise a byte change mask and
+//                 the changed bytes
+//
+//  A packed message has the format:
+//
+//      MAGIC_1 MAGIC_2 bit stream (MSB first), padded to a byte, payload
+//
+//  where the bit stream starts with:
+//
+//      PACKED (1) KEY FRAME (1) SEQUENCE (4) fields...
+//
+//  A key frame is coded against an all zero reference; any other frame
+//  is coded against the header with sequence number SEQUENCE - 1, which
+//  is the last report the aircraft knows was delivered. The ground keeps
+//  the previous reference as well, so a report that was delivered but
+//  reported as failed to the aircraft still expands when it is re-sent.
+//
+//  A raw message which happens to start with the magic bytes is escaped
+//  by inserting MAGIC_1 MAGIC_2 0x00 in front of it.
+//
+//  Before a header is packed the module checks that the message really
+//  carries a header (the CRC and size fields check out) and that the
+//  packed header expands back to the original; otherwise the message is
+//  sent as is.
+//
+//******************************************************************************
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#if defined( __BORLANDC__ ) || defined( WIN32 )
+    #include "artl.h"
+    #include "artlx.h"
+    #ifdef __BORLANDC__
+        #include "Stubfunctions.h"
+        #include "DebugOut.h"
+    #endif
+#else
+    #include <stddef.h>
+
+    #include "FileUtils.h"
+    #include "ReportHdrCodec.h"
+    #include "RulesBin.h"
+    #include "SystemLog.h"
+    #include "utils.h"
+#endif
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+#define HDR_MAGIC_1                 0xB7
+#define HDR_MAGIC_2                 0x3C
+#define HDR_MAGIC_SIZE              2
+#define HDR_ESCAPE_SIZE             ( HDR_MAGIC_SIZE + 1 )
+
+#define HDR_KEYFRAME_INTERVAL       16      // Delivered reports between key frames
+#define HDR_SEQ_MASK                0x0F
+
+#define RPT_HDR_SIZE                ( (WORD)sizeof( RPT_HEADER_STRUCT ) )
+
+#define TIME_TAG_ZERO               0
+#define TIME_TAG_REF_DELTA          1
+#define TIME_TAG_PREV_DELTA         2
+#define TIME_TAG_RAW                3
+
+#define MAX_HDR_FIELDS              12
+#define HDR_NO_FIELD                0xFF
+
+// Marker values GenerateHeader() is asked to write when the layout is
+// probed. The bytes are not printable so they cannot come from the
+// aircraft identification.
+#define HDR_PROBE_TYPE              0xC3A5
+#define HDR_PROBE_SIZE              0xA5C3
+#define HDR_PROBE_TIME              0xB4D2E1F0L
+
+#define ENUM_SHORT_BITS             6
+#define VARINT_GROUP_BITS           7
+#define VARINT_MAX_GROUPS           5
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+typedef BYTE    HDR_FIELD_KINDS;
+enum hdr_field_kinds
+{
+    HDR_FIELD_CRC,
+    HDR_FIELD_SIZE,
+    HDR_FIELD_ENUM,
+    HDR_FIELD_TIME,
+    HDR_FIELD_CONSTANT
+};
+
+
+typedef struct
+{
+    HDR_FIELD_KINDS kind;
+    BYTE            byOffset;
+    BYTE            byWidth;
+
+} HDR_FIELD;
+
+
+typedef struct
+{
+    BYTE* pbyBuff;
+    WORD  wBit;
+    WORD  wMaxBits;
+    BOOL  bOverflow;
+
+} BIT_STREAM;
+
+
+typedef struct
+{
+    BOOL  bProbed;
+    BOOL  bKnown;                   // hdrSchema describes the header
+    BYTE  byNbrFields;
+    BYTE  byTypeField;              // hdrSchema index of the report type
+    BYTE  bySizeField;
+    BYTE  byTimeReqField;           // HDR_NO_FIELD if not found
+
+} HDR_LAYOUT_INFO;
+
+
+typedef struct
+{
+    BOOL  bEnabled;
+    BOOL  bHaveRef;
+    BYTE  byRefSeq;
+    WORD  wCommitsSinceKey;
+    BYTE  byRef[MAX_HDR_CODEC_REF_SIZE];
+
+    BOOL  bPending;                 // Last message sent was packed
+    BYTE  byPendingSeq;
+    BOOL  bPendingKey;
+    WORD  wPendingPackedLen;
+    BYTE  byPending[MAX_HDR_CODEC_REF_SIZE];
+
+} HDR_CODEC_INFO;
+
+
+//------------------------------------------------------------------------------
+//  GLOBAL DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+// Built by BuildHdrSchema(), in header order
+static HDR_FIELD        hdrSchema[MAX_HDR_FIELDS];
+static HDR_LAYOUT_INFO  hdrLayout;
+
+#define NBR_HDR_FIELDS              ( hdrLayout.byNbrFields )
+
+static HDR_CODEC_INFO   hdrCodec;
+static REPORT_HDR_STATS hdrStats[NBR_HDR_STATS_TYPES];
+
+static const BYTE       byZeroRef[MAX_HDR_CODEC_REF_SIZE] = { 0 };
+static BYTE             byPackedHdr[MAX_HDR_CODEC_REF_SIZE];
+static BYTE             byCheckHdr[MAX_HDR_CODEC_REF_SIZE];
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTION PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+static BOOL  HdrLayoutKnown( void );
+static void  BuildHdrSchema( void );
+static BYTE  FindProbeValue( const BYTE* pbyProbe, const BYTE* pbyValue, BYTE byWidth );
+static BOOL  AddHdrField( HDR_FIELD_KINDS kind, BYTE byOffset, BYTE byWidth );
+static BYTE  FieldWidth( BYTE byField );
+static DWORD GetField( const BYTE* pbyHdr, BYTE byField );
+static void  PutField( BYTE* pbyHdr, BYTE byField, DWORD dwValue );
+static BOOL  IsReportHeader( const BYTE* pbyMsg, WORD wLength );
+static void  PutBits( BIT_STREAM* pBits, DWORD dwValue, BYTE byNbrBits );
+static DWORD GetBits( BIT_STREAM* pBits, BYTE byNbrBits );
+static DWORD ZigZag( DWORD dwDelta );
+static DWORD UnZigZag( DWORD dwValue );
+static BYTE  VarintBits( DWORD dwValue );
+static void  PutVarint( BIT_STREAM* pBits, DWORD dwValue );
+static DWORD GetVarint( BIT_STREAM* pBits );
+static WORD  EncodeHdr( const BYTE* pbyHdr, const BYTE* pbyRef, BOOL bKeyFrame,
+                        BYTE bySeq, BYTE* pbyOut, WORD wMaxLength );
+static BOOL  DecodeHdr( BIT_STREAM* pBits, const BYTE* pbyRef, BYTE* pbyHdr );
+static void  UpdateHdrStats( WORD wMsgType, WORD wPackedLen );
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: InitReportHdrCodec
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables.
+//
+//******************************************************************************
+void InitReportHdrCodec( void )
+{
+    MemSet( &hdrCodec, 0, sizeof( hdrCodec ) );
+    MemSet( hdrStats, 0, sizeof( hdrStats ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: SetReportHdrCodec
+//
+//  Arguments:
+//    IN  bEnable - TRUE to pack report headers.
+//                  FALSE to send them as they are (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to enable the header codec.
+//
+//******************************************************************************
+void SetReportHdrCodec( const BOOL bEnable )
+{
+    if( bEnable && !HdrLayoutKnown() )
+    {
+        SystemLog( "Report header layout not found - header codec stays off" );
+    }
+
+    if( bEnable != hdrCodec.bEnabled )
+    {
+        // Start over with a key frame
+        hdrCodec.bHaveRef = FALSE;
+        hdrCodec.bPending = FALSE;
+    }
+
+    hdrCodec.bEnabled = bEnable;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrCodec
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if report headers are packed.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the header codec mode.
+//
+//******************************************************************************
+BOOL GetReportHdrCodec( void )
+{
+    return hdrCodec.bEnabled;
+}
+
+
+//******************************************************************************
+//
+//  Function: PackReportHdr
+//
+//  Arguments:
+//    IN/OUT pbyMsg     - Outbound message, packed in place.
+//    IN     wLength    - Length of the message.
+//    IN     wMaxLength - Size of the pbyMsg buffer.
+//
+//  Returns: WORD length of the message to send.
+//
+//  Description: Packs the header of a report if the codec is enabled and
+//               the message carries a valid RPT_HEADER_STRUCT (CRC and size
+//               check out). Anything else is sent as is. Must be followed
+//               by CommitReportHdr() once the message was delivered.
+//
+//******************************************************************************
+WORD PackReportHdr( BYTE* pbyMsg, WORD wLength, WORD wMaxLength )
+{
+    BIT_STREAM bits;
+    BOOL       bKeyFrame;
+    BYTE       bySeq;
+    WORD       wPackedLen;
+    WORD       wIndex;
+    BYTE       byField;
+
+    hdrCodec.bPending = FALSE;
+
+    if( !hdrCodec.bEnabled || !HdrLayoutKnown() )
+    {
+        return wLength;
+    }
+
+    if( IsReportHeader( pbyMsg, wLength ) )
+    {
+        bKeyFrame = ( !hdrCodec.bHaveRef ) ||
+                    ( hdrCodec.wCommitsSinceKey >= HDR_KEYFRAME_INTERVAL );
+        bySeq     = (BYTE)( ( hdrCodec.byRefSeq + 1 ) & HDR_SEQ_MASK );
+
+        wPackedLen = EncodeHdr( pbyMsg, bKeyFrame ? byZeroRef : hdrCodec.byRef,
+                                bKeyFrame, bySeq, byPackedHdr, RPT_HDR_SIZE );
+
+        if( wPackedLen > 0 )
+        {
+            // Expand it the way the ground will before committing to it
+            bits.pbyBuff   = byPackedHdr;
+            bits.wBit      = ( HDR_MAGIC_SIZE * 8 ) + 6;
+            bits.wMaxBits  = wPackedLen * 8;
+            bits.bOverflow = FALSE;
+
+            if( DecodeHdr( &bits, bKeyFrame ? byZeroRef : hdrCodec.byRef, byCheckHdr ) )
+            {
+                for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+                {
+                    if( ( hdrSchema[byField].kind == HDR_FIELD_CRC ) ||
+                        ( hdrSchema[byField].kind == HDR_FIELD_SIZE ) )
+                    {
+                        PutField( byCheckHdr, byField, GetField( pbyMsg, byField ) );
+                    }
+                }
+
+                for( wIndex = 0; wIndex < RPT_HDR_SIZE; wIndex++ )
+                {
+                    if( byCheckHdr[wIndex] != pbyMsg[wIndex] )
+                    {
+                        break;
+                    }
+                }
+
+                if( wIndex == RPT_HDR_SIZE )
+                {
+                    MemCpy( hdrCodec.byPending, pbyMsg, RPT_HDR_SIZE );
+                    hdrCodec.byPendingSeq      = bySeq;
+                    hdrCodec.bPendingKey       = bKeyFrame;
+                    hdrCodec.wPendingPackedLen = wPackedLen;
+                    hdrCodec.bPending          = TRUE;
+
+                    // Payload moves down over the space the header gave up
+                    for( wIndex = RPT_HDR_SIZE; wIndex < wLength; wIndex++ )
+                    {
+                        pbyMsg[wIndex - RPT_HDR_SIZE + wPackedLen] = pbyMsg[wIndex];
+                    }
+
+                    MemCpy( pbyMsg, byPackedHdr, wPackedLen );
+
+                    return wLength - RPT_HDR_SIZE + wPackedLen;
+                }
+            }
+        }
+    }
+
+    // Sent raw; escape it if the ground would take it for a packed one
+    if( ( wLength >= HDR_MAGIC_SIZE ) &&
+        ( pbyMsg[0] == HDR_MAGIC_1 ) && ( pbyMsg[1] == HDR_MAGIC_2 ) &&
+        ( wLength + HDR_ESCAPE_SIZE <= wMaxLength ) )
+    {
+        for( wIndex = wLength; wIndex > 0; wIndex-- )
+        {
+            pbyMsg[wIndex - 1 + HDR_ESCAPE_SIZE] = pbyMsg[wIndex - 1];
+        }
+
+        pbyMsg[0] = HDR_MAGIC_1;
+        pbyMsg[1] = HDR_MAGIC_2;
+        pbyMsg[2] = 0x00;
+
+        wLength += HDR_ESCAPE_SIZE;
+    }
+
+    return wLength;
+}
+
+
+//******************************************************************************
+//
+//  Function: CommitReportHdr
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: The message from the last PackReportHdr() call was
+//               delivered; its header becomes the delta reference.
+//
+//******************************************************************************
+void CommitReportHdr( void )
+{
+    if( !hdrCodec.bPending )
+    {
+        return;
+    }
+
+    MemCpy( hdrCodec.byRef, hdrCodec.byPending, RPT_HDR_SIZE );
+    hdrCodec.byRefSeq = hdrCodec.byPendingSeq;
+    hdrCodec.bHaveRef = TRUE;
+    hdrCodec.bPending = FALSE;
+
+    if( hdrCodec.bPendingKey )
+    {
+        hdrCodec.wCommitsSinceKey = 0;
+    }
+    hdrCodec.wCommitsSinceKey++;
+
+    UpdateHdrStats( (WORD)GetField( hdrCodec.byRef, hdrLayout.byTypeField ), hdrCodec.wPendingPackedLen );
+}
+
+
+//******************************************************************************
+//
+//  Function: InitHdrCodecState
+//
+//  Arguments:
+//    OUT pState - Ground side reference to initialize.
+//
+//  Returns: void.
+//
+//  Description: Clears a ground side reference (one per aircraft).
+//
+//******************************************************************************
+void InitHdrCodecState( HDR_CODEC_STATE* pState )
+{
+    MemSet( pState, 0, sizeof( HDR_CODEC_STATE ) );
+}
+
+
+//******************************************************************************
+//
+//  Function: ExpandReportHdr
+//
+//  Arguments:
+//    IN/OUT pState  - Ground side reference of the sending aircraft.
+//    IN     pbyIn   - Received SBD message.
+//    IN     wInLen  - Length of the received message.
+//    OUT    pbyOut  - Expanded report.
+//    IN     wOutMax - Size of the pbyOut buffer.
+//
+//  Returns: WORD length of the expanded report.
+//           0 if the message refers to a header the ground does not hold
+//             (the report must wait for the next key frame).
+//
+//  Description: Ground side expander. Messages that were not packed are
+//               copied as they are.
+//
+//******************************************************************************
+WORD ExpandReportHdr( HDR_CODEC_STATE* pState, const BYTE* pbyIn, WORD wInLen,
+                      BYTE* pbyOut, WORD wOutMax )
+{
+    BIT_STREAM  bits;
+    const BYTE* pbyRef;
+    BOOL        bKeyFrame;
+    BYTE        bySeq;
+    BYTE        byRefSlot;
+    WORD        wPayloadStart;
+    WORD        wTotal;
+    BYTE        byField;
+
+    if( ( wInLen <= HDR_MAGIC_SIZE ) ||
+        ( pbyIn[0] != HDR_MAGIC_1 ) || ( pbyIn[1] != HDR_MAGIC_2 ) )
+    {
+        if( wInLen > wOutMax )
+        {
+            return 0;
+        }
+
+        MemCpy( pbyOut, (void*)pbyIn, wInLen );
+        return wInLen;
+    }
+
+    if( !HdrLayoutKnown() )
+    {
+        return 0;
+    }
+
+    bits.pbyBuff   = (BYTE*)pbyIn;
+    bits.wBit      = HDR_MAGIC_SIZE * 8;
+    bits.wMaxBits  = wInLen * 8;
+    bits.bOverflow = FALSE;
+
+    if( GetBits( &bits, 1 ) == 0 )
+    {
+        // Escaped raw message
+        if( ( wInLen < HDR_ESCAPE_SIZE ) || ( wInLen - HDR_ESCAPE_SIZE > wOutMax ) )
+        {
+            return 0;
+        }
+
+        MemCpy( pbyOut, (void*)&pbyIn[HDR_ESCAPE_SIZE], wInLen - HDR_ESCAPE_SIZE );
+        return wInLen - HDR_ESCAPE_SIZE;
+    }
+
+    bKeyFrame = (BOOL)GetBits( &bits, 1 );
+    bySeq     = (BYTE)GetBits( &bits, 4 );
+    byRefSlot = 0;
+
+    if( bKeyFrame )
+    {
+        pbyRef = byZeroRef;
+    }
+    else
+    {
+        for( byRefSlot = 0; byRefSlot < 2; byRefSlot++ )
+        {
+            if( pState->bHaveRef[byRefSlot] &&
+                ( pState->bySeq[byRefSlot] == ( ( bySeq - 1 ) & HDR_SEQ_MASK ) ) )
+            {
+                break;
+            }
+        }
+
+        if( byRefSlot == 2 )
+        {
+            return 0;
+        }
+
+        pbyRef = pState->byRef[byRefSlot];
+    }
+
+    if( !DecodeHdr( &bits, pbyRef, byCheckHdr ) )
+    {
+        return 0;
+    }
+
+    wPayloadStart = ( bits.wBit + 7 ) / 8;
+    wTotal        = RPT_HDR_SIZE + ( wInLen - wPayloadStart );
+
+    if( wTotal > wOutMax )
+    {
+        return 0;
+    }
+
+    MemCpy( pbyOut, byCheckHdr, RPT_HDR_SIZE );
+    MemCpy( &pbyOut[RPT_HDR_SIZE], (void*)&pbyIn[wPayloadStart], wInLen - wPayloadStart );
+
+    // Rebuild the elided fields, the CRC last
+    for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+    {
+        if( hdrSchema[byField].kind == HDR_FIELD_SIZE )
+        {
+            PutField( pbyOut, byField, wTotal );
+        }
+    }
+
+    for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+    {
+        if( hdrSchema[byField].kind == HDR_FIELD_CRC )
+        {
+            PutField( pbyOut, byField, CalcCRC( &pbyOut[CRC_SIZE], wTotal - CRC_SIZE ) );
+        }
+    }
+
+    // The reference that was used is kept in case this report is re-sent
+    if( bKeyFrame || ( byRefSlot == 0 ) )
+    {
+        MemCpy( pState->byRef[1], pState->byRef[0], RPT_HDR_SIZE );
+        pState->bySeq[1]    = pState->bySeq[0];
+        pState->bHaveRef[1] = pState->bHaveRef[0];
+    }
+
+    MemCpy( pState->byRef[0], pbyOut, RPT_HDR_SIZE );
+    pState->bySeq[0]    = bySeq;
+    pState->bHaveRef[0] = TRUE;
+
+    return wTotal;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrStats
+//
+//  Arguments:
+//    IN  byIndex - 0 to NBR_HDR_STATS_TYPES-1.
+//    OUT pStats  - Savings for one report type.
+//
+//  Returns: TRUE if the entry is in use.
+//           FALSE otherwise.
+//
+//  Description: Reports the header byte savings per report type.
+//
+//******************************************************************************
+BOOL GetReportHdrStats( BYTE byIndex, REPORT_HDR_STATS* pStats )
+{
+    if( ( byIndex >= NBR_HDR_STATS_TYPES ) || ( hdrStats[byIndex].dwMsgs == 0 ) )
+    {
+        return FALSE;
+    }
+
+    MemCpy( pStats, &hdrStats[byIndex], sizeof( REPORT_HDR_STATS ) );
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrField
+//
+//  Arguments:
+//    IN  pbyMsg   - Report, header not packed.
+//    IN  wLength  - Length of the report.
+//    IN  field    - Header field wanted.
+//    OUT pdwValue - Value of the field.
+//
+//  Returns: TRUE if the field was read.
+//           FALSE if the header layout is not known, the field was not
+//                 found in it or the report is shorter than a header.
+//
+//  Description: Lets other modules read the report header without
+//               assuming its layout.
+//
+//******************************************************************************
+BOOL GetReportHdrField( const BYTE* pbyMsg, WORD wLength, RPT_HDR_FIELDS field,
+                        DWORD* pdwValue )
+{
+    BYTE byField;
+
+    if( !HdrLayoutKnown() || ( wLength < RPT_HDR_SIZE ) )
+    {
+        return FALSE;
+    }
+
+    switch( field )
+    {
+        case RPT_HDR_FIELD_TYPE:
+            byField = hdrLayout.byTypeField;
+            break;
+
+        case RPT_HDR_FIELD_SIZE:
+            byField = hdrLayout.bySizeField;
+            break;
+
+        case RPT_HDR_FIELD_TIME_REQUESTED:
+            byField = hdrLayout.byTimeReqField;
+            break;
+
+        default:
+            byField = HDR_NO_FIELD;
+            break;
+    }
+
+    if( byField == HDR_NO_FIELD )
+    {
+        return FALSE;
+    }
+
+    *pdwValue = GetField( pbyMsg, byField );
+
+    return TRUE;
+}
+
+
+//------------------------------------------------------------------------------
+//  PRIVATE FUNCTIONS
+//------------------------------------------------------------------------------
+
+
+//******************************************************************************
+//
+//  Function: HdrLayoutKnown
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if hdrSchema describes RPT_HEADER_STRUCT.
+//           FALSE otherwise.
+//
+//  Description: Builds hdrSchema on the first call.
+//
+//******************************************************************************
+BOOL HdrLayoutKnown( void )
+{
+    if( !hdrLayout.bProbed )
+    {
+        BuildHdrSchema();
+    }
+
+    return hdrLayout.bKnown;
+}
+
+
+//******************************************************************************
+//
+//  Function: BuildHdrSchema
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: Finds the fields of RPT_HEADER_STRUCT. The CRC must be the
+//               first field and the report type and size must be found, or
+//               the layout is left unknown. The bytes between the fields
+//               found become CONSTANT fields. Only the marker values are
+//               looked for, so the aircraft and the ground build the same
+//               schema.
+//
+//******************************************************************************
+void BuildHdrSchema( void )
+{
+    RPT_HEADER_STRUCT probe;
+    HDR_FIELD         found[4];
+    WORD              wType   = HDR_PROBE_TYPE;
+    WORD              wSize   = HDR_PROBE_SIZE;
+    DWORD             dwTime  = HDR_PROBE_TIME;
+    BYTE              byFound = 0;
+    BYTE              byOffset;
+    BYTE              byRun;
+    BYTE              byIndex;
+    BYTE              byOther;
+
+    MemSet( &hdrLayout, 0, sizeof( hdrLayout ) );
+    hdrLayout.bProbed        = TRUE;
+    hdrLayout.byTypeField    = HDR_NO_FIELD;
+    hdrLayout.bySizeField    = HDR_NO_FIELD;
+    hdrLayout.byTimeReqField = HDR_NO_FIELD;
+
+    if( ( RPT_HDR_SIZE > MAX_HDR_CODEC_REF_SIZE ) ||
+        ( offsetof( RPT_HEADER_STRUCT, wCRC ) != 0 ) ||
+        ( sizeof( probe.wCRC ) != CRC_SIZE ) )
+    {
+        return;
+    }
+
+    MemSet( &probe, 0, sizeof( probe ) );
+    GenerateHeader( &probe, HDR_PROBE_TYPE, HDR_PROBE_SIZE, HDR_PROBE_TIME );
+
+    found[byFound].kind     = HDR_FIELD_CRC;
+    found[byFound].byOffset = 0;
+    found[byFound].byWidth  = CRC_SIZE;
+    byFound++;
+
+    found[byFound].kind     = HDR_FIELD_ENUM;
+    found[byFound].byOffset = FindProbeValue( (BYTE*)&probe, (BYTE*)&wType, sizeof( WORD ) );
+    found[byFound].byWidth  = sizeof( WORD );
+    byFound++;
+
+    found[byFound].kind     = HDR_FIELD_SIZE;
+    found[byFound].byOffset = FindProbeValue( (BYTE*)&probe, (BYTE*)&wSize, sizeof( WORD ) );
+    found[byFound].byWidth  = sizeof( WORD );
+    byFound++;
+
+    if( ( found[1].byOffset == HDR_NO_FIELD ) || ( found[2].byOffset == HDR_NO_FIELD ) )
+    {
+        return;
+    }
+
+    // Not needed; without it time requested goes as CONSTANT bytes.
+    found[byFound].kind     = HDR_FIELD_TIME;
+    found[byFound].byOffset = FindProbeValue( (BYTE*)&probe, (BYTE*)&dwTime, sizeof( DWORD ) );
+    found[byFound].byWidth  = sizeof( DWORD );
+
+    if( found[byFound].byOffset != HDR_NO_FIELD )
+    {
+        byFound++;
+    }
+
+    for( byIndex = 0; byIndex < byFound; byIndex++ )
+    {
+        for( byOther = byIndex + 1; byOther < byFound; byOther++ )
+        {
+            if( ( found[byIndex].byOffset < found[byOther].byOffset + found[byOther].byWidth ) &&
+                ( found[byOther].byOffset < found[byIndex].byOffset + found[byIndex].byWidth ) )
+            {
+                return;
+            }
+        }
+    }
+
+    byOffset = 0;
+
+    while( byOffset < RPT_HDR_SIZE )
+    {
+        for( byIndex = 0; byIndex < byFound; byIndex++ )
+        {
+            if( found[byIndex].byOffset == byOffset )
+            {
+                break;
+            }
+        }
+
+        if( byIndex < byFound )
+        {
+            if( found[byIndex].kind == HDR_FIELD_ENUM )
+            {
+                hdrLayout.byTypeField = hdrLayout.byNbrFields;
+            }
+            else if( found[byIndex].kind == HDR_FIELD_SIZE )
+            {
+                hdrLayout.bySizeField = hdrLayout.byNbrFields;
+            }
+            else if( found[byIndex].kind == HDR_FIELD_TIME )
+            {
+                hdrLayout.byTimeReqField = hdrLayout.byNbrFields;
+            }
+
+            if( !AddHdrField( found[byIndex].kind, byOffset, found[byIndex].byWidth ) )
+            {
+                return;
+            }
+
+            byOffset += found[byIndex].byWidth;
+            continue;
+        }
+
+        // Run of bytes up to the next field found
+        byRun = byOffset;
+
+        do
+        {
+            byOffset++;
+
+            for( byIndex = 0; byIndex < byFound; byIndex++ )
+            {
+                if( found[byIndex].byOffset == byOffset )
+                {
+                    break;
+                }
+            }
+
+        } while( ( byOffset < RPT_HDR_SIZE ) && ( byIndex == byFound ) );
+
+        if( !AddHdrField( HDR_FIELD_CONSTANT, byRun, (BYTE)( byOffset - byRun ) ) )
+        {
+            return;
+        }
+    }
+
+    hdrLayout.bKnown = TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: FindProbeValue
+//
+//  Arguments:
+//    IN  pbyProbe - Header filled by GenerateHeader().
+//    IN  pbyValue - Marker value, as stored by the target.
+//    IN  byWidth  - Size of the marker value.
+//
+//  Returns: BYTE offset of the marker in the header.
+//           HDR_NO_FIELD if it is not there, or is there more than once.
+//
+//******************************************************************************
+BYTE FindProbeValue( const BYTE* pbyProbe, const BYTE* pbyValue, BYTE byWidth )
+{
+    BYTE byFound = HDR_NO_FIELD;
+    BYTE byOffset;
+    BYTE byIndex;
+
+    for( byOffset = CRC_SIZE; byOffset + byWidth <= RPT_HDR_SIZE; byOffset++ )
+    {
+        for( byIndex = 0; byIndex < byWidth; byIndex++ )
+        {
+            if( pbyProbe[byOffset + byIndex] != pbyValue[byIndex] )
+            {
+                break;
+            }
+        }
+
+        if( byIndex == byWidth )
+        {
+            if( byFound != HDR_NO_FIELD )
+            {
+                return HDR_NO_FIELD;
+            }
+
+            byFound = byOffset;
+        }
+    }
+
+    return byFound;
+}
+
+
+//******************************************************************************
+//
+//  Function: AddHdrField
+//
+//  Arguments:
+//    IN  kind     - How the field is coded.
+//    IN  byOffset - Offset of the field in the header.
+//    IN  byWidth  - Width of the field in bytes.
+//
+//  Returns: TRUE if the field was added to hdrSchema.
+//           FALSE if hdrSchema is full.
+//
+//******************************************************************************
+BOOL AddHdrField( HDR_FIELD_KINDS kind, BYTE byOffset, BYTE byWidth )
+{
+    if( hdrLayout.byNbrFields == MAX_HDR_FIELDS )
+    {
+        return FALSE;
+    }
+
+    hdrSchema[hdrLayout.byNbrFields].kind     = kind;
+    hdrSchema[hdrLayout.byNbrFields].byOffset = byOffset;
+    hdrSchema[hdrLayout.byNbrFields].byWidth  = byWidth;
+    hdrLayout.byNbrFields++;
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: FieldWidth
+//
+//  Arguments:
+//    IN  byField - Index into hdrSchema.
+//
+//  Returns: BYTE width of the field in bytes.
+//
+//******************************************************************************
+BYTE FieldWidth( BYTE byField )
+{
+    return hdrSchema[byField].byWidth;
+}
+
+
+//******************************************************************************
+//
+//  Function: GetField
+//
+//  Arguments:
+//    IN  pbyHdr  - Header.
+//    IN  byField - Index into hdrSchema (field of 4 bytes or less).
+//
+//  Returns: DWORD value of the field.
+//
+//  Description: Reads a big endian header field.
+//
+//******************************************************************************
+DWORD GetField( const BYTE* pbyHdr, BYTE byField )
+{
+    DWORD dwValue = 0;
+    BYTE  byIndex;
+
+    for( byIndex = 0; byIndex < FieldWidth( byField ); byIndex++ )
+    {
+        dwValue = ( dwValue << 8 ) | pbyHdr[hdrSchema[byField].byOffset + byIndex];
+    }
+
+    return dwValue;
+}
+
+
+//******************************************************************************
+//
+//  Function: PutField
+//
+//  Arguments:
+//    OUT pbyHdr  - Header.
+//    IN  byField - Index into hdrSchema (field of 4 bytes or less).
+//    IN  dwValue - Value to write.
+//
+//  Returns: void.
+//
+//  Description: Writes a big endian header field.
+//
+//******************************************************************************
+void PutField( BYTE* pbyHdr, BYTE byField, DWORD dwValue )
+{
+    BYTE byIndex = FieldWidth( byField );
+
+    while( byIndex > 0 )
+    {
+        byIndex--;
+        pbyHdr[hdrSchema[byField].byOffset + byIndex] = (BYTE)dwValue;
+        dwValue >>= 8;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: IsReportHeader
+//
+//  Arguments:
+//    IN  pbyMsg  - Outbound message.
+//    IN  wLength - Length of the message.
+//
+//  Returns: TRUE if the message starts with a valid RPT_HEADER_STRUCT.
+//           FALSE otherwise.
+//
+//  Description: The CRC must cover the rest of the message and the size
+//               field must match its length, or the ground could not
+//               rebuild them.
+//
+//******************************************************************************
+BOOL IsReportHeader( const BYTE* pbyMsg, WORD wLength )
+{
+    BYTE byField;
+
+    if( wLength < RPT_HDR_SIZE )
+    {
+        return FALSE;
+    }
+
+    for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+    {
+        if( ( hdrSchema[byField].kind == HDR_FIELD_CRC ) &&
+            ( GetField( pbyMsg, byField ) !=
+              CalcCRC( (BYTE*)&pbyMsg[CRC_SIZE], wLength - CRC_SIZE ) ) )
+        {
+            return FALSE;
+        }
+
+        if( ( hdrSchema[byField].kind == HDR_FIELD_SIZE ) &&
+            ( GetField( pbyMsg, byField ) != wLength ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+//******************************************************************************
+//
+//  Function: PutBits
+//
+//  Arguments:
+//    IN/OUT pBits     - Bit stream.
+//    IN     dwValue   - Value to write.
+//    IN     byNbrBits - Number of low order bits of dwValue (1-32).
+//
+//  Returns: void.
+//
+//  Description: Appends bits, most significant first. Sets bOverflow
+//               instead of writing past the end of the buffer.
+//
+//******************************************************************************
+void PutBits( BIT_STREAM* pBits, DWORD dwValue, BYTE byNbrBits )
+{
+    BYTE byMask;
+
+    while( byNbrBits > 0 )
+    {
+        byNbrBits--;
+
+        if( pBits->wBit >= pBits->wMaxBits )
+        {
+            pBits->bOverflow = TRUE;
+            return;
+        }
+
+        byMask = (BYTE)( 0x80 >> ( pBits->wBit & 7 ) );
+
+        if( dwValue & ( (DWORD)1 << byNbrBits ) )
+        {
+            pBits->pbyBuff[pBits->wBit >> 3] |= byMask;
+        }
+        else
+        {
+            pBits->pbyBuff[pBits->wBit >> 3] &= (BYTE)~byMask;
+        }
+
+        pBits->wBit++;
+    }
+}
+
+
+//******************************************************************************
+//
+//  Function: GetBits
+//
+//  Arguments:
+//    IN/OUT pBits     - Bit stream.
+//    IN     byNbrBits - Number of bits to read (1-32).
+//
+//  Returns: DWORD value read.
+//
+//  Description: Reads bits, most significant first. Sets bOverflow when
+//               reading past the end of the buffer.
+//
+//******************************************************************************
+DWORD GetBits( BIT_STREAM* pBits, BYTE byNbrBits )
+{
+    DWORD dwValue = 0;
+
+    while( byNbrBits > 0 )
+    {
+        byNbrBits--;
+
+        if( pBits->wBit >= pBits->wMaxBits )
+        {
+            pBits->bOverflow = TRUE;
+            return 0;
+        }
+
+        dwValue <<= 1;
+
+        if( pBits->pbyBuff[pBits->wBit >> 3] & ( 0x80 >> ( pBits->wBit & 7 ) ) )
+        {
+            dwValue |= 1;
+        }
+
+        pBits->wBit++;
+    }
+
+    return dwValue;
+}
+
+
+//******************************************************************************
+//
+//  Function: ZigZag
+//
+//  Arguments:
+//    IN  dwDelta - Two's complement difference.
+//
+//  Returns: DWORD with small magnitudes of either sign mapped to small values.
+//
+//  Description: Maps 0, -1, 1, -2... to 0, 1, 2, 3...
+//
+//******************************************************************************
+DWORD ZigZag( DWORD dwDelta )
+{
+    return ( dwDelta << 1 ) ^ ( ( dwDelta & 0x80000000L ) ? 0xFFFFFFFFL : 0L );
+}
+
+
+//******************************************************************************
+//
+//  Function: UnZigZag
+//
+//  Arguments:
+//    IN  dwValue - Value produced by ZigZag().
+//
+//  Returns: DWORD two's complement difference.
+//
+//  Description: Inverse of ZigZag().
+//
+//******************************************************************************
+DWORD UnZigZag( DWORD dwValue )
+{
+    return ( dwValue >> 1 ) ^ ( ( dwValue & 1 ) ? 0xFFFFFFFFL : 0L );
+}
+
+
+//******************************************************************************
+//
+//  Function: VarintBits
+//
+//  Arguments:
+//    IN  dwValue - Value to code.
+//
+//  Returns: BYTE number of bits PutVarint() uses for dwValue.
+//
+//  Description: Each group carries a continuation bit and 7 value bits.
+//
+//******************************************************************************
+BYTE VarintBits( DWORD dwValue )
+{
+    BYTE byBits = 0;
+
+    do
+    {
+        byBits   += VARINT_GROUP_BITS + 1;
+        dwValue >>= VARINT_GROUP_BITS;
+
+    } while( dwValue != 0 );
+
+    return byBits;
+}
+
+
+//******************************************************************************
+//
+//  Function: PutVarint
+//
+//  Arguments:
+//    IN/OUT pBits   - Bit stream.
+//    IN     dwValue - Value to write.
+//
+//  Returns: void.
+//
+//  Description: Writes dwValue 7 bits at a time, low order group first.
+//
+//******************************************************************************
+void PutVarint( BIT_STREAM* pBits, DWORD dwValue )
+{
+    DWORD dwGroup;
+
+    do
+    {
+        dwGroup  = dwValue & 0x7F;
+        dwValue >>= VARINT_GROUP_BITS;
+
+        PutBits( pBits, ( dwValue != 0 ) ? 1 : 0, 1 );
+        PutBits( pBits, dwGroup, VARINT_GROUP_BITS );
+
+    } while( dwValue != 0 );
+}
+
+
+//******************************************************************************
+//
+//  Function: GetVarint
+//
+//  Arguments:
+//    IN/OUT pBits - Bit stream.
+//
+//  Returns: DWORD value read.
+//
+//  Description: Inverse of PutVarint(). Sets bOverflow on a runaway value.
+//
+//******************************************************************************
+DWORD GetVarint( BIT_STREAM* pBits )
+{
+    DWORD dwValue = 0;
+    BYTE  byGroup = 0;
+    BOOL  bMore;
+
+    do
+    {
+        if( byGroup == VARINT_MAX_GROUPS )
+        {
+            pBits->bOverflow = TRUE;
+            return 0;
+        }
+
+        bMore    = (BOOL)GetBits( pBits, 1 );
+        dwValue |= GetBits( pBits, VARINT_GROUP_BITS ) << ( byGroup * VARINT_GROUP_BITS );
+        byGroup++;
+
+    } while( bMore && !pBits->bOverflow );
+
+    return dwValue;
+}
+
+
+//******************************************************************************
+//
+//  Function: EncodeHdr
+//
+//  Arguments:
+//    IN  pbyHdr     - Header to pack.
+//    IN  pbyRef     - Reference header (all zeros for a key frame).
+//    IN  bKeyFrame  - TRUE if pbyRef is the zero reference.
+//    IN  bySeq      - Sequence number of this header.
+//    OUT pbyOut     - Packed header, magic included.
+//    IN  wMaxLength - Size of pbyOut.
+//
+//  Returns: WORD length of the packed header.
+//           0 if it does not fit in wMaxLength.
+//
+//  Description: Packs each field of hdrSchema.
+//
+//******************************************************************************
+WORD EncodeHdr( const BYTE* pbyHdr, const BYTE* pbyRef, BOOL bKeyFrame,
+                BYTE bySeq, BYTE* pbyOut, WORD wMaxLength )
+{
+    BIT_STREAM bits;
+    BYTE       byField;
+    BYTE       byIndex;
+    BYTE       byWidth;
+    DWORD      dwValue;
+    DWORD      dwPrevTime;
+    BOOL       bHavePrevTime;
+    BYTE       byRefBits;
+    BYTE       byPrevBits;
+
+    if( wMaxLength <= HDR_MAGIC_SIZE )
+    {
+        return 0;
+    }
+
+    pbyOut[0] = HDR_MAGIC_1;
+    pbyOut[1] = HDR_MAGIC_2;
+
+    bits.pbyBuff   = pbyOut;
+    bits.wBit      = HDR_MAGIC_SIZE * 8;
+    bits.wMaxBits  = wMaxLength * 8;
+    bits.bOverflow = FALSE;
+
+    PutBits( &bits, 1, 1 );
+    PutBits( &bits, bKeyFrame ? 1 : 0, 1 );
+    PutBits( &bits, bySeq, 4 );
+
+    dwPrevTime    = 0;
+    bHavePrevTime = FALSE;
+
+    for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+    {
+        switch( hdrSchema[byField].kind )
+        {
+            case HDR_FIELD_ENUM:
+                dwValue = GetField( pbyHdr, byField );
+
+                if( dwValue == GetField( pbyRef, byField ) )
+                {
+                    PutBits( &bits, 0, 1 );
+                }
+                else if( dwValue < ( 1 << ENUM_SHORT_BITS ) )
+                {
+                    PutBits( &bits, 2, 2 );
+                    PutBits( &bits, dwValue, ENUM_SHORT_BITS );
+                }
+                else
+                {
+                    PutBits( &bits, 3, 2 );
+                    PutBits( &bits, dwValue, (BYTE)( FieldWidth( byField ) * 8 ) );
+                }
+                break;
+
+            case HDR_FIELD_TIME:
+                dwValue    = GetField( pbyHdr, byField );
+                byRefBits  = VarintBits( ZigZag( dwValue - GetField( pbyRef, byField ) ) );
+                byPrevBits = VarintBits( ZigZag( dwValue - dwPrevTime ) );
+                byWidth    = (BYTE)( FieldWidth( byField ) * 8 );
+
+                if( dwValue == 0 )
+                {
+                    PutBits( &bits, TIME_TAG_ZERO, 2 );
+                }
+                else if( ( byRefBits < byWidth ) &&
+                         ( !bHavePrevTime || ( byRefBits <= byPrevBits ) ) )
+                {
+                    PutBits( &bits, TIME_TAG_REF_DELTA, 2 );
+                    PutVarint( &bits, ZigZag( dwValue - GetField( pbyRef, byField ) ) );
+                }
+                else if( bHavePrevTime && ( byPrevBits < byWidth ) )
+                {
+                    PutBits( &bits, TIME_TAG_PREV_DELTA, 2 );
+                    PutVarint( &bits, ZigZag( dwValue - dwPrevTime ) );
+                }
+                else
+                {
+                    PutBits( &bits, TIME_TAG_RAW, 2 );
+                    PutBits( &bits, dwValue, byWidth );
+                }
+
+                if( dwValue != 0 )
+                {
+                    dwPrevTime    = dwValue;
+                    bHavePrevTime = TRUE;
+                }
+                break;
+
+            case HDR_FIELD_CONSTANT:
+                byWidth = FieldWidth( byField );
+
+                for( byIndex = 0; byIndex < byWidth; byIndex++ )
+                {
+                    if( pbyHdr[hdrSchema[byField].byOffset + byIndex] !=
+                        pbyRef[hdrSchema[byField].byOffset + byIndex] )
+                    {
+                        break;
+                    }
+                }
+
+                if( byIndex == byWidth )
+                {
+                    PutBits( &bits, 0, 1 );
+                    break;
+                }
+
+                // Change mask, then the bytes that changed
+                PutBits( &bits, 1, 1 );
+
+                for( byIndex = 0; byIndex < byWidth; byIndex++ )
+                {
+                    PutBits( &bits, ( pbyHdr[hdrSchema[byField].byOffset + byIndex] !=
+                                      pbyRef[hdrSchema[byField].byOffset + byIndex] ) ? 1 : 0, 1 );
+                }
+
+                for( byIndex = 0; byIndex < byWidth; byIndex++ )
+                {
+                    if( pbyHdr[hdrSchema[byField].byOffset + byIndex] !=
+                        pbyRef[hdrSchema[byField].byOffset + byIndex] )
+                    {
+                        PutBits( &bits, pbyHdr[hdrSchema[byField].byOffset + byIndex], 8 );
+                    }
+                }
+                break;
+
+            default:
+                // CRC and size are rebuilt by the ground
+                break;
+        }
+    }
+
+    if( bits.bOverflow )
+    {
+        return 0;
+    }
+
+    // Pad the last byte so the payload starts on a byte boundary
+    if( bits.wBit & 7 )
+    {
+        PutBits( &bits, 0, (BYTE)( 8 - ( bits.wBit & 7 ) ) );
+    }
+
+    return bits.bOverflow ? 0 : ( bits.wBit / 8 );
+}
+
+
+//******************************************************************************
+//
+//  Function: DecodeHdr
+//
+//  Arguments:
+//    IN/OUT pBits  - Bit stream positioned on the first field.
+//    IN     pbyRef - Reference header (all zeros for a key frame).
+//    OUT    pbyHdr - Unpacked header, CRC and size left zero.
+//
+//  Returns: TRUE if the header was unpacked.
+//           FALSE if the bit stream is truncated or corrupt.
+//
+//  Description: Inverse of EncodeHdr().
+//
+//******************************************************************************
+BOOL DecodeHdr( BIT_STREAM* pBits, const BYTE* pbyRef, BYTE* pbyHdr )
+{
+    BYTE  byField;
+    BYTE  byIndex;
+    BYTE  byWidth;
+    DWORD dwValue;
+    DWORD dwPrevTime;
+    BYTE  byMask[MAX_HDR_CODEC_REF_SIZE];
+
+    MemSet( pbyHdr, 0, RPT_HDR_SIZE );
+
+    dwPrevTime = 0;
+
+    for( byField = 0; byField < NBR_HDR_FIELDS; byField++ )
+    {
+        switch( hdrSchema[byField].kind )
+        {
+            case HDR_FIELD_ENUM:
+                if( GetBits( pBits, 1 ) == 0 )
+                {
+                    dwValue = GetField( pbyRef, byField );
+                }
+                else if( GetBits( pBits, 1 ) == 0 )
+                {
+                    dwValue = GetBits( pBits, ENUM_SHORT_BITS );
+                }
+                else
+                {
+                    dwValue = GetBits( pBits, (BYTE)( FieldWidth( byField ) * 8 ) );
+                }
+
+                PutField( pbyHdr, byField, dwValue );
+                break;
+
+            case HDR_FIELD_TIME:
+                switch( GetBits( pBits, 2 ) )
+                {
+                    case TIME_TAG_REF_DELTA:
+                        dwValue = GetField( pbyRef, byField ) + UnZigZag( GetVarint( pBits ) );
+                        break;
+
+                    case TIME_TAG_PREV_DELTA:
+                        dwValue = dwPrevTime + UnZigZag( GetVarint( pBits ) );
+                        break;
+
+                    case TIME_TAG_RAW:
+                        dwValue = GetBits( pBits, (BYTE)( FieldWidth( byField ) * 8 ) );
+                        break;
+
+                    default:
+                        dwValue = 0;
+                        break;
+                }
+
+                PutField( pbyHdr, byField, dwValue );
+
+                if( dwValue != 0 )
+                {
+                    dwPrevTime = dwValue;
+                }
+                break;
+
+            case HDR_FIELD_CONSTANT:
+                byWidth = FieldWidth( byField );
+
+                MemCpy( &pbyHdr[hdrSchema[byField].byOffset],
+                        (void*)&pbyRef[hdrSchema[byField].byOffset], byWidth );
+
+                if( GetBits( pBits, 1 ) == 0 )
+                {
+                    break;
+                }
+
+                for( byIndex = 0; byIndex < byWidth; byIndex++ )
+                {
+                    byMask[byIndex] = (BYTE)GetBits( pBits, 1 );
+                }
+
+                for( byIndex = 0; byIndex < byWidth; byIndex++ )
+                {
+                    if( byMask[byIndex] )
+                    {
+                        pbyHdr[hdrSchema[byField].byOffset + byIndex] = (BYTE)GetBits( pBits, 8 );
+                    }
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return !pBits->bOverflow;
+}
+
+
+//******************************************************************************
+//
+//  Function: UpdateHdrStats
+//
+//  Arguments:
+//    IN  wMsgType   - Report type of the delivered report.
+//    IN  wPackedLen - Length of its packed header.
+//
+//  Returns: void.
+//
+//  Description: Accumulates header savings for the report type. Types
+//               beyond NBR_HDR_STATS_TYPES are not tracked.
+//
+//******************************************************************************
+void UpdateHdrStats( WORD wMsgType, WORD wPackedLen )
+{
+    BYTE byIndex;
+
+    for( byIndex = 0; byIndex < NBR_HDR_STATS_TYPES; byIndex++ )
+    {
+        if( ( hdrStats[byIndex].dwMsgs == 0 ) ||
+            ( hdrStats[byIndex].wMsgType == wMsgType ) )
+        {
+            hdrStats[byIndex].wMsgType          = wMsgType;
+            hdrStats[byIndex].dwMsgs++;
+            hdrStats[byIndex].dwRawHdrBytes    += RPT_HDR_SIZE;
+            hdrStats[byIndex].dwPackedHdrBytes += wPackedLen;
+            break;
+        }
+    }
+}
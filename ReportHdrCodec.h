@@ -0,0 +1,250 @@
+//******************************************************************************
+//
+//  ReportHdrCodec.h: Module Title
+//
+//      Copyright (c) 2001-2010, Aeromechanical Services Ltd.
+//      ALL RIGHTS RESERVED
+//
+//  This module packs the RPT_HEADER_STRUCT at the front of outbound SBD
+//  reports, and expands it again on the ground.
+//
+//  Fields the ground can derive (CRC, size) are elided, the time
+//  requested is sent as a variable length delta, the report type is
+//  bit-packed and the other bytes are only sent when they change. The
+//  field offsets are found from RPT_HEADER_STRUCT and GenerateHeader().
+//  Deltas are taken against the header of the last report that was
+//  delivered; a full (key frame) header is sent periodically so the
+//  ground can always resynchronize.
+//
+//  The encoder must be enabled by embedded rules once the ground
+//  endpoint can expand packed reports.
+//
+//******************************************************************************
+
+#ifndef _REPORTHDRCODEC_H
+
+    #define _REPORTHDRCODEC_H
+
+
+//------------------------------------------------------------------------------
+//  INCLUDES
+//------------------------------------------------------------------------------
+
+#include "typedefs.h"
+
+//------------------------------------------------------------------------------
+//  CONSTANT & MACRO DEFINITIONS
+//------------------------------------------------------------------------------
+
+
+/*artldef+*/
+#define MAX_HDR_CODEC_REF_SIZE      64      // Must be >= sizeof( RPT_HEADER_STRUCT )
+#define NBR_HDR_STATS_TYPES         8       // Report types tracked for savings
+/*artldef-*/
+
+
+//------------------------------------------------------------------------------
+//  TYPEDEF DECLARATIONS
+//------------------------------------------------------------------------------
+
+
+/*artltyp+*/
+// Reference header kept by each end of the link. The ground keeps one
+// per aircraft; the previous reference is kept so that a report that was
+// delivered, but not acknowledged to the aircraft, can still be expanded.
+typedef struct
+{
+    BOOL  bHaveRef[2];
+    BYTE  bySeq[2];
+    BYTE  byRef[2][MAX_HDR_CODEC_REF_SIZE];
+
+} HDR_CODEC_STATE;
+
+
+typedef struct
+{
+    WORD  wMsgType;
+    DWORD dwMsgs;                   // Packed reports delivered
+    DWORD dwRawHdrBytes;            // Header bytes before packing
+    DWORD dwPackedHdrBytes;         // Header bytes after packing
+
+} REPORT_HDR_STATS;
+
+
+// Header fields other modules can read with GetReportHdrField()
+typedef BYTE    RPT_HDR_FIELDS;
+enum rpt_hdr_fields
+{
+    RPT_HDR_FIELD_TYPE,
+    RPT_HDR_FIELD_SIZE,
+    RPT_HDR_FIELD_TIME_REQUESTED
+};
+/*artltyp-*/
+
+
+//------------------------------------------------------------------------------
+//  PUBLIC FUNCTIONS PROTOTYPES
+//------------------------------------------------------------------------------
+
+
+/*artlx+*/
+//******************************************************************************
+//
+//  Function: InitReportHdrCodec
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: This function must be the first to be called from this
+//               module in order to set local variables.
+//
+//******************************************************************************
+void InitReportHdrCodec( void );
+
+
+//******************************************************************************
+//
+//  Function: SetReportHdrCodec
+//
+//  Arguments:
+//    IN  bEnable - TRUE to pack report headers.
+//                  FALSE to send them as they are (default).
+//
+//  Returns: void.
+//
+//  Description: Allows embedded rules to enable the header codec.
+//
+//******************************************************************************
+void SetReportHdrCodec( const BOOL bEnable );
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrCodec
+//
+//  Arguments: void.
+//
+//  Returns: TRUE if report headers are packed.
+//           FALSE otherwise.
+//
+//  Description: Allows embedded rules to get the header codec mode.
+//
+//******************************************************************************
+BOOL GetReportHdrCodec( void );
+
+
+//******************************************************************************
+//
+//  Function: PackReportHdr
+//
+//  Arguments:
+//    IN/OUT pbyMsg     - Outbound message, packed in place.
+//    IN     wLength    - Length of the message.
+//    IN     wMaxLength - Size of the pbyMsg buffer.
+//
+//  Returns: WORD length of the message to send.
+//
+//  Description: Packs the header of a report if the codec is enabled and
+//               the message carries a valid RPT_HEADER_STRUCT (CRC and size
+//               check out). Anything else is sent as is. Must be followed
+//               by CommitReportHdr() once the message was delivered.
+//
+//******************************************************************************
+WORD PackReportHdr( BYTE* pbyMsg, WORD wLength, WORD wMaxLength );
+
+
+//******************************************************************************
+//
+//  Function: CommitReportHdr
+//
+//  Arguments: void.
+//
+//  Returns: void.
+//
+//  Description: The message from the last PackReportHdr() call was
+//               delivered; its header becomes the delta reference.
+//
+//******************************************************************************
+void CommitReportHdr( void );
+
+
+//******************************************************************************
+//
+//  Function: InitHdrCodecState
+//
+//  Arguments:
+//    OUT pState - Ground side reference to initialize.
+//
+//  Returns: void.
+//
+//  Description: Clears a ground side reference (one per aircraft).
+//
+//******************************************************************************
+void InitHdrCodecState( HDR_CODEC_STATE* pState );
+
+
+//******************************************************************************
+//
+//  Function: ExpandReportHdr
+//
+//  Arguments:
+//    IN/OUT pState  - Ground side reference of the sending aircraft.
+//    IN     pbyIn   - Received SBD message.
+//    IN     wInLen  - Length of the received message.
+//    OUT    pbyOut  - Expanded report.
+//    IN     wOutMax - Size of the pbyOut buffer.
+//
+//  Returns: WORD length of the expanded report.
+//           0 if the message refers to a header the ground does not hold
+//             (the report must wait for the next key frame).
+//
+//  Description: Ground side expander. Messages that were not packed are
+//               copied as they are.
+//
+//******************************************************************************
+WORD ExpandReportHdr( HDR_CODEC_STATE* pState, const BYTE* pbyIn, WORD wInLen,
+                      BYTE* pbyOut, WORD wOutMax );
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrStats
+//
+//  Arguments:
+//    IN  byIndex - 0 to NBR_HDR_STATS_TYPES-1.
+//    OUT pStats  - Savings for one report type.
+//
+//  Returns: TRUE if the entry is in use.
+//           FALSE otherwise.
+//
+//  Description: Reports the header byte savings per report type.
+//
+//******************************************************************************
+BOOL GetReportHdrStats( BYTE byIndex, REPORT_HDR_STATS* pStats );
+
+
+//******************************************************************************
+//
+//  Function: GetReportHdrField
+//
+//  Arguments:
+//    IN  pbyMsg   - Report, header not packed.
+//    IN  wLength  - Length of the report.
+//    IN  field    - Header field wanted.
+//    OUT pdwValue - Value of the field.
+//
+//  Returns: TRUE if the field was read.
+//           FALSE if the header layout is not known, the field was not
+//                 found in it or the report is shorter than a header.
+//
+//  Description: Lets other modules read the report header without
+//               assuming its layout.
+//
+//******************************************************************************
+BOOL GetReportHdrField( const BYTE* pbyMsg, WORD wLength, RPT_HDR_FIELDS field,
+                        DWORD* pdwValue );
+/*artlx-*/
+
+
+#endif // _REPORTHDRCODEC_H
@@ -244,6 +244,23 @@ void ModemIsr( void );
 void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength );
 
 
+//******************************************************************************
+//
+//  Function: ModemPortReceiveBuffer
+//
+//  Arguments:
+//    OUT pBuffer    - Filled with the bytes received from the modem.
+//    IN  wMaxLength - Size of pBuffer.
+//
+//  Returns: WORD number of bytes placed in pBuffer.
+//
+//  Description: Call this function to take as many received bytes as fit
+//               in one call rather than one GetModemPortChar() at a time.
+//
+//******************************************************************************
+WORD ModemPortReceiveBuffer( BYTE* pBuffer, WORD wMaxLength );
+
+
 //******************************************************************************
 //
 //  Function: ModemPortSending
@@ -260,6 +277,118 @@ void ModemPortSendBuffer( BYTE* pBuffer, WORD wLength );
 BOOL ModemPortSending( void );
 
 
+//******************************************************************************
+//
+//  Function: GetModemPortRxSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the oldest received byte in the RX queue.
+//
+//  Returns: WORD number of contiguous received bytes at *ppbySpan.
+//
+//  Description: Gives direct access to the RX queue so received data can be
+//               moved without a per byte call. The span stays valid until
+//               ReleaseModemPortRxSpan() is called. A wrapped queue is
+//               returned as two spans over two calls.
+//
+//******************************************************************************
+WORD GetModemPortRxSpan( BYTE** ppbySpan );
+
+
+//******************************************************************************
+//
+//  Function: ReleaseModemPortRxSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes of the span that were consumed.
+//
+//  Returns: void.
+//
+//  Description: Removes wLength bytes from the front of the RX queue.
+//
+//******************************************************************************
+void ReleaseModemPortRxSpan( WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortTxSpan
+//
+//  Arguments:
+//    OUT ppbySpan - Set to the first free byte in the TX queue.
+//
+//  Returns: WORD number of contiguous free bytes at *ppbySpan.
+//
+//  Description: Gives direct access to the TX queue so data can be written
+//               in place. Nothing is sent until CommitModemPortTxSpan().
+//
+//******************************************************************************
+WORD GetModemPortTxSpan( BYTE** ppbySpan );
+
+
+//******************************************************************************
+//
+//  Function: CommitModemPortTxSpan
+//
+//  Arguments:
+//    IN  wLength - Number of bytes written into the span.
+//
+//  Returns: void.
+//
+//  Description: Adds the bytes written in place to the TX queue and starts
+//               the transmission.
+//
+//******************************************************************************
+void CommitModemPortTxSpan( WORD wLength );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortRxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD number of bytes waiting in the RX queue.
+//
+//  Description: Used for flow control and latency accounting.
+//
+//******************************************************************************
+WORD GetModemPortRxCount( void );
+
+
+//******************************************************************************
+//
+//  Function: GetModemPortTxCount
+//
+//  Arguments: void.
+//
+//  Returns: WORD number of bytes still waiting to be sent.
+//
+//  Description: Used for flow control and latency accounting.
+//
+//******************************************************************************
+WORD GetModemPortTxCount( void );
+
+
+#ifdef MODEM_GROUND_LOOPBACK
+//******************************************************************************
+//
+//  Function: LoopbackModemPortRx
+//
+//  Arguments:
+//    IN  pBuffer - Bytes from the simulated transceiver.
+//    IN  wLength - Number of bytes.
+//
+//  Returns: void.
+//
+//  Description: Adds the bytes to the RX queue as if they had been
+//               received on the UART.
+//
+//******************************************************************************
+void LoopbackModemPortRx( const BYTE* pBuffer, WORD wLength );
+#endif
+
+
 //******************************************************************************
 //
 //  Function: ReadModemPortRILine